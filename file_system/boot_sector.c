@@ -46,7 +46,7 @@ typedef struct boot_sector_raw_t boot_sector_raw_t;
 /*
  * Used to read in the raw boot sector data.
  */
-boot_sector_raw_t* readBootSector(boot_sector_raw_t* bootSectorRaw, FILE* storageDevice);
+boot_sector_raw_t* readBootSector(boot_sector_raw_t* bootSectorRaw, storage_device_t* storageDevice);
 
 
 /*
@@ -62,7 +62,7 @@ boot_sect_t* parseBootSector(boot_sector_raw_t* bootSectorRaw);
 //
 
 
-boot_sect_t* getBootSector(FILE* storageDevice) {
+boot_sect_t* getBootSector(storage_device_t* storageDevice) {
 
 	//
 	// PARAMETER CHECK.
@@ -70,18 +70,25 @@ boot_sect_t* getBootSector(FILE* storageDevice) {
 		handleError(L"getBootSector", L"NULL 'storageDevice' parameter");
 
 	//
-	// READ IN THE BOOT SECTOR VIA THE STORAGE DEVICE INTERFACE.
-	boot_sector_raw_t* bootSectorRaw = (boot_sector_raw_t*) malloc(DEFAULT_BYTES_PER_SECTOR);
-	readBootSector(bootSectorRaw, storageDevice);
-	if (bootSectorRaw == NULL)
-		handleError(L"getBootSector", L"Unable to read boot sector from file");
+	// IF THE DEVICE IS MEMORY-MAPPED, THEN THE BOOT SECTOR IS PARSED IN PLACE.
+	// OTHERWISE, READ IN THE BOOT SECTOR VIA THE STORAGE DEVICE INTERFACE.
+	boot_sector_raw_t* bootSectorRaw = (boot_sector_raw_t*)
+			viewSectors(0, 1, DEFAULT_BYTES_PER_SECTOR, storageDevice);
+	uint8_t isView = (bootSectorRaw != NULL);
+	if (!isView) {
+		bootSectorRaw = (boot_sector_raw_t*) malloc(DEFAULT_BYTES_PER_SECTOR);
+		if (bootSectorRaw == NULL)
+			handleError(L"getBootSector", L"Unable to read boot sector from file");
+		readBootSector(bootSectorRaw, storageDevice);
+	}
 
 	//
 	// TRANSLATE THE RAW BOOT SECTOR.
 	boot_sect_t* bootSector = parseBootSector(bootSectorRaw);
 	if (bootSector == NULL)
 		handleError(L"getBootSector", L"Unable to process raw boot sector contents");
-	free (bootSectorRaw);
+	if (!isView)
+		free (bootSectorRaw);
 
 	//
 	// RETURN THE BOOT SECTOR DATA STRUCTURE.
@@ -169,9 +176,9 @@ struct boot_sector_raw_t {
 };
 
 
-boot_sector_raw_t* readBootSector(boot_sector_raw_t* bootSectorRaw, FILE* storageDevice) {
+boot_sector_raw_t* readBootSector(boot_sector_raw_t* bootSectorRaw, storage_device_t* storageDevice) {
 
-	uint32_t* sectorLocation = (uint32_t*) malloc(sizeof(uint32_t));
+	uint64_t* sectorLocation = (uint64_t*) malloc(sizeof(uint64_t));
 	sectorLocation[0] = 0;
 
 	readSectors((uint8_t*) bootSectorRaw,
@@ -23,7 +23,7 @@
 // (NOTHING)
 
 // LAYER 3: STORAGE_DEVICE
-// (NOTHING)
+#include "device_interface.h"
 
 // ERROR HANDLING
 // (NOTHING)
@@ -80,7 +80,7 @@ typedef struct {
  * Extracts the file system's boot sector, and stores the information in a
  * boot_sect_t data structure.
  */
-boot_sect_t* getBootSector(FILE* storageDevice);
+boot_sect_t* getBootSector(storage_device_t* storageDevice);
 
 
 
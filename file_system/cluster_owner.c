@@ -0,0 +1,248 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                           CLUSTER OWNER INDEX
+ * of a directory tree, which maps a cluster number back to the file or
+ * directory whose cluster sequence it is in.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "cluster_owner.h"
+#include "directory.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+
+
+
+/*
+ * One extent of a file or directory, as it is kept in the index.
+ */
+typedef struct {
+
+	uint32_t firstCluster;         // The first cluster of the extent.
+	uint32_t lastCluster;          // The last cluster of the extent.
+	uint32_t treeOrder;            // The order the extent was found in, walking the tree.
+	file_t*  owner;                // The file or directory the extent belongs to.
+
+} owned_extent_t;
+
+
+/*
+ * The extents of every file and directory, in order of their first cluster,
+ * with no two of them overlapping.
+ */
+struct cluster_owner_index_t {
+
+	owned_extent_t* extents;
+	uint32_t        numExtents;
+
+};
+
+
+/*
+ * Used to count the extents of every file and directory below the given
+ * directory.
+ */
+uint64_t countOwnedExtents(file_t* directory);
+
+
+/*
+ * Used to add the extents of the given file or directory, and of everything
+ * below it, to the index.
+ */
+void addOwnedExtents(file_t* file, cluster_owner_index_t* clusterOwnerIndex);
+
+
+/*
+ * Used to order extents by their first cluster, and then by the order they
+ * were found in (for qsort).
+ */
+int compareOwnedExtents(const void* first, const void* second);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+cluster_owner_index_t* getClusterOwnerIndex(file_t* directoryTree) {
+
+	//
+	// PARAMETER CHECK.
+	if (directoryTree == NULL)
+		handleError(L"getClusterOwnerIndex", L"NULL 'directoryTree' parameter");
+
+	//
+	// ALLOCATE THE INDEX, WITH ROOM FOR EVERY EXTENT IN THE TREE.
+	uint64_t maxExtents = directoryTree->numExtents + countOwnedExtents(directoryTree);
+	if (maxExtents > UINT32_MAX)
+		handleError(L"getClusterOwnerIndex", L"The directory tree has too many extents to index");
+	cluster_owner_index_t* clusterOwnerIndex = (cluster_owner_index_t*) calloc(1, sizeof(cluster_owner_index_t));
+	if (clusterOwnerIndex == NULL)
+		handleError(L"getClusterOwnerIndex", L"Unable to allocate memory for the cluster owner index");
+	clusterOwnerIndex->extents = (owned_extent_t*) malloc((maxExtents + 1) * sizeof(owned_extent_t));
+	if (clusterOwnerIndex->extents == NULL)
+		handleError(L"getClusterOwnerIndex", L"Unable to allocate memory for the cluster owner index");
+
+	//
+	// GATHER THE EXTENTS, AND SORT THEM BY THEIR FIRST CLUSTER.
+	addOwnedExtents(directoryTree, clusterOwnerIndex);
+	qsort(clusterOwnerIndex->extents, clusterOwnerIndex->numExtents,
+	      sizeof(owned_extent_t), compareOwnedExtents);
+
+	//
+	// EXTENTS ONLY OVERLAP IF CHAINS ARE CROSS-LINKED (OR LOOP, AND REPEAT
+	// THEIR OWN EXTENTS).  TRIM EACH EXTENT TO THE CLUSTERS THAT NO EARLIER
+	// ONE HOLDS, DROPPING IT IF THERE ARE NONE LEFT, AND JOIN IT TO THE ONE
+	// BEFORE IF IT CARRIES ON WHERE THAT ONE ENDS, FOR THE SAME OWNER.  THEN
+	// EACH CLUSTER IS IN AT MOST ONE EXTENT, AND ONE BINARY SEARCH FINDS IT.
+	owned_extent_t* extents = clusterOwnerIndex->extents;
+	uint32_t numKept = 0;
+	uint32_t extentIndex = 0;
+	while (extentIndex < clusterOwnerIndex->numExtents) {
+		owned_extent_t extent = extents[extentIndex];
+		if (numKept > 0 && extent.firstCluster <= extents[numKept - 1].lastCluster)
+			extent.firstCluster = extents[numKept - 1].lastCluster + 1;
+		if (numKept > 0 && extent.lastCluster < extent.firstCluster) {
+			extentIndex++;
+			continue;
+		}
+		if (numKept > 0 && extent.owner == extents[numKept - 1].owner &&
+		    extent.firstCluster == extents[numKept - 1].lastCluster + 1)
+			extents[numKept - 1].lastCluster = extent.lastCluster;
+		else {
+			extents[numKept] = extent;
+			numKept++;
+		}
+		extentIndex++;
+	}
+	clusterOwnerIndex->numExtents = numKept;
+
+	//
+	// RETURN THE INDEX.
+	return clusterOwnerIndex;
+
+}
+
+
+file_t* getClusterOwner(cluster_owner_index_t* clusterOwnerIndex,
+                        uint32_t               clusterNumber) {
+
+	owned_extent_t* extents = clusterOwnerIndex->extents;
+	if (clusterOwnerIndex->numExtents == 0 || clusterNumber < extents[0].firstCluster)
+		return NULL;
+
+	//
+	// FIND THE LAST EXTENT THAT STARTS AT OR BEFORE THE CLUSTER.
+	uint32_t low  = 0;
+	uint32_t high = clusterOwnerIndex->numExtents - 1;
+	while (low < high) {
+		uint32_t middle = low + ((high - low + 1) / 2);
+		if (extents[middle].firstCluster <= clusterNumber)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	//
+	// THAT EXTENT HOLDS THE CLUSTER, UNLESS IT ENDS BEFORE IT (NO OTHER
+	// EXTENT CAN HOLD IT, SINCE NONE OVERLAP).
+	return (extents[low].lastCluster >= clusterNumber) ? extents[low].owner : NULL;
+
+}
+
+
+void freeClusterOwnerIndex(cluster_owner_index_t* clusterOwnerIndex) {
+
+	if (clusterOwnerIndex == NULL)
+		return;
+	free(clusterOwnerIndex->extents);
+	free(clusterOwnerIndex);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+uint64_t countOwnedExtents(file_t* directory) {
+
+	uint64_t numExtents = 0;
+	uint32_t childIndex = 0;
+	while (childIndex < directory->numChildren) {
+		file_t* child = &(directory->children[childIndex]);
+		numExtents += child->numExtents;
+		if (child->type)
+			numExtents += countOwnedExtents(child);
+		childIndex++;
+	}
+	return numExtents;
+
+}
+
+
+void addOwnedExtents(file_t* file, cluster_owner_index_t* clusterOwnerIndex) {
+
+	//
+	// ADD THE FILE'S OWN EXTENTS.
+	uint32_t extentIndex = 0;
+	while (extentIndex < file->numExtents) {
+		owned_extent_t* ownedExtent = &(clusterOwnerIndex->extents[clusterOwnerIndex->numExtents]);
+		ownedExtent->firstCluster = file->extents[extentIndex].firstCluster;
+		ownedExtent->lastCluster  = file->extents[extentIndex].firstCluster
+		                          + file->extents[extentIndex].numClusters - 1;
+		ownedExtent->treeOrder    = clusterOwnerIndex->numExtents;
+		ownedExtent->owner        = file;
+		clusterOwnerIndex->numExtents++;
+		extentIndex++;
+	}
+
+	//
+	// THEN THOSE OF EVERYTHING BELOW IT.
+	if (file->type || file->parentDirectory == NULL) {
+		uint32_t childIndex = 0;
+		while (childIndex < file->numChildren) {
+			addOwnedExtents(&(file->children[childIndex]), clusterOwnerIndex);
+			childIndex++;
+		}
+	}
+
+}
+
+
+int compareOwnedExtents(const void* first, const void* second) {
+
+	const owned_extent_t* firstExtent  = (const owned_extent_t*) first;
+	const owned_extent_t* secondExtent = (const owned_extent_t*) second;
+	if (firstExtent->firstCluster != secondExtent->firstCluster)
+		return (firstExtent->firstCluster > secondExtent->firstCluster) ? 1 : -1;
+	return (firstExtent->treeOrder > secondExtent->treeOrder) - (firstExtent->treeOrder < secondExtent->treeOrder);
+
+}
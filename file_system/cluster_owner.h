@@ -0,0 +1,86 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                           CLUSTER OWNER INDEX
+ * of a directory tree, which maps a cluster number back to the file or
+ * directory whose cluster sequence it is in (e.g. to find out which file a
+ * bad sector, or a hit from a scan of the disk, belongs to).
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef CLUSTER_OWNER_H_
+#define CLUSTER_OWNER_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "directory.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+/*
+ * An index of which file or directory owns each cluster (see
+ * getClusterOwnerIndex).
+ */
+typedef struct cluster_owner_index_t cluster_owner_index_t;
+
+
+
+
+/*
+ * Builds an index of the owners of the clusters of every file and directory
+ * in the given directory tree (including the root directory itself).  The
+ * index is built from the extents the tree already holds, so no chain is
+ * followed again, and it takes one entry per extent (not per cluster).
+ *
+ * The tree must not be freed while the index is in use.
+ */
+cluster_owner_index_t* getClusterOwnerIndex(file_t* directoryTree);
+
+
+
+
+/*
+ * Returns the file or directory that owns the given cluster, or NULL if no
+ * file or directory does (e.g. the cluster is free, or lost).  If more than
+ * one claims it (i.e. their chains are cross-linked), then the one whose
+ * extent holding it starts at the lowest cluster is returned (or, if two such
+ * extents start at the same cluster, the one found first in the tree).
+ *
+ * This takes one binary search through the extents, however many of them
+ * overlap, so millions of clusters can be looked up per second.  Any number
+ * of threads may look up clusters at once.
+ */
+file_t* getClusterOwner(cluster_owner_index_t* clusterOwnerIndex,
+                        uint32_t               clusterNumber);
+
+
+
+
+/*
+ * Frees the index (but not the directory tree).
+ */
+void freeClusterOwnerIndex(cluster_owner_index_t* clusterOwnerIndex);
+
+
+
+
+#endif
@@ -56,9 +56,29 @@ typedef struct directory_entry_raw_t directory_entry_raw_t;
  *     - cluster sequence
  */
 void getDirectoryTreeRecursive(file_t* root,
-                               boot_sect_t* bootSector,
-                               uint32_t*    fileAllocationTable,
-                               FILE*        storageDevice);
+                               volume_t*    volume,
+                               fat_t*       fileAllocationTable,
+                               storage_device_t* storageDevice);
+
+
+/*
+ * Used to mark the children of the given directory (and all of their
+ * descendants) that could not be read in full as damaged.  "fatDamaged" tells
+ * whether part of the file allocation table could not be read.
+ */
+void markDamagedFiles(file_t* directory,
+                      uint8_t fatDamaged,
+                      volume_t* volume,
+                      storage_device_t* storageDevice);
+
+
+/*
+ * Used to prefetch the clusters of every subdirectory of the given directory,
+ * ahead of the directory being traversed.
+ */
+void prefetchSubdirectories(file_t* directory,
+                            volume_t* volume,
+                            storage_device_t* storageDevice);
 
 
 /*
@@ -69,8 +89,8 @@ void getDirectoryTreeRecursive(file_t* root,
 file_t* parseDirectoryEntries(directory_entry_raw_t* directoryEntriesRaw,
 							  uint32_t* numEntries,
 							  uint32_t maxDirectoryEntries,
-							  uint32_t* fileAllocationTable,
-							  boot_sect_t* bootSector);
+							  fat_t* fileAllocationTable,
+							  volume_t* volume);
 
 
 /*
@@ -78,8 +98,8 @@ file_t* parseDirectoryEntries(directory_entry_raw_t* directoryEntriesRaw,
  */
 void parseDirectoryEntry(file_t* directoryEntry,
                          directory_entry_raw_t* directoryEntryRaw,
-						 uint32_t* fileAllocationTable,
-                         boot_sect_t* bootSector);
+						 fat_t* fileAllocationTable,
+                         volume_t* volume);
 
 
 /*
@@ -88,8 +108,8 @@ void parseDirectoryEntry(file_t* directoryEntry,
 void parseDirectoryEntry_VFAT(file_t* directoryEntry,
 							 directory_entry_raw_t* vfatRawEntrySequence,
 							 uint32_t vfatSequenceCount,
-							 uint32_t* fileAllocationTable,
-							 boot_sect_t* bootSector);
+							 fat_t* fileAllocationTable,
+							 volume_t* volume);
 
 
 /*
@@ -121,8 +141,8 @@ void extractEntrytype(file_t* directoryEntry,
  */
 void extractEntryFirstCluster(file_t* directoryEntry,
 							  directory_entry_raw_t* directoryEntryRaw,
-							  boot_sect_t* bootSector,
-							  uint32_t* fileAllocationTable);
+							  volume_t* volume,
+							  fat_t* fileAllocationTable);
 
 
 /*
@@ -139,15 +159,15 @@ void extractEntrySize(file_t* directoryEntry,
 //
 
 
-file_t* getDirectoryTree(boot_sect_t* bootSector,
-                         uint32_t*    fileAllocationTable,
-                         FILE*        storageDevice) {
+file_t* getDirectoryTree(volume_t* volume,
+                         fat_t*       fileAllocationTable,
+                         storage_device_t* storageDevice) {
 
 	//
 	// PARAMETER CHECK.
-	if (bootSector == NULL)
+	if (volume == NULL)
 		handleError(L"getDirectory",
-					L"NULL 'bootSector' parameter");
+					L"NULL 'volume' parameter");
 	if (fileAllocationTable == NULL)
 		handleError(L"getDirectory",
 					L"NULL 'fileAllocationTable' parameter");
@@ -162,9 +182,10 @@ file_t* getDirectoryTree(boot_sect_t* bootSector,
 	rootDirectory->type = 1;
 	rootDirectory->size = 0;
 	rootDirectory->parentDirectory = NULL;
+	rootDirectory->damaged = 0;
 
 	//
-	// THE ROOT DIRECTORY MUST BE READ IN MANUALLY FOR A FAT12 SYSTEM, BECAUSE
+	// THE ROOT DIRECTORY MUST BE READ IN MANUALLY FOR A FAT12 OR FAT16 SYSTEM, BECAUSE
 	// IT DOES NOT HAVE A CLUSTER SEQUENCE (IT IS STORED BEFORE THE DATA ARE).
 	// FOR FAT32, HOWEVER, THE ROOT DIRECTORY CAN BE READ IN LIKE ANY OTHER
 	// DIRECTORY ON DISK, BECAUSE IT IS IN THE DATA AREA AND, THEREFORE, HAS A
@@ -172,49 +193,56 @@ file_t* getDirectoryTree(boot_sect_t* bootSector,
 	directory_entry_raw_t* rootDirectoryRaw;
 	uint32_t maxRootDirectoryEntries;
 	uint32_t bufferSize;
-	switch (getFatVersion(bootSector)) {
+	uint8_t  isView = 0;
+	switch (volume->fatVersion) {
 
 		case FAT12:
+		case FAT16:
 
 			//
-			// THERE ARE NO CLUSTERS FOR THE ROOT IN FAT12, BECAUSE IN FAT12,
-			// THE ROOT DIRECTORY COMES BEFORE THE START OF THE DATA AREA.
-			rootDirectory->clusters = NULL;
+			// THERE ARE NO CLUSTERS FOR THE ROOT IN FAT12 (OR FAT16), BECAUSE IN
+			// FAT12, THE ROOT DIRECTORY COMES BEFORE THE START OF THE DATA AREA.
+			rootDirectory->extents = NULL;
+			rootDirectory->numExtents = 0;
 			rootDirectory->numClusters = 0;
 
 			//
 			// CALCULATE THE SIZE OF THE BUFFER TO ALLOCATE.
 			bufferSize = BYTES_PER_DIRECTORY_ENTRY
-			           * bootSector->numRootEntries_FAT12;
-
-			//
-			// CREATE THE MEMORY BUFFER.
-			rootDirectoryRaw = (directory_entry_raw_t*) malloc(bufferSize);
-			if (rootDirectoryRaw == NULL)
-				handleError(L"getDirectoryTree", L"Unable to allocate memory to read the root directory");
+			           * volume->bootSector->numRootEntries_FAT12;
 
 			//
 			// GET THE STARTING SECTOR NUMBER.
-			uint32_t* sectorNumber = (uint32_t*) malloc(sizeof(uint32_t));
-			sectorNumber[0] = getSectorNumber_RootDirectory(bootSector);
+			uint64_t sectorNumber = volume->firstSector_Root;
 
 			//
 			// GET THE NUMBER OF SECTORS IN THE ROOT DIRECTORY.
-			uint32_t numSectors = bufferSize / bootSector->bytesPerSector;
+			uint32_t numSectors = bufferSize / volume->bytesPerSector;
+
+			//
+			// IF THE DEVICE IS MEMORY-MAPPED, THEN PARSE THE ROOT DIRECTORY IN PLACE.
+			rootDirectoryRaw = (directory_entry_raw_t*)
+					viewSectors(sectorNumber, numSectors, volume->bytesPerSector, storageDevice);
+			if (rootDirectoryRaw != NULL)
+				isView = 1;
 
 			//
-			// GET THE RAW ROOT DIRECTORY DATA.
-			readSectors((uint8_t*) rootDirectoryRaw,
-						sectorNumber,
-			            1,
-			            bootSector->bytesPerSector,
-			            numSectors,
-			            storageDevice);
-			free(sectorNumber);
+			// OTHERWISE, CREATE THE MEMORY BUFFER AND GET THE RAW ROOT DIRECTORY DATA.
+			else {
+				rootDirectoryRaw = (directory_entry_raw_t*) malloc(bufferSize);
+				if (rootDirectoryRaw == NULL)
+					handleError(L"getDirectoryTree", L"Unable to allocate memory to read the root directory");
+				readSectors((uint8_t*) rootDirectoryRaw,
+				            &sectorNumber,
+				            1,
+				            volume->bytesPerSector,
+				            numSectors,
+				            storageDevice);
+			}
 
 			//
 			// GET THE MAXIMUM POSSIBLE NUMBER OF DIRECTORY ENTRIES (USED BY THE PARSER).
-			maxRootDirectoryEntries = bootSector->numRootEntries_FAT12;
+			maxRootDirectoryEntries = volume->bootSector->numRootEntries_FAT12;
 			break;
 
 		case FAT32:
@@ -224,30 +252,43 @@ file_t* getDirectoryTree(boot_sect_t* bootSector,
 			// OTHER DIRECTORY, BECAUSE IN FAT32, THE ROOT DIRECTORY IS PART OF
 			// THE DATA AREA.
 			// THE FOLLOWING FUNCTION CALL WILL GET THE SEQUENCE OF ROOT
-			// CLUSTERS, AS WELL AS SET THE numClusters ENTRY IN THE ROOT
-			// DIRECTORY STRUCT AT THE SAME TIME.
-			rootDirectory->clusters =
-			                getClusterSequence(bootSector->rootClusterNumber_FAT32,
-											   bootSector,
-											   fileAllocationTable,
-											   &(rootDirectory->numClusters));
+			// CLUSTERS, AS WELL AS SET THE numExtents AND numClusters ENTRIES
+			// IN THE ROOT DIRECTORY STRUCT AT THE SAME TIME.
+			rootDirectory->extents =
+			                getClusterChain(volume->rootCluster,
+			                                volume,
+			                                fileAllocationTable,
+			                                &(rootDirectory->numExtents),
+			                                &(rootDirectory->numClusters));
 
 			//
 			// CALCULATE THE SIZE OF THE BUFFER TO ALLOCATE.
 			bufferSize = rootDirectory->numClusters
-			           * bootSector->sectorsPerCluster
-			           * bootSector->bytesPerSector;
+			           * volume->sectorsPerCluster
+			           * volume->bytesPerSector;
 
 			//
-			// CREATE THE MEMORY BUFFER.
-			rootDirectoryRaw = (directory_entry_raw_t*) malloc(bufferSize);
-			if (rootDirectoryRaw == NULL)
-				handleError(L"getDirectoryTree", L"Unable to allocate memory to read the root directory");
-			readClusters((uint8_t*) rootDirectoryRaw,
-			             rootDirectory->clusters,
-			             rootDirectory->numClusters,
-			             bootSector,
-			             storageDevice);
+			// IF THE DEVICE IS MEMORY-MAPPED, THEN PARSE THE ROOT DIRECTORY IN PLACE.
+			rootDirectoryRaw = (directory_entry_raw_t*)
+					viewClusters(rootDirectory->extents,
+					             rootDirectory->numExtents,
+					             volume,
+					             storageDevice);
+			if (rootDirectoryRaw != NULL)
+				isView = 1;
+
+			//
+			// OTHERWISE, CREATE THE MEMORY BUFFER AND READ IN THE CLUSTERS.
+			else {
+				rootDirectoryRaw = (directory_entry_raw_t*) malloc(bufferSize);
+				if (rootDirectoryRaw == NULL)
+					handleError(L"getDirectoryTree", L"Unable to allocate memory to read the root directory");
+				readClusters((uint8_t*) rootDirectoryRaw,
+				             rootDirectory->extents,
+				             rootDirectory->numExtents,
+				             volume,
+				             storageDevice);
+			}
 
 			//
 			// GET THE MAXIMUM POSSIBLE NUMBER OF DIRECTORY ENTRIES (USED BY THE PARSER).
@@ -262,17 +303,38 @@ file_t* getDirectoryTree(boot_sect_t* bootSector,
 										  &(rootDirectory->numChildren),
 										  maxRootDirectoryEntries,
 										  fileAllocationTable,
-										  bootSector);
+										  volume);
 
 	//
-	// FREE THE RAW DATA BUFFER.
-	free(rootDirectoryRaw);
+	// FREE THE RAW DATA BUFFER (UNLESS IT IS A VIEW OF THE DEVICE).
+	if (!isView)
+		free(rootDirectoryRaw);
 
 	//
 	// CALL THE RECURSIVE FUNCTION.
-	getDirectoryTreeRecursive(rootDirectory, bootSector,
+	getDirectoryTreeRecursive(rootDirectory, volume,
 	                          fileAllocationTable, storageDevice);
 
+	//
+	// IN DEGRADED MODE, MARK EVERYTHING THAT COULD NOT BE READ IN FULL.
+	if (storageDevice->damageMap != NULL) {
+		if (volume->fatVersion != FAT32)
+			rootDirectory->damaged = areSectorsDamaged(volume->firstSector_Root,
+			                                           bufferSize / volume->bytesPerSector,
+			                                           volume->bytesPerSector,
+			                                           storageDevice);
+		else
+			rootDirectory->damaged = areClustersDamaged(rootDirectory->extents,
+			                                            rootDirectory->numExtents,
+			                                            volume,
+			                                            storageDevice);
+		uint8_t fatDamaged = areSectorsDamaged(volume->firstSector_FAT,
+		                                       volume->sectorsPerFAT,
+		                                       volume->bytesPerSector,
+		                                       storageDevice);
+		markDamagedFiles(rootDirectory, fatDamaged, volume, storageDevice);
+	}
+
 	//
 	// RETURN THE DIRECTORY TREE.
 	return rootDirectory;
@@ -281,59 +343,114 @@ file_t* getDirectoryTree(boot_sect_t* bootSector,
 
 
 void getDirectoryTreeRecursive(file_t* root,
-                               boot_sect_t* bootSector,
-                               uint32_t*    fileAllocationTable,
-                               FILE*        storageDevice) {
+                               volume_t*    volume,
+                               fat_t*       fileAllocationTable,
+                               storage_device_t* storageDevice) {
 
 	if (root == NULL)
 		return;
 
+	//
+	// SET THE PARENT OF THE CHILDREN TO root, AND COUNT HOW MANY EXTENTS THE
+	// CHILD DIRECTORIES ARE MADE UP OF.
 	uint32_t childIndex = 0;
-	directory_entry_raw_t* childRaw;
+	uint32_t numDirectoryExtents = 0;
 	while (childIndex < root->numChildren) {
-
-		//
-		// SETTING THE PARENT OF THE CHILDREN TO root.
 		root->children[childIndex].parentDirectory = root;
+		if (root->children[childIndex].type)
+			numDirectoryExtents += root->children[childIndex].numExtents;
+		childIndex++;
+	}
 
-		//
-		// RECURSIVE CALL ON DIRECTORIES.
-		if(root->children[childIndex].type) {
+	//
+	// GET EVERY CHILD DIRECTORY'S RAW CONTENTS.  IF THE DEVICE IS
+	// MEMORY-MAPPED, THEN THEY CAN BE PARSED IN PLACE.  OTHERWISE, THE READS
+	// FOR ALL OF THEM ARE GATHERED INTO ONE BATCH AND SUBMITTED TOGETHER.
+	// A DIRECTORY THAT LOOPS BACK TO ONE OF ITS ANCESTORS IS NOT READ AT ALL
+	// (AND SO IS LEFT WITHOUT CHILDREN).
+	directory_entry_raw_t** childRaw = (directory_entry_raw_t**)
+			calloc(root->numChildren, sizeof(directory_entry_raw_t*));
+	uint8_t* isView = (uint8_t*) calloc(root->numChildren, sizeof(uint8_t));
+	sector_extent_t* extents = (sector_extent_t*)
+			malloc(numDirectoryExtents * sizeof(sector_extent_t));
+	if (childRaw == NULL || isView == NULL || (extents == NULL && numDirectoryExtents > 0))
+		handleError(L"getDirectoryTreeRecursive", L"Unable to allocate memory to read a directory");
+	uint32_t numExtents = 0;
+	childIndex = 0;
+	while (childIndex < root->numChildren) {
+		file_t* child = &(root->children[childIndex]);
+		if (child->type && !isDirectoryLoop(child)) {
+			childRaw[childIndex] = (directory_entry_raw_t*)
+					viewClusters(child->extents, child->numExtents, volume, storageDevice);
+			isView[childIndex] = (childRaw[childIndex] != NULL);
+			if (!isView[childIndex]) {
+				childRaw[childIndex] = (directory_entry_raw_t*)
+						malloc(child->numClusters
+						       * volume->sectorsPerCluster
+						       * volume->bytesPerSector);
+				if (childRaw[childIndex] == NULL)
+					handleError(L"getDirectoryTreeRecursive", L"Unable to allocate memory to read a directory");
+				getSectorExtents(&(extents[numExtents]),
+				                 (uint8_t*) childRaw[childIndex],
+				                 child->extents,
+				                 child->numExtents,
+				                 volume);
+				numExtents += child->numExtents;
+			}
+		}
+		childIndex++;
+	}
+	readSectorExtents(extents, numExtents, volume->bytesPerSector, storageDevice);
+	free(extents);
 
-			//
-			// GET CHILD'S RAW DIRECTORY CONTENTS.
-			childRaw = (directory_entry_raw_t*)
-						malloc(root->children[childIndex].numClusters
-							   * bootSector->sectorsPerCluster
-							   * bootSector->bytesPerSector);
-			if (childRaw == NULL)
-				handleError(L"getDirectoryTreeRecursive", L"Unable to allocate memory to read a directory");
-			readClusters((uint8_t*) childRaw,
-						 root->children[childIndex].clusters,
-			             root->children[childIndex].numClusters,
-			             bootSector,
-			             storageDevice);
+	//
+	// PARSE EACH CHILD DIRECTORY.
+	childIndex = 0;
+	while (childIndex < root->numChildren) {
+		file_t* child = &(root->children[childIndex]);
+		if (child->type && childRaw[childIndex] != NULL) {
 
 			//
 			// GET THE PARSED ENTRIES FOR THE CHILD DIRECTORY.
-			uint32_t maxEntries = (root->children[childIndex].numClusters
-			                           * bootSector->sectorsPerCluster
-								       * bootSector->bytesPerSector
+			uint32_t maxEntries = (child->numClusters
+			                           * volume->sectorsPerCluster
+								       * volume->bytesPerSector
 								   ) / BYTES_PER_DIRECTORY_ENTRY;
-			root->children[childIndex].children =
-			    parseDirectoryEntries(childRaw,
-			                          &(root->children[childIndex].numChildren),
-			                          maxEntries,
-									  fileAllocationTable,
-			                          bootSector);
+			child->children = parseDirectoryEntries(childRaw[childIndex],
+			                                        &(child->numChildren),
+			                                        maxEntries,
+			                                        fileAllocationTable,
+			                                        volume);
 
 			//
-			// FREE THE RAW DATA BUFFER.
-			free(childRaw);
+			// FREE THE RAW DATA BUFFER (UNLESS IT IS A VIEW OF THE DEVICE).
+			if (!isView[childIndex])
+				free(childRaw[childIndex]);
+
+		}
+		childIndex++;
+	}
+	free(childRaw);
+	free(isView);
+
+	//
+	// RECURSE INTO EACH CHILD DIRECTORY.  WHILE ONE CHILD'S SUBTREE IS BEING
+	// READ, THE SUBDIRECTORIES OF THE NEXT CHILD IN THE QUEUE ARE PREFETCHED.
+	childIndex = 0;
+	while (childIndex < root->numChildren) {
+		if (root->children[childIndex].type) {
+
+			//
+			// FIND THE NEXT CHILD DIRECTORY, AND PREFETCH ITS SUBDIRECTORIES.
+			uint32_t nextIndex = childIndex + 1;
+			while (nextIndex < root->numChildren && !root->children[nextIndex].type)
+				nextIndex++;
+			if (nextIndex < root->numChildren)
+				prefetchSubdirectories(&(root->children[nextIndex]), volume, storageDevice);
 
 			//
 			// CALL THE RECURSIVE FUNCTION.
-			getDirectoryTreeRecursive(&(root->children[childIndex]), bootSector,
+			getDirectoryTreeRecursive(&(root->children[childIndex]), volume,
 									  fileAllocationTable, storageDevice);
 
 		}
@@ -342,6 +459,28 @@ void getDirectoryTreeRecursive(file_t* root,
 }
 
 
+uint8_t isDirectoryLoop(file_t* directory) {
+
+	//
+	// A DIRECTORY WITHOUT CLUSTERS HAS NOTHING TO READ, SO IT CANNOT LOOP.
+	if (directory->numExtents == 0)
+		return 0;
+	uint32_t firstCluster = directory->extents[0].firstCluster;
+
+	//
+	// COMPARE ITS FIRST CLUSTER WITH THOSE OF ITS ANCESTORS.  (THE ROOT
+	// DIRECTORY OF A FAT12 OR FAT16 VOLUME HAS NO CLUSTERS.)
+	file_t* ancestor = directory->parentDirectory;
+	while (ancestor != NULL) {
+		if (ancestor->numExtents > 0 && ancestor->extents[0].firstCluster == firstCluster)
+			return 1;
+		ancestor = ancestor->parentDirectory;
+	}
+	return 0;
+
+}
+
+
 
 
 //
@@ -349,6 +488,77 @@ void getDirectoryTreeRecursive(file_t* root,
 //
 
 
+void markDamagedFiles(file_t* directory,
+                      uint8_t fatDamaged,
+                      volume_t* volume,
+                      storage_device_t* storageDevice) {
+
+	uint64_t bytesPerCluster = volume->bytesPerCluster;
+	uint32_t childIndex = 0;
+	while (childIndex < directory->numChildren) {
+		file_t* child = &(directory->children[childIndex]);
+
+		//
+		// A FILE OR DIRECTORY IS DAMAGED IF ANY OF ITS CLUSTERS ARE.
+		child->damaged = areClustersDamaged(child->extents, child->numExtents,
+		                                    volume, storageDevice);
+
+		//
+		// A FILE THAT HAS FEWER CLUSTERS THAN ITS SIZE CALLS FOR HAD ITS
+		// CLUSTER SEQUENCE CUT SHORT, MOST LIKELY BY THE DAMAGE TO THE FAT.
+		if (fatDamaged && !child->type && (uint64_t) child->numClusters * bytesPerCluster < child->size)
+			child->damaged = 1;
+
+		if (child->type)
+			markDamagedFiles(child, fatDamaged, volume, storageDevice);
+		childIndex++;
+	}
+
+}
+
+
+void prefetchSubdirectories(file_t* directory,
+                            volume_t* volume,
+                            storage_device_t* storageDevice) {
+
+	//
+	// NOTHING TO DO IF PREFETCHING IS DISABLED.
+	if (storageDevice->prefetchWindow == 0)
+		return;
+
+	//
+	// COUNT THE EXTENTS OF THE SUBDIRECTORIES.
+	uint32_t numExtents = 0;
+	uint32_t childIndex = 0;
+	while (childIndex < directory->numChildren) {
+		if (directory->children[childIndex].type)
+			numExtents += directory->children[childIndex].numExtents;
+		childIndex++;
+	}
+	if (numExtents == 0)
+		return;
+
+	//
+	// GATHER THEM INTO ONE LIST, IN TRAVERSAL ORDER, AND PREFETCH IT.
+	cluster_extent_t* extents = (cluster_extent_t*) malloc(numExtents * sizeof(cluster_extent_t));
+	if (extents == NULL)
+		handleError(L"prefetchSubdirectories", L"Unable to allocate memory for the prefetch list");
+	numExtents = 0;
+	childIndex = 0;
+	while (childIndex < directory->numChildren) {
+		file_t* child = &(directory->children[childIndex]);
+		if (child->type) {
+			memcpy(&(extents[numExtents]), child->extents, child->numExtents * sizeof(cluster_extent_t));
+			numExtents += child->numExtents;
+		}
+		childIndex++;
+	}
+	prefetchClusters(extents, numExtents, volume, storageDevice);
+	free(extents);
+
+}
+
+
 struct directory_entry_raw_t {
 
 	char name[8];                /* The name, not including the file extension */
@@ -366,13 +576,14 @@ struct directory_entry_raw_t {
 file_t* parseDirectoryEntries(directory_entry_raw_t* directoryEntriesRaw,
 							  uint32_t* numEntries,
 							  uint32_t maxDirectoryEntries,
-							  uint32_t* fileAllocationTable,
-							  boot_sect_t* bootSector) {
+							  fat_t* fileAllocationTable,
+							  volume_t* volume) {
 
 	//
-	// CREATE THE EMPTY DIRECTORY ENTRY STRUCTS.
+	// CREATE THE EMPTY DIRECTORY ENTRY STRUCTS (ZEROED, SO THAT NONE OF THEM
+	// START OUT MARKED AS DAMAGED).
 	file_t* directoryEntries = (file_t*)
-			malloc(maxDirectoryEntries * sizeof(file_t));
+			calloc(maxDirectoryEntries, sizeof(file_t));
 
 	//
 	// VARIABLES USED IN LOOP.
@@ -445,7 +656,7 @@ file_t* parseDirectoryEntries(directory_entry_raw_t* directoryEntriesRaw,
 			                         vfatRawEntrySequence,
 			                         vfatSequenceCount,
 									 fileAllocationTable,
-			                         bootSector);
+			                         volume);
 			vfatSequenceCount = 0;
 			indexSrc = indexSrc + 1;
 			*numEntries = *numEntries + 1;
@@ -455,7 +666,7 @@ file_t* parseDirectoryEntries(directory_entry_raw_t* directoryEntriesRaw,
 		//
 		// IF THE CURRENT ITERATION MADE IT THIS FAR, THEN THIS ENTRY IS
 		// JUST AN ORDINARY DIRECTORY ENTRY.
-		parseDirectoryEntry(dstEntry, srcEntry, fileAllocationTable, bootSector);
+		parseDirectoryEntry(dstEntry, srcEntry, fileAllocationTable, volume);
 		indexSrc = indexSrc + 1;
 		*numEntries = *numEntries + 1;
 
@@ -467,14 +678,14 @@ file_t* parseDirectoryEntries(directory_entry_raw_t* directoryEntriesRaw,
 
 void parseDirectoryEntry(file_t* directoryEntry,
                          directory_entry_raw_t* directoryEntryRaw,
-						 uint32_t* fileAllocationTable,
-                         boot_sect_t* bootSector) {
+						 fat_t* fileAllocationTable,
+                         volume_t* volume) {
 
 	//
 	// EXTRACT THE FILE'S NAME, TYPE, FIRST CLUSTER, AND SIZE FROM DIRECTORY ENTRY.
 	extractEntryName(directoryEntry, directoryEntryRaw);
 	extractEntrytype(directoryEntry, directoryEntryRaw);
-	extractEntryFirstCluster(directoryEntry, directoryEntryRaw, bootSector, fileAllocationTable);
+	extractEntryFirstCluster(directoryEntry, directoryEntryRaw, volume, fileAllocationTable);
 	extractEntrySize(directoryEntry, directoryEntryRaw);
 
 }
@@ -483,14 +694,14 @@ void parseDirectoryEntry(file_t* directoryEntry,
 void parseDirectoryEntry_VFAT(file_t* directoryEntry,
                               directory_entry_raw_t* vfatRawEntrySequence,
                               uint32_t vfatSequenceCount,
-							  uint32_t* fileAllocationTable,
-                              boot_sect_t* bootSector) {
+							  fat_t* fileAllocationTable,
+                              volume_t* volume) {
 
 	//
 	// EXTRACT THE FILE'S NAME, TYPE, FIRST CLUSTER, AND SIZE FROM DIRECTORY ENTRY.
 	extractEntryName_VFAT(directoryEntry, vfatRawEntrySequence, vfatSequenceCount);
 	extractEntrytype(directoryEntry, &(vfatRawEntrySequence[vfatSequenceCount-1]));
-	extractEntryFirstCluster(directoryEntry, &(vfatRawEntrySequence[vfatSequenceCount-1]), bootSector, fileAllocationTable);
+	extractEntryFirstCluster(directoryEntry, &(vfatRawEntrySequence[vfatSequenceCount-1]), volume, fileAllocationTable);
 	extractEntrySize(directoryEntry, &(vfatRawEntrySequence[vfatSequenceCount-1]));
 
 }
@@ -651,41 +862,23 @@ void extractEntrytype(file_t* directoryEntry,
 
 void extractEntryFirstCluster(file_t* directoryEntry,
 							  directory_entry_raw_t* directoryEntryRaw,
-							  boot_sect_t* bootSector,
-							  uint32_t* fileAllocationTable) {
-	uint32_t firstCluster;
-	switch(getFatVersion(bootSector)) {
+							  volume_t* volume,
+							  fat_t* fileAllocationTable) {
 
-		case FAT12:	
-
-			//
-			// EXTRACTS THE 2-BYTE INTEGER FROM THE RAW DATA THAT REPRESENTS THE
-			// NUMBER OF THE FIRST CLUSTER.
-			firstCluster = (uint32_t)
-			               (((uint32_t) directoryEntryRaw->firstCluster[1]) <<  8) |
-			               (((uint32_t) directoryEntryRaw->firstCluster[0]) <<  0);
-			break;
-
-		case FAT32:
-
-			//
-			// EXTRACTS THE 4-BYTE INTEGER FROM THE RAW DATA THAT REPRESENTS THE
-			// NUMBER OF THE FIRST CLUSTER.
-			firstCluster = (uint32_t)
-			               (((uint32_t) directoryEntryRaw->reserved[9]     & 0b00001111) << 24) |
-			               (((uint32_t) directoryEntryRaw->reserved[8]     & 0b11111111) << 16) |
-			               (((uint32_t) directoryEntryRaw->firstCluster[1] & 0b11111111) <<  8) |
-			               (((uint32_t) directoryEntryRaw->firstCluster[0] & 0b11111111) <<  0) ;
-			break;
-
-	}
+	//
+	// EXTRACTS THE NUMBER OF THE FIRST CLUSTER FROM THE RAW DATA.  THE HIGH
+	// HALF OF IT IS STORED IN THE RESERVED BYTES (AND IS ONLY USED BY FAT32).
+	uint32_t firstCluster =
+			volume->width->getEntryFirstCluster(directoryEntryRaw->firstCluster,
+			                                    &(directoryEntryRaw->reserved[8]));
 
 	//
 	// GET THE CLUSTER SEQUENCE.
-	directoryEntry->clusters = getClusterSequence(firstCluster,
-	                                              bootSector,
-												  fileAllocationTable,
-												  &(directoryEntry->numClusters));
+	directoryEntry->extents = getClusterChain(firstCluster,
+	                                          volume,
+	                                          fileAllocationTable,
+	                                          &(directoryEntry->numExtents),
+	                                          &(directoryEntry->numClusters));
 
 }
 
@@ -21,9 +21,11 @@
 
 // LAYER 2: FILE_SYSTEM
 #include "boot_sector.h"
+#include "file_allocation_table.h"
+#include "volume.h"
 
 // LAYER 3: STORAGE_DEVICE
-// (NOTHING)
+#include "device_interface.h"
 
 // ERROR HANDLING
 #include "error.h"
@@ -49,8 +51,24 @@
 
 
 
+/*
+ * A run of clusters that directly follow one another on the device (e.g. the
+ * whole of an unfragmented file).
+ */
+typedef struct {
+
+	uint32_t  firstCluster;        // The number of the first cluster in the run.
+	uint32_t  numClusters;         // The number of clusters in the run.
+
+} cluster_extent_t;
+
+
+
+
 /*
  * A data structure used to store the information for a file or directory.
+ * Its cluster sequence is stored as the runs of contiguous clusters it is
+ * made up of, in order.
  */
 typedef struct file_t file_t;
 struct file_t {
@@ -58,11 +76,13 @@ struct file_t {
 	wchar_t*  name;                // The name of the file (empty string for root).
 	uint8_t   type;                // Set to 1 (TRUE) if this is a directory.
 	uint32_t  size;                // The file size (0 for directories).
-	uint32_t* clusters;            // The file's sequence of cluster numbers.
-	uint32_t  numClusters;         // The number of cluster numbers in the sequence.
+	cluster_extent_t* extents;     // The file's cluster sequence, as runs of contiguous clusters.
+	uint32_t  numExtents;          // The number of runs in the sequence.
+	uint32_t  numClusters;         // The number of clusters in the sequence.
 	file_t*   parentDirectory;     // The parent directory (NULL for root).
 	file_t*   children;            // The child directories and files.
 	uint32_t  numChildren;         // The number of child directories.
+	uint8_t   damaged;             // Set to 1 (TRUE) if part of it could not be read.
 
 };
 
@@ -72,10 +92,26 @@ struct file_t {
 /*
  * Returns the full directory tree.  This is a tree data structure containing a
  * file_t for every file and directory stored in the device.
+ *
+ * If the device is being read in degraded mode (see enableDegradedReads),
+ * every file and directory that lies partly on unreadable sectors is marked as
+ * damaged, as is every file whose cluster sequence is too short for its size
+ * while part of the file allocation table could not be read.
+ */
+file_t* getDirectoryTree(volume_t* volume,
+                         fat_t*       fileAllocationTable,
+                         storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns 1 if the given directory starts at the same cluster as one of its
+ * ancestors (in a corrupted file system), in which case reading it would read
+ * the ancestor again, and so on without end.  getDirectoryTree leaves such a
+ * directory without children.
  */
-file_t* getDirectoryTree(boot_sect_t* bootSector,
-                         uint32_t*    fileAllocationTable,
-                         FILE*        storageDevice);
+uint8_t isDirectoryLoop(file_t* directory);
 
 
 
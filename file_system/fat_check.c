@@ -0,0 +1,421 @@
+/******************************************************************************
+ * This file contains functions and data structures that perform a
+ *                      FILE ALLOCATION TABLE CONSISTENCY CHECK
+ * of a FAT filesystem, comparing the chains in the table with the directory
+ * tree that refers to them.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "directory.h"
+#include "fat_check.h"
+#include "file_allocation_table.h"
+#include "file_system_tools.h"
+#include "volume.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <wchar.h>
+
+
+
+
+/*
+ * Everything a check works with.
+ */
+typedef struct {
+
+	volume_t*            volume;
+	fat_t*               fileAllocationTable;
+	FILE*                report;       // Where the problems are written (NULL if nowhere).
+	fat_check_summary_t* summary;
+	uint64_t*            claimed;      // A bit for each cluster that some chain has been followed through.
+	uint64_t*            marked;       // A bit for each cluster of the chain being followed (and later, for each lost cluster that another lost cluster links to).
+
+} fat_check_t;
+
+
+/*
+ * Used to test, set and clear a cluster's bit in a bitmap.
+ */
+uint8_t testClusterBit(uint64_t* bitmap, uint32_t clusterNumber);
+void    setClusterBit(uint64_t* bitmap, uint32_t clusterNumber);
+void    clearClusterBit(uint64_t* bitmap, uint32_t clusterNumber);
+
+
+/*
+ * Used to determine if a FAT entry links to a cluster that exists.
+ */
+uint8_t isLinkInRange(fat_check_t* check, uint32_t entry);
+
+
+/*
+ * Used to check the chains of every file and directory below the given
+ * directory, and the sizes of the files.
+ */
+void checkDirectoryChains(fat_check_t* check, file_t* directory);
+
+
+/*
+ * Used to follow the chain of the given file or directory once, claiming its
+ * clusters, and reporting a cycle, a cross-link or a bad link if it runs into
+ * one.  Returns 1 if the chain loops back into itself.
+ */
+uint8_t checkChain(fat_check_t* check, file_t* owner);
+
+
+/*
+ * Used to find, and report, every chain that no file or directory refers to.
+ */
+void checkLostChains(fat_check_t* check);
+
+
+/*
+ * Used to determine if a cluster is in use (neither free nor marked bad), but
+ * is not in any chain that has been followed.
+ */
+uint8_t isLostCluster(fat_check_t* check, uint32_t clusterNumber);
+
+
+/*
+ * Used to follow a lost chain from the given cluster (as far as it is lost),
+ * claiming its clusters, and report it.
+ */
+void checkLostChain(fat_check_t* check, uint32_t firstCluster);
+
+
+/*
+ * Used to write a problem with a file or directory to the report: its name,
+ * its one or two numbers (written with the given format, e.g. L"0x%x" for a
+ * cluster number, or L"%u" for a number of clusters), and the file's path
+ * name.
+ */
+void reportFileProblem(fat_check_t* check, wchar_t* problem,
+                       wchar_t* numberFormat, uint32_t first, uint32_t second,
+                       file_t* file);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+void checkFileAllocationTable(file_t*              directoryTree,
+                              volume_t*            volume,
+                              fat_t*               fileAllocationTable,
+                              FILE*                report,
+                              fat_check_summary_t* summary) {
+
+	//
+	// PARAMETER CHECK.
+	if (directoryTree == NULL)
+		handleError(L"checkFileAllocationTable", L"NULL 'directoryTree' parameter");
+	if (volume == NULL)
+		handleError(L"checkFileAllocationTable", L"NULL 'volume' parameter");
+	if (fileAllocationTable == NULL)
+		handleError(L"checkFileAllocationTable", L"NULL 'fileAllocationTable' parameter");
+	if (summary == NULL)
+		handleError(L"checkFileAllocationTable", L"NULL 'summary' parameter");
+
+	//
+	// START WITH EMPTY BITMAPS, WITH A BIT FOR EVERY CLUSTER NUMBER UP TO THE
+	// HIGHEST ONE.
+	fat_check_t check;
+	uint64_t numWords = ((uint64_t) volume->maxClusterNumber / 64) + 1;
+	check.volume              = volume;
+	check.fileAllocationTable = fileAllocationTable;
+	check.report              = report;
+	check.summary             = summary;
+	check.claimed             = (uint64_t*) calloc(numWords, sizeof(uint64_t));
+	check.marked              = (uint64_t*) calloc(numWords, sizeof(uint64_t));
+	if (check.claimed == NULL || check.marked == NULL)
+		handleError(L"checkFileAllocationTable", L"Unable to allocate memory for the cluster bitmaps");
+	*summary = (fat_check_summary_t) {0};
+
+	if (report != NULL)
+		fwprintf(report, L"# readfat FAT consistency report (%lu clusters)\n",
+		         (unsigned long) (volume->maxClusterNumber - 1));
+
+	//
+	// FOLLOW EVERY CHAIN IN THE DIRECTORY TREE, STARTING WITH THE ROOT
+	// DIRECTORY'S (WHICH ONLY FAT32 HAS).
+	if (directoryTree->numExtents > 0)
+		checkChain(&check, directoryTree);
+	checkDirectoryChains(&check, directoryTree);
+
+	//
+	// EVERY CLUSTER THAT IS IN USE, BUT THAT NO CHAIN WENT THROUGH, IS LOST.
+	checkLostChains(&check);
+
+	//
+	// END THE REPORT WITH THE COUNTS.
+	if (report != NULL) {
+		fwprintf(report, L"summary\tcycles\t%llu\n",           (unsigned long long) summary->numCycles);
+		fwprintf(report, L"summary\tcross-links\t%llu\n",      (unsigned long long) summary->numCrossLinks);
+		fwprintf(report, L"summary\tbad-links\t%llu\n",        (unsigned long long) summary->numBadLinks);
+		fwprintf(report, L"summary\tsize-mismatches\t%llu\n",  (unsigned long long) summary->numSizeMismatches);
+		fwprintf(report, L"summary\tdirectory-loops\t%llu\n",  (unsigned long long) summary->numDirectoryLoops);
+		fwprintf(report, L"summary\tlost-chains\t%llu\n",      (unsigned long long) summary->numLostChains);
+		fwprintf(report, L"summary\tlost-clusters\t%llu\n",    (unsigned long long) summary->numLostClusters);
+	}
+
+	free(check.claimed);
+	free(check.marked);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+uint8_t testClusterBit(uint64_t* bitmap, uint32_t clusterNumber) {
+
+	return (bitmap[clusterNumber / 64] >> (clusterNumber % 64)) & 1;
+
+}
+
+
+void setClusterBit(uint64_t* bitmap, uint32_t clusterNumber) {
+
+	bitmap[clusterNumber / 64] |= ((uint64_t) 1) << (clusterNumber % 64);
+
+}
+
+
+void clearClusterBit(uint64_t* bitmap, uint32_t clusterNumber) {
+
+	bitmap[clusterNumber / 64] &= ~(((uint64_t) 1) << (clusterNumber % 64));
+
+}
+
+
+uint8_t isLinkInRange(fat_check_t* check, uint32_t entry) {
+
+	return entry >= 2 && entry <= check->volume->maxClusterNumber;
+
+}
+
+
+void checkDirectoryChains(fat_check_t* check, file_t* directory) {
+
+	uint32_t childIndex = 0;
+	while (childIndex < directory->numChildren) {
+		file_t* child = &(directory->children[childIndex]);
+
+		//
+		// A DIRECTORY THAT LOOPS BACK TO AN ANCESTOR SHARES THE ANCESTOR'S
+		// CHAIN (WHICH HAS ALREADY BEEN FOLLOWED), AND WAS NEVER READ.
+		if (child->type && isDirectoryLoop(child)) {
+			check->summary->numDirectoryLoops++;
+			reportFileProblem(check, L"directory-loop", L"0x%x", child->extents[0].firstCluster, 0, child);
+			childIndex++;
+			continue;
+		}
+
+		//
+		// FOLLOW THE CHAIN.
+		uint8_t isCycle = 0;
+		if (child->numExtents > 0)
+			isCycle = checkChain(check, child);
+
+		//
+		// A FILE'S CHAIN MUST HAVE JUST ENOUGH CLUSTERS TO HOLD ITS SIZE.
+		// (A CHAIN THAT LOOPS HAS NO LENGTH TO SPEAK OF.)
+		if (!child->type && !isCycle) {
+			uint64_t expectedClusters = ((uint64_t) child->size + check->volume->bytesPerCluster - 1)
+			                          >> check->volume->bytesPerClusterShift;
+			if (child->numClusters != expectedClusters) {
+				check->summary->numSizeMismatches++;
+				reportFileProblem(check, L"size-mismatch", L"%u\t%u", child->numClusters, (uint32_t) expectedClusters, child);
+			}
+		}
+
+		//
+		// CHECK EVERYTHING BELOW A DIRECTORY.
+		if (child->type)
+			checkDirectoryChains(check, child);
+		childIndex++;
+	}
+
+}
+
+
+uint8_t checkChain(fat_check_t* check, file_t* owner) {
+
+	//
+	// FOLLOW THE CHAIN ONE CLUSTER AT A TIME (NOT THROUGH THE FILE'S EXTENTS,
+	// WHICH WERE CUT OFF IF THE CHAIN LOOPS), MARKING EACH CLUSTER AS PART OF
+	// THIS CHAIN AND AS CLAIMED.
+	uint32_t firstCluster  = owner->extents[0].firstCluster;
+	uint32_t clusterNumber = firstCluster;
+	uint32_t numMarked = 0;
+	uint8_t  isCycle = 0;
+	while (1) {
+
+		//
+		// A CLUSTER ALREADY IN THIS CHAIN MEANS IT LOOPS BACK INTO ITSELF.
+		if (testClusterBit(check->marked, clusterNumber)) {
+			check->summary->numCycles++;
+			reportFileProblem(check, L"cycle", L"0x%x", clusterNumber, 0, owner);
+			isCycle = 1;
+			break;
+		}
+
+		//
+		// A CLUSTER ALREADY IN ANOTHER CHAIN MEANS THE TWO ARE CROSS-LINKED.
+		// THE REST OF THE CHAIN HAS ALREADY BEEN FOLLOWED, SO IT IS NOT
+		// FOLLOWED AGAIN.
+		if (testClusterBit(check->claimed, clusterNumber)) {
+			check->summary->numCrossLinks++;
+			reportFileProblem(check, L"cross-link", L"0x%x", clusterNumber, 0, owner);
+			break;
+		}
+		setClusterBit(check->marked,  clusterNumber);
+		setClusterBit(check->claimed, clusterNumber);
+		numMarked++;
+
+		//
+		// MOVE ON TO THE NEXT CLUSTER, UNLESS THIS IS THE END OF THE CHAIN,
+		// OR THE LINK LEADS NOWHERE (INCLUDING TO A FREE OR BAD CLUSTER).
+		uint32_t entry = getFATEntry(check->fileAllocationTable, clusterNumber);
+		if (entry >= check->volume->endOfChainMarker)
+			break;
+		if (!isLinkInRange(check, entry)) {
+			check->summary->numBadLinks++;
+			reportFileProblem(check, L"bad-link", L"0x%x\t0x%x", clusterNumber, entry, owner);
+			break;
+		}
+		clusterNumber = entry;
+
+	}
+
+	//
+	// UNMARK THE CHAIN, BY FOLLOWING IT AGAIN AS FAR AS IT WAS MARKED.
+	clusterNumber = firstCluster;
+	while (numMarked > 0) {
+		clearClusterBit(check->marked, clusterNumber);
+		clusterNumber = getFATEntry(check->fileAllocationTable, clusterNumber);
+		numMarked--;
+	}
+
+	return isCycle;
+
+}
+
+
+void checkLostChains(fat_check_t* check) {
+
+	uint32_t maxClusterNumber = check->volume->maxClusterNumber;
+
+	//
+	// MARK EVERY LOST CLUSTER THAT ANOTHER LOST CLUSTER LINKS TO.
+	uint32_t clusterNumber = 2;
+	while (clusterNumber <= maxClusterNumber) {
+		if (isLostCluster(check, clusterNumber)) {
+			uint32_t entry = getFATEntry(check->fileAllocationTable, clusterNumber);
+			if (isLinkInRange(check, entry))
+				setClusterBit(check->marked, entry);
+		}
+		clusterNumber++;
+	}
+
+	//
+	// EVERY LOST CLUSTER THAT NO OTHER ONE LINKS TO STARTS A LOST CHAIN.
+	clusterNumber = 2;
+	while (clusterNumber <= maxClusterNumber) {
+		if (!testClusterBit(check->marked, clusterNumber) && isLostCluster(check, clusterNumber))
+			checkLostChain(check, clusterNumber);
+		clusterNumber++;
+	}
+
+	//
+	// ANY LOST CLUSTERS THAT ARE LEFT ARE IN LOST CHAINS THAT LOOP, WITH NO
+	// START.  EACH ONE IS REPORTED FROM THE FIRST OF ITS CLUSTERS FOUND.
+	clusterNumber = 2;
+	while (clusterNumber <= maxClusterNumber) {
+		if (isLostCluster(check, clusterNumber))
+			checkLostChain(check, clusterNumber);
+		clusterNumber++;
+	}
+
+}
+
+
+uint8_t isLostCluster(fat_check_t* check, uint32_t clusterNumber) {
+
+	if (testClusterBit(check->claimed, clusterNumber))
+		return 0;
+	uint32_t entry = getFATEntry(check->fileAllocationTable, clusterNumber);
+	return entry != 0 && entry != check->volume->badClusterMarker;
+
+}
+
+
+void checkLostChain(fat_check_t* check, uint32_t firstCluster) {
+
+	//
+	// FOLLOW THE CHAIN WHILE IT IS LOST, CLAIMING EACH CLUSTER SO THAT IT IS
+	// ONLY EVER COUNTED ONCE.
+	uint64_t numClusters = 0;
+	uint32_t clusterNumber = firstCluster;
+	while (isLinkInRange(check, clusterNumber) && isLostCluster(check, clusterNumber)) {
+		setClusterBit(check->claimed, clusterNumber);
+		numClusters++;
+		clusterNumber = getFATEntry(check->fileAllocationTable, clusterNumber);
+	}
+
+	//
+	// REPORT IT.
+	check->summary->numLostChains++;
+	check->summary->numLostClusters += numClusters;
+	if (check->report != NULL)
+		fwprintf(check->report, L"lost-chain\t0x%x\t%llu\n", firstCluster, (unsigned long long) numClusters);
+
+}
+
+
+void reportFileProblem(fat_check_t* check, wchar_t* problem,
+                       wchar_t* numberFormat, uint32_t first, uint32_t second,
+                       file_t* file) {
+
+	if (check->report == NULL)
+		return;
+
+	//
+	// THE ROOT DIRECTORY'S PATH NAME IS EMPTY, SO IT IS WRITTEN AS "/".
+	wchar_t* absolutePathName = (file->parentDirectory == NULL) ? NULL : getAbsolutePathName(file);
+	wchar_t* pathName = (absolutePathName == NULL) ? L"/" : absolutePathName;
+
+	//
+	// WRITE THE PROBLEM, ITS ONE OR TWO NUMBERS, AND THE PATH NAME.
+	fwprintf(check->report, L"%ls\t", problem);
+	fwprintf(check->report, numberFormat, first, second);
+	fwprintf(check->report, L"\t%ls\n", pathName);
+	free(absolutePathName);
+
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+ * This file contains functions and data structures that perform a
+ *                      FILE ALLOCATION TABLE CONSISTENCY CHECK
+ * of a FAT filesystem, comparing the chains in the table with the directory
+ * tree that refers to them.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef FAT_CHECK_H_
+#define FAT_CHECK_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "directory.h"
+#include "file_allocation_table.h"
+#include "volume.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdio.h>
+
+
+
+
+/*
+ * A data structure used to store the number of problems of each kind that a
+ * check found.
+ */
+typedef struct {
+
+	uint64_t numCycles;            // Chains that loop back into themselves.
+	uint64_t numCrossLinks;        // Chains that run into another chain's clusters.
+	uint64_t numBadLinks;          // Links to a cluster that does not exist (or to a free or bad one).
+	uint64_t numSizeMismatches;    // Files whose chains are not as long as their sizes call for.
+	uint64_t numDirectoryLoops;    // Directories that start at the same cluster as an ancestor.
+	uint64_t numLostChains;        // Chains that no file or directory refers to.
+	uint64_t numLostClusters;      // The clusters in the lost chains.
+
+} fat_check_summary_t;
+
+
+
+
+/*
+ * Checks the file allocation table against the directory tree, and counts the
+ * problems it finds in "summary".  If "report" is not NULL, then every problem
+ * is also written to it, one per line, as tab-separated fields (cluster
+ * numbers in hex, numbers of clusters in decimal, path names last):
+ *
+ *     cycle           CLUSTER                     PATH
+ *     cross-link      CLUSTER                     PATH
+ *     bad-link        CLUSTER  ENTRY              PATH
+ *     size-mismatch   CLUSTERS EXPECTED_CLUSTERS  PATH
+ *     directory-loop  CLUSTER                     PATH
+ *     lost-chain      CLUSTER  CLUSTERS
+ *
+ * where CLUSTER is the cluster the problem was found at (the cluster a cycle
+ * returns to, the first shared cluster of a cross-link, the cluster with the
+ * bad entry, the first cluster of a looping directory, or the first cluster of
+ * a lost chain).  The report starts with a line beginning with '#', and ends
+ * with a "summary" line for each count in fat_check_summary_t.
+ *
+ * Each chain is followed once, and each cluster is visited at most a few
+ * times, using bitmaps of the clusters that are in some chain and in the
+ * chain being followed, so the check takes time in proportion to the number
+ * of clusters, and never loops, however corrupted the table is.
+ */
+void checkFileAllocationTable(file_t*              directoryTree,
+                              volume_t*            volume,
+                              fat_t*               fileAllocationTable,
+                              FILE*                report,
+                              fat_check_summary_t* summary);
+
+
+
+
+#endif
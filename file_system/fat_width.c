@@ -0,0 +1,338 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                                FAT WIDTH
+ * of a filesystem (12, 16 or 32 bits per FAT entry).
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "fat_width.h"
+#include "file_system_tools.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <wchar.h>
+
+// SIMD INTRINSICS (x86 ONLY)
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE FAT12 TRANSLATION HAS SSSE3 AND AVX2 VERSIONS ON x86, CHOSEN AT RUN TIME
+// BY WHAT THE CPU SUPPORTS.  ANYWHERE ELSE, ONLY THE SCALAR VERSION IS BUILT.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FAT12_SIMD
+#endif
+
+
+
+
+//
+// GENERATORS
+//
+
+// GENERATES THE FUNCTION THAT EXTRACTS THE FIRST CLUSTER OF A FILE FROM ITS
+// DIRECTORY ENTRY (ONLY FAT32 USES THE HIGH HALF, AND MASKS OFF ITS RESERVED
+// BITS), AND THE TABLE OF EVERYTHING FOR THE WIDTH.  WIDTH IS A CONSTANT, SO
+// THE TEST ON IT IS RESOLVED AT COMPILE TIME.  THE TRANSLATION IS WRITTEN OUT
+// BY HAND FOR EACH WIDTH THAT NEEDS ONE (BELOW): A FAT32 TABLE IS READ IN
+// PLACE (SEE getFATEntry), SO ONLY FAT12 AND FAT16 DO.
+#define DEFINE_FAT_WIDTH(WIDTH, TRANSLATE)                                                    \
+uint32_t getEntryFirstCluster_FAT##WIDTH(const uint8_t* firstClusterLow,                      \
+                                         const uint8_t* firstClusterHigh) {                   \
+	uint32_t firstCluster = (((uint32_t) firstClusterLow[1]) << 8) | ((uint32_t) firstClusterLow[0]); \
+	if (WIDTH == 32)                                                                          \
+		firstCluster = ((((uint32_t) firstClusterHigh[1]) << 24) |                            \
+		                (((uint32_t) firstClusterHigh[0]) << 16) |                            \
+		                firstCluster) & FAT32_ENTRY_MASK;                                     \
+	return firstCluster;                                                                      \
+}                                                                                             \
+                                                                                              \
+const fat_width_t fatWidth_FAT##WIDTH = {                                                     \
+	FAT##WIDTH,                                                                               \
+	FAT##WIDTH##_ENTRY_MASK,                                                                  \
+	FAT##WIDTH##_BAD_CLUSTER,                                                                 \
+	FAT##WIDTH##_END_OF_CHAIN,                                                                \
+	TRANSLATE,                                                                                \
+	getEntryFirstCluster_FAT##WIDTH                                                           \
+};
+
+
+
+
+/*
+ * Used to decode the unusual 12-bit FAT entries.
+ */
+void translateFileAllocationTable_FAT12(uint32_t*      fileAllocationTable,
+                                        const uint8_t* fileAllocationTableRaw,
+                                        uint32_t       numFATEntries);
+
+
+/*
+ * Used to decode 12-bit FAT entries one pair (three bytes) at a time, starting
+ * at the given entry (which must be even).  The last entry is decoded on its
+ * own if the number of entries is odd.
+ */
+void translateFAT12Entries_Scalar(uint32_t*      fileAllocationTable,
+                                  const uint8_t* fileAllocationTableRaw,
+                                  uint32_t       firstEntry,
+                                  uint32_t       numFATEntries);
+
+
+#ifdef FAT12_SIMD
+/*
+ * Used to decode 12-bit FAT entries with SSSE3 shuffles, eight entries (twelve
+ * bytes) at a time.  Returns the number of entries decoded; the rest are left
+ * for the scalar version.
+ */
+uint32_t translateFAT12Entries_SSSE3(uint32_t*      fileAllocationTable,
+                                     const uint8_t* fileAllocationTableRaw,
+                                     uint32_t       numFATEntries);
+
+
+/*
+ * Used to decode 12-bit FAT entries with AVX2 shuffles and shifts, eight
+ * entries (twelve bytes) at a time.  Returns the number of entries decoded;
+ * the rest are left for the scalar version.
+ */
+uint32_t translateFAT12Entries_AVX2(uint32_t*      fileAllocationTable,
+                                    const uint8_t* fileAllocationTableRaw,
+                                    uint32_t       numFATEntries);
+#endif
+
+
+/*
+ * Used to decode the 16-bit FAT entries, which are whole little-endian words.
+ */
+void translateFileAllocationTable_FAT16(uint32_t*      fileAllocationTable,
+                                        const uint8_t* fileAllocationTableRaw,
+                                        uint32_t       numFATEntries);
+
+
+
+
+//
+// THE CODE GENERATED FOR EACH WIDTH.
+//
+
+DEFINE_FAT_WIDTH(12, translateFileAllocationTable_FAT12)
+DEFINE_FAT_WIDTH(16, translateFileAllocationTable_FAT16)
+DEFINE_FAT_WIDTH(32, NULL)
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+const fat_width_t* getFatWidth(uint32_t fatVersion) {
+
+	switch (fatVersion) {
+
+		case FAT12:
+			return &fatWidth_FAT12;
+
+		case FAT16:
+			return &fatWidth_FAT16;
+
+		case FAT32:
+			return &fatWidth_FAT32;
+
+		default:
+			handleError(L"getFatWidth", L"Unknown FAT version");
+			return NULL;
+
+	}
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void translateFileAllocationTable_FAT12(uint32_t*      fileAllocationTable,
+                                        const uint8_t* fileAllocationTableRaw,
+                                        uint32_t       numFATEntries) {
+
+	//
+	// DECODE AS MANY ENTRIES AS POSSIBLE WITH THE WIDEST INSTRUCTIONS THE CPU
+	// SUPPORTS.
+	uint32_t entryNumber = 0;
+#ifdef FAT12_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		entryNumber = translateFAT12Entries_AVX2(fileAllocationTable,
+		                                         fileAllocationTableRaw,
+		                                         numFATEntries);
+	else if (__builtin_cpu_supports("ssse3"))
+		entryNumber = translateFAT12Entries_SSSE3(fileAllocationTable,
+		                                          fileAllocationTableRaw,
+		                                          numFATEntries);
+#endif
+
+	//
+	// DECODE THE REST ONE PAIR AT A TIME.
+	translateFAT12Entries_Scalar(fileAllocationTable,
+	                             fileAllocationTableRaw,
+	                             entryNumber,
+	                             numFATEntries);
+
+}
+
+
+void translateFAT12Entries_Scalar(uint32_t*      fileAllocationTable,
+                                  const uint8_t* fileAllocationTableRaw,
+                                  uint32_t       firstEntry,
+                                  uint32_t       numFATEntries) {
+
+	//
+	// DECODES THE UNUSUAL 12-BIT FAT ENTRIES.
+	uint64_t byteNumber  = ((uint64_t) firstEntry / 2) * 3;
+	uint32_t entryNumber = firstEntry;
+	uint32_t combined24BitValue;
+	while (entryNumber + 2 <= numFATEntries) {
+		combined24BitValue = (uint32_t)
+							 (((uint32_t) fileAllocationTableRaw[byteNumber+2]) << 16) |
+							 (((uint32_t) fileAllocationTableRaw[byteNumber+1]) <<  8) |
+							 (((uint32_t) fileAllocationTableRaw[byteNumber+0]) <<  0);
+		fileAllocationTable[entryNumber]   = (uint32_t) (combined24BitValue % 4096);
+		fileAllocationTable[entryNumber+1] = (uint32_t) (combined24BitValue / 4096);
+
+		entryNumber = entryNumber + 2;
+		byteNumber  = byteNumber  + 3;
+	}
+
+	//
+	// IF THE NUMBER OF ENTRIES IS ODD, THEN THE LAST ONE IS ON ITS OWN, IN THE
+	// FIRST ONE AND A HALF BYTES OF ITS PAIR.
+	if (entryNumber < numFATEntries)
+		fileAllocationTable[entryNumber] = (uint32_t)
+							 ((((uint32_t) fileAllocationTableRaw[byteNumber+1] & 0x0f) << 8) |
+							  (((uint32_t) fileAllocationTableRaw[byteNumber+0])        << 0));
+
+}
+
+
+#ifdef FAT12_SIMD
+__attribute__((target("ssse3")))
+uint32_t translateFAT12Entries_SSSE3(uint32_t*      fileAllocationTable,
+                                     const uint8_t* fileAllocationTableRaw,
+                                     uint32_t       numFATEntries) {
+
+	//
+	// EACH PAIR OF ENTRIES IS THREE BYTES: AB CD EF GIVES 0xDAB AND 0xEFC.
+	// SHUFFLE THE TWO BYTES HOLDING EACH ENTRY INTO THE LOW HALF OF ITS OWN
+	// 32-BIT LANE (AB CD FOR THE FIRST, CD EF FOR THE SECOND), THEN KEEP THE LOW
+	// 12 BITS OF THE EVEN LANES AND THE HIGH 12 BITS OF THE ODD ONES.
+	const __m128i shuffleLow  = _mm_setr_epi8(0, 1, -1, -1,  1,  2, -1, -1,
+	                                          3, 4, -1, -1,  4,  5, -1, -1);
+	const __m128i shuffleHigh = _mm_setr_epi8(6, 7, -1, -1,  7,  8, -1, -1,
+	                                          9, 10, -1, -1, 10, 11, -1, -1);
+	const __m128i maskEven    = _mm_setr_epi32(0xfff, 0, 0xfff, 0);
+	const __m128i maskOdd     = _mm_setr_epi32(0, 0xfff, 0, 0xfff);
+
+	//
+	// EVERY GROUP OF EIGHT ENTRIES USES TWELVE BYTES, BUT IS LOADED WITH A
+	// SIXTEEN BYTE READ, WHICH MUST NOT GO PAST THE LAST BYTE OF THE LAST ENTRY.
+	uint64_t numBytes    = ((uint64_t) numFATEntries * 3 + 1) / 2;
+	uint64_t byteNumber  = 0;
+	uint32_t entryNumber = 0;
+	while (byteNumber + 16 <= numBytes) {
+		__m128i raw  = _mm_loadu_si128((const __m128i*) (fileAllocationTableRaw + byteNumber));
+		__m128i low  = _mm_shuffle_epi8(raw, shuffleLow);
+		__m128i high = _mm_shuffle_epi8(raw, shuffleHigh);
+		low  = _mm_or_si128(_mm_and_si128(low, maskEven),
+		                    _mm_and_si128(_mm_srli_epi32(low, 4), maskOdd));
+		high = _mm_or_si128(_mm_and_si128(high, maskEven),
+		                    _mm_and_si128(_mm_srli_epi32(high, 4), maskOdd));
+		_mm_storeu_si128((__m128i*) (fileAllocationTable + entryNumber),     low);
+		_mm_storeu_si128((__m128i*) (fileAllocationTable + entryNumber + 4), high);
+
+		entryNumber = entryNumber + 8;
+		byteNumber  = byteNumber  + 12;
+	}
+
+	return entryNumber;
+
+}
+
+
+__attribute__((target("avx2")))
+uint32_t translateFAT12Entries_AVX2(uint32_t*      fileAllocationTable,
+                                    const uint8_t* fileAllocationTableRaw,
+                                    uint32_t       numFATEntries) {
+
+	//
+	// THE SAME AS THE SSSE3 VERSION, EXCEPT THAT ALL EIGHT ENTRIES ARE SHUFFLED
+	// AT ONCE (THE FIRST FOUR IN THE LOW HALF OF THE REGISTER, AND THE OTHER
+	// FOUR IN THE HIGH HALF), AND EACH LANE IS SHIFTED BY ITS OWN AMOUNT.
+	const __m256i shuffle = _mm256_setr_epi8(0, 1, -1, -1,  1,  2, -1, -1,
+	                                         3, 4, -1, -1,  4,  5, -1, -1,
+	                                         6, 7, -1, -1,  7,  8, -1, -1,
+	                                         9, 10, -1, -1, 10, 11, -1, -1);
+	const __m256i shifts  = _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4);
+	const __m256i mask    = _mm256_set1_epi32(0xfff);
+
+	//
+	// EVERY GROUP OF EIGHT ENTRIES USES TWELVE BYTES, BUT IS LOADED WITH A
+	// SIXTEEN BYTE READ, WHICH MUST NOT GO PAST THE LAST BYTE OF THE LAST ENTRY.
+	uint64_t numBytes    = ((uint64_t) numFATEntries * 3 + 1) / 2;
+	uint64_t byteNumber  = 0;
+	uint32_t entryNumber = 0;
+	while (byteNumber + 16 <= numBytes) {
+		__m128i raw     = _mm_loadu_si128((const __m128i*) (fileAllocationTableRaw + byteNumber));
+		__m256i entries = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(raw), shuffle);
+		entries = _mm256_and_si256(_mm256_srlv_epi32(entries, shifts), mask);
+		_mm256_storeu_si256((__m256i*) (fileAllocationTable + entryNumber), entries);
+
+		entryNumber = entryNumber + 8;
+		byteNumber  = byteNumber  + 12;
+	}
+
+	return entryNumber;
+
+}
+#endif
+
+
+void translateFileAllocationTable_FAT16(uint32_t*      fileAllocationTable,
+                                        const uint8_t* fileAllocationTableRaw,
+                                        uint32_t       numFATEntries) {
+
+	uint32_t entryNumber = 0;
+	while (entryNumber < numFATEntries) {
+		const uint8_t* entryRaw = fileAllocationTableRaw + ((uint64_t) entryNumber * 2);
+		fileAllocationTable[entryNumber] = (((uint32_t) entryRaw[1]) << 8) | ((uint32_t) entryRaw[0]);
+		entryNumber++;
+	}
+
+}
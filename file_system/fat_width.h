@@ -0,0 +1,100 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                                FAT WIDTH
+ * of a filesystem (12, 16 or 32 bits per FAT entry).  Everything that depends
+ * on the width is generated once for each width, with that width's masks,
+ * markers and entry size built in as constants, and a volume picks its width
+ * once (see getVolume), rather than checking the FAT version for every entry
+ * or cluster.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef FAT_WIDTH_H_
+#define FAT_WIDTH_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE BITS OF A FAT ENTRY THAT HOLD A CLUSTER NUMBER.  (THE TOP 4 BITS OF A
+// FAT32 ENTRY ARE RESERVED.)
+#define FAT12_ENTRY_MASK   0x00000fff
+#define FAT16_ENTRY_MASK   0x0000ffff
+#define FAT32_ENTRY_MASK   0x0fffffff
+
+// THE FAT ENTRY THAT MARKS A BAD CLUSTER.
+#define FAT12_BAD_CLUSTER  0x00000ff7
+#define FAT16_BAD_CLUSTER  0x0000fff7
+#define FAT32_BAD_CLUSTER  0x0ffffff7
+
+// THE LOWEST FAT ENTRY THAT MARKS THE END OF A CHAIN.
+#define FAT12_END_OF_CHAIN 0x00000ff8
+#define FAT16_END_OF_CHAIN 0x0000fff8
+#define FAT32_END_OF_CHAIN 0x0ffffff8
+
+
+
+
+/*
+ * A data structure used to store everything that depends on the width of a
+ * FAT's entries: the width's constants, and the functions generated for it.
+ */
+typedef struct {
+
+	uint32_t fatVersion;           // FAT12, FAT16 or FAT32 (i.e. the width in bits).
+	uint32_t entryMask;            // The bits of an entry that hold a cluster number.
+	uint32_t badClusterMarker;     // The entry that marks a bad cluster.
+	uint32_t endOfChainMarker;     // The lowest entry that marks the end of a chain.
+
+	// Decodes the first "numFATEntries" entries of the raw FAT into an array
+	// of integers (NULL for FAT32, whose raw entries are used as they are).
+	void     (*translateFileAllocationTable)(uint32_t*      fileAllocationTable,
+	                                         const uint8_t* fileAllocationTableRaw,
+	                                         uint32_t       numFATEntries);
+
+	// Extracts the first cluster of a file from the two (little-endian) halves
+	// stored in its directory entry.  Only FAT32 uses the high half.
+	uint32_t (*getEntryFirstCluster)(const uint8_t* firstClusterLow,
+	                                 const uint8_t* firstClusterHigh);
+
+} fat_width_t;
+
+
+
+
+/*
+ * Returns the functions and constants for the given FAT version (FAT12, FAT16
+ * or FAT32).
+ */
+const fat_width_t* getFatWidth(uint32_t fatVersion);
+
+
+
+
+#endif
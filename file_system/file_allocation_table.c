@@ -33,30 +33,92 @@
 #include <stdio.h>
 #include <wchar.h>
 
+// POSIX
+#include <pthread.h>
+#include <unistd.h>
 
 
 
+
+/*
+ * A window of a paged file allocation table that is in memory.
+ */
+typedef struct {
+
+	uint32_t windowNumber;         // Which window of the table this is.
+	uint64_t lastUsed;             // When it was last looked in (for eviction).
+	uint8_t* data;                 // Its contents (FAT_WINDOW_SIZE bytes).
+
+} fat_window_t;
+
+
+/*
+ * The windows of a paged file allocation table that are in memory.  Every
+ * window has a slot it is kept in while it is in memory, and there are only
+ * so many slots.
+ */
+struct fat_window_cache_t {
+
+	storage_device_t* storageDevice; // Where the windows are read from.
+	uint64_t        firstSector;   // The first sector of the table.
+	uint32_t        numSectors;    // The number of sectors in the table.
+	uint32_t        bytesPerSector;
+	uint32_t        entryShift;    // log2 of the number of bytes per entry.
+	uint32_t        entryMask;     // The bits of an entry that hold a cluster number.
+	uint32_t        numWindows;    // The number of windows in the table.
+	int32_t*        slotOfWindow;  // The slot each window is in (-1 if it is not in memory).
+	fat_window_t*   slots;         // The slots.
+	uint32_t        numSlots;      // The number of slots.
+	uint32_t        numSlotsUsed;  // The number of slots that have ever been filled.
+	uint64_t        useCount;      // Counts lookups, to date when windows were last used.
+	uint64_t        windowsRead;   // The number of windows read in.
+	pthread_mutex_t lock;          // Held while looking up an entry.
+
+};
+
+
 /*
  * Used to translate the raw file allocation table.
  */
-uint32_t* translateFileAllocationTable(boot_sect_t* bootSector,
+uint32_t* translateFileAllocationTable(volume_t* volume,
                                        uint8_t* fileAllocationTableRaw);
 
 
 /*
- * A FAT12 helper function for translating the raw file allocation table.
+ * Used to read a window of a paged file allocation table into a slot (evicting
+ * the least recently used window, if every slot is full).  Returns the slot.
+ */
+uint32_t loadFATWindow(fat_window_cache_t* windowCache, uint32_t windowNumber);
+
+
+/*
+ * Used to find the run of a compressed file allocation table that the given
+ * entry is in.
  */
-void translateFileAllocationTable_FAT12(boot_sect_t* bootSector,
-                                        uint32_t* fileAllocationTable,
-										uint8_t* fileAllocationTableRaw);
+uint32_t findFATRun(fat_t* fileAllocationTable, uint32_t entryNumber);
+
+
+/*
+ * A range of entries of the file allocation table that one thread sweeps for
+ * runs of linked clusters, and the runs it finds there.
+ */
+typedef struct {
+
+	fat_t*         fileAllocationTable;
+	uint32_t       firstCluster;   // The first cluster whose link is checked.
+	uint32_t       endCluster;     // Just past the last cluster whose link is checked.
+	fat_segment_t* segments;       // The runs found in the range.
+	uint32_t       numSegments;
+	uint32_t       maxSegments;
+
+} chain_index_range_t;
 
 
 /*
- * A FAT32 helper function for translating the raw file allocation table.
+ * Used to sweep one range of the file allocation table for runs of linked
+ * clusters (run by each thread of indexClusterChains).
  */
-void translateFileAllocationTable_FAT32(boot_sect_t* bootSector,
-                                        uint32_t* fileAllocationTable,
-										uint8_t* fileAllocationTableRaw);
+void* indexClusterChainRange(void* range);
 
 
 
@@ -66,54 +128,154 @@ void translateFileAllocationTable_FAT32(boot_sect_t* bootSector,
 //
 
 
-uint32_t* getFileAllocationTable(boot_sect_t* bootSector,
-                                 FILE* storageDevice) {
+fat_t* getFileAllocationTable(volume_t* volume,
+                              storage_device_t* storageDevice) {
 
 	//
 	// PARAMETER CHECK.
-	if (bootSector == NULL)
-		handleError(L"getFileAllocationTable", L"NULL 'bootSector' parameter");
+	if (volume == NULL)
+		handleError(L"getFileAllocationTable", L"NULL 'volume' parameter");
 	if (storageDevice == NULL)
 		handleError(L"getFileAllocationTable", L"NULL 'storageDevice' parameter");
 
 	//
-	// ALLOCATE THE BUFFER FOR THE RAW DATA.
-	uint32_t numSectors = (getFatVersion(bootSector) == FAT12) ?
-							bootSector->sectorsPerFAT_FAT12 :
-							bootSector->sectorsPerFAT_FAT32;
-	uint32_t bufferSize = bootSector->bytesPerSector * numSectors;
-	uint8_t* buffer = (uint8_t*) malloc(bufferSize);
-	if (buffer == NULL)
-		handleError(L"getFileAllocationTable", L"Unable to allocate memory to read the file allocation table");
+	// GET THE SIZE AND LOCATION OF THE RAW DATA.
+	uint32_t numSectors  = volume->sectorsPerFAT;
+	uint64_t firstSector = volume->firstSector_FAT;
 
 	//
-	// GENERATE AN ARRAY OF SECTOR LOCATIONS TO BE READ IN.
-	// THE LIST ONLY CONTAINS ONE ITEM -- THE STARTING SECTOR NUMBER OF THE FAT.
-	// THE ARRAY IS NEEDED FOR THE readSectors FUNCTION.
-	uint32_t* sectorNumber = (uint32_t*) malloc(sizeof(uint32_t));
-	sectorNumber[0] = getSectorNumber_FileAllocationTable(bootSector);
+	// ALLOCATE THE TABLE.
+	fat_t* fileAllocationTable = (fat_t*) calloc(1, sizeof(fat_t));
+	if (fileAllocationTable == NULL)
+		handleError(L"getFileAllocationTable", L"Unable to allocate memory for the file allocation table");
+	fileAllocationTable->numEntries = volume->numFATEntries;
 
 	//
-	// READ IN THE RAW FILE ALLOCATION TABLE.
-	readSectors(buffer,
-	            sectorNumber,
-	            1,
-	            bootSector->bytesPerSector,
-	            getFatVersion(bootSector) == FAT12 ? bootSector->sectorsPerFAT_FAT12 :  bootSector->sectorsPerFAT_FAT32,
-	            storageDevice);
+	// IF THE DEVICE IS MEMORY-MAPPED, THEN THE RAW FILE ALLOCATION TABLE IS
+	// USED (OR TRANSLATED) STRAIGHT OUT OF THE MAPPING.
+	uint8_t* buffer = (uint8_t*) viewSectors(firstSector,
+	                                         numSectors,
+	                                         volume->bytesPerSector,
+	                                         storageDevice);
+	uint8_t isView = (buffer != NULL);
+
+	//
+	// OTHERWISE, IT MUST BE READ INTO A BUFFER FIRST.
+	if (!isView) {
+
+		//
+		// ALLOCATE THE BUFFER FOR THE RAW DATA.
+		uint64_t bufferSize = (uint64_t) volume->bytesPerSector * numSectors;
+		buffer = (uint8_t*) malloc(bufferSize);
+		if (buffer == NULL)
+			handleError(L"getFileAllocationTable", L"Unable to allocate memory to read the file allocation table");
+
+		//
+		// SPLIT THE RAW FILE ALLOCATION TABLE INTO CHUNKS, SO THAT THEY CAN ALL
+		// BE IN FLIGHT AT ONCE IF THE DEVICE SUPPORTS ASYNCHRONOUS READS.
+		uint32_t numExtents = (numSectors + FAT_SECTORS_PER_READ - 1) / FAT_SECTORS_PER_READ;
+		sector_extent_t* extents = (sector_extent_t*) malloc(numExtents * sizeof(sector_extent_t));
+		if (extents == NULL && numExtents > 0)
+			handleError(L"getFileAllocationTable", L"Unable to allocate memory to read the file allocation table");
+		uint32_t extentIndex = 0;
+		while (extentIndex < numExtents) {
+			extents[extentIndex].firstSector = firstSector + (extentIndex * FAT_SECTORS_PER_READ);
+			extents[extentIndex].numSectors  = (extentIndex == numExtents - 1) ?
+			                                   numSectors - (extentIndex * FAT_SECTORS_PER_READ) :
+			                                   FAT_SECTORS_PER_READ;
+			extents[extentIndex].buffer      = buffer + ((uint64_t) extentIndex * FAT_SECTORS_PER_READ
+			                                             * volume->bytesPerSector);
+			extentIndex++;
+		}
+
+		//
+		// READ IN THE RAW FILE ALLOCATION TABLE.
+		readSectorExtents(extents, numExtents, volume->bytesPerSector, storageDevice);
+		free(extents);
+	}
+
+	//
+	// A FAT32 TABLE IS USED AS IT IS (SEE getFATEntry), SO THE RAW DATA ARE
+	// KEPT.
+	if (volume->width->translateFileAllocationTable == NULL) {
+		fileAllocationTable->raw       = buffer;
+		fileAllocationTable->rawBuffer = isView ? NULL : buffer;
+	}
+
+	//
+	// ANY OTHER TABLE IS TRANSLATED, AND THE RAW DATA ARE FREED.
+	else {
+		fileAllocationTable->entries = translateFileAllocationTable(volume, buffer);
+		if (!isView)
+			free(buffer);
+	}
+
+	//
+	// RETURN THE FILE ALLOCATION TABLE.
+	return fileAllocationTable;
+
+}
+
+
+fat_t* getPagedFileAllocationTable(volume_t*         volume,
+                                   storage_device_t* storageDevice,
+                                   uint64_t          maxBytes) {
 
 	//
-	// FREE THE SECTOR NUMBERS ARRAY WE CREATED FOR THE readSectors FUNCTION.
-	free(sectorNumber);
+	// PARAMETER CHECK.
+	if (volume == NULL)
+		handleError(L"getPagedFileAllocationTable", L"NULL 'volume' parameter");
+	if (storageDevice == NULL)
+		handleError(L"getPagedFileAllocationTable", L"NULL 'storageDevice' parameter");
+
+	//
+	// A FAT12 TABLE IS TOO SMALL TO BE WORTH PAGING (AND ITS ENTRIES CAN
+	// STRADDLE TWO WINDOWS), AND A TABLE ON A MEMORY-MAPPED DEVICE IS ALREADY
+	// PAGED IN ON DEMAND BY THE OPERATING SYSTEM.
+	if (volume->fatVersion == FAT12 ||
+	    viewSectors(volume->firstSector_FAT, volume->sectorsPerFAT,
+	                volume->bytesPerSector, storageDevice) != NULL)
+		return getFileAllocationTable(volume, storageDevice);
+
+	//
+	// ALLOCATE THE TABLE AND ITS WINDOW CACHE.
+	fat_t* fileAllocationTable = (fat_t*) calloc(1, sizeof(fat_t));
+	fat_window_cache_t* windowCache = (fat_window_cache_t*) calloc(1, sizeof(fat_window_cache_t));
+	if (fileAllocationTable == NULL || windowCache == NULL)
+		handleError(L"getPagedFileAllocationTable", L"Unable to allocate memory for the file allocation table");
+	fileAllocationTable->numEntries  = volume->numFATEntries;
+	fileAllocationTable->windowCache = windowCache;
 
 	//
-	// TRANSLATE THE RAW FILE ALLOCATION TABLE.
-	uint32_t* fileAllocationTable =
-			translateFileAllocationTable(bootSector, buffer);
+	// WORK OUT HOW MANY WINDOWS THE TABLE'S ENTRIES TAKE UP, AND HOW MANY OF
+	// THEM CAN BE KEPT IN MEMORY.
+	windowCache->storageDevice  = storageDevice;
+	windowCache->firstSector    = volume->firstSector_FAT;
+	windowCache->numSectors     = volume->sectorsPerFAT;
+	windowCache->bytesPerSector = volume->bytesPerSector;
+	windowCache->entryShift     = (volume->fatVersion == FAT32) ? 2 : 1;
+	windowCache->entryMask      = volume->width->entryMask;
+	uint64_t tableSize = (uint64_t) volume->numFATEntries << windowCache->entryShift;
+	windowCache->numWindows = (uint32_t) ((tableSize + FAT_WINDOW_SIZE - 1) / FAT_WINDOW_SIZE);
+	uint64_t numSlots = maxBytes / FAT_WINDOW_SIZE;
+	if (numSlots < 1)
+		numSlots = 1;
+	if (numSlots > windowCache->numWindows)
+		numSlots = windowCache->numWindows;
+	windowCache->numSlots = (uint32_t) numSlots;
 
 	//
-	// FREE THE RAW FILE ALLOCATION TABLE DATA.
-	free(buffer);
+	// NO WINDOW IS IN MEMORY YET.
+	windowCache->slotOfWindow = (int32_t*) malloc(((uint64_t) windowCache->numWindows + 1) * sizeof(int32_t));
+	windowCache->slots = (fat_window_t*) calloc(windowCache->numSlots + 1, sizeof(fat_window_t));
+	if (windowCache->slotOfWindow == NULL || windowCache->slots == NULL)
+		handleError(L"getPagedFileAllocationTable", L"Unable to allocate memory for the file allocation table");
+	uint32_t windowNumber = 0;
+	while (windowNumber < windowCache->numWindows) {
+		windowCache->slotOfWindow[windowNumber] = -1;
+		windowNumber++;
+	}
+	pthread_mutex_init(&(windowCache->lock), NULL);
 
 	//
 	// RETURN THE FILE ALLOCATION TABLE.
@@ -122,26 +284,342 @@ uint32_t* getFileAllocationTable(boot_sect_t* bootSector,
 }
 
 
-uint32_t getNumFATEntries(boot_sect_t* bootSector) {
+uint32_t getPagedFATEntry(fat_t* fileAllocationTable, uint32_t entryNumber) {
+
+	fat_window_cache_t* windowCache = fileAllocationTable->windowCache;
+
+	//
+	// FIND THE WINDOW THE ENTRY IS IN, AND WHERE IN THE WINDOW IT IS.
+	uint64_t byteOffset   = (uint64_t) entryNumber << windowCache->entryShift;
+	uint32_t windowNumber = (uint32_t) (byteOffset / FAT_WINDOW_SIZE);
+	uint32_t windowOffset = (uint32_t) (byteOffset % FAT_WINDOW_SIZE);
+
+	//
+	// READ THE WINDOW IN IF IT IS NOT IN MEMORY.
+	pthread_mutex_lock(&(windowCache->lock));
+	int32_t slot = windowCache->slotOfWindow[windowNumber];
+	if (slot < 0)
+		slot = (int32_t) loadFATWindow(windowCache, windowNumber);
+	windowCache->useCount++;
+	windowCache->slots[slot].lastUsed = windowCache->useCount;
 
 	//
-	// THE APPROACH TO DETERMINING THE NUMBER OF ENTRIES IN THE FAT TABLE
-	// DIFFERS BETWEEN FAT12 AND FAT32.
-	switch (getFatVersion(bootSector)) {
+	// DECODE THE ENTRY.
+	const uint8_t* entryRaw = windowCache->slots[slot].data + windowOffset;
+	uint32_t entry = (((uint32_t) entryRaw[1]) << 8) | ((uint32_t) entryRaw[0]);
+	if (windowCache->entryShift == 2)
+		entry |= (((uint32_t) entryRaw[3]) << 24) | (((uint32_t) entryRaw[2]) << 16);
+	pthread_mutex_unlock(&(windowCache->lock));
+
+	return entry & windowCache->entryMask;
+
+}
 
-		case FAT12:
-			return bootSector->numSectors_FAT12 / bootSector->sectorsPerCluster;
-			break;
 
-		case FAT32:
-			return bootSector->numSectors_FAT32 / bootSector->sectorsPerCluster;
-			break;
+fat_t* getCompressedFileAllocationTable(volume_t* volume,
+                                        storage_device_t* storageDevice) {
+
+	//
+	// PARAMETER CHECK.
+	if (volume == NULL)
+		handleError(L"getCompressedFileAllocationTable", L"NULL 'volume' parameter");
+	if (storageDevice == NULL)
+		handleError(L"getCompressedFileAllocationTable", L"NULL 'storageDevice' parameter");
+
+	//
+	// READ THE TABLE IN ONE WINDOW AT A TIME, SO THAT THE WHOLE TABLE IS NEVER
+	// IN MEMORY AT ONCE.  (A FAT12 TABLE, OR ONE ON A MEMORY-MAPPED DEVICE, IS
+	// READ AS IT IS; SEE getPagedFileAllocationTable.)
+	fat_t* wholeTable = getPagedFileAllocationTable(volume, storageDevice, FAT_WINDOW_SIZE);
 
-		default:
-			return 0;
+	//
+	// ALLOCATE THE COMPRESSED TABLE.  THE ARRAY OF RUNS STARTS SMALL, AND IS
+	// DOUBLED WHENEVER IT FILLS UP.
+	fat_t* fileAllocationTable = (fat_t*) calloc(1, sizeof(fat_t));
+	uint32_t maxRuns = 1024;
+	fat_run_t* runs = (fat_run_t*) malloc(maxRuns * sizeof(fat_run_t));
+	if (fileAllocationTable == NULL || runs == NULL)
+		handleError(L"getCompressedFileAllocationTable", L"Unable to allocate memory for the file allocation table");
+	fileAllocationTable->numEntries = wholeTable->numEntries;
 
+	//
+	// SPLIT THE ENTRIES INTO RUNS.  AN ENTRY JOINS THE CURRENT RUN IF IT IS THE
+	// SAME AS THE RUN'S FIRST ENTRY, OR IF IT IS ONE MORE THAN THE ENTRY BEFORE
+	// IT (WHICH MAKES A RUN OF TWO ENTRIES SEQUENTIAL).  OTHERWISE, IT STARTS A
+	// NEW RUN.
+	uint32_t numRuns = 0;
+	uint32_t entryNumber = 0;
+	while (entryNumber < wholeTable->numEntries) {
+		uint32_t entry = getFATEntry(wholeTable, entryNumber);
+		if (numRuns > 0) {
+			fat_run_t* run = &runs[numRuns - 1];
+			uint32_t offset = entryNumber - run->firstEntry;
+			uint32_t firstValue = run->firstValue & ~FAT_RUN_SEQUENTIAL;
+			if (run->firstValue & FAT_RUN_SEQUENTIAL) {
+				if (entry == firstValue + offset) {
+					entryNumber++;
+					continue;
+				}
+			}
+			else if (entry == firstValue) {
+				entryNumber++;
+				continue;
+			}
+			else if (offset == 1 && entry == firstValue + 1) {
+				run->firstValue |= FAT_RUN_SEQUENTIAL;
+				entryNumber++;
+				continue;
+			}
+		}
+		if (numRuns + 1 == maxRuns) {
+			maxRuns *= 2;
+			runs = (fat_run_t*) realloc(runs, maxRuns * sizeof(fat_run_t));
+			if (runs == NULL)
+				handleError(L"getCompressedFileAllocationTable", L"Unable to allocate memory for the file allocation table");
+		}
+		runs[numRuns].firstEntry = entryNumber;
+		runs[numRuns].firstValue = entry;
+		numRuns++;
+		entryNumber++;
 	}
 
+	//
+	// END THE LAST RUN WITH ONE THAT STARTS PAST THE END OF THE TABLE, AND GIVE
+	// BACK THE UNUSED PART OF THE ARRAY.
+	runs[numRuns].firstEntry = wholeTable->numEntries;
+	runs[numRuns].firstValue = 0;
+	fat_run_t* shrunkRuns = (fat_run_t*) realloc(runs, (numRuns + 1) * sizeof(fat_run_t));
+	if (shrunkRuns != NULL)
+		runs = shrunkRuns;
+	fileAllocationTable->runs    = runs;
+	fileAllocationTable->numRuns = numRuns;
+
+	//
+	// FREE THE WHOLE TABLE, AND RETURN THE COMPRESSED ONE.
+	freeFileAllocationTable(wholeTable);
+	return fileAllocationTable;
+
+}
+
+
+uint32_t getCompressedFATEntry(fat_t* fileAllocationTable, uint32_t entryNumber) {
+
+	//
+	// FIND THE RUN THE ENTRY IS IN.
+	uint32_t runNumber = findFATRun(fileAllocationTable, entryNumber);
+	fat_run_t* run = &(fileAllocationTable->runs[runNumber]);
+
+	//
+	// WORK OUT THE ENTRY FROM THE RUN'S FIRST ENTRY.
+	if (run->firstValue & FAT_RUN_SEQUENTIAL)
+		return (run->firstValue & ~FAT_RUN_SEQUENTIAL) + (entryNumber - run->firstEntry);
+	return run->firstValue;
+
+}
+
+
+void indexClusterChains(fat_t* fileAllocationTable, volume_t* volume) {
+
+	//
+	// PARAMETER CHECK.
+	if (fileAllocationTable == NULL)
+		handleError(L"indexClusterChains", L"NULL 'fileAllocationTable' parameter");
+	if (volume == NULL)
+		handleError(L"indexClusterChains", L"NULL 'volume' parameter");
+
+	//
+	// THE LINK OF EVERY CLUSTER BUT THE LAST ONE IS CHECKED.  (THE LAST ONE
+	// CANNOT LINK TO THE CLUSTER AFTER IT, WHICH DOES NOT EXIST.)
+	uint32_t firstCluster = 2;
+	uint32_t endCluster   = volume->maxClusterNumber;
+	uint32_t numEntries   = (endCluster > firstCluster) ? endCluster - firstCluster : 0;
+
+	//
+	// SPLIT THE TABLE INTO RANGES, ONE PER THREAD.  ONLY A TABLE WHOSE ENTRIES
+	// ARE READ STRAIGHT OUT OF MEMORY IS SPLIT; LOOKING UP THE ENTRIES OF A
+	// COMPRESSED TABLE FROM SEVERAL PLACES AT ONCE WOULD ONLY DEFEAT ITS
+	// MEMORY OF THE LAST RUN USED.
+	uint32_t numRanges = 1;
+	if (fileAllocationTable->runs == NULL) {
+		long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+		numRanges = numEntries / CHAIN_INDEX_ENTRIES_PER_THREAD;
+		if (numRanges > CHAIN_INDEX_THREADS)
+			numRanges = CHAIN_INDEX_THREADS;
+		if (numProcessors > 0 && numRanges > (uint32_t) numProcessors)
+			numRanges = (uint32_t) numProcessors;
+		if (numRanges < 1)
+			numRanges = 1;
+	}
+	chain_index_range_t ranges[CHAIN_INDEX_THREADS];
+	pthread_t threads[CHAIN_INDEX_THREADS];
+	uint8_t   isThread[CHAIN_INDEX_THREADS];
+	uint32_t  rangeIndex = 0;
+	while (rangeIndex < numRanges) {
+		ranges[rangeIndex].fileAllocationTable = fileAllocationTable;
+		ranges[rangeIndex].firstCluster = firstCluster + (uint32_t) (((uint64_t) numEntries * rangeIndex) / numRanges);
+		ranges[rangeIndex].endCluster   = firstCluster + (uint32_t) (((uint64_t) numEntries * (rangeIndex + 1)) / numRanges);
+		ranges[rangeIndex].segments     = NULL;
+		ranges[rangeIndex].numSegments  = 0;
+		ranges[rangeIndex].maxSegments  = 0;
+		rangeIndex++;
+	}
+
+	//
+	// SWEEP EVERY RANGE BUT THE FIRST ON A THREAD OF ITS OWN, AND THE FIRST ON
+	// THIS ONE.  (A RANGE WHOSE THREAD CANNOT BE STARTED IS SWEPT HERE, TOO.)
+	rangeIndex = 1;
+	while (rangeIndex < numRanges) {
+		isThread[rangeIndex] = (pthread_create(&(threads[rangeIndex]), NULL,
+		                                       indexClusterChainRange, &(ranges[rangeIndex])) == 0);
+		if (!isThread[rangeIndex])
+			indexClusterChainRange(&(ranges[rangeIndex]));
+		rangeIndex++;
+	}
+	indexClusterChainRange(&(ranges[0]));
+	uint64_t numSegments = ranges[0].numSegments;
+	rangeIndex = 1;
+	while (rangeIndex < numRanges) {
+		if (isThread[rangeIndex])
+			pthread_join(threads[rangeIndex], NULL);
+		numSegments += ranges[rangeIndex].numSegments;
+		rangeIndex++;
+	}
+
+	//
+	// JOIN THE RANGES' RUNS TOGETHER, IN ORDER.  A RUN THAT CROSSES FROM ONE
+	// RANGE INTO THE NEXT WAS FOUND AS TWO PIECES, WHICH ARE JOINED BACK UP.
+	fat_segment_t* segments = (fat_segment_t*) malloc((numSegments + 1) * sizeof(fat_segment_t));
+	if (segments == NULL)
+		handleError(L"indexClusterChains", L"Unable to allocate memory for the cluster chain index");
+	uint32_t numJoined = 0;
+	rangeIndex = 0;
+	while (rangeIndex < numRanges) {
+		chain_index_range_t* range = &(ranges[rangeIndex]);
+		uint32_t segmentIndex = 0;
+		if (numJoined > 0 && range->numSegments > 0 &&
+		    segments[numJoined - 1].lastCluster == range->segments[0].firstCluster) {
+			segments[numJoined - 1].lastCluster = range->segments[0].lastCluster;
+			segmentIndex = 1;
+		}
+		while (segmentIndex < range->numSegments) {
+			segments[numJoined] = range->segments[segmentIndex];
+			numJoined++;
+			segmentIndex++;
+		}
+		free(range->segments);
+		rangeIndex++;
+	}
+
+	//
+	// REPLACE THE OLD INDEX (IF ANY) WITH THE NEW ONE.
+	free(fileAllocationTable->segments);
+	fileAllocationTable->segments    = segments;
+	fileAllocationTable->numSegments = numJoined;
+	fileAllocationTable->lastSegment = 0;
+
+}
+
+
+uint32_t getLinkedRunEnd(fat_t* fileAllocationTable, uint32_t clusterNumber) {
+
+	fat_segment_t* segments = fileAllocationTable->segments;
+	uint32_t numSegments = fileAllocationTable->numSegments;
+	if (segments == NULL || numSegments == 0)
+		return clusterNumber;
+
+	//
+	// TRY THE RUN LOOKED UP LAST, AND THE ONE AFTER IT, FIRST.  (THE RUN IS
+	// REMEMBERED WITH ATOMIC LOADS AND STORES, AS IN findFATRun.)
+	uint32_t segmentIndex = __atomic_load_n(&(fileAllocationTable->lastSegment), __ATOMIC_RELAXED);
+	uint8_t found = 0;
+	if (segments[segmentIndex].firstCluster <= clusterNumber) {
+		if (segmentIndex + 1 == numSegments || clusterNumber < segments[segmentIndex + 1].firstCluster)
+			found = 1;
+		else if (segmentIndex + 2 == numSegments || clusterNumber < segments[segmentIndex + 2].firstCluster) {
+			segmentIndex++;
+			found = 1;
+		}
+	}
+
+	//
+	// OTHERWISE, SEARCH FOR THE LAST RUN THAT STARTS AT OR BEFORE THE CLUSTER.
+	if (!found) {
+		if (clusterNumber < segments[0].firstCluster)
+			return clusterNumber;
+		uint32_t low  = 0;
+		uint32_t high = numSegments - 1;
+		while (low < high) {
+			uint32_t middle = low + ((high - low + 1) / 2);
+			if (segments[middle].firstCluster <= clusterNumber)
+				low = middle;
+			else
+				high = middle - 1;
+		}
+		segmentIndex = low;
+	}
+	__atomic_store_n(&(fileAllocationTable->lastSegment), segmentIndex, __ATOMIC_RELAXED);
+
+	//
+	// THE CLUSTER MAY LIE PAST THE END OF THE RUN THAT STARTS BEFORE IT.
+	if (clusterNumber > segments[segmentIndex].lastCluster)
+		return clusterNumber;
+	return segments[segmentIndex].lastCluster;
+
+}
+
+
+void getFATRunStatistics(fat_t*    fileAllocationTable,
+                         uint64_t* numRuns,
+                         uint64_t* numBytes) {
+
+	*numRuns  = 0;
+	*numBytes = 0;
+	if (fileAllocationTable == NULL || fileAllocationTable->runs == NULL)
+		return;
+	*numRuns  = fileAllocationTable->numRuns;
+	*numBytes = ((uint64_t) fileAllocationTable->numRuns + 1) * sizeof(fat_run_t);
+
+}
+
+
+uint64_t getFATWindowStatistics(fat_t* fileAllocationTable) {
+
+	if (fileAllocationTable == NULL || fileAllocationTable->windowCache == NULL)
+		return 0;
+	pthread_mutex_lock(&(fileAllocationTable->windowCache->lock));
+	uint64_t windowsRead = fileAllocationTable->windowCache->windowsRead;
+	pthread_mutex_unlock(&(fileAllocationTable->windowCache->lock));
+	return windowsRead;
+
+}
+
+
+void freeFileAllocationTable(fat_t* fileAllocationTable) {
+
+	if (fileAllocationTable == NULL)
+		return;
+
+	//
+	// FREE THE WINDOWS OF A PAGED TABLE.
+	fat_window_cache_t* windowCache = fileAllocationTable->windowCache;
+	if (windowCache != NULL) {
+		uint32_t slot = 0;
+		while (slot < windowCache->numSlotsUsed) {
+			free(windowCache->slots[slot].data);
+			slot++;
+		}
+		free(windowCache->slots);
+		free(windowCache->slotOfWindow);
+		pthread_mutex_destroy(&(windowCache->lock));
+		free(windowCache);
+	}
+
+	free(fileAllocationTable->entries);
+	free(fileAllocationTable->rawBuffer);
+	free(fileAllocationTable->runs);
+	free(fileAllocationTable->segments);
+	free(fileAllocationTable);
+
 }
 
 
@@ -152,12 +630,12 @@ uint32_t getNumFATEntries(boot_sect_t* bootSector) {
 //
 
 
-uint32_t* translateFileAllocationTable(boot_sect_t* bootSector,
+uint32_t* translateFileAllocationTable(volume_t* volume,
                                        uint8_t* fileAllocationTableRaw) {
 
 	//
 	// CALCULATE HOW MUCH MEMORY TO ALLOCATE FOR THE ARRAY OF FAT ENTRIES.
-	uint32_t  tableSize = getNumFATEntries(bootSector) * sizeof(uint32_t);
+	uint64_t  tableSize = (uint64_t) volume->numFATEntries * sizeof(uint32_t);
 
 	//
 	// ALLOCATE MEMORY FOR THE ARRAY OF FAT ENTRIES.
@@ -167,24 +645,11 @@ uint32_t* translateFileAllocationTable(boot_sect_t* bootSector,
 					L"Unable to allocate memory for the file allocation table");
 
 	//
-	// TRANSLATE THE RAW DATA.
-	// THE APPROACH TO TRANSLATING THE FAT ENTRIES DIFFERS BETWEEN FAT12
-	// AND FAT32.
-	switch (getFatVersion(bootSector)) {
-
-		case FAT12:
-			translateFileAllocationTable_FAT12(bootSector,
-                                               fileAllocationTable,
-											   fileAllocationTableRaw);
-			break;
-
-		case FAT32:
-			translateFileAllocationTable_FAT32(bootSector,
-                                               fileAllocationTable,
-											   fileAllocationTableRaw);
-			break;
-
-	}
+	// TRANSLATE THE RAW DATA, WITH THE TRANSLATION GENERATED FOR THE VOLUME'S
+	// FAT WIDTH (SEE fat_width.h).
+	volume->width->translateFileAllocationTable(fileAllocationTable,
+	                                            fileAllocationTableRaw,
+	                                            volume->numFATEntries);
 
 	//
 	// RETURN THE ARRAY OF FAT ENTRIES.
@@ -193,50 +658,127 @@ uint32_t* translateFileAllocationTable(boot_sect_t* bootSector,
 }
 
 
-void translateFileAllocationTable_FAT12(boot_sect_t* bootSector,
-                                        uint32_t* fileAllocationTable,
-										uint8_t* fileAllocationTableRaw) {
+uint32_t loadFATWindow(fat_window_cache_t* windowCache, uint32_t windowNumber) {
 
 	//
-	// DECODES THE UNUSUAL 12-BIT FAT ENTRIES.
-	uint32_t byteNumber  = 0;
-	uint32_t entryNumber = 0;
-	uint32_t combined24BitValue;
-	uint32_t numFATEntries = getNumFATEntries(bootSector);
-	while (entryNumber < numFATEntries) {
-		combined24BitValue = (uint32_t)
-							 (((uint32_t) fileAllocationTableRaw[byteNumber+2]) << 16) |
-							 (((uint32_t) fileAllocationTableRaw[byteNumber+1]) <<  8) |
-							 (((uint32_t) fileAllocationTableRaw[byteNumber+0]) <<  0);
-		fileAllocationTable[entryNumber]   = (uint32_t) (combined24BitValue % 4096);
-		fileAllocationTable[entryNumber+1] = (uint32_t) (combined24BitValue / 4096);
-		
-		entryNumber = entryNumber + 2;
-		byteNumber  = byteNumber  + 3;
+	// USE A SLOT THAT HAS NEVER BEEN FILLED, IF THERE IS ONE.
+	uint32_t slot;
+	if (windowCache->numSlotsUsed < windowCache->numSlots) {
+		slot = windowCache->numSlotsUsed;
+		windowCache->slots[slot].data = (uint8_t*) malloc(FAT_WINDOW_SIZE);
+		if (windowCache->slots[slot].data == NULL)
+			handleError(L"loadFATWindow", L"Unable to allocate memory for a window of the file allocation table");
+		windowCache->numSlotsUsed++;
 	}
 
+	//
+	// OTHERWISE, EVICT THE WINDOW THAT WAS USED LEAST RECENTLY.  (THIS ONLY
+	// HAPPENS WHEN A WINDOW HAS TO BE READ IN, WHICH COSTS FAR MORE THAN
+	// LOOKING THROUGH THE SLOTS.)
+	else {
+		slot = 0;
+		uint32_t candidate = 1;
+		while (candidate < windowCache->numSlots) {
+			if (windowCache->slots[candidate].lastUsed < windowCache->slots[slot].lastUsed)
+				slot = candidate;
+			candidate++;
+		}
+		windowCache->slotOfWindow[windowCache->slots[slot].windowNumber] = -1;
+	}
+
+	//
+	// READ THE WINDOW IN.  THE LAST WINDOW MAY RUN PAST THE END OF THE TABLE,
+	// SO ONLY THE SECTORS OF IT THAT ARE IN THE TABLE ARE READ.
+	uint32_t sectorsPerWindow = FAT_WINDOW_SIZE / windowCache->bytesPerSector;
+	uint64_t firstSector = windowCache->firstSector + ((uint64_t) windowNumber * sectorsPerWindow);
+	uint32_t numSectors = sectorsPerWindow;
+	if ((uint64_t) windowNumber * sectorsPerWindow + numSectors > windowCache->numSectors)
+		numSectors = windowCache->numSectors - (windowNumber * sectorsPerWindow);
+	readSectors(windowCache->slots[slot].data,
+	            &firstSector,
+	            1,
+	            windowCache->bytesPerSector,
+	            numSectors,
+	            windowCache->storageDevice);
+	windowCache->windowsRead++;
+
+	//
+	// RECORD WHERE THE WINDOW IS.
+	windowCache->slots[slot].windowNumber = windowNumber;
+	windowCache->slotOfWindow[windowNumber] = (int32_t) slot;
+	return slot;
+
 }
 
 
-void translateFileAllocationTable_FAT32(boot_sect_t* bootSector,
-                                        uint32_t* fileAllocationTable,
-										uint8_t* fileAllocationTableRaw) {
+uint32_t findFATRun(fat_t* fileAllocationTable, uint32_t entryNumber) {
+
+	fat_run_t* runs = fileAllocationTable->runs;
 
 	//
-	// DECODES THE 32-BIT FAT ENTRIES.
-	uint32_t byteNumber  = 0;
-	uint32_t entryNumber = 0;
-	uint32_t numFATEntries = getNumFATEntries(bootSector);
-	while (entryNumber < numFATEntries) {
-		fileAllocationTable[entryNumber] = (uint32_t)
-					(((uint32_t) fileAllocationTableRaw[byteNumber+3] & 0b00001111) << 24) |
-					(((uint32_t) fileAllocationTableRaw[byteNumber+2] & 0b11111111) << 16) |
-					(((uint32_t) fileAllocationTableRaw[byteNumber+1] & 0b11111111) <<  8) |
-					(((uint32_t) fileAllocationTableRaw[byteNumber+0] & 0b11111111) <<  0);
-		
-		entryNumber = entryNumber + 1;
-		byteNumber  = byteNumber  + 4;
+	// TRY THE RUN THE LAST ENTRY WAS IN, AND THE ONE AFTER IT, FIRST.  A CHAIN
+	// IS ALMOST ALWAYS WALKED FROM ONE OF THEM TO THE OTHER.  (THE RUN IS
+	// REMEMBERED WITH ATOMIC LOADS AND STORES, SO ANY NUMBER OF THREADS CAN
+	// LOOK UP ENTRIES AT ONCE.)
+	uint32_t runNumber = __atomic_load_n(&(fileAllocationTable->lastRun), __ATOMIC_RELAXED);
+	if (runs[runNumber].firstEntry <= entryNumber) {
+		if (entryNumber < runs[runNumber + 1].firstEntry)
+			return runNumber;
+		if (runNumber + 1 < fileAllocationTable->numRuns &&
+		    entryNumber < runs[runNumber + 2].firstEntry) {
+			__atomic_store_n(&(fileAllocationTable->lastRun), runNumber + 1, __ATOMIC_RELAXED);
+			return runNumber + 1;
+		}
 	}
 
+	//
+	// OTHERWISE, SEARCH FOR THE LAST RUN THAT STARTS AT OR BEFORE THE ENTRY.
+	uint32_t low  = 0;
+	uint32_t high = fileAllocationTable->numRuns - 1;
+	while (low < high) {
+		uint32_t middle = low + ((high - low + 1) / 2);
+		if (runs[middle].firstEntry <= entryNumber)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	__atomic_store_n(&(fileAllocationTable->lastRun), low, __ATOMIC_RELAXED);
+	return low;
+
 }
 
+
+void* indexClusterChainRange(void* range) {
+
+	chain_index_range_t* chainRange = (chain_index_range_t*) range;
+	fat_t* fileAllocationTable = chainRange->fileAllocationTable;
+
+	//
+	// LOOK AT EACH CLUSTER'S ENTRY IN TURN.  A CLUSTER THAT LINKS TO THE ONE
+	// AFTER IT EITHER LENGTHENS THE CURRENT RUN (IF IT IS THE RUN'S LAST
+	// CLUSTER) OR STARTS A NEW ONE.
+	uint32_t clusterNumber = chainRange->firstCluster;
+	while (clusterNumber < chainRange->endCluster) {
+		if (getFATEntry(fileAllocationTable, clusterNumber) == clusterNumber + 1) {
+			if (chainRange->numSegments > 0 &&
+			    chainRange->segments[chainRange->numSegments - 1].lastCluster == clusterNumber)
+				chainRange->segments[chainRange->numSegments - 1].lastCluster = clusterNumber + 1;
+			else {
+				if (chainRange->numSegments == chainRange->maxSegments) {
+					chainRange->maxSegments = (chainRange->maxSegments == 0) ? 1024 : chainRange->maxSegments * 2;
+					chainRange->segments = (fat_segment_t*)
+							realloc(chainRange->segments, chainRange->maxSegments * sizeof(fat_segment_t));
+					if (chainRange->segments == NULL)
+						handleError(L"indexClusterChainRange", L"Unable to allocate memory for the cluster chain index");
+				}
+				chainRange->segments[chainRange->numSegments].firstCluster = clusterNumber;
+				chainRange->segments[chainRange->numSegments].lastCluster  = clusterNumber + 1;
+				chainRange->numSegments++;
+			}
+		}
+		clusterNumber++;
+	}
+
+	return NULL;
+
+}
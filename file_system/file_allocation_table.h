@@ -21,9 +21,10 @@
 
 // LAYER 2: FILE_SYSTEM
 #include "boot_sector.h"
+#include "volume.h"
 
 // LAYER 3: STORAGE_DEVICE
-// (NOTHING)
+#include "device_interface.h"
 
 // ERROR HANDLING
 #include "error.h"
@@ -35,21 +36,253 @@
 
 
 
+//
+// CONSTANTS
+//
+
+// THE NUMBER OF SECTORS OF THE FILE ALLOCATION TABLE REQUESTED IN EACH READ.
+// THE TABLE IS READ IN AS A BATCH OF THESE CHUNKS.
+#define FAT_SECTORS_PER_READ 2048
+
+// THE SIZE OF EACH WINDOW OF A PAGED FILE ALLOCATION TABLE (IN BYTES).  IT IS
+// A MULTIPLE OF EVERY SECTOR SIZE, SO A WINDOW IS ALWAYS A WHOLE NUMBER OF
+// SECTORS.
+#define FAT_WINDOW_SIZE (64 * 1024)
+
+// SET IN THE "firstValue" OF A RUN OF A COMPRESSED FILE ALLOCATION TABLE WHOSE
+// ENTRIES COUNT UP BY ONE (I.E. EACH CLUSTER IS FOLLOWED BY THE NEXT ONE).
+// NO ENTRY USES THIS BIT, SINCE THE TOP 4 BITS OF EVEN A FAT32 ENTRY ARE
+// MASKED OFF.
+#define FAT_RUN_SEQUENTIAL 0x80000000
+
+// THE MOST THREADS THAT SWEEP THE FILE ALLOCATION TABLE FOR CONTIGUOUS RUNS OF
+// CLUSTERS AT ONCE, AND THE FEWEST ENTRIES WORTH GIVING A THREAD OF ITS OWN.
+#define CHAIN_INDEX_THREADS            4
+#define CHAIN_INDEX_ENTRIES_PER_THREAD (1024 * 1024)
+
+
+
+
+/*
+ * The windows of a paged file allocation table that are in memory (see
+ * getPagedFileAllocationTable).
+ */
+typedef struct fat_window_cache_t fat_window_cache_t;
+
+
+
+
+/*
+ * A run of entries of a compressed file allocation table (see
+ * getCompressedFileAllocationTable).  The run starts at entry "firstEntry" and
+ * ends where the next run starts.  Its entries are either all the same (e.g.
+ * a span of free clusters), or, if "firstValue" has FAT_RUN_SEQUENTIAL set,
+ * count up by one from the first (e.g. the clusters of a contiguous file).
+ */
+typedef struct {
+
+	uint32_t firstEntry;           // The first entry in the run.
+	uint32_t firstValue;           // The value of the first entry (| FAT_RUN_SEQUENTIAL).
+
+} fat_run_t;
+
+
+
+
+/*
+ * A run of clusters that are linked one to the next in the file allocation
+ * table (i.e. the entry of each cluster but the last is the cluster after
+ * it).  A chain that reaches any cluster of the run goes through the rest of
+ * it, in order, up to its last cluster.
+ */
+typedef struct {
+
+	uint32_t firstCluster;         // The first cluster in the run.
+	uint32_t lastCluster;          // The last cluster in the run.
+
+} fat_segment_t;
+
+
+
+
+/*
+ * A data structure used to store a file allocation table, whose entries are
+ * looked up with getFATEntry.
+ *
+ * The entries of a FAT32 table are already little-endian 32-bit words, so they
+ * are read straight out of the raw table (masking off the reserved top 4
+ * bits), which is not copied at all if the device is memory-mapped.  The
+ * entries of FAT12 and FAT16 tables are translated into an array of integers.
+ * A paged table has neither: its entries are read out of whichever window of
+ * the table they are in, and the window is read in the first time it is
+ * needed.  Nor does a compressed table, whose entries are kept as runs.
+ */
+typedef struct {
+
+	uint32_t       numEntries;     // The number of entries in the table.
+	uint32_t*      entries;        // The translated entries (NULL if they are read from the raw table).
+	const uint8_t* raw;            // The raw FAT32 table (NULL if the entries are translated).
+	uint8_t*       rawBuffer;      // The memory the raw table was read into (NULL if it is a view of the device).
+	fat_window_cache_t* windowCache; // The windows of a paged table (NULL unless the table is paged).
+	fat_run_t*     runs;           // The runs of a compressed table, and one more that starts at "numEntries" (NULL unless the table is compressed).
+	uint32_t       numRuns;        // The number of runs (not counting the one at the end).
+	uint32_t       lastRun;        // The run the last entry looked up was in.
+	fat_segment_t* segments;       // The runs of linked clusters, in order (NULL if the table is not indexed).
+	uint32_t       numSegments;    // The number of runs of linked clusters.
+	uint32_t       lastSegment;    // The run of linked clusters that was looked up last.
+
+} fat_t;
+
+
+
+
+/*
+ * Reads in the file allocation table, and returns it.
+ */
+fat_t* getFileAllocationTable(volume_t* volume,
+                              storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns a file allocation table that is read in on demand, one window of
+ * FAT_WINDOW_SIZE bytes at a time, the first time an entry in the window is
+ * looked up.  At most "maxBytes" bytes of windows (but at least one window)
+ * are kept in memory; the least recently used window is evicted to make room
+ * for another.  Looking up the entries of a few chains on a huge volume then
+ * only reads the parts of the table that hold them.
+ *
+ * A FAT12 table (a few kilobytes at most), or one on a memory-mapped device,
+ * is not paged, and is returned as if by getFileAllocationTable.
+ */
+fat_t* getPagedFileAllocationTable(volume_t*         volume,
+                                   storage_device_t* storageDevice,
+                                   uint64_t          maxBytes);
+
+
+
+
+/*
+ * Reads in the file allocation table, and compresses it into runs of entries
+ * that are all the same or that count up by one (see fat_run_t).  Most
+ * entries on a real volume either are free or point to the next cluster, so
+ * a volume whose files are mostly contiguous needs a small fraction of the
+ * memory of the whole table.  The table is read in a window at a time while
+ * it is being compressed, so the whole table is never in memory either.
+ *
+ * Looking up an entry takes a binary search through the runs, except that
+ * the run of the entry looked up last, and the run after it, are tried first,
+ * so walking a chain costs O(1) per cluster.
+ */
+fat_t* getCompressedFileAllocationTable(volume_t* volume,
+                                        storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns the given entry of a compressed file allocation table.  Use
+ * getFATEntry instead, which works on every kind of table.
+ */
+uint32_t getCompressedFATEntry(fat_t* fileAllocationTable, uint32_t entryNumber);
+
+
+
+
+/*
+ * Returns the given entry of a paged file allocation table.  Use getFATEntry
+ * instead, which works on every kind of table.
+ */
+uint32_t getPagedFATEntry(fat_t* fileAllocationTable, uint32_t entryNumber);
+
+
+
+
+/*
+ * Returns the given entry of the file allocation table (i.e. the number of the
+ * cluster that follows the given cluster).  The entry number must be less
+ * than the number of entries.
+ *
+ * This is called for every cluster of every chain, so it is defined here,
+ * where it can be inlined.
+ */
+static inline uint32_t getFATEntry(fat_t* fileAllocationTable, uint32_t entryNumber) {
+
+	if (fileAllocationTable->entries != NULL)
+		return fileAllocationTable->entries[entryNumber];
+
+	if (fileAllocationTable->runs != NULL)
+		return getCompressedFATEntry(fileAllocationTable, entryNumber);
+
+	if (fileAllocationTable->windowCache != NULL)
+		return getPagedFATEntry(fileAllocationTable, entryNumber);
+
+	const uint8_t* entryRaw = fileAllocationTable->raw + ((uint64_t) entryNumber * 4);
+	return ((((uint32_t) entryRaw[3]) << 24) |
+	        (((uint32_t) entryRaw[2]) << 16) |
+	        (((uint32_t) entryRaw[1]) <<  8) |
+	        (((uint32_t) entryRaw[0]) <<  0)) & FAT32_ENTRY_MASK;
+
+}
+
+
+
+
+/*
+ * Sweeps through the file allocation table once, from start to end, and
+ * records every run of clusters that are linked one to the next (see
+ * fat_segment_t).  A large table is split into ranges of entries that are
+ * swept by up to CHAIN_INDEX_THREADS threads at once.
+ *
+ * Following a chain through the index (see getLinkedRunEnd) then takes one
+ * lookup per fragment of the file, rather than one dependent lookup in the
+ * table per cluster.  The sweep touches every entry, so it pays off on a
+ * volume with many (or large) files, but not on a mostly empty one.  (Nor on
+ * a paged table, all of which it would read in.)
+ */
+void indexClusterChains(fat_t* fileAllocationTable, volume_t* volume);
+
+
+
+
+/*
+ * Returns the last cluster of the run of linked clusters (see fat_segment_t)
+ * that a chain reaching the given cluster goes through, or the cluster itself
+ * if it is not in such a run (or the table is not indexed).
+ */
+uint32_t getLinkedRunEnd(fat_t* fileAllocationTable, uint32_t clusterNumber);
+
+
+
+
+/*
+ * Gets the number of windows of a paged file allocation table that have been
+ * read in (counting a window again each time it is read back in after being
+ * evicted).  This is 0 for a table that is not paged.
+ */
+uint64_t getFATWindowStatistics(fat_t* fileAllocationTable);
+
+
+
+
 /*
- * Extracts the entries from the file allocation table and stores them in an
- * array of integers, the returns the array.
+ * Gets the number of runs a compressed file allocation table is kept as, and
+ * the number of bytes they take up.  Both are 0 for a table that is not
+ * compressed.
  */
-uint32_t* getFileAllocationTable(boot_sect_t* bootSector,
-                                 FILE* storageDevice);
+void getFATRunStatistics(fat_t*    fileAllocationTable,
+                         uint64_t* numRuns,
+                         uint64_t* numBytes);
 
 
 
 
 /*
- * Returns the number of file allocation table entries, which is equal to the
- * total number of clusters on the storage device.
+ * Frees the file allocation table.  (A table read straight out of a
+ * memory-mapped device must be freed before the device is closed.)
  */
-uint32_t getNumFATEntries(boot_sect_t* bootSector);
+void freeFileAllocationTable(fat_t* fileAllocationTable);
 
 
 
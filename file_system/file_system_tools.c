@@ -39,27 +39,17 @@
 
 
 /*
- * Used to determine the number of clusters in a sequence.
+ * Used to determine if a given cluster number is valid.
  */
-uint32_t getClusterSequenceLength(uint32_t firstCluster,
-                                  boot_sect_t* bootSector,
-								  uint32_t* fileAllocationTable);
+uint8_t isValidClusterNumber(uint32_t clusterNumber,
+							 volume_t* volume);
 
 
 /*
- * Used to determine if an entry in the file allocation table indicates whether
- * or not the given cluster is the last cluster in the sequence.
+ * Used to count the clusters of a chain that is known to loop back into
+ * itself, up to (but not including) the first cluster it repeats.
  */
-uint8_t hasNext(uint32_t clusterNumber,
-				boot_sect_t* bootSector,
-				uint32_t* fileAllocationTable);
-
-
-/*
- * Used to determine if a given cluster number is valid.
- */
-uint8_t isValidClusterNumber(uint32_t clusterNumber,
-							 boot_sect_t* bootSector);
+uint32_t getLoopingChainLength(uint32_t firstCluster, fat_t* fileAllocationTable);
 
 
 /*
@@ -173,160 +163,249 @@ uint32_t getFatVersion(boot_sect_t* bootSector) {
 }
 
 
-uint32_t* getClusterSequence(uint32_t  firstCluster,
-                             boot_sect_t* bootSector,
-                             uint32_t* fileAllocationTable,
-                             uint32_t* numClusters) {
+cluster_extent_t* getClusterChain(uint32_t  firstCluster,
+                                  volume_t* volume,
+                                  fat_t*    fileAllocationTable,
+                                  uint32_t* numExtents,
+                                  uint32_t* numClusters) {
 
+	//
+	// CHECKING IF THE FILE IS EMPTY OR OTHERWISE INVALID.
+	*numExtents  = 0;
+	*numClusters = 0;
+	if (!isValidClusterNumber(firstCluster, volume))
+		return NULL;
 
 	//
-	// DETERMINE THE NUMBER OF CLUSTERS IN THE SEQUENCE.
-	*numClusters = getClusterSequenceLength(firstCluster,
-                                            bootSector,
-	                                        fileAllocationTable);
+	// CREATE AN ARRAY TO STORE THE EXTENTS.  MOST FILES ARE A SINGLE EXTENT,
+	// SO IT STARTS WITH ROOM FOR ONE, AND IS DOUBLED WHENEVER IT FILLS UP.
+	uint32_t maxExtents = 1;
+	cluster_extent_t* extents = (cluster_extent_t*) malloc(maxExtents * sizeof(cluster_extent_t));
+	if (extents == NULL)
+		handleError(L"getClusterChain",
+		            L"Unable to allocate memory for a cluster sequence");
 
 	//
-	// CREATE AN EMPTY ARRAY TO STORE THE SEQUENCE OF CLUSTER NUMBERS.
-	uint32_t* clusterSequence =
-					(uint32_t*) malloc(sizeof(uint32_t) * (*numClusters));
-	if (clusterSequence == NULL)
-		handleError(L"getClusterSequence",
-		            L"Unable to allocate memory for a cluster number sequence");
+	// THE FIRST CLUSTER STARTS THE FIRST EXTENT.
+	extents[0].firstCluster = firstCluster;
+	extents[0].numClusters  = 1;
+	*numExtents  = 1;
+	*numClusters = 1;
 
 	//
-	// GETTING THE SEQUENCE.
-	uint32_t clusterCount  = 0;
-	uint32_t clusterNumber = firstCluster;
-	while (clusterCount < (*numClusters)) {
+	// MOVE FROM ONE CLUSTER TO THE NEXT (USING THE FILE ALLOCATION TABLE)
+	// UNTIL THE NEXT CLUSTER NUMBER IS NOT VALID (E.G. END OF CHAIN).  IF THE
+	// TABLE IS INDEXED, THEN EACH RUN OF LINKED CLUSTERS IS SKIPPED TO ITS
+	// END IN ONE STEP, INSTEAD OF BEING FOLLOWED ONE CLUSTER AT A TIME.
+	uint32_t clusterNumber = getLinkedRunEnd(fileAllocationTable, firstCluster);
+	extents[0].numClusters += clusterNumber - firstCluster;
+	*numClusters           += clusterNumber - firstCluster;
+	uint32_t nextCluster = getFATEntry(fileAllocationTable, clusterNumber);
+
+	//
+	// A CORRUPTED TABLE CAN LINK A CHAIN BACK INTO ITSELF, SO THE CLUSTERS THE
+	// CHAIN JUMPS TO ARE WATCHED FOR A REPEAT (BRENT'S METHOD: A REMEMBERED
+	// CLUSTER IS COMPARED WITH EACH NEW ONE, AND IS REPLACED AFTER 1, 2, 4, ...
+	// STEPS).  THIS ONLY TELLS THAT THE CHAIN LOOPS, NOT WHERE; IT IS CUT OFF
+	// BELOW, ONCE THE WALK HAS STOPPED.
+	uint32_t rememberedCluster = firstCluster;
+	uint32_t stepsSinceRemembered = 0;
+	uint32_t stepsUntilReplaced = 1;
+	while (isValidClusterNumber(nextCluster, volume) && nextCluster != rememberedCluster) {
+		stepsSinceRemembered++;
+		if (stepsSinceRemembered == stepsUntilReplaced) {
+			rememberedCluster = nextCluster;
+			stepsSinceRemembered = 0;
+			stepsUntilReplaced *= 2;
+		}
 
 		//
-		// SAVE CURRENT CLUSTER NUMBER TO SEQUENCE ARRAY.
-		clusterSequence[clusterCount] = clusterNumber;
+		// IF THE CLUSTER DIRECTLY FOLLOWS THE CURRENT EXTENT, THEN IT JUST
+		// LENGTHENS IT.
+		cluster_extent_t* extent = &(extents[*numExtents - 1]);
+		if (nextCluster == extent->firstCluster + extent->numClusters)
+			extent->numClusters++;
 
 		//
-		// GET NEXT CLUSTER NUMBER.
-		if (clusterCount < (*numClusters) - 1)
-			clusterNumber = fileAllocationTable[clusterNumber];
+		// OTHERWISE, IT STARTS A NEW EXTENT.
+		else {
+			if (*numExtents == maxExtents) {
+				maxExtents *= 2;
+				extents = (cluster_extent_t*) realloc(extents, maxExtents * sizeof(cluster_extent_t));
+				if (extents == NULL)
+					handleError(L"getClusterChain",
+					            L"Unable to allocate memory for a cluster sequence");
+			}
+			extents[*numExtents].firstCluster = nextCluster;
+			extents[*numExtents].numClusters  = 1;
+			(*numExtents)++;
+		}
 
 		//
-		// INCREMENT THE CLUSTER COUNT.
-		clusterCount++;
-		
+		// SKIP TO THE END OF THE CLUSTER'S RUN, AND GET THE NEXT CLUSTER NUMBER.
+		(*numClusters)++;
+		clusterNumber = getLinkedRunEnd(fileAllocationTable, nextCluster);
+		extents[*numExtents - 1].numClusters += clusterNumber - nextCluster;
+		*numClusters                         += clusterNumber - nextCluster;
+		nextCluster = getFATEntry(fileAllocationTable, clusterNumber);
+
+	}
+
+	//
+	// IF THE CHAIN LOOPS, THEN EVERY CLUSTER UP TO THE FIRST ONE IT REPEATS HAS
+	// BEEN WALKED (IN ORDER), AND PROBABLY SOME MORE AFTER IT.  CUT THE
+	// EXTENTS OFF JUST BEFORE THE FIRST REPEAT, SO THAT EACH CLUSTER IS IN
+	// THEM ONCE, HOWEVER FAR THE WALK WENT (WHICH DEPENDS ON HOW THE TABLE IS
+	// INDEXED).
+	if (isValidClusterNumber(nextCluster, volume)) {
+		*numClusters = getLoopingChainLength(firstCluster, fileAllocationTable);
+		uint32_t clustersLeft = *numClusters;
+		uint32_t extentIndex = 0;
+		while (extents[extentIndex].numClusters < clustersLeft) {
+			clustersLeft -= extents[extentIndex].numClusters;
+			extentIndex++;
+		}
+		extents[extentIndex].numClusters = clustersLeft;
+		*numExtents = extentIndex + 1;
 	}
 
 	//
-	// RETURN THE LIST OF CLUSTER NUMBERS.
-	return clusterSequence;
+	// GIVE BACK THE UNUSED PART OF THE ARRAY, AND RETURN THE EXTENTS.
+	if (*numExtents < maxExtents) {
+		cluster_extent_t* shrunkExtents = (cluster_extent_t*) realloc(extents, *numExtents * sizeof(cluster_extent_t));
+		if (shrunkExtents != NULL)
+			extents = shrunkExtents;
+	}
+	return extents;
 
 }
 
 
 
-uint32_t getSectorNumber_FileAllocationTable(boot_sect_t* bootSector) {
+uint64_t getSectorNumber_DataCluster(volume_t* volume,
+									 uint32_t clusterNumber) {
+
+	//
+	// CHECK FOR INVALID CLUSTER NUMBERS.
+	if (!isValidClusterNumber(clusterNumber, volume))
+		handleError(L"getSectorNumber_DataCluster",
+		            L"Request made for the sector number of an invalid cluster number");
 
 	//
-	// DETERMINE THE FIRST SECTOR OF THE FILE ALLOCATION TABLE.
-	// THIS IS THE SAME FOR BOTH FAT12 AND FAT32 FILE SYSTEMS.
-	return bootSector->numReservedSectors;
+	// CLUSTER 2 IS THE FIRST ONE IN THE DATA AREA.
+	return volume->firstSector_Data
+	     + ((uint64_t) (clusterNumber - 2) << volume->sectorsPerClusterShift);
 
 }
 
 
-uint32_t getSectorNumber_RootDirectory(boot_sect_t* bootSector) {
+uint8_t* readClusters(uint8_t*          buffer,
+                      cluster_extent_t* clusterExtents,
+                      uint32_t          numExtents,
+					  volume_t*         volume,
+					  storage_device_t* storageDevice) {
+
+	if (numExtents == 0)
+		return buffer;
 
 	//
-	// DETERMINE THE FIRST SECTOR OF THE ROOT DIRECTORY.
-	// THIS DIFFERS BETWEEN FAT12 AND FAT32 FILE SYSTEMS.
-	switch (getFatVersion(bootSector)) {
+	// TURN EACH RUN OF CLUSTERS INTO A RUN OF SECTORS.
+	sector_extent_t* extents = (sector_extent_t*) malloc(numExtents * sizeof(sector_extent_t));
+	if (extents == NULL)
+		handleError(L"readClusters", L"Unable to allocate memory for the extents");
+	getSectorExtents(extents, buffer, clusterExtents, numExtents, volume);
 
-		case FAT12:
-			return getSectorNumber_FileAllocationTable(bootSector)
-				 + (bootSector->sectorsPerFAT_FAT12 * bootSector->numFATs);
-			break;
+	//
+	// READ IN THE CLUSTERS.
+	readSectorExtents(extents, numExtents, volume->bytesPerSector, storageDevice);
+	free(extents);
 
-		case FAT32:
-			return getSectorNumber_FileAllocationTable(bootSector)
-				 + (bootSector->sectorsPerFAT_FAT32 * bootSector->numFATs)
-				 + (bootSector->sectorsPerCluster * (bootSector->rootClusterNumber_FAT32 - 2));
-			break;
+	//
+	// RETURN THE BUFFER.
+	return buffer;
+
+}
 
-		default:
-			return 0;
 
+void getSectorExtents(sector_extent_t*  extents,
+                      uint8_t*          buffer,
+                      cluster_extent_t* clusterExtents,
+                      uint32_t          numExtents,
+                      volume_t*         volume) {
+
+	uint64_t bufferOffset = 0;
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		extents[extentIndex].firstSector =
+			getSectorNumber_DataCluster(volume, clusterExtents[extentIndex].firstCluster);
+		extents[extentIndex].numSectors = clusterExtents[extentIndex].numClusters
+		                                  << volume->sectorsPerClusterShift;
+		extents[extentIndex].buffer = (buffer == NULL) ? NULL : buffer + bufferOffset;
+		bufferOffset += (uint64_t) clusterExtents[extentIndex].numClusters * volume->bytesPerCluster;
+		extentIndex++;
 	}
 
 }
 
 
-uint32_t getSectorNumber_DataCluster(boot_sect_t* bootSector,
-									 uint32_t clusterNumber) {
+void prefetchClusters(cluster_extent_t* clusterExtents,
+                      uint32_t          numExtents,
+                      volume_t*         volume,
+                      storage_device_t* storageDevice) {
 
-	//
-	// CHECK FOR INVALID CLUSTER NUMBERS.
-	if (!isValidClusterNumber(clusterNumber, bootSector))
-		handleError(L"getSectorNumber_DataCluster",
-		            L"Request made for the sector number of an invalid cluster number");
+	if (numExtents == 0)
+		return;
 
 	//
-	// DETERMINE THE FIRST SECTOR IN DATA AREA.
-	// THIS DIFFERS BETWEEN FAT12 AND FAT32 FILE SYSTEMS.
-	uint32_t firstSectorInDataArea = 0;
-	switch (getFatVersion(bootSector)) {
+	// TURN THE CLUSTERS INTO SECTOR EXTENTS, AND PASS THEM ON TO THE DEVICE,
+	// WHICH LIMITS THEM TO ITS PREFETCH WINDOW.
+	sector_extent_t* extents = (sector_extent_t*) malloc(numExtents * sizeof(sector_extent_t));
+	if (extents == NULL)
+		handleError(L"prefetchClusters", L"Unable to allocate memory for the prefetch extents");
+	getSectorExtents(extents, NULL, clusterExtents, numExtents, volume);
+	prefetchSectorExtents(extents, numExtents, volume->bytesPerSector, storageDevice);
+	free(extents);
 
-		case FAT12:
-			firstSectorInDataArea = getSectorNumber_FileAllocationTable(bootSector)
-							+ (bootSector->sectorsPerFAT_FAT12 * bootSector->numFATs)
-							+ ((bootSector->numRootEntries_FAT12 * 32) / bootSector->bytesPerSector);
-			break;
+}
 
-		case FAT32:
-			firstSectorInDataArea = getSectorNumber_FileAllocationTable(bootSector)
-							+ (bootSector->sectorsPerFAT_FAT32 * bootSector->numFATs);
-			break;
 
-		default:
-			return 0;
+uint8_t areClustersDamaged(cluster_extent_t* clusterExtents,
+                           uint32_t          numExtents,
+                           volume_t*         volume,
+                           storage_device_t* storageDevice) {
 
+	//
+	// ASK THE DEVICE ABOUT EACH RUN OF CONTIGUOUS CLUSTERS IN TURN.
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		if (areSectorsDamaged(getSectorNumber_DataCluster(volume, clusterExtents[extentIndex].firstCluster),
+		                      clusterExtents[extentIndex].numClusters << volume->sectorsPerClusterShift,
+		                      volume->bytesPerSector,
+		                      storageDevice))
+			return 1;
+		extentIndex++;
 	}
-
-	uint32_t sectorNumber = firstSectorInDataArea
-						  + (clusterNumber - 2) * bootSector->sectorsPerCluster;
-
-	return sectorNumber;
+	return 0;
 
 }
 
 
-uint8_t* readClusters(uint8_t*     buffer,
-                      uint32_t*    clusterNumbers,
-                      uint32_t     numClusters,
-					  boot_sect_t* bootSector,
-					  FILE*        storageDevice) {
+const uint8_t* viewClusters(cluster_extent_t* clusterExtents,
+                            uint32_t          numExtents,
+                            volume_t*         volume,
+                            storage_device_t* storageDevice) {
 
 	//
-	// GET THE LOCATION OF THE FIRST SECTOR FOR EACH CLUSTER IN THE SEQUENCE.
-	uint32_t* sectorLocations = (uint32_t*) malloc(numClusters * sizeof(uint32_t));
-	uint32_t  clusterCount = 0;
-	while (clusterCount < numClusters) {
-		sectorLocations[clusterCount] =
-			getSectorNumber_DataCluster(bootSector, clusterNumbers[clusterCount]);
-		clusterCount++;
-	}
+	// A VIEW IS ONLY POSSIBLE IF THE CLUSTERS ARE CONTIGUOUS ON THE DEVICE.
+	if (numExtents != 1)
+		return NULL;
 
 	//
-	// READ IN THE CLUSTERS.
-	readSectors((uint8_t*) buffer,
-	            sectorLocations,
-	            numClusters,
-	            bootSector->bytesPerSector,
-	            bootSector->sectorsPerCluster,
-	            storageDevice);
-
-	free(sectorLocations);
-
-	//
-	// RETURN THE BUFFER.
-	return buffer;
+	// ASK THE STORAGE DEVICE FOR A VIEW OF THE WHOLE RUN OF SECTORS.
+	return viewSectors(getSectorNumber_DataCluster(volume, clusterExtents[0].firstCluster),
+	                   clusterExtents[0].numClusters << volume->sectorsPerClusterShift,
+	                   volume->bytesPerSector,
+	                   storageDevice);
 
 }
 
@@ -365,105 +444,58 @@ wchar_t* getAbsolutePathName(file_t* file) {
 //
 
 
-uint32_t getClusterSequenceLength(uint32_t     firstCluster,
-                                  boot_sect_t* bootSector,
-								  uint32_t*    fileAllocationTable) {
-
-	//
-	// CHECKING IF THE FILE IS EMPTY OR OTHERWISE INVALID.
-	if (!isValidClusterNumber(firstCluster, bootSector))
-		return 0;
+uint8_t isValidClusterNumber(uint32_t clusterNumber, volume_t* volume) {
 
 	//
-	// THERE IS AT LEAST ONE VALID CLUSTER IN THE SEQUENCE (THE FIRST CLUSTER).
-	uint32_t numClusters = 1;
+	// CLUSTERS 0 AND 1 DO NOT EXIST, AND NEITHER DOES ANY CLUSTER PAST THE
+	// END OF THE DATA AREA.  THIS ALSO RULES OUT THE BAD CLUSTER AND END OF
+	// CHAIN MARKERS, WHICH ARE ALWAYS PAST THE END.
+	return clusterNumber >= 2 && clusterNumber <= volume->maxClusterNumber;
 
-	//
-	// MOVE FROM ONE CLUSTER TO THE NEXT (USING THE FILE ALLOCATION TABLE)
-	// AND COUNT THE TOTAL NUMBER OF CLUSTERS IN THE SEQUENCE.
-	uint32_t currentCluster = firstCluster;
-	while (hasNext(currentCluster, bootSector, fileAllocationTable)) {	
-		numClusters++;
-		currentCluster = fileAllocationTable[currentCluster];
-	}
-	
-	//
-	// RETURN THE NUMBER OF CLUSTERS IN THE SEQUENCE.
-	return numClusters;
-	
 }
 
 
-uint8_t hasNext(uint32_t clusterNumber,
-				boot_sect_t* bootSector,
-				uint32_t* fileAllocationTable) {
-
-	//
-	// CHECK IF THE CLUSTER NUMBER IS INVALID.  IF SO, THEN THERE IS NOT A
-	// NEXT CLUSTER.
-	if (!isValidClusterNumber(clusterNumber, bootSector))
-		return 0;
+uint32_t getLoopingChainLength(uint32_t firstCluster, fat_t* fileAllocationTable) {
+
+	//
+	// FIND THE LENGTH OF THE LOOP (BRENT'S METHOD AGAIN, BUT ONE CLUSTER AT A
+	// TIME): ONCE THE FAST CLUSTER COMES BACK TO THE REMEMBERED ONE, THE STEPS
+	// SINCE IT WAS REMEMBERED ARE THE LOOP'S LENGTH.
+	uint32_t rememberedCluster = firstCluster;
+	uint32_t fastCluster = getFATEntry(fileAllocationTable, firstCluster);
+	uint32_t loopLength = 1;
+	uint32_t stepsUntilReplaced = 1;
+	while (fastCluster != rememberedCluster) {
+		if (loopLength == stepsUntilReplaced) {
+			rememberedCluster = fastCluster;
+			stepsUntilReplaced *= 2;
+			loopLength = 0;
+		}
+		fastCluster = getFATEntry(fileAllocationTable, fastCluster);
+		loopLength++;
+	}
 
 	//
-	// OTHERWISE, GET THE NEXT CLUSTER NUMBER, AND RETURN TRUE IF IT IS VALID.
-	uint32_t nextCluster = fileAllocationTable[clusterNumber];
-	return isValidClusterNumber(nextCluster, bootSector);
-
-}
-
-
-uint8_t isValidClusterNumber(uint32_t clusterNumber, boot_sect_t* bootSector) {
+	// THEN FIND WHERE THE LOOP STARTS: TWO CLUSTERS A LOOP'S LENGTH APART
+	// FIRST MEET AT ITS START.
+	uint32_t slowCluster = firstCluster;
+	fastCluster = firstCluster;
+	uint32_t step = 0;
+	while (step < loopLength) {
+		fastCluster = getFATEntry(fileAllocationTable, fastCluster);
+		step++;
+	}
+	uint32_t loopStart = 0;
+	while (slowCluster != fastCluster) {
+		slowCluster = getFATEntry(fileAllocationTable, slowCluster);
+		fastCluster = getFATEntry(fileAllocationTable, fastCluster);
+		loopStart++;
+	}
 
 	//
-	// DETERMINE WHETHER OR NOT THE GIVEN CLUSTER NUMBER IS VALID.
-	// THIS DIFFERS BETWEEN FAT12 AND FAT32 FILE SYSTEMS.
-	switch (getFatVersion(bootSector)) {
-
-		case FAT12:
-			if (clusterNumber != 0x000 &&
-				clusterNumber != 0x001 &&
-				clusterNumber != 0xff8 &&
-				clusterNumber != 0xff9 &&
-				clusterNumber != 0xffa &&
-				clusterNumber != 0xffb &&
-				clusterNumber != 0xffc &&
-				clusterNumber != 0xffd &&
-				clusterNumber != 0xffe &&
-				clusterNumber != 0xfff)
-				return 1;
-			else
-				return 0;
-			break;
-
-		case FAT32:
-			if (clusterNumber >= bootSector->rootClusterNumber_FAT32 &&
-				clusterNumber != 0x00000ff8 &&
-				clusterNumber != 0x00000ff9 &&
-				clusterNumber != 0x00000ffa &&
-				clusterNumber != 0x00000ffb &&
-				clusterNumber != 0x00000ffc &&
-				clusterNumber != 0x00000ffd &&
-				clusterNumber != 0x00000ffe &&
-				clusterNumber != 0x00000fff &&
-				clusterNumber != 0x0000fff8 &&
-				clusterNumber != 0x0000fff9 &&
-				clusterNumber != 0x0000fffa &&
-				clusterNumber != 0x0000fffb &&
-				clusterNumber != 0x0000fffc &&
-				clusterNumber != 0x0000fffd &&
-				clusterNumber != 0x0000fffe &&
-				clusterNumber != 0x0000ffff &&
-				clusterNumber != 0x0fffffff)
-				return 1;
-			else
-				return 0;
-			break;
+	// THE CLUSTERS BEFORE THE LOOP, AND THE LOOP ITSELF, ARE ALL DIFFERENT.
+	return loopStart + loopLength;
 
-		default:
-			return 0;
-
-	}
-	
 }
 
 
@@ -23,9 +23,10 @@
 #include "boot_sector.h"
 #include "file_allocation_table.h"
 #include "directory.h"
+#include "volume.h"
 
 // LAYER 3: STORAGE_DEVICE
-// (NOTHING)
+#include "device_interface.h"
 
 // ERROR HANDLING
 #include "error.h"
@@ -49,7 +50,8 @@
 
 
 /*
- * Returns the FAT version (FAT12, FAT16, or FAT32).
+ * Returns the FAT version (FAT12, FAT16, or FAT32).  This is worked out once,
+ * by getVolume; everything else should use the volume's fatVersion.
  */
 uint32_t getFatVersion(boot_sect_t* bootSector);
 
@@ -57,61 +59,104 @@ uint32_t getFatVersion(boot_sect_t* bootSector);
 
 
 /*
- * Returns the first sector number of the file allocation table.
+ * Returns the first sector number of the specified cluster number.
+ * If the cluster number is invalid, an error is raised.
  */
-uint32_t getSectorNumber_FileAllocationTable(boot_sect_t* bootSector);
+uint64_t getSectorNumber_DataCluster(volume_t* volume,
+									 uint32_t clusterNumber);
 
 
 
 
 /*
- * Returns the first sector number of the root directory.
+ * Reads the specified sequence of clusters (given as runs of contiguous
+ * clusters) from the storage device.  The contents of the clusters is
+ * returned as one long array of bytes.  Each run is read in with a single
+ * request.
  */
-uint32_t getSectorNumber_RootDirectory(boot_sect_t* bootSector);
+uint8_t* readClusters(uint8_t*          buffer,
+                      cluster_extent_t* clusterExtents,
+                      uint32_t          numExtents,
+					  volume_t*         volume,
+					  storage_device_t* storageDevice);
 
 
 
 
 /*
- * Returns the first sector number of the specified cluster number.
- * If the cluster number is invalid, this function will return 0.
+ * Turns the specified runs of clusters into sector extents to be read into
+ * the given buffer (see readSectorExtents), one sector extent per run.  The
+ * "extents" array must have room for "numExtents" extents.  The buffer may be
+ * NULL if the extents are only going to be prefetched.
  */
-uint32_t getSectorNumber_DataCluster(boot_sect_t* bootSector,
-									 uint32_t clusterNumber);
+void getSectorExtents(sector_extent_t*  extents,
+                      uint8_t*          buffer,
+                      cluster_extent_t* clusterExtents,
+                      uint32_t          numExtents,
+                      volume_t*         volume);
+
+
+
+
+/*
+ * Tells the storage device that the specified runs of clusters (e.g. a
+ * file_t's extents) will be read soon, so that they can be read ahead in the
+ * background.  Only as much as the device's prefetch window is requested,
+ * starting from the first cluster.
+ */
+void prefetchClusters(cluster_extent_t* clusterExtents,
+                      uint32_t          numExtents,
+                      volume_t*         volume,
+                      storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns 1 if any of the specified runs of clusters lies on sectors that the
+ * storage device could not read (see enableDegradedReads), and 0 otherwise.
+ */
+uint8_t areClustersDamaged(cluster_extent_t* clusterExtents,
+                           uint32_t          numExtents,
+                           volume_t*         volume,
+                           storage_device_t* storageDevice);
 
 
 
 
 /*
- * Reads the specified sequence of clusters from the storage device.
- * The contents of the clusters is returned as one long array of bytes.
+ * Returns a read-only, zero-copy view of the specified runs of clusters, if
+ * the storage device is memory-mapped and there is only one run.  Otherwise,
+ * NULL is returned and the clusters must be read in with readClusters.
  */
-uint8_t* readClusters(uint8_t*     buffer,
-                      uint32_t*    clusterNumbers,
-                      uint32_t     numClusters,
-					  boot_sect_t* bootSector,
-					  FILE*        storageDevice);
+const uint8_t* viewClusters(cluster_extent_t* clusterExtents,
+                            uint32_t          numExtents,
+                            volume_t*         volume,
+                            storage_device_t* storageDevice);
 
 
 
 
 /*
  * Determines the cluster sequence starting from the given cluster using the
- * file allocation table provided.
+ * file allocation table provided, as runs of contiguous clusters.  The chain
+ * is followed once, and each cluster that directly follows the one before it
+ * just lengthens the current run, so an unfragmented file of any size is a
+ * single extent.  A chain that loops back into itself (in a corrupted table)
+ * is cut off once the loop is found; see checkFileAllocationTable for a full
+ * check of the table.
  *
  * THIS RETURNS THE CLUSTER *NUMBERS*, NOT THE CLUSTER CONTENTS!!
  *
- * NOTE: The number of clusters in the result is saved in the numClusters
- *       parameter.  To call this function, first create a new uint32_t
- *       variable:
- *           uint32_t numClusters;
- *       then pass it to the function as a pointer:
- *           getClusterSequence(..., ..., &numClusters);
+ * NOTE: The number of extents, and the total number of clusters in them, are
+ *       saved in the numExtents and numClusters parameters.  The result is
+ *       NULL if there are no clusters.
  */
-uint32_t* getClusterSequence(uint32_t  firstCluster,
-                             boot_sect_t* bootSector,
-                             uint32_t* fileAllocationTable,
-							 uint32_t* numClusters);
+cluster_extent_t* getClusterChain(uint32_t  firstCluster,
+                                  volume_t* volume,
+                                  fat_t*    fileAllocationTable,
+                                  uint32_t* numExtents,
+                                  uint32_t* numClusters);
 
 
 
@@ -0,0 +1,162 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                                  VOLUME
+ * geometry of a FAT filesystem (where everything is, and how big it is).
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "boot_sector.h"
+#include "fat_width.h"
+#include "file_system_tools.h"
+#include "volume.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+
+
+
+/*
+ * Used to get log2 of a power of two.
+ */
+uint32_t getShift(uint32_t powerOfTwo);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+volume_t* getVolume(boot_sect_t* bootSector) {
+
+	//
+	// PARAMETER CHECK.
+	if (bootSector == NULL)
+		handleError(L"getVolume", L"NULL 'bootSector' parameter");
+
+	//
+	// THE SECTOR AND CLUSTER SIZES MUST BE POWERS OF TWO (AS THE SPECIFICATION
+	// REQUIRES), SO THAT CLUSTER NUMBERS CAN BE TURNED INTO SECTOR NUMBERS
+	// WITH SHIFTS INSTEAD OF MULTIPLICATIONS.
+	uint32_t bytesPerSector    = bootSector->bytesPerSector;
+	uint32_t sectorsPerCluster = bootSector->sectorsPerCluster;
+	if (bytesPerSector < 512 || bytesPerSector > 4096 || (bytesPerSector & (bytesPerSector - 1)) != 0 ||
+	    sectorsPerCluster == 0 || (sectorsPerCluster & (sectorsPerCluster - 1)) != 0)
+		handleError(L"getVolume", L"The boot sector gives an invalid sector or cluster size");
+
+	//
+	// ALLOCATE THE VOLUME.
+	volume_t* volume = (volume_t*) calloc(1, sizeof(volume_t));
+	if (volume == NULL)
+		handleError(L"getVolume", L"Unable to allocate memory for the volume");
+	volume->bootSector = bootSector;
+	volume->fatVersion = getFatVersion(bootSector);
+	volume->width      = getFatWidth(volume->fatVersion);
+
+	//
+	// THE SIZES.
+	volume->bytesPerSector         = bytesPerSector;
+	volume->sectorsPerCluster      = sectorsPerCluster;
+	volume->bytesPerCluster        = bytesPerSector * sectorsPerCluster;
+	volume->sectorsPerClusterShift = getShift(sectorsPerCluster);
+	volume->bytesPerClusterShift   = getShift(volume->bytesPerCluster);
+
+	//
+	// THE LAYOUT: THE RESERVED SECTORS, THEN EVERY COPY OF THE FAT, THEN (FOR
+	// FAT12 AND FAT16 ONLY) THE ROOT DIRECTORY, THEN THE DATA AREA.
+	volume->sectorsPerFAT   = (volume->fatVersion == FAT32) ?
+	                          bootSector->sectorsPerFAT_FAT32 :
+	                          bootSector->sectorsPerFAT_FAT12;
+	volume->firstSector_FAT = bootSector->numReservedSectors;
+	volume->numSectors_Root = (volume->fatVersion == FAT32) ? 0 :
+	                          (bootSector->numRootEntries_FAT12 * 32 + bytesPerSector - 1) / bytesPerSector;
+	volume->firstSector_Data = volume->firstSector_FAT
+	                         + (uint64_t) volume->sectorsPerFAT * bootSector->numFATs
+	                         + volume->numSectors_Root;
+
+	//
+	// THE ROOT DIRECTORY OF A FAT32 VOLUME IS AN ORDINARY CLUSTER CHAIN IN
+	// THE DATA AREA.
+	if (volume->fatVersion == FAT32) {
+		volume->rootCluster      = bootSector->rootClusterNumber_FAT32;
+		volume->firstSector_Root = volume->firstSector_Data
+		                         + ((uint64_t) (volume->rootCluster - 2) << volume->sectorsPerClusterShift);
+	}
+	else
+		volume->firstSector_Root = volume->firstSector_Data - volume->numSectors_Root;
+
+	//
+	// THE NUMBER OF CLUSTERS IN THE DATA AREA.
+	uint64_t numSectorsTotal = bootSector->numSectors_FAT12;
+	if (numSectorsTotal == 0)
+		numSectorsTotal = bootSector->numSectors_FAT32;
+	if (numSectorsTotal > volume->firstSector_Data)
+		volume->numClusters = (uint32_t) ((numSectorsTotal - volume->firstSector_Data)
+		                                  >> volume->sectorsPerClusterShift);
+
+	//
+	// THE FAT HAS AN ENTRY FOR EVERY CLUSTER, PLUS TWO RESERVED ENTRIES AT THE
+	// FRONT, BUT NEVER MORE THAN FIT IN IT.  NO CLUSTER PAST THE LAST ENTRY
+	// CAN BE VALID, SINCE IT COULD NOT BE LOOKED UP.
+	uint64_t maxFATEntries = ((uint64_t) volume->sectorsPerFAT * bytesPerSector * 8) / volume->fatVersion;
+	uint64_t numFATEntries = (uint64_t) volume->numClusters + 2;
+	if (numFATEntries > maxFATEntries)
+		numFATEntries = maxFATEntries;
+	volume->numFATEntries    = (uint32_t) numFATEntries;
+	volume->maxClusterNumber = (numFATEntries > 2) ? (uint32_t) (numFATEntries - 1) : 1;
+
+	//
+	// THE SPECIAL FAT ENTRIES.
+	volume->badClusterMarker = volume->width->badClusterMarker;
+	volume->endOfChainMarker = volume->width->endOfChainMarker;
+
+	//
+	// A CLUSTER NUMBER THAT WOULD CLASH WITH THE SPECIAL ENTRIES CAN NEVER BE
+	// USED, HOWEVER LARGE THE FAT IS.
+	if (volume->maxClusterNumber >= volume->badClusterMarker)
+		volume->maxClusterNumber = volume->badClusterMarker - 1;
+
+	//
+	// RETURN THE VOLUME.
+	return volume;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+uint32_t getShift(uint32_t powerOfTwo) {
+
+	uint32_t shift = 0;
+	while ((1u << shift) < powerOfTwo)
+		shift++;
+	return shift;
+
+}
@@ -0,0 +1,84 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                                  VOLUME
+ * geometry of a FAT filesystem (where everything is, and how big it is).
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef VOLUME_H_
+#define VOLUME_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+#include "boot_sector.h"
+#include "fat_width.h"
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+/*
+ * A data structure used to store the geometry of a FAT volume.
+ * Everything here is worked out from the boot sector once, by getVolume, so
+ * that none of it has to be worked out again for every cluster or directory
+ * entry.  The volume is passed to everything in the file system layer in
+ * place of the boot sector.
+ */
+typedef struct {
+
+	boot_sect_t* bootSector;       // The boot sector the volume was worked out from.
+	uint32_t  fatVersion;          // FAT12, FAT16 or FAT32.
+	const fat_width_t* width;      // The code generated for the volume's FAT width.
+
+	uint32_t  bytesPerSector;      // The number of bytes per sector.
+	uint32_t  sectorsPerCluster;   // The number of sectors per cluster.
+	uint32_t  bytesPerCluster;     // The number of bytes per cluster.
+	uint32_t  sectorsPerClusterShift; // log2(sectorsPerCluster).
+	uint32_t  bytesPerClusterShift;   // log2(bytesPerCluster).
+
+	uint32_t  sectorsPerFAT;       // The number of sectors in each copy of the FAT.
+	uint64_t  firstSector_FAT;     // The first sector of the (first) FAT.
+	uint64_t  firstSector_Root;    // The first sector of the root directory.
+	uint32_t  numSectors_Root;     // The number of sectors in the root directory (0 for FAT32).
+	uint64_t  firstSector_Data;    // The first sector of the data area (cluster 2).
+	uint32_t  rootCluster;         // The first cluster of the root directory (0 unless FAT32).
+
+	uint32_t  numClusters;         // The number of clusters in the data area.
+	uint32_t  numFATEntries;       // The number of FAT entries that are used (and read).
+	uint32_t  maxClusterNumber;    // The highest valid cluster number.
+	uint32_t  badClusterMarker;    // The FAT entry that marks a bad cluster.
+	uint32_t  endOfChainMarker;    // The lowest FAT entry that marks the end of a chain.
+
+} volume_t;
+
+
+
+
+/*
+ * Works out the geometry of the volume described by the given boot sector.
+ * The volume keeps a pointer to the boot sector, which must outlive it.
+ */
+volume_t* getVolume(boot_sect_t* bootSector);
+
+
+
+
+#endif
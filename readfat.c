@@ -20,11 +20,18 @@
 
 // LAYER 2: FILE_SYSTEM
 #include "boot_sector.h"
+#include "cluster_owner.h"
 #include "directory.h"
+#include "fat_check.h"
 #include "file_allocation_table.h"
 #include "file_system_tools.h"
+#include "volume.h"
 
 // LAYER 3: STORAGE_DEVICE
+#include "async_reader.h"
+#include "backend_http.h"
+#include "block_cache.h"
+#include "damage_map.h"
 #include "device_interface.h"
 
 // ERROR HANDLING
@@ -37,6 +44,9 @@
 #include <wchar.h>
 #include <locale.h>
 
+// POSIX
+#include <unistd.h>
+
 
 
 
@@ -51,49 +61,245 @@ int main(int argc, char** argv) {
 	// PRINT A PROGRAM HEADER.
 	printHeader();
 
+	//
+	// CHECK COMMAND OPTIONS.
+	//     -m    MEMORY-MAP THE STORAGE DEVICE INSTEAD OF READING IT WITH pread.
+	//     -d    READ THE STORAGE DEVICE WITH O_DIRECT, BYPASSING THE PAGE CACHE.
+	//     -r    READ THE STORAGE DEVICE WITH POSITIONAL READS (pread, THE DEFAULT).
+	//     -s    READ THE STORAGE DEVICE AS A SPARSE IMAGE, SKIPPING ITS HOLES.
+	//     -z    READ THE STORAGE DEVICE AS A COMPRESSED (GZIP OR SEEKABLE ZSTD) IMAGE.
+	//     -S    READ THE STORAGE DEVICE AS A SPLIT IMAGE, NAMED BY ITS FIRST SEGMENT.
+	//     -q    READ THE DISK INSIDE A QCOW2 CONTAINER.
+	//     -v    READ THE DISK INSIDE A SPARSE VMDK CONTAINER.
+	//     -u    READ THE STORAGE DEVICE FROM AN http:// URL (WITH A BLOCK CACHE).
+	//     -n N  FETCH OVER UP TO N CONNECTIONS AT ONCE (WITH -u).
+	//     -b F  READ FAILING MEDIA, RECORDING UNREADABLE SECTORS IN THE MAP FILE F.
+	//     -a    SUBMIT BATCHES OF READS ASYNCHRONOUSLY.
+	//     -c N  CACHE UP TO N MEGABYTES OF SECTORS IN MEMORY.
+	//     -p N  PREFETCH UP TO N KILOBYTES AHEAD OF THE DIRECTORY TRAVERSAL.
+	//     -f N  KEEP ONLY N MEGABYTES OF THE FILE ALLOCATION TABLE IN MEMORY, READING IT IN WINDOWS.
+	//     -R    KEEP THE FILE ALLOCATION TABLE IN MEMORY AS RUNS OF ENTRIES.
+	//     -L    INDEX THE FILE ALLOCATION TABLE IN ONE SWEEP, AND FOLLOW CHAINS THROUGH THE INDEX.
+	//     -o C  PRINT WHICH FILE OWNS CLUSTER C (DECIMAL, OR HEX WITH 0x).  MAY BE GIVEN MORE THAN ONCE.
+	//     -k F  CHECK THE FILE ALLOCATION TABLE AGAINST THE DIRECTORY TREE, WRITING THE PROBLEMS TO FILE F.
+	uint8_t  storageMode = STORAGE_MODE_PREAD;
+	uint8_t  asyncReads = 0;
+	uint64_t cacheSize = 0;
+	uint64_t prefetchWindow = 0;
+	uint64_t fatMemoryLimit = 0;
+	uint8_t  compressFAT = 0;
+	uint8_t  indexChains = 0;
+	uint32_t* ownerQueries = (uint32_t*) malloc(argc * sizeof(uint32_t));
+	uint32_t numOwnerQueries = 0;
+	uint64_t ownerQuery;
+	char*    optionEnd;
+	if (ownerQueries == NULL)
+		handleError(L"main", L"Unable to allocate memory for the command options");
+	uint32_t httpConnections = HTTP_DEFAULT_CONNECTIONS;
+	char*    damageMapFileName = NULL;
+	char*    checkReportFileName = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "mdrszSqvuac:p:n:b:f:RLo:k:")) != -1) {
+		switch (option) {
+			case 'm':
+				storageMode = STORAGE_MODE_MMAP;
+				break;
+			case 'd':
+				storageMode = STORAGE_MODE_DIRECT;
+				break;
+			case 'r':
+				storageMode = STORAGE_MODE_PREAD;
+				break;
+			case 's':
+				storageMode = STORAGE_MODE_SPARSE;
+				break;
+			case 'z':
+				storageMode = STORAGE_MODE_COMPRESSED;
+				break;
+			case 'S':
+				storageMode = STORAGE_MODE_SPLIT;
+				break;
+			case 'q':
+				storageMode = STORAGE_MODE_QCOW2;
+				break;
+			case 'v':
+				storageMode = STORAGE_MODE_VMDK;
+				break;
+			case 'u':
+				storageMode = STORAGE_MODE_HTTP;
+				break;
+			case 'a':
+				asyncReads = 1;
+				break;
+			case 'c':
+				cacheSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				if (cacheSize == 0)
+					handleError(L"main", L"The Cache Size Must Be a Positive Number of Megabytes");
+				break;
+			case 'p':
+				prefetchWindow = strtoull(optarg, NULL, 10) * 1024;
+				if (prefetchWindow == 0)
+					handleError(L"main", L"The Prefetch Window Must Be a Positive Number of Kilobytes");
+				break;
+			case 'n':
+				httpConnections = (uint32_t) strtoul(optarg, NULL, 10);
+				if (httpConnections == 0)
+					handleError(L"main", L"The Number of Connections Must Be a Positive Number");
+				break;
+			case 'b':
+				damageMapFileName = optarg;
+				break;
+			case 'f':
+				fatMemoryLimit = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				if (fatMemoryLimit == 0)
+					handleError(L"main", L"The FAT Memory Limit Must Be a Positive Number of Megabytes");
+				break;
+			case 'R':
+				compressFAT = 1;
+				break;
+			case 'L':
+				indexChains = 1;
+				break;
+			case 'o':
+				ownerQuery = strtoull(optarg, &optionEnd, 0);
+				if (*optarg == '\0' || *optionEnd != '\0' || ownerQuery > UINT32_MAX)
+					handleError(L"main", L"The Cluster Number Must Be a Number (Decimal, or Hex with 0x)");
+				ownerQueries[numOwnerQueries] = (uint32_t) ownerQuery;
+				numOwnerQueries++;
+				break;
+			case 'k':
+				checkReportFileName = optarg;
+				break;
+			default:
+				handleError(L"main", L"Unknown Command Option");
+		}
+	}
+
 	//
 	// CHECK COMMAND ARGUMENTS.
-	if (argc != 2)
+	if (argc - optind != 1)
 		handleError(L"main", L"The Image Pathname Must Be Specified in the Command");
+	if (compressFAT && fatMemoryLimit > 0)
+		handleError(L"main", L"The -f and -R Options Cannot Be Used Together");
+	if (indexChains && fatMemoryLimit > 0)
+		handleError(L"main", L"The -f and -L Options Cannot Be Used Together");
 
 	//
 	// GET FILENAME.
-	char* fileName = argv[1];
+	char* fileName = argv[optind];
 
 	//
 	// OPEN THE STORAGE DEVICE FILE.
-	FILE* storageDevice = openStorageDevice(fileName);
+	//     EVERY READ FROM A WEB SERVER IS A ROUND TRIP, SO A DEVICE READ OVER
+	//     HTTP ALWAYS GETS A BLOCK CACHE.
+	storage_device_t* storageDevice;
+	if (storageMode == STORAGE_MODE_HTTP) {
+		storageDevice = openStorageDeviceOverHttp(fileName, httpConnections);
+		if (cacheSize == 0)
+			cacheSize = DEFAULT_BLOCK_CACHE_SIZE;
+	}
+	else
+		storageDevice = openStorageDevice(fileName, storageMode);
+	if (asyncReads)
+		enableAsyncReads(storageDevice, DEFAULT_ASYNC_QUEUE_DEPTH);
+	if (cacheSize > 0)
+		enableBlockCache(storageDevice, cacheSize);
+	setPrefetchWindow(storageDevice, prefetchWindow);
+	if (damageMapFileName != NULL)
+		enableDegradedReads(storageDevice, damageMapFileName, DEFAULT_READ_RETRIES);
 
 	//
 	// GET THE BOOT SECTOR.
 	boot_sect_t* bootSector = getBootSector(storageDevice);
 
 	//
-	// GET THE FAT VERSION.
-	uint8_t fatVersion = getFatVersion(bootSector);
+	// WORK OUT THE GEOMETRY OF THE VOLUME.
+	volume_t* volume = getVolume(bootSector);
 
 	//
-	// CHECK THE FAT VERSION.
-	if (fatVersion == FAT16)
-		handleError(L"main", L"FAT16 File Systems are not Supported");	
+	// PRINT THE FILE SYSTEM INFORMATION.
+	printFileSystemInformation(fileName, volume);
 
 	//
-	// PRINT THE FILE SYSTEM INFORMATION.
-	printFileSystemInformation(fileName, bootSector);
+	// GET THE FILE ALLOCATION TABLE (A WINDOW AT A TIME, IF ITS MEMORY IS
+	// LIMITED, OR AS RUNS OF ENTRIES, IF IT IS TO BE COMPRESSED).
+	fat_t* fileAllocationTable;
+	if (fatMemoryLimit > 0)
+		fileAllocationTable = getPagedFileAllocationTable(volume, storageDevice, fatMemoryLimit);
+	else if (compressFAT)
+		fileAllocationTable = getCompressedFileAllocationTable(volume, storageDevice);
+	else
+		fileAllocationTable = getFileAllocationTable(volume, storageDevice);
 
 	//
-	// GET THE FILE ALLOCATION TABLE.
-	uint32_t* fileAllocationTable = getFileAllocationTable(bootSector, storageDevice);
+	// INDEX THE RUNS OF LINKED CLUSTERS IN THE FILE ALLOCATION TABLE (IF ASKED TO).
+	if (indexChains)
+		indexClusterChains(fileAllocationTable, volume);
 
 	//
 	// GET THE DIRECTORY TREE.
-	file_t* directoryTree = getDirectoryTree(bootSector, fileAllocationTable, storageDevice);
+	file_t* directoryTree = getDirectoryTree(volume, fileAllocationTable, storageDevice);
 
 	//
 	// PRINT THE DIRECTORY TREE.
 	printDirectoryTreeHeader();
-	printDirectory(directoryTree, 1, bootSector, fileAllocationTable);
+	printDirectory(directoryTree, 1, volume, fileAllocationTable);
+
+	//
+	// PRINT THE OWNERS OF THE CLUSTERS ASKED ABOUT (IF ANY).
+	if (numOwnerQueries > 0) {
+		cluster_owner_index_t* clusterOwnerIndex = getClusterOwnerIndex(directoryTree);
+		printClusterOwners(ownerQueries, numOwnerQueries, clusterOwnerIndex, volume);
+		freeClusterOwnerIndex(clusterOwnerIndex);
+	}
+	free(ownerQueries);
+
+	//
+	// CHECK THE FILE ALLOCATION TABLE AGAINST THE DIRECTORY TREE (IF ASKED TO),
+	// AND PRINT HOW MANY PROBLEMS WERE FOUND.
+	if (checkReportFileName != NULL) {
+		FILE* checkReport = fopen(checkReportFileName, "w");
+		if (checkReport == NULL)
+			handleError(L"main", L"Unable to open the FAT check report file");
+		fat_check_summary_t checkSummary;
+		checkFileAllocationTable(directoryTree, volume, fileAllocationTable, checkReport, &checkSummary);
+		fclose(checkReport);
+		printFATCheckSummary(&checkSummary, checkReportFileName);
+	}
+
+	//
+	// PRINT THE CACHE STATISTICS (IF THERE IS A CACHE).
+	if (storageDevice->blockCache != NULL) {
+		uint64_t cacheHits, cacheMisses;
+		getBlockCacheStatistics(storageDevice->blockCache, &cacheHits, &cacheMisses);
+		printCacheStatistics(cacheHits, cacheMisses);
+	}
+
+	//
+	// PRINT THE DAMAGE STATISTICS (IF THE DEVICE IS BEING READ IN DEGRADED MODE).
+	if (storageDevice->damageMap != NULL) {
+		uint64_t numDamagedRegions, numDamagedBytes;
+		getDamageStatistics(storageDevice->damageMap, &numDamagedRegions, &numDamagedBytes);
+		printDamageStatistics(damageMapFileName, numDamagedRegions, numDamagedBytes);
+	}
+
+	//
+	// PRINT THE FAT WINDOW STATISTICS (IF THE FILE ALLOCATION TABLE IS PAGED).
+	if (fileAllocationTable->windowCache != NULL)
+		printFATWindowStatistics(getFATWindowStatistics(fileAllocationTable), fatMemoryLimit);
+
+	//
+	// PRINT THE FAT RUN STATISTICS (IF THE FILE ALLOCATION TABLE IS COMPRESSED).
+	if (fileAllocationTable->runs != NULL) {
+		uint64_t numFATRuns, numFATRunBytes;
+		getFATRunStatistics(fileAllocationTable, &numFATRuns, &numFATRunBytes);
+		printFATRunStatistics(numFATRuns, numFATRunBytes, fileAllocationTable->numEntries);
+	}
 	
+	//
+	// FREE THE FILE ALLOCATION TABLE (WHICH MAY BE A VIEW OF THE DEVICE).
+	freeFileAllocationTable(fileAllocationTable);
+
 	//
 	// CLOSE THE STORAGE DEVICE FILE.
 	closeStorageDevice(storageDevice);
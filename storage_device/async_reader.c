@@ -0,0 +1,508 @@
+/******************************************************************************
+ * This file contains functions and data structures that perform
+ *                       ASYNCHRONOUS BATCH READS
+ * from the storage device.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "async_reader.h"
+#include "device_interface.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX & LINUX
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE LARGEST NUMBER OF BYTES SUBMITTED IN A SINGLE io_uring READ.  ANYTHING
+// LEFT OVER IS FINISHED WITH pread.
+#define MAX_BYTES_PER_RING_READ (1u << 30)
+
+// THE NUMBER OF TIMES IN A ROW THE KERNEL MAY TURN AWAY A SUBMISSION (WITH
+// NOTHING IN FLIGHT TO WAIT FOR) BEFORE THE REST OF THE BATCH IS READ WITH
+// pread INSTEAD.
+#define MAX_RING_SUBMIT_RETRIES 64
+
+
+
+
+/*
+ * A data structure used to store the state of an asynchronous reader.
+ */
+struct async_reader_t {
+
+	int      fileDescriptor;       // The file descriptor to read from.
+	uint32_t queueDepth;           // The maximum number of reads in flight.
+	uint8_t  useRing;              // Set to 1 if io_uring is being used.
+	pthread_mutex_t batchLock;     // Lets only one batch be submitted at a time.
+
+	//
+	// THE io_uring SUBMISSION AND COMPLETION QUEUES (ONLY IF useRing IS SET).
+	int                  ringFd;
+	void*                sqRing;
+	size_t               sqRingSize;
+	void*                cqRing;
+	size_t               cqRingSize;
+	struct io_uring_sqe* sqes;
+	size_t               sqesSize;
+	uint32_t*            sqTail;
+	uint32_t*            sqMask;
+	uint32_t*            sqArray;
+	uint32_t*            cqHead;
+	uint32_t*            cqTail;
+	uint32_t*            cqMask;
+	struct io_uring_cqe* cqes;
+
+	//
+	// THE THREAD POOL AND ITS CURRENT BATCH (ONLY IF useRing IS NOT SET).
+	pthread_t        threads[ASYNC_READER_THREADS];
+	pthread_mutex_t  lock;
+	pthread_cond_t   workReady;
+	pthread_cond_t   workDone;
+	sector_extent_t* extents;
+	uint32_t         numExtents;
+	uint32_t         nextExtent;
+	uint32_t         numFinished;
+	uint32_t         bytesPerSector;
+	uint8_t          shutdown;
+
+};
+
+
+/*
+ * Used to set up the io_uring queues.  Returns 0 if io_uring is unavailable.
+ */
+uint8_t setupRing(async_reader_t* asyncReader);
+
+
+/*
+ * Used to submit a batch of extents through io_uring and wait for them.
+ */
+void readExtentsRing(async_reader_t*  asyncReader,
+                     sector_extent_t* extents,
+                     uint32_t         numExtents,
+                     uint32_t         bytesPerSector);
+
+
+/*
+ * Used to hand a batch of extents to the thread pool and wait for them.
+ */
+void readExtentsThreaded(async_reader_t*  asyncReader,
+                         sector_extent_t* extents,
+                         uint32_t         numExtents,
+                         uint32_t         bytesPerSector);
+
+
+/*
+ * The main loop of each thread in the pool.
+ */
+void* readerThread(void* argument);
+
+
+/*
+ * Used to read the given number of bytes with pread, no matter how many calls
+ * it takes.
+ */
+void preadFully(int fileDescriptor, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+async_reader_t* openAsyncReader(int fileDescriptor, uint32_t queueDepth) {
+
+	//
+	// ALLOCATE THE READER.
+	async_reader_t* asyncReader = (async_reader_t*) calloc(1, sizeof(async_reader_t));
+	if (asyncReader == NULL)
+		handleError(L"openAsyncReader", L"Unable to allocate memory for the asynchronous reader");
+	asyncReader->fileDescriptor = fileDescriptor;
+	asyncReader->queueDepth = (queueDepth == 0) ? DEFAULT_ASYNC_QUEUE_DEPTH : queueDepth;
+	pthread_mutex_init(&(asyncReader->batchLock), NULL);
+
+	//
+	// PREFER io_uring.
+	asyncReader->useRing = setupRing(asyncReader);
+	if (asyncReader->useRing)
+		return asyncReader;
+
+	//
+	// OTHERWISE, START UP THE THREAD POOL.
+	pthread_mutex_init(&(asyncReader->lock), NULL);
+	pthread_cond_init(&(asyncReader->workReady), NULL);
+	pthread_cond_init(&(asyncReader->workDone), NULL);
+	uint32_t threadNumber = 0;
+	while (threadNumber < ASYNC_READER_THREADS) {
+		if (pthread_create(&(asyncReader->threads[threadNumber]), NULL, readerThread, asyncReader) != 0)
+			handleError(L"openAsyncReader", L"Unable to start the reader threads");
+		threadNumber++;
+	}
+
+	return asyncReader;
+
+}
+
+
+void readExtentsAsync(async_reader_t*  asyncReader,
+                      sector_extent_t* extents,
+                      uint32_t         numExtents,
+                      uint32_t         bytesPerSector) {
+
+	//
+	// PARAMETER CHECK.
+	if (asyncReader == NULL)
+		handleError(L"readExtentsAsync", L"NULL 'asyncReader' parameter");
+	if (numExtents == 0)
+		return;
+
+	//
+	// THERE IS ONLY ONE RING (OR ONE BATCH FOR THE THREAD POOL), SO BATCHES
+	// FROM DIFFERENT THREADS TAKE TURNS.
+	pthread_mutex_lock(&(asyncReader->batchLock));
+	if (asyncReader->useRing)
+		readExtentsRing(asyncReader, extents, numExtents, bytesPerSector);
+	else
+		readExtentsThreaded(asyncReader, extents, numExtents, bytesPerSector);
+	pthread_mutex_unlock(&(asyncReader->batchLock));
+
+}
+
+
+void closeAsyncReader(async_reader_t* asyncReader) {
+
+	if (asyncReader == NULL)
+		return;
+
+	//
+	// TEAR DOWN THE io_uring QUEUES.
+	if (asyncReader->useRing) {
+		munmap(asyncReader->sqes, asyncReader->sqesSize);
+		if (asyncReader->cqRing != asyncReader->sqRing)
+			munmap(asyncReader->cqRing, asyncReader->cqRingSize);
+		munmap(asyncReader->sqRing, asyncReader->sqRingSize);
+		close(asyncReader->ringFd);
+	}
+
+	//
+	// OR TELL THE THREADS TO EXIT, AND WAIT FOR THEM.
+	else {
+		pthread_mutex_lock(&(asyncReader->lock));
+		asyncReader->shutdown = 1;
+		pthread_cond_broadcast(&(asyncReader->workReady));
+		pthread_mutex_unlock(&(asyncReader->lock));
+		uint32_t threadNumber = 0;
+		while (threadNumber < ASYNC_READER_THREADS) {
+			pthread_join(asyncReader->threads[threadNumber], NULL);
+			threadNumber++;
+		}
+		pthread_mutex_destroy(&(asyncReader->lock));
+		pthread_cond_destroy(&(asyncReader->workReady));
+		pthread_cond_destroy(&(asyncReader->workDone));
+	}
+
+	pthread_mutex_destroy(&(asyncReader->batchLock));
+	free(asyncReader);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+uint8_t setupRing(async_reader_t* asyncReader) {
+
+	//
+	// ASK THE KERNEL FOR A RING.  THIS FAILS ON OLD KERNELS, AND WHEN io_uring
+	// HAS BEEN DISABLED (E.G. BY A CONTAINER'S SECCOMP POLICY).
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int ringFd = (int) syscall(__NR_io_uring_setup, asyncReader->queueDepth, &params);
+	if (ringFd < 0)
+		return 0;
+
+	//
+	// MAP THE SUBMISSION AND COMPLETION RINGS.  NEWER KERNELS LET BOTH SHARE
+	// ONE MAPPING.
+	asyncReader->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	asyncReader->cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (asyncReader->cqRingSize > asyncReader->sqRingSize)
+			asyncReader->sqRingSize = asyncReader->cqRingSize;
+		asyncReader->cqRingSize = asyncReader->sqRingSize;
+	}
+	asyncReader->sqRing = mmap(NULL, asyncReader->sqRingSize, PROT_READ | PROT_WRITE,
+	                           MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (asyncReader->sqRing == MAP_FAILED) {
+		close(ringFd);
+		return 0;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		asyncReader->cqRing = asyncReader->sqRing;
+	else {
+		asyncReader->cqRing = mmap(NULL, asyncReader->cqRingSize, PROT_READ | PROT_WRITE,
+		                           MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (asyncReader->cqRing == MAP_FAILED) {
+			munmap(asyncReader->sqRing, asyncReader->sqRingSize);
+			close(ringFd);
+			return 0;
+		}
+	}
+
+	//
+	// MAP THE ARRAY OF SUBMISSION QUEUE ENTRIES.
+	asyncReader->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	asyncReader->sqes = (struct io_uring_sqe*) mmap(NULL, asyncReader->sqesSize, PROT_READ | PROT_WRITE,
+	                                                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (asyncReader->sqes == MAP_FAILED) {
+		if (asyncReader->cqRing != asyncReader->sqRing)
+			munmap(asyncReader->cqRing, asyncReader->cqRingSize);
+		munmap(asyncReader->sqRing, asyncReader->sqRingSize);
+		close(ringFd);
+		return 0;
+	}
+
+	//
+	// FIND THE RING HEADS, TAILS AND MASKS WITHIN THE MAPPINGS.
+	uint8_t* sqRing = (uint8_t*) asyncReader->sqRing;
+	uint8_t* cqRing = (uint8_t*) asyncReader->cqRing;
+	asyncReader->sqTail  = (uint32_t*) (sqRing + params.sq_off.tail);
+	asyncReader->sqMask  = (uint32_t*) (sqRing + params.sq_off.ring_mask);
+	asyncReader->sqArray = (uint32_t*) (sqRing + params.sq_off.array);
+	asyncReader->cqHead  = (uint32_t*) (cqRing + params.cq_off.head);
+	asyncReader->cqTail  = (uint32_t*) (cqRing + params.cq_off.tail);
+	asyncReader->cqMask  = (uint32_t*) (cqRing + params.cq_off.ring_mask);
+	asyncReader->cqes    = (struct io_uring_cqe*) (cqRing + params.cq_off.cqes);
+
+	//
+	// THE KERNEL MAY HAVE ROUNDED THE QUEUE SIZE; NEVER EXCEED WHAT IT GAVE US.
+	if (asyncReader->queueDepth > params.sq_entries)
+		asyncReader->queueDepth = params.sq_entries;
+	asyncReader->ringFd = ringFd;
+	return 1;
+
+}
+
+
+void readExtentsRing(async_reader_t*  asyncReader,
+                     sector_extent_t* extents,
+                     uint32_t         numExtents,
+                     uint32_t         bytesPerSector) {
+
+	uint32_t nextExtent   = 0;
+	uint32_t numQueued    = 0;
+	uint32_t numInFlight  = 0;
+	uint32_t numFinished  = 0;
+	uint32_t numRetries   = 0;
+	while (numFinished < numExtents) {
+
+		//
+		// FILL THE SUBMISSION QUEUE UP TO THE QUEUE DEPTH.
+		uint32_t tail = *(asyncReader->sqTail);
+		while (nextExtent < numExtents && numInFlight + numQueued < asyncReader->queueDepth) {
+			uint64_t numBytes = (uint64_t) extents[nextExtent].numSectors * bytesPerSector;
+			uint32_t index = tail & *(asyncReader->sqMask);
+			struct io_uring_sqe* sqe = &(asyncReader->sqes[index]);
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode    = IORING_OP_READ;
+			sqe->fd        = asyncReader->fileDescriptor;
+			sqe->addr      = (uint64_t) (uintptr_t) extents[nextExtent].buffer;
+			sqe->len       = (numBytes > MAX_BYTES_PER_RING_READ) ? MAX_BYTES_PER_RING_READ : (uint32_t) numBytes;
+			sqe->off       = (uint64_t) extents[nextExtent].firstSector * bytesPerSector;
+			sqe->user_data = nextExtent;
+			asyncReader->sqArray[index] = index;
+			tail++;
+			numQueued++;
+			nextExtent++;
+		}
+		__atomic_store_n(asyncReader->sqTail, tail, __ATOMIC_RELEASE);
+
+		//
+		// SUBMIT THE QUEUED READS, AND WAIT FOR AT LEAST ONE TO COMPLETE.
+		// THE KERNEL MAY TAKE FEWER THAN WE QUEUED; THE REST GO NEXT TIME.
+		int result = (int) syscall(__NR_io_uring_enter, asyncReader->ringFd,
+		                           numQueued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			handleError(L"readExtentsAsync", L"Unable to submit reads to io_uring");
+		if (result > 0) {
+			numQueued   -= (uint32_t) result;
+			numInFlight += (uint32_t) result;
+			numRetries   = 0;
+		}
+
+		//
+		// IF THE KERNEL TOOK NOTHING, AND NOTHING IS IN FLIGHT, THERE IS NO
+		// COMPLETION TO WAIT FOR, SO YIELD BEFORE TRYING AGAIN.  IF IT KEEPS
+		// TURNING THE READS AWAY, TAKE BACK THE ONES STILL QUEUED (THE KERNEL
+		// HAS NOT SEEN THEM), AND READ THE REST OF THE BATCH WITH pread.
+		else if (numInFlight == 0) {
+			numRetries++;
+			if (numRetries < MAX_RING_SUBMIT_RETRIES)
+				sched_yield();
+			else {
+				__atomic_store_n(asyncReader->sqTail, tail - numQueued, __ATOMIC_RELEASE);
+				nextExtent -= numQueued;
+				numQueued = 0;
+				while (nextExtent < numExtents) {
+					preadFully(asyncReader->fileDescriptor,
+					           extents[nextExtent].buffer,
+					           (uint64_t) extents[nextExtent].numSectors * bytesPerSector,
+					           (uint64_t) extents[nextExtent].firstSector * bytesPerSector);
+					nextExtent++;
+					numFinished++;
+				}
+			}
+		}
+
+		//
+		// REAP EVERY COMPLETION THAT IS READY.
+		uint32_t head = *(asyncReader->cqHead);
+		while (head != __atomic_load_n(asyncReader->cqTail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe* cqe = &(asyncReader->cqes[head & *(asyncReader->cqMask)]);
+			sector_extent_t* extent = &(extents[cqe->user_data]);
+			uint64_t numBytes = (uint64_t) extent->numSectors * bytesPerSector;
+			uint64_t numRead  = (cqe->res < 0) ? 0 : (uint64_t) cqe->res;
+
+			//
+			// A FAILED OR SHORT READ IS FINISHED SYNCHRONOUSLY.  THIS ALSO
+			// COVERS KERNELS THAT DO NOT SUPPORT IORING_OP_READ, AND REPORTS
+			// GENUINE I/O ERRORS THE SAME WAY AS readSectors.
+			if (numRead < numBytes)
+				preadFully(asyncReader->fileDescriptor,
+				           extent->buffer + numRead,
+				           numBytes - numRead,
+				           (uint64_t) extent->firstSector * bytesPerSector + numRead);
+
+			head++;
+			numInFlight--;
+			numFinished++;
+		}
+		__atomic_store_n(asyncReader->cqHead, head, __ATOMIC_RELEASE);
+
+	}
+
+}
+
+
+void readExtentsThreaded(async_reader_t*  asyncReader,
+                         sector_extent_t* extents,
+                         uint32_t         numExtents,
+                         uint32_t         bytesPerSector) {
+
+	//
+	// HAND THE BATCH TO THE THREADS.
+	pthread_mutex_lock(&(asyncReader->lock));
+	asyncReader->extents        = extents;
+	asyncReader->numExtents     = numExtents;
+	asyncReader->nextExtent     = 0;
+	asyncReader->numFinished    = 0;
+	asyncReader->bytesPerSector = bytesPerSector;
+	pthread_cond_broadcast(&(asyncReader->workReady));
+
+	//
+	// WAIT UNTIL EVERY EXTENT HAS BEEN READ.
+	while (asyncReader->numFinished < numExtents)
+		pthread_cond_wait(&(asyncReader->workDone), &(asyncReader->lock));
+	asyncReader->extents    = NULL;
+	asyncReader->numExtents = 0;
+	asyncReader->nextExtent = 0;
+	pthread_mutex_unlock(&(asyncReader->lock));
+
+}
+
+
+void* readerThread(void* argument) {
+
+	async_reader_t* asyncReader = (async_reader_t*) argument;
+
+	pthread_mutex_lock(&(asyncReader->lock));
+	while (1) {
+
+		//
+		// WAIT FOR AN EXTENT TO READ (OR TO BE TOLD TO EXIT).
+		while (!asyncReader->shutdown && asyncReader->nextExtent >= asyncReader->numExtents)
+			pthread_cond_wait(&(asyncReader->workReady), &(asyncReader->lock));
+		if (asyncReader->shutdown)
+			break;
+
+		//
+		// CLAIM THE NEXT EXTENT, AND READ IT WITHOUT HOLDING THE LOCK.
+		sector_extent_t extent = asyncReader->extents[asyncReader->nextExtent];
+		uint32_t bytesPerSector = asyncReader->bytesPerSector;
+		asyncReader->nextExtent++;
+		pthread_mutex_unlock(&(asyncReader->lock));
+		preadFully(asyncReader->fileDescriptor,
+		           extent.buffer,
+		           (uint64_t) extent.numSectors * bytesPerSector,
+		           (uint64_t) extent.firstSector * bytesPerSector);
+		pthread_mutex_lock(&(asyncReader->lock));
+
+		//
+		// LET THE SUBMITTER KNOW WHEN THE LAST EXTENT IS DONE.
+		asyncReader->numFinished++;
+		if (asyncReader->numFinished == asyncReader->numExtents)
+			pthread_cond_signal(&(asyncReader->workDone));
+	}
+	pthread_mutex_unlock(&(asyncReader->lock));
+
+	return NULL;
+
+}
+
+
+void preadFully(int fileDescriptor, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset) {
+
+	while (numBytes > 0) {
+		ssize_t result = pread(fileDescriptor, buffer, numBytes, (off_t) byteOffset);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			handleError(L"readExtentsAsync",
+			            L"Unable to read in requested sectors");
+		buffer     += result;
+		numBytes   -= result;
+		byteOffset += result;
+	}
+
+}
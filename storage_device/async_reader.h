@@ -0,0 +1,82 @@
+/******************************************************************************
+ * This file contains functions and data structures that perform
+ *                       ASYNCHRONOUS BATCH READS
+ * from the storage device.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef ASYNC_READER_H_
+#define ASYNC_READER_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "device_interface.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE DEFAULT NUMBER OF READS THAT MAY BE IN FLIGHT AT ONCE.
+#define DEFAULT_ASYNC_QUEUE_DEPTH 32
+
+// THE NUMBER OF THREADS USED WHEN io_uring IS NOT AVAILABLE.
+#define ASYNC_READER_THREADS 4
+
+
+
+
+/*
+ * Opens an asynchronous reader on the given file descriptor.  The reader
+ * submits its reads through io_uring if the kernel allows it, and otherwise
+ * falls back to a small pool of threads calling pread.  Up to "queueDepth"
+ * reads are kept in flight at once.
+ */
+async_reader_t* openAsyncReader(int fileDescriptor, uint32_t queueDepth);
+
+
+
+
+/*
+ * Submits all the given extents at once, and returns when every one of them
+ * has been read into its buffer.  It may be called by several threads at
+ * once; their batches are submitted one after another.
+ */
+void readExtentsAsync(async_reader_t*  asyncReader,
+                      sector_extent_t* extents,
+                      uint32_t         numExtents,
+                      uint32_t         bytesPerSector);
+
+
+
+
+/*
+ * Closes the asynchronous reader (but not its file descriptor).
+ */
+void closeAsyncReader(async_reader_t* asyncReader);
+
+
+
+
+#endif
@@ -0,0 +1,823 @@
+/******************************************************************************
+ * This file contains the
+ *                         COMPRESSED BACKEND
+ * which reads a compressed image, decompressing only the parts that are read.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_compressed.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// COMPRESSION LIBRARIES
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE FORMATS A COMPRESSED IMAGE CAN BE IN.
+#define COMPRESSION_FORMAT_GZIP 0
+#define COMPRESSION_FORMAT_ZSTD 1
+
+// THE SIZE OF THE WINDOW OF PREVIOUS OUTPUT THAT DEFLATE CAN REFER BACK INTO,
+// WHICH EVERY GZIP CHECKPOINT MUST HOLD ON TO.
+#define GZIP_WINDOW_SIZE 32768
+
+// HOW MUCH COMPRESSED DATA IS READ IN AT A TIME WHILE DECOMPRESSING.
+#define COMPRESSED_INPUT_SIZE (64 * 1024)
+
+// IDENTIFIES A SAVED GZIP INDEX FILE (AND ITS VERSION).
+#define GZIP_INDEX_MAGIC "RFGZIDX1"
+
+// THE SUFFIX ADDED TO AN IMAGE'S NAME TO GET THE NAME OF ITS SAVED GZIP INDEX.
+#define GZIP_INDEX_SUFFIX ".gzidx"
+
+// THE SEEK TABLE AT THE END OF A SEEKABLE ZSTD IMAGE.
+#define ZSTD_SEEKABLE_MAGIC      0x8F92EAB1
+#define ZSTD_SEEK_TABLE_FOOTER   9
+#define ZSTD_SKIPPABLE_HEADER    8
+#define ZSTD_SEEK_ENTRY_CHECKSUM 0x80
+
+
+
+
+/*
+ * A data structure used to store one chunk of the image that can be
+ * decompressed on its own: a zstd frame, or the span between two gzip
+ * checkpoints.
+ */
+typedef struct {
+
+	uint64_t uncompressedOffset;   // Where the chunk starts in the decompressed image.
+	uint64_t compressedOffset;     // Where the chunk starts in the compressed file.
+	uint32_t compressedLength;     // The length of the compressed frame (zstd only).
+	uint32_t bits;                 // The bits of the previous byte that belong to the chunk (gzip only).
+	uint32_t windowLength;         // The length of the compressed window (gzip only).
+	uint8_t* window;               // The 32 KiB of output before the chunk, compressed (gzip only).
+
+} compressed_chunk_t;
+
+
+/*
+ * A data structure used to store one decompressed chunk in the cache.
+ */
+typedef struct {
+
+	uint32_t chunkIndex;           // The chunk held (if "data" is not NULL).
+	uint8_t* data;                 // The decompressed chunk.
+	uint64_t lastUsed;             // When the chunk was last read from.
+
+} cached_chunk_t;
+
+
+/*
+ * A data structure used to store the state of the compressed backend.
+ */
+typedef struct {
+
+	int                 fileDescriptor;                 // The compressed file.
+	uint8_t             format;                         // One of the COMPRESSION_FORMAT_ constants.
+	uint64_t            compressedSize;                 // The size of the compressed file.
+	uint64_t            size;                           // The size of the decompressed image.
+	compressed_chunk_t* chunks;                         // The chunks, in order.
+	uint32_t            numChunks;                      // The number of chunks.
+	uint32_t            maxChunks;                      // The number of chunks there is room for.
+	cached_chunk_t      cache[COMPRESSED_CACHE_CHUNKS]; // The most recently used decompressed chunks.
+	uint64_t            useCounter;                     // Counts reads, to find the least recently used chunk.
+	pthread_mutex_t     cacheLock;                      // Guards the cache.
+
+} compressed_backend_t;
+
+
+/*
+ * The compressed backend's operations (see storage_backend.h).
+ */
+void     readCompressedExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getCompressedSize(storage_backend_t* backend);
+uint32_t getCompressedBlockSize(storage_backend_t* backend);
+void     closeCompressedBackend(storage_backend_t* backend);
+
+
+/*
+ * Used to decompress the whole gzip image once, recording a checkpoint every
+ * GZIP_INDEX_SPAN bytes.
+ */
+void buildGzipIndex(compressed_backend_t* compressedBackend);
+
+
+/*
+ * Used to add a checkpoint to a gzip index.  The window is circular, with
+ * "windowLeft" bytes of it not yet overwritten by the latest output.
+ */
+void addGzipCheckpoint(compressed_backend_t* compressedBackend,
+                       uint32_t              bits,
+                       uint64_t              compressedOffset,
+                       uint64_t              uncompressedOffset,
+                       uint32_t              windowLeft,
+                       uint8_t*              window);
+
+
+/*
+ * Used to save a gzip index next to the image, and to load it again.  Loading
+ * returns 0 (having loaded nothing) unless the index was saved for this very
+ * image.  Saving fails silently, since the index can always be rebuilt.
+ */
+void    saveGzipIndex(compressed_backend_t* compressedBackend, char* indexFileName, struct stat* status);
+uint8_t loadGzipIndex(compressed_backend_t* compressedBackend, char* indexFileName, struct stat* status);
+
+
+/*
+ * Used to find every frame of a seekable zstd image through its seek table.
+ */
+void loadZstdSeekTable(compressed_backend_t* compressedBackend);
+
+
+/*
+ * Used to find the chunk that holds the given byte of the decompressed image.
+ */
+uint32_t findChunk(compressed_backend_t* compressedBackend, uint64_t byteOffset);
+
+
+/*
+ * Used to get the decompressed length of a chunk.
+ */
+uint64_t getChunkLength(compressed_backend_t* compressedBackend, uint32_t chunkIndex);
+
+
+/*
+ * Used to get a decompressed chunk, from the cache if possible.  The cache
+ * lock must be held.
+ */
+uint8_t* getDecompressedChunk(compressed_backend_t* compressedBackend, uint32_t chunkIndex);
+
+
+/*
+ * Used to decompress a chunk into a buffer of its decompressed length.
+ */
+void decompressGzipChunk(compressed_backend_t* compressedBackend, uint32_t chunkIndex, uint8_t* buffer);
+void decompressZstdChunk(compressed_backend_t* compressedBackend, uint32_t chunkIndex, uint8_t* buffer);
+
+
+/*
+ * Used to read a range of the compressed file, no matter how many calls it
+ * takes.
+ */
+void preadCompressed(compressed_backend_t* compressedBackend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openCompressedBackend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	compressed_backend_t* compressedBackend = (compressed_backend_t*) calloc(1, sizeof(compressed_backend_t));
+	if (compressedBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	pthread_mutex_init(&(compressedBackend->cacheLock), NULL);
+
+	//
+	// OPEN THE COMPRESSED FILE.
+	compressedBackend->fileDescriptor = open(deviceFileName, O_RDONLY);
+	struct stat status;
+	if (compressedBackend->fileDescriptor < 0 || fstat(compressedBackend->fileDescriptor, &status) != 0)
+		handleError(L"openDevice",
+		            L"The storage device could not be opened");
+	compressedBackend->compressedSize = (uint64_t) status.st_size;
+
+	//
+	// TELL THE FORMAT FROM THE MAGIC NUMBER AT THE START OF THE FILE.
+	uint8_t magic[4] = { 0, 0, 0, 0 };
+	if (compressedBackend->compressedSize >= sizeof(magic))
+		preadCompressed(compressedBackend, magic, sizeof(magic), 0);
+	if (magic[0] == 0x1f && magic[1] == 0x8b) {
+
+		//
+		// A GZIP IMAGE NEEDS ITS INDEX, WHICH IS ONLY BUILT IF IT WAS NOT SAVED
+		// BEFORE.
+		compressedBackend->format = COMPRESSION_FORMAT_GZIP;
+		char* indexFileName = (char*) malloc(strlen(deviceFileName) + strlen(GZIP_INDEX_SUFFIX) + 1);
+		if (indexFileName == NULL)
+			handleError(L"openDevice",
+			            L"Unable to allocate memory for the storage device");
+		strcpy(indexFileName, deviceFileName);
+		strcat(indexFileName, GZIP_INDEX_SUFFIX);
+		if (!loadGzipIndex(compressedBackend, indexFileName, &status)) {
+			buildGzipIndex(compressedBackend);
+			saveGzipIndex(compressedBackend, indexFileName, &status);
+		}
+		free(indexFileName);
+	}
+	else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+		compressedBackend->format = COMPRESSION_FORMAT_ZSTD;
+#ifdef HAVE_ZSTD
+		loadZstdSeekTable(compressedBackend);
+#else
+		handleError(L"openDevice",
+		            L"This program was built without zstd support (make ZSTD=1)");
+#endif
+	}
+	else
+		handleError(L"openDevice",
+		            L"The storage device is not a gzip or zstd image");
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS NO FILE DESCRIPTOR FOR THE ASYNCHRONOUS
+	// READER, SINCE THE FILE DOES NOT HOLD THE IMAGE'S BYTES AS THEY ARE.
+	storage_backend_t* backend = allocateStorageBackend(compressedBackend);
+	backend->readExtents  = readCompressedExtents;
+	backend->getSize      = getCompressedSize;
+	backend->getBlockSize = getCompressedBlockSize;
+	backend->close        = closeCompressedBackend;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readCompressedExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	compressed_backend_t* compressedBackend = (compressed_backend_t*) backend->state;
+
+	pthread_mutex_lock(&(compressedBackend->cacheLock));
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint8_t* buffer   = extents[extentIndex].buffer;
+		uint64_t position = extents[extentIndex].byteOffset;
+		uint64_t end      = extents[extentIndex].byteOffset + extents[extentIndex].numBytes;
+
+		//
+		// VERIFY THE EXTENT IS ACTUALLY IN THE IMAGE.
+		if (end > compressedBackend->size || end < position)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+
+		//
+		// COPY THE EXTENT OUT OF EACH CHUNK IT TOUCHES IN TURN.
+		while (position < end) {
+			uint32_t chunkIndex  = findChunk(compressedBackend, position);
+			uint64_t chunkOffset = position - compressedBackend->chunks[chunkIndex].uncompressedOffset;
+			uint64_t numBytes    = getChunkLength(compressedBackend, chunkIndex) - chunkOffset;
+			if (numBytes > end - position)
+				numBytes = end - position;
+			memcpy(buffer, getDecompressedChunk(compressedBackend, chunkIndex) + chunkOffset, numBytes);
+			buffer   += numBytes;
+			position += numBytes;
+		}
+
+		extentIndex++;
+	}
+	pthread_mutex_unlock(&(compressedBackend->cacheLock));
+
+}
+
+
+uint64_t getCompressedSize(storage_backend_t* backend) {
+
+	return ((compressed_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getCompressedBlockSize(storage_backend_t* backend) {
+
+	//
+	// THERE IS NO PREFERRED SIZE, SINCE A WHOLE CHUNK IS DECOMPRESSED (AND
+	// CACHED) WHATEVER IS READ FROM IT.
+	(void) backend;
+	return 1;
+
+}
+
+
+void closeCompressedBackend(storage_backend_t* backend) {
+
+	compressed_backend_t* compressedBackend = (compressed_backend_t*) backend->state;
+
+	uint32_t index = 0;
+	while (index < COMPRESSED_CACHE_CHUNKS) {
+		free(compressedBackend->cache[index].data);
+		index++;
+	}
+	index = 0;
+	while (index < compressedBackend->numChunks) {
+		free(compressedBackend->chunks[index].window);
+		index++;
+	}
+	free(compressedBackend->chunks);
+	pthread_mutex_destroy(&(compressedBackend->cacheLock));
+	close(compressedBackend->fileDescriptor);
+	free(compressedBackend);
+	free(backend);
+
+}
+
+
+void buildGzipIndex(compressed_backend_t* compressedBackend) {
+
+	//
+	// SET UP TO DECOMPRESS THE GZIP STREAM.  THE WINDOW STARTS OUT AS ZEROS,
+	// SO THAT THE FIRST CHECKPOINT'S (UNUSED) WINDOW IS DEFINED.
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, 15 + 16) != Z_OK)
+		handleError(L"openDevice", L"Unable to start decompressing the storage device");
+	uint8_t* input  = (uint8_t*) malloc(COMPRESSED_INPUT_SIZE);
+	uint8_t* window = (uint8_t*) calloc(1, GZIP_WINDOW_SIZE);
+	if (input == NULL || window == NULL)
+		handleError(L"openDevice", L"Unable to allocate memory to index the storage device");
+
+	//
+	// DECOMPRESS ONE DEFLATE BLOCK AT A TIME, INTO THE CIRCULAR WINDOW.
+	uint64_t inputOffset = 0;
+	uint64_t totalIn = 0;
+	uint64_t totalOut = 0;
+	uint64_t lastCheckpoint = 0;
+	int result = Z_OK;
+	while (result != Z_STREAM_END) {
+
+		//
+		// READ IN MORE OF THE COMPRESSED FILE WHEN IT RUNS OUT.
+		if (stream.avail_in == 0) {
+			uint64_t numBytes = compressedBackend->compressedSize - inputOffset;
+			if (numBytes == 0)
+				handleError(L"openDevice", L"The compressed storage device is truncated");
+			if (numBytes > COMPRESSED_INPUT_SIZE)
+				numBytes = COMPRESSED_INPUT_SIZE;
+			preadCompressed(compressedBackend, input, numBytes, inputOffset);
+			inputOffset += numBytes;
+			stream.next_in  = input;
+			stream.avail_in = (uInt) numBytes;
+		}
+
+		//
+		// WRAP AROUND TO THE START OF THE WINDOW WHEN IT FILLS UP.
+		if (stream.avail_out == 0) {
+			stream.next_out  = window;
+			stream.avail_out = GZIP_WINDOW_SIZE;
+		}
+
+		//
+		// DECOMPRESS UP TO THE END OF THE CURRENT BLOCK.
+		totalIn  += stream.avail_in;
+		totalOut += stream.avail_out;
+		result = inflate(&stream, Z_BLOCK);
+		totalIn  -= stream.avail_in;
+		totalOut -= stream.avail_out;
+		if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+			handleError(L"openDevice", L"The compressed storage device is corrupt");
+
+		//
+		// AT THE END OF A BLOCK (BUT NOT THE LAST ONE), ADD A CHECKPOINT IF IT
+		// IS THE FIRST, OR IF IT HAS BEEN LONG ENOUGH SINCE THE LAST ONE.
+		if (result != Z_STREAM_END &&
+		    (stream.data_type & 128) && !(stream.data_type & 64) &&
+		    (compressedBackend->numChunks == 0 || totalOut - lastCheckpoint >= GZIP_INDEX_SPAN)) {
+			addGzipCheckpoint(compressedBackend, (uint32_t) (stream.data_type & 7),
+			                  totalIn, totalOut, stream.avail_out, window);
+			lastCheckpoint = totalOut;
+		}
+	}
+
+	//
+	// ONLY A SINGLE GZIP MEMBER IS SUPPORTED.
+	if (stream.avail_in != 0 || inputOffset != compressedBackend->compressedSize)
+		handleError(L"openDevice", L"Gzip images made of several members are not supported");
+
+	compressedBackend->size = totalOut;
+	inflateEnd(&stream);
+	free(input);
+	free(window);
+
+}
+
+
+void addGzipCheckpoint(compressed_backend_t* compressedBackend,
+                       uint32_t              bits,
+                       uint64_t              compressedOffset,
+                       uint64_t              uncompressedOffset,
+                       uint32_t              windowLeft,
+                       uint8_t*              window) {
+
+	//
+	// MAKE ROOM FOR THE CHECKPOINT.
+	if (compressedBackend->numChunks == compressedBackend->maxChunks) {
+		compressedBackend->maxChunks = (compressedBackend->maxChunks == 0) ? 16 : compressedBackend->maxChunks * 2;
+		compressedBackend->chunks = (compressed_chunk_t*)
+				realloc(compressedBackend->chunks, compressedBackend->maxChunks * sizeof(compressed_chunk_t));
+		if (compressedBackend->chunks == NULL)
+			handleError(L"openDevice", L"Unable to allocate memory to index the storage device");
+	}
+
+	//
+	// UNWRAP THE CIRCULAR WINDOW, SO THAT IT ENDS WITH THE LATEST OUTPUT.
+	uint8_t unwrapped[GZIP_WINDOW_SIZE];
+	memcpy(unwrapped, window + GZIP_WINDOW_SIZE - windowLeft, windowLeft);
+	memcpy(unwrapped + windowLeft, window, GZIP_WINDOW_SIZE - windowLeft);
+
+	//
+	// KEEP THE WINDOW COMPRESSED, SINCE THERE IS ONE FOR EVERY CHECKPOINT.
+	uLongf windowLength = compressBound(GZIP_WINDOW_SIZE);
+	uint8_t* compressedWindow = (uint8_t*) malloc(windowLength);
+	if (compressedWindow == NULL ||
+	    compress2(compressedWindow, &windowLength, unwrapped, GZIP_WINDOW_SIZE, Z_BEST_SPEED) != Z_OK)
+		handleError(L"openDevice", L"Unable to index the storage device");
+
+	compressed_chunk_t* chunk = &(compressedBackend->chunks[compressedBackend->numChunks]);
+	memset(chunk, 0, sizeof(compressed_chunk_t));
+	chunk->uncompressedOffset = uncompressedOffset;
+	chunk->compressedOffset   = compressedOffset;
+	chunk->bits               = bits;
+	chunk->windowLength       = (uint32_t) windowLength;
+	chunk->window             = (uint8_t*) realloc(compressedWindow, windowLength);
+	compressedBackend->numChunks++;
+
+}
+
+
+void saveGzipIndex(compressed_backend_t* compressedBackend, char* indexFileName, struct stat* status) {
+
+	FILE* indexFile = fopen(indexFileName, "wb");
+	if (indexFile == NULL)
+		return;
+
+	//
+	// THE HEADER IDENTIFIES THE IMAGE THE INDEX BELONGS TO.
+	uint64_t header[5];
+	header[0] = compressedBackend->compressedSize;
+	header[1] = (uint64_t) status->st_mtim.tv_sec;
+	header[2] = (uint64_t) status->st_mtim.tv_nsec;
+	header[3] = compressedBackend->size;
+	header[4] = ((uint64_t) GZIP_INDEX_SPAN << 32) | compressedBackend->numChunks;
+	uint8_t ok = (fwrite(GZIP_INDEX_MAGIC, 1, 8, indexFile) == 8 &&
+	              fwrite(header, sizeof(header), 1, indexFile) == 1);
+
+	//
+	// THEN COME THE CHECKPOINTS.
+	uint32_t chunkIndex = 0;
+	while (ok && chunkIndex < compressedBackend->numChunks) {
+		compressed_chunk_t* chunk = &(compressedBackend->chunks[chunkIndex]);
+		uint64_t fields[4] = { chunk->uncompressedOffset, chunk->compressedOffset,
+		                       chunk->bits, chunk->windowLength };
+		ok = (fwrite(fields, sizeof(fields), 1, indexFile) == 1 &&
+		      fwrite(chunk->window, 1, chunk->windowLength, indexFile) == chunk->windowLength);
+		chunkIndex++;
+	}
+
+	//
+	// NEVER LEAVE A PARTIAL INDEX BEHIND.
+	if (fclose(indexFile) != 0 || !ok)
+		unlink(indexFileName);
+
+}
+
+
+uint8_t loadGzipIndex(compressed_backend_t* compressedBackend, char* indexFileName, struct stat* status) {
+
+	FILE* indexFile = fopen(indexFileName, "rb");
+	if (indexFile == NULL)
+		return 0;
+
+	//
+	// CHECK THE INDEX WAS SAVED FOR THIS VERY IMAGE.
+	char magic[8];
+	uint64_t header[5];
+	if (fread(magic, 1, 8, indexFile) != 8 || memcmp(magic, GZIP_INDEX_MAGIC, 8) != 0 ||
+	    fread(header, sizeof(header), 1, indexFile) != 1 ||
+	    header[0] != compressedBackend->compressedSize ||
+	    header[1] != (uint64_t) status->st_mtim.tv_sec ||
+	    header[2] != (uint64_t) status->st_mtim.tv_nsec ||
+	    (header[4] >> 32) != GZIP_INDEX_SPAN ||
+	    (header[4] & 0xffffffff) == 0 ||
+	    (header[4] & 0xffffffff) > header[3] / GZIP_INDEX_SPAN + 1) {
+		fclose(indexFile);
+		return 0;
+	}
+
+	//
+	// READ IN THE CHECKPOINTS.  THEY MUST START AT THE START OF THE IMAGE,
+	// GO UP STRICTLY WITHIN IT, AND POINT INTO THE COMPRESSED FILE (PAST ITS
+	// FIRST BYTE, IF PART OF THE BYTE BEFORE THEM IS NEEDED).
+	uint32_t numChunks = (uint32_t) (header[4] & 0xffffffff);
+	compressed_chunk_t* chunks = (compressed_chunk_t*) calloc(numChunks, sizeof(compressed_chunk_t));
+	if (chunks == NULL)
+		handleError(L"openDevice", L"Unable to allocate memory to index the storage device");
+	uint8_t ok = 1;
+	uint32_t chunkIndex = 0;
+	while (ok && chunkIndex < numChunks) {
+		uint64_t fields[4];
+		ok = (fread(fields, sizeof(fields), 1, indexFile) == 1 &&
+		      fields[0] < header[3] &&
+		      (chunkIndex == 0 ? fields[0] == 0 : fields[0] > chunks[chunkIndex - 1].uncompressedOffset) &&
+		      fields[1] <= compressedBackend->compressedSize &&
+		      (fields[2] == 0 || fields[1] >= 1) &&
+		      fields[2] < 8 && fields[3] <= compressBound(GZIP_WINDOW_SIZE));
+		if (ok) {
+			chunks[chunkIndex].uncompressedOffset = fields[0];
+			chunks[chunkIndex].compressedOffset   = fields[1];
+			chunks[chunkIndex].bits               = (uint32_t) fields[2];
+			chunks[chunkIndex].windowLength       = (uint32_t) fields[3];
+			chunks[chunkIndex].window             = (uint8_t*) malloc(fields[3]);
+			ok = (chunks[chunkIndex].window != NULL &&
+			      fread(chunks[chunkIndex].window, 1, fields[3], indexFile) == fields[3]);
+			chunkIndex++;
+		}
+	}
+	fclose(indexFile);
+
+	//
+	// A DAMAGED INDEX IS SIMPLY REBUILT.
+	if (!ok) {
+		while (chunkIndex > 0) {
+			chunkIndex--;
+			free(chunks[chunkIndex].window);
+		}
+		free(chunks);
+		return 0;
+	}
+
+	compressedBackend->chunks    = chunks;
+	compressedBackend->numChunks = numChunks;
+	compressedBackend->maxChunks = numChunks;
+	compressedBackend->size      = header[3];
+	return 1;
+
+}
+
+
+void loadZstdSeekTable(compressed_backend_t* compressedBackend) {
+
+	//
+	// READ THE FOOTER AT THE VERY END OF THE FILE.
+	uint8_t footer[ZSTD_SEEK_TABLE_FOOTER];
+	if (compressedBackend->compressedSize < ZSTD_SKIPPABLE_HEADER + ZSTD_SEEK_TABLE_FOOTER)
+		handleError(L"openDevice", L"The zstd image has no seek table");
+	preadCompressed(compressedBackend, footer, ZSTD_SEEK_TABLE_FOOTER,
+	                compressedBackend->compressedSize - ZSTD_SEEK_TABLE_FOOTER);
+	uint32_t numFrames  = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((uint32_t) footer[3] << 24);
+	uint8_t  descriptor = footer[4];
+	uint32_t magic      = footer[5] | (footer[6] << 8) | (footer[7] << 16) | ((uint32_t) footer[8] << 24);
+	if (magic != ZSTD_SEEKABLE_MAGIC || numFrames == 0)
+		handleError(L"openDevice", L"The zstd image has no seek table");
+
+	//
+	// READ IN THE SEEK TABLE'S ENTRIES.
+	uint32_t entrySize  = (descriptor & ZSTD_SEEK_ENTRY_CHECKSUM) ? 12 : 8;
+	uint64_t tableSize  = (uint64_t) numFrames * entrySize;
+	if (tableSize > compressedBackend->compressedSize - ZSTD_SKIPPABLE_HEADER - ZSTD_SEEK_TABLE_FOOTER)
+		handleError(L"openDevice", L"The zstd image's seek table is corrupt");
+	uint64_t tableStart = compressedBackend->compressedSize - ZSTD_SEEK_TABLE_FOOTER - tableSize;
+	uint8_t* table = (uint8_t*) malloc(tableSize);
+	compressedBackend->chunks = (compressed_chunk_t*) calloc(numFrames, sizeof(compressed_chunk_t));
+	if (table == NULL || compressedBackend->chunks == NULL)
+		handleError(L"openDevice", L"Unable to allocate memory for the zstd seek table");
+	preadCompressed(compressedBackend, table, tableSize, tableStart);
+
+	//
+	// THE FRAMES FOLLOW ONE ANOTHER FROM THE START OF THE FILE, IN BOTH THE
+	// COMPRESSED FILE AND THE DECOMPRESSED IMAGE.
+	uint64_t compressedOffset = 0;
+	uint64_t uncompressedOffset = 0;
+	uint32_t frameIndex = 0;
+	while (frameIndex < numFrames) {
+		uint8_t* entry = table + ((uint64_t) frameIndex * entrySize);
+		compressed_chunk_t* chunk = &(compressedBackend->chunks[frameIndex]);
+		chunk->compressedOffset   = compressedOffset;
+		chunk->uncompressedOffset = uncompressedOffset;
+		chunk->compressedLength   = entry[0] | (entry[1] << 8) | (entry[2] << 16) | ((uint32_t) entry[3] << 24);
+		compressedOffset   += chunk->compressedLength;
+		uncompressedOffset += entry[4] | (entry[5] << 8) | (entry[6] << 16) | ((uint32_t) entry[7] << 24);
+		frameIndex++;
+	}
+	free(table);
+	if (compressedOffset > tableStart - ZSTD_SKIPPABLE_HEADER)
+		handleError(L"openDevice", L"The zstd image's seek table is corrupt");
+
+	compressedBackend->numChunks = numFrames;
+	compressedBackend->maxChunks = numFrames;
+	compressedBackend->size      = uncompressedOffset;
+
+}
+
+
+uint32_t findChunk(compressed_backend_t* compressedBackend, uint64_t byteOffset) {
+
+	//
+	// BINARY SEARCH FOR THE LAST CHUNK THAT STARTS AT OR BEFORE THE OFFSET.
+	uint32_t low  = 0;
+	uint32_t high = compressedBackend->numChunks;
+	while (high - low > 1) {
+		uint32_t middle = low + (high - low) / 2;
+		if (compressedBackend->chunks[middle].uncompressedOffset <= byteOffset)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+
+}
+
+
+uint64_t getChunkLength(compressed_backend_t* compressedBackend, uint32_t chunkIndex) {
+
+	uint64_t chunkEnd = (chunkIndex + 1 < compressedBackend->numChunks) ?
+	                    compressedBackend->chunks[chunkIndex + 1].uncompressedOffset :
+	                    compressedBackend->size;
+	return chunkEnd - compressedBackend->chunks[chunkIndex].uncompressedOffset;
+
+}
+
+
+uint8_t* getDecompressedChunk(compressed_backend_t* compressedBackend, uint32_t chunkIndex) {
+
+	compressedBackend->useCounter++;
+
+	//
+	// LOOK FOR THE CHUNK IN THE CACHE, KEEPING TRACK OF WHICH ENTRY TO REPLACE
+	// IF IT IS NOT THERE (AN EMPTY ONE, OR ELSE THE LEAST RECENTLY USED ONE).
+	cached_chunk_t* victim = &(compressedBackend->cache[0]);
+	uint32_t cacheIndex = 0;
+	while (cacheIndex < COMPRESSED_CACHE_CHUNKS) {
+		cached_chunk_t* entry = &(compressedBackend->cache[cacheIndex]);
+		if (entry->data != NULL && entry->chunkIndex == chunkIndex) {
+			entry->lastUsed = compressedBackend->useCounter;
+			return entry->data;
+		}
+		if (victim->data != NULL &&
+		    (entry->data == NULL || entry->lastUsed < victim->lastUsed))
+			victim = entry;
+		cacheIndex++;
+	}
+
+	//
+	// DECOMPRESS THE CHUNK INTO THE ENTRY BEING REPLACED.
+	free(victim->data);
+	victim->data = (uint8_t*) malloc(getChunkLength(compressedBackend, chunkIndex));
+	if (victim->data == NULL)
+		handleError(L"readSectors", L"Unable to allocate memory to decompress the storage device");
+	if (compressedBackend->format == COMPRESSION_FORMAT_GZIP)
+		decompressGzipChunk(compressedBackend, chunkIndex, victim->data);
+	else
+		decompressZstdChunk(compressedBackend, chunkIndex, victim->data);
+	victim->chunkIndex = chunkIndex;
+	victim->lastUsed   = compressedBackend->useCounter;
+	return victim->data;
+
+}
+
+
+void decompressGzipChunk(compressed_backend_t* compressedBackend, uint32_t chunkIndex, uint8_t* buffer) {
+
+	compressed_chunk_t* chunk = &(compressedBackend->chunks[chunkIndex]);
+
+	//
+	// START A RAW DEFLATE STREAM AT THE CHECKPOINT.  IF THE CHECKPOINT IS IN
+	// THE MIDDLE OF A BYTE, THE REST OF THAT BYTE IS PRIMED FIRST.
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, -15) != Z_OK)
+		handleError(L"readSectors", L"Unable to start decompressing the storage device");
+	uint64_t inputOffset = chunk->compressedOffset;
+	if (chunk->bits != 0) {
+		uint8_t byte;
+		preadCompressed(compressedBackend, &byte, 1, inputOffset - 1);
+		inflatePrime(&stream, (int) chunk->bits, byte >> (8 - chunk->bits));
+	}
+
+	//
+	// GIVE IT THE 32 KiB OF OUTPUT THAT CAME BEFORE THE CHECKPOINT.
+	uint8_t dictionary[GZIP_WINDOW_SIZE];
+	uLongf dictionaryLength = GZIP_WINDOW_SIZE;
+	if (uncompress(dictionary, &dictionaryLength, chunk->window, chunk->windowLength) != Z_OK ||
+	    inflateSetDictionary(&stream, dictionary, (uInt) dictionaryLength) != Z_OK)
+		handleError(L"readSectors", L"The compressed storage device's index is corrupt");
+
+	//
+	// DECOMPRESS UNTIL THE WHOLE CHUNK IS OUT.
+	uint8_t* input = (uint8_t*) malloc(COMPRESSED_INPUT_SIZE);
+	if (input == NULL)
+		handleError(L"readSectors", L"Unable to allocate memory to decompress the storage device");
+	stream.next_out  = buffer;
+	stream.avail_out = (uInt) getChunkLength(compressedBackend, chunkIndex);
+	while (stream.avail_out > 0) {
+		if (stream.avail_in == 0) {
+			uint64_t numBytes = compressedBackend->compressedSize - inputOffset;
+			if (numBytes > COMPRESSED_INPUT_SIZE)
+				numBytes = COMPRESSED_INPUT_SIZE;
+			if (numBytes == 0)
+				break;
+			preadCompressed(compressedBackend, input, numBytes, inputOffset);
+			inputOffset += numBytes;
+			stream.next_in  = input;
+			stream.avail_in = (uInt) numBytes;
+		}
+		int result = inflate(&stream, Z_NO_FLUSH);
+		if (result == Z_STREAM_END)
+			break;
+		if (result != Z_OK && result != Z_BUF_ERROR)
+			handleError(L"readSectors", L"The compressed storage device is corrupt");
+	}
+	if (stream.avail_out != 0)
+		handleError(L"readSectors", L"The compressed storage device is corrupt");
+
+	inflateEnd(&stream);
+	free(input);
+
+}
+
+
+void decompressZstdChunk(compressed_backend_t* compressedBackend, uint32_t chunkIndex, uint8_t* buffer) {
+
+#ifdef HAVE_ZSTD
+
+	compressed_chunk_t* chunk = &(compressedBackend->chunks[chunkIndex]);
+
+	//
+	// READ IN THE WHOLE FRAME, AND DECOMPRESS IT IN ONE GO.
+	uint8_t* frame = (uint8_t*) malloc(chunk->compressedLength);
+	if (frame == NULL)
+		handleError(L"readSectors", L"Unable to allocate memory to decompress the storage device");
+	preadCompressed(compressedBackend, frame, chunk->compressedLength, chunk->compressedOffset);
+	uint64_t chunkLength = getChunkLength(compressedBackend, chunkIndex);
+	size_t result = ZSTD_decompress(buffer, chunkLength, frame, chunk->compressedLength);
+	if (ZSTD_isError(result) || result != chunkLength)
+		handleError(L"readSectors", L"The compressed storage device is corrupt");
+	free(frame);
+
+#else
+
+	(void) compressedBackend;
+	(void) chunkIndex;
+	(void) buffer;
+	handleError(L"readSectors", L"This program was built without zstd support (make ZSTD=1)");
+
+#endif
+
+}
+
+
+void preadCompressed(compressed_backend_t* compressedBackend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset) {
+
+	uint64_t numRead = 0;
+	while (numRead < numBytes) {
+		ssize_t result = pread(compressedBackend->fileDescriptor, buffer + numRead,
+		                       numBytes - numRead, (off_t) (byteOffset + numRead));
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		numRead += (uint64_t) result;
+	}
+
+}
@@ -0,0 +1,70 @@
+/******************************************************************************
+ * This file contains the
+ *                         COMPRESSED BACKEND
+ * which reads a compressed image, decompressing only the parts that are read.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_COMPRESSED_H_
+#define BACKEND_COMPRESSED_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+//
+// CONSTANTS
+//
+
+// HOW MUCH DECOMPRESSED DATA THERE IS BETWEEN THE CHECKPOINTS OF A GZIP INDEX
+// (AT LEAST).
+#define GZIP_INDEX_SPAN (1024 * 1024)
+
+// THE NUMBER OF DECOMPRESSED CHUNKS (FRAMES OR CHECKPOINT SPANS) KEPT IN THE
+// BACKEND'S CACHE.
+#define COMPRESSED_CACHE_CHUNKS 8
+
+
+
+
+/*
+ * Opens a compressed image, which is split into chunks that can each be
+ * decompressed on their own.  Reads then only decompress the chunks they
+ * touch, and the most recently used chunks are kept decompressed in a small
+ * cache.  Two formats are understood:
+ *
+ *   - gzip.  The first time an image is opened, it is decompressed once from
+ *     start to end, and a checkpoint (the position in the compressed stream
+ *     and the 32 KiB of output before it) is recorded every GZIP_INDEX_SPAN
+ *     bytes.  The index is saved next to the image (with ".gzidx" appended to
+ *     its name) if possible, and reused as long as the image is unchanged.
+ *
+ *   - Seekable zstd (independent frames followed by a seek table).  The frames
+ *     are found through the seek table.  This is only available if the
+ *     program was built with zstd (make ZSTD=1).
+ */
+storage_backend_t* openCompressedBackend(char* deviceFileName);
+
+
+
+
+#endif
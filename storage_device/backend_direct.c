@@ -0,0 +1,364 @@
+/******************************************************************************
+ * This file contains the
+ *                           DIRECT BACKEND
+ * which reads the storage device with O_DIRECT, bypassing the page cache.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// O_DIRECT IS A GNU EXTENSION, AND MUST BE REQUESTED BEFORE ANY HEADER IS
+// INCLUDED.
+//
+#define _GNU_SOURCE
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_direct.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX & LINUX
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE ALIGNMENT USED WHEN THE DEVICE DOES NOT REPORT ONE.
+#define DEFAULT_DIRECT_IO_ALIGNMENT 4096
+
+
+
+
+/*
+ * A data structure used to store a device opened for direct reads, along with
+ * its pool of aligned buffers.
+ */
+typedef struct {
+
+	int             fileDescriptor;                      // The device, opened with O_DIRECT.
+	uint64_t        size;                                // The size of the device (in bytes).
+	uint32_t        alignment;                           // The required alignment (in bytes).
+	uint8_t*        buffers[DIRECT_IO_POOL_SIZE];        // The aligned buffers (allocated on first use).
+	uint8_t         inUse[DIRECT_IO_POOL_SIZE];          // Set to 1 while a buffer is handed out.
+	pthread_mutex_t poolLock;                            // Guards the pool.
+	pthread_cond_t  bufferFree;                          // Signalled when a buffer is returned.
+
+} direct_backend_t;
+
+
+/*
+ * The direct backend's operations (see storage_backend.h).
+ */
+void     readDirectExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getDirectSize(storage_backend_t* backend);
+uint32_t getDirectBlockSize(storage_backend_t* backend);
+void     closeDirectBackend(storage_backend_t* backend);
+
+
+/*
+ * Used to read a range of bytes that need not be aligned.  The read is widened
+ * to the alignment boundaries and bounced through an aligned buffer, unless
+ * it is already aligned.
+ */
+void readDirectBytes(direct_backend_t* directBackend,
+                     uint8_t*          buffer,
+                     uint64_t          byteOffset,
+                     uint64_t          numBytes);
+
+
+/*
+ * Used to take an aligned buffer from the pool, waiting for one if they are
+ * all in use.
+ */
+uint8_t* acquireAlignedBuffer(direct_backend_t* directBackend);
+
+
+/*
+ * Used to return an aligned buffer to the pool.
+ */
+void releaseAlignedBuffer(direct_backend_t* directBackend, uint8_t* buffer);
+
+
+/*
+ * Used to read an aligned range of the device, no matter how many calls it
+ * takes.  Returns the number of bytes read, which is only less than requested
+ * at the end of the device.
+ */
+uint64_t preadAligned(direct_backend_t* directBackend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openDirectBackend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE STRUCT.
+	direct_backend_t* directBackend = (direct_backend_t*) calloc(1, sizeof(direct_backend_t));
+	if (directBackend == NULL)
+		handleError(L"openDirectBackend", L"Unable to allocate memory for the storage device");
+
+	//
+	// OPEN THE DEVICE, BYPASSING THE PAGE CACHE.
+	directBackend->fileDescriptor = open(deviceFileName, O_RDONLY | O_DIRECT);
+	if (directBackend->fileDescriptor < 0)
+		handleError(L"openDirectBackend", L"The storage device could not be opened for direct reads");
+
+	//
+	// GET THE SIZE OF THE DEVICE.
+	off_t size = lseek(directBackend->fileDescriptor, 0, SEEK_END);
+	if (size <= 0)
+		handleError(L"openDirectBackend", L"Unable to determine the size of the storage device");
+	directBackend->size = (uint64_t) size;
+
+	//
+	// GET THE ALIGNMENT.  A BLOCK DEVICE REPORTS ITS LOGICAL BLOCK SIZE; FOR AN
+	// IMAGE FILE, THE FILESYSTEM'S PREFERRED I/O SIZE IS ALWAYS A MULTIPLE OF
+	// THE UNDERLYING DEVICE'S LOGICAL BLOCK SIZE.
+	struct stat status;
+	int logicalBlockSize = 0;
+	directBackend->alignment = DEFAULT_DIRECT_IO_ALIGNMENT;
+	if (fstat(directBackend->fileDescriptor, &status) == 0) {
+		if (S_ISBLK(status.st_mode) &&
+		    ioctl(directBackend->fileDescriptor, BLKSSZGET, &logicalBlockSize) == 0 &&
+		    logicalBlockSize > 0)
+			directBackend->alignment = (uint32_t) logicalBlockSize;
+		else if (!S_ISBLK(status.st_mode) && status.st_blksize > 0)
+			directBackend->alignment = (uint32_t) status.st_blksize;
+	}
+
+	//
+	// THE ALIGNMENT MUST BE A POWER OF TWO THAT DIVIDES THE BUFFER SIZE.
+	if ((directBackend->alignment & (directBackend->alignment - 1)) != 0 ||
+	    directBackend->alignment > DIRECT_IO_BUFFER_SIZE)
+		handleError(L"openDirectBackend", L"Unsupported direct I/O alignment");
+
+	//
+	// SET UP THE (EMPTY) BUFFER POOL.
+	pthread_mutex_init(&(directBackend->poolLock), NULL);
+	pthread_cond_init(&(directBackend->bufferFree), NULL);
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS NO DESCRIPTOR FOR THE ASYNCHRONOUS
+	// READER, SINCE IT WOULD READ INTO THE CALLER'S (UNALIGNED) BUFFERS, AND
+	// NO PREFETCHING, SINCE THE PAGE CACHE IS NEVER USED.
+	storage_backend_t* backend = allocateStorageBackend(directBackend);
+	backend->readExtents  = readDirectExtents;
+	backend->getSize      = getDirectSize;
+	backend->getBlockSize = getDirectBlockSize;
+	backend->close        = closeDirectBackend;
+	return backend;
+
+}
+
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readDirectExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		readDirectBytes((direct_backend_t*) backend->state,
+		                extents[extentIndex].buffer,
+		                extents[extentIndex].byteOffset,
+		                extents[extentIndex].numBytes);
+		extentIndex++;
+	}
+
+}
+
+
+uint64_t getDirectSize(storage_backend_t* backend) {
+
+	return ((direct_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getDirectBlockSize(storage_backend_t* backend) {
+
+	return ((direct_backend_t*) backend->state)->alignment;
+
+}
+
+
+void closeDirectBackend(storage_backend_t* backend) {
+
+	direct_backend_t* directBackend = (direct_backend_t*) backend->state;
+
+	uint32_t bufferIndex = 0;
+	while (bufferIndex < DIRECT_IO_POOL_SIZE) {
+		free(directBackend->buffers[bufferIndex]);
+		bufferIndex++;
+	}
+	pthread_mutex_destroy(&(directBackend->poolLock));
+	pthread_cond_destroy(&(directBackend->bufferFree));
+	close(directBackend->fileDescriptor);
+	free(directBackend);
+	free(backend);
+
+}
+
+
+void readDirectBytes(direct_backend_t* directBackend,
+                     uint8_t*          buffer,
+                     uint64_t          byteOffset,
+                     uint64_t          numBytes) {
+
+	uint64_t alignmentMask = (uint64_t) directBackend->alignment - 1;
+
+	//
+	// IF EVERYTHING IS ALREADY ALIGNED, READ STRAIGHT INTO THE CALLER'S BUFFER.
+	if (((uintptr_t) buffer & alignmentMask) == 0 &&
+	    (byteOffset & alignmentMask) == 0 &&
+	    (numBytes & alignmentMask) == 0) {
+		if (preadAligned(directBackend, buffer, numBytes, byteOffset) != numBytes)
+			handleError(L"readSectors", L"Unable to read in requested sectors");
+		return;
+	}
+
+	//
+	// OTHERWISE, BOUNCE THE READ THROUGH AN ALIGNED BUFFER, ONE BUFFER-FULL
+	// AT A TIME.
+	uint8_t* alignedBuffer = acquireAlignedBuffer(directBackend);
+	while (numBytes > 0) {
+
+		//
+		// WIDEN THE START OF THE READ DOWN TO AN ALIGNMENT BOUNDARY.
+		uint64_t alignedOffset = byteOffset & ~alignmentMask;
+		uint64_t leadingBytes  = byteOffset - alignedOffset;
+
+		//
+		// TAKE AS MUCH AS FITS IN THE BUFFER, THEN WIDEN THE END OF THE READ
+		// UP TO AN ALIGNMENT BOUNDARY.
+		uint64_t chunkBytes = DIRECT_IO_BUFFER_SIZE - leadingBytes;
+		if (chunkBytes > numBytes)
+			chunkBytes = numBytes;
+		uint64_t alignedLength = (leadingBytes + chunkBytes + alignmentMask) & ~alignmentMask;
+
+		//
+		// READ, THEN COPY OUT JUST THE PART THAT WAS ASKED FOR.  THE DEVICE MAY
+		// END BEFORE THE WIDENED END, WHICH IS FINE.
+		if (preadAligned(directBackend, alignedBuffer, alignedLength, alignedOffset) < leadingBytes + chunkBytes)
+			handleError(L"readSectors", L"Unable to read in requested sectors");
+		memcpy(buffer, alignedBuffer + leadingBytes, chunkBytes);
+
+		buffer     += chunkBytes;
+		byteOffset += chunkBytes;
+		numBytes   -= chunkBytes;
+	}
+	releaseAlignedBuffer(directBackend, alignedBuffer);
+
+}
+
+
+uint8_t* acquireAlignedBuffer(direct_backend_t* directBackend) {
+
+	pthread_mutex_lock(&(directBackend->poolLock));
+	while (1) {
+
+		//
+		// HAND OUT THE FIRST BUFFER THAT IS NOT IN USE, ALLOCATING IT IF THIS
+		// IS THE FIRST TIME IT IS NEEDED.
+		uint32_t bufferIndex = 0;
+		while (bufferIndex < DIRECT_IO_POOL_SIZE) {
+			if (!directBackend->inUse[bufferIndex]) {
+				if (directBackend->buffers[bufferIndex] == NULL &&
+				    posix_memalign((void**) &(directBackend->buffers[bufferIndex]),
+				                   directBackend->alignment, DIRECT_IO_BUFFER_SIZE) != 0)
+					handleError(L"readSectors", L"Unable to allocate an aligned buffer");
+				directBackend->inUse[bufferIndex] = 1;
+				pthread_mutex_unlock(&(directBackend->poolLock));
+				return directBackend->buffers[bufferIndex];
+			}
+			bufferIndex++;
+		}
+
+		//
+		// EVERY BUFFER IS IN USE, SO WAIT FOR ONE TO COME BACK.
+		pthread_cond_wait(&(directBackend->bufferFree), &(directBackend->poolLock));
+	}
+
+}
+
+
+void releaseAlignedBuffer(direct_backend_t* directBackend, uint8_t* buffer) {
+
+	pthread_mutex_lock(&(directBackend->poolLock));
+	uint32_t bufferIndex = 0;
+	while (bufferIndex < DIRECT_IO_POOL_SIZE) {
+		if (directBackend->buffers[bufferIndex] == buffer)
+			directBackend->inUse[bufferIndex] = 0;
+		bufferIndex++;
+	}
+	pthread_cond_signal(&(directBackend->bufferFree));
+	pthread_mutex_unlock(&(directBackend->poolLock));
+
+}
+
+
+uint64_t preadAligned(direct_backend_t* directBackend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset) {
+
+	uint64_t numRead = 0;
+	while (numRead < numBytes) {
+		ssize_t result = pread(directBackend->fileDescriptor, buffer + numRead,
+		                       numBytes - numRead, (off_t) (byteOffset + numRead));
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0)
+			handleError(L"readSectors", L"Unable to read in requested sectors");
+		numRead += (uint64_t) result;
+
+		//
+		// A SHORT READ ONLY HAPPENS AT THE END OF THE DEVICE, WHICH MAY LEAVE
+		// US AT AN UNALIGNED OFFSET THAT CANNOT BE READ FROM AGAIN.
+		if (result == 0 || (numRead & ((uint64_t) directBackend->alignment - 1)) != 0)
+			break;
+	}
+	return numRead;
+
+}
@@ -0,0 +1,60 @@
+/******************************************************************************
+ * This file contains the
+ *                           DIRECT BACKEND
+ * which reads the storage device with O_DIRECT, bypassing the page cache.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_DIRECT_H_
+#define BACKEND_DIRECT_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+//
+// CONSTANTS
+//
+
+// THE SIZE OF EACH ALIGNED BUFFER IN THE POOL.  READS LARGER THAN THIS ARE
+// SPLIT INTO SEVERAL DEVICE REQUESTS.
+#define DIRECT_IO_BUFFER_SIZE (1024 * 1024)
+
+// THE NUMBER OF ALIGNED BUFFERS IN THE POOL.
+#define DIRECT_IO_POOL_SIZE 4
+
+
+
+
+/*
+ * Opens the specified device or image file with O_DIRECT, so that reads
+ * bypass the page cache entirely.  The required alignment (which is also the
+ * backend's block size) is taken from the logical block size of a block
+ * device, or from the preferred I/O size of an image file.
+ *
+ * Neither the offset, the length, nor the buffer of a read need to be
+ * aligned: unaligned reads are widened to the alignment boundaries and copied
+ * out of a buffer from a pool of aligned buffers.
+ */
+storage_backend_t* openDirectBackend(char* deviceFileName);
+
+
+
+
+#endif
@@ -0,0 +1,773 @@
+/******************************************************************************
+ * This file contains the
+ *                            HTTP BACKEND
+ * which reads an image from a web server with HTTP/1.1 range requests.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// strcasestr IS A GNU EXTENSION, AND MUST BE REQUESTED BEFORE ANY HEADER IS
+// INCLUDED.
+//
+#define _GNU_SOURCE
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_http.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE SIZE OF EACH CONNECTION'S RECEIVE BUFFER, WHICH HOLDS THE HEADERS OF A
+// RESPONSE (BODIES ARE RECEIVED STRAIGHT INTO THE CALLER'S BUFFER).
+#define HTTP_BUFFER_SIZE (16 * 1024)
+
+// THE LONGEST HEADER LINE THAT IS KEPT (LONGER LINES ARE CUT SHORT).
+#define HTTP_MAX_LINE 1024
+
+
+
+
+/*
+ * A data structure used to store one connection to the server.
+ */
+typedef struct {
+
+	int      socket;                       // The connection (-1 if it is closed).
+	uint8_t  buffer[HTTP_BUFFER_SIZE];     // What has been received but not yet used.
+	uint32_t bufferStart;                  // The first unused byte in the buffer.
+	uint32_t bufferEnd;                    // The end of what has been received.
+
+} http_connection_t;
+
+
+/*
+ * A data structure used to store the state of the HTTP backend.
+ */
+typedef struct {
+
+	char*              hostHeader;         // The "host[:port]" part of the URL.
+	char*              path;               // The image's path on the server.
+	struct addrinfo*   addresses;          // The server's addresses.
+	uint64_t           size;               // The size of the image (in bytes).
+	http_connection_t* connections;        // The connections to the server.
+	uint32_t           numConnections;     // The number of connections.
+	uint32_t*          idleConnections;    // A stack of the connections not in use.
+	uint32_t           numIdle;            // The number of connections on the stack.
+	pthread_mutex_t    poolLock;           // Guards the stack.
+	pthread_cond_t     connectionFreed;    // Signalled when a connection goes back on the stack.
+
+} http_backend_t;
+
+
+/*
+ * A data structure used to store one range request, and the pieces of the
+ * caller's extents that it covers.
+ */
+typedef struct {
+
+	uint64_t       byteOffset;             // Where the range starts in the image.
+	uint64_t       numBytes;               // The length of the range.
+	byte_extent_t* pieces;                 // The pieces it covers, in order.
+	uint32_t       numPieces;              // The number of pieces.
+
+} http_request_t;
+
+
+/*
+ * A data structure used to store the requests of one read, which are shared
+ * out between several threads.
+ */
+typedef struct {
+
+	http_backend_t* httpBackend;
+	http_request_t* requests;
+	uint32_t        numRequests;
+	uint32_t        nextRequest;           // The first request no thread has taken yet.
+	pthread_mutex_t lock;                  // Guards "nextRequest".
+
+} http_batch_t;
+
+
+/*
+ * The HTTP backend's operations (see storage_backend.h).
+ */
+void     readHttpExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getHttpSize(storage_backend_t* backend);
+uint32_t getHttpBlockSize(storage_backend_t* backend);
+void     closeHttpBackend(storage_backend_t* backend);
+
+
+/*
+ * Used to split a URL into the server's name and port, and the image's path.
+ */
+void parseHttpUrl(http_backend_t* httpBackend, char* url);
+
+
+/*
+ * The main loop of each thread working through a batch of requests.
+ */
+void* httpWorker(void* argument);
+
+
+/*
+ * Used to carry out a request, and hand each of its pieces its bytes.
+ */
+void performHttpRequest(http_backend_t* httpBackend, http_request_t* request);
+
+
+/*
+ * Used to fetch a range of the image into a buffer over one of the idle
+ * connections, waiting for one if they are all busy.  If "totalSize" is not
+ * NULL, it is set to the size of the whole image.
+ */
+void fetchHttpRange(http_backend_t* httpBackend,
+                    uint8_t*        buffer,
+                    uint64_t        byteOffset,
+                    uint64_t        numBytes,
+                    uint64_t*       totalSize);
+
+
+/*
+ * Used to send a range request over the given connection (connecting it first
+ * if need be), and receive the answer.  Returns 0 if the server could not be
+ * reached, or closed the connection before answering (which a server may do
+ * to a kept-alive connection at any time), so that the request can be tried
+ * again on a new connection.
+ */
+uint8_t tryHttpRange(http_backend_t*    httpBackend,
+                     http_connection_t* connection,
+                     uint8_t*           buffer,
+                     uint64_t           byteOffset,
+                     uint64_t           numBytes,
+                     uint64_t*          totalSize);
+
+
+/*
+ * Used to open and close a connection to the server.  Connecting returns 0 if
+ * none of the server's addresses answered.
+ */
+uint8_t connectHttp(http_backend_t* httpBackend, http_connection_t* connection);
+void    disconnectHttp(http_connection_t* connection);
+
+
+/*
+ * Used to receive from a connection.  A line is received without its line
+ * ending.  Both return 0 if the connection was closed or failed first.
+ */
+uint8_t receiveHttpLine(http_connection_t* connection, char* line);
+uint8_t receiveHttpBytes(http_connection_t* connection, uint8_t* buffer, uint64_t numBytes);
+
+
+/*
+ * Used to order extents by where they start in the image (for qsort).
+ */
+int compareByteExtents(const void* first, const void* second);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openHttpBackend(char* url, uint32_t numConnections) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	http_backend_t* httpBackend = (http_backend_t*) calloc(1, sizeof(http_backend_t));
+	if (httpBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	pthread_mutex_init(&(httpBackend->poolLock), NULL);
+	pthread_cond_init(&(httpBackend->connectionFreed), NULL);
+
+	//
+	// FIND THE SERVER.
+	parseHttpUrl(httpBackend, url);
+
+	//
+	// SET UP THE CONNECTIONS, ALL IDLE.  THEY ARE ONLY OPENED WHEN THEY ARE
+	// FIRST NEEDED.
+	if (numConnections == 0)
+		numConnections = HTTP_DEFAULT_CONNECTIONS;
+	httpBackend->numConnections  = numConnections;
+	httpBackend->connections     = (http_connection_t*) calloc(numConnections, sizeof(http_connection_t));
+	httpBackend->idleConnections = (uint32_t*) calloc(numConnections, sizeof(uint32_t));
+	if (httpBackend->connections == NULL || httpBackend->idleConnections == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	while (httpBackend->numIdle < numConnections) {
+		httpBackend->connections[httpBackend->numIdle].socket = -1;
+		httpBackend->idleConnections[httpBackend->numIdle] = httpBackend->numIdle;
+		httpBackend->numIdle++;
+	}
+
+	//
+	// FETCH THE FIRST BYTE, BOTH TO LEARN THE SIZE OF THE IMAGE AND TO MAKE
+	// SURE THE SERVER ANSWERS RANGE REQUESTS.
+	uint8_t firstByte;
+	uint64_t totalSize = 0;
+	fetchHttpRange(httpBackend, &firstByte, 0, 1, &totalSize);
+	if (totalSize == 0)
+		handleError(L"openDevice",
+		            L"The web server did not give the size of the image");
+	httpBackend->size = totalSize;
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS NO FILE DESCRIPTOR FOR THE ASYNCHRONOUS
+	// READER, AND NOTHING TO ADVISE.
+	storage_backend_t* backend = allocateStorageBackend(httpBackend);
+	backend->readExtents  = readHttpExtents;
+	backend->getSize      = getHttpSize;
+	backend->getBlockSize = getHttpBlockSize;
+	backend->close        = closeHttpBackend;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readHttpExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	http_backend_t* httpBackend = (http_backend_t*) backend->state;
+
+	//
+	// VERIFY THE EXTENTS ARE ACTUALLY IN THE IMAGE, AND COUNT THE PIECES THEY
+	// MUST BE SPLIT INTO SO THAT NO REQUEST IS TOO LARGE.
+	uint64_t numPieces = 0;
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint64_t end = extents[extentIndex].byteOffset + extents[extentIndex].numBytes;
+		if (end > httpBackend->size || end < extents[extentIndex].byteOffset)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		numPieces += (extents[extentIndex].numBytes + HTTP_MAX_REQUEST_SIZE - 1) / HTTP_MAX_REQUEST_SIZE;
+		extentIndex++;
+	}
+	if (numPieces == 0)
+		return;
+
+	//
+	// SPLIT THE EXTENTS UP, AND PUT THE PIECES IN ORDER.
+	byte_extent_t*  pieces   = (byte_extent_t*) malloc(numPieces * sizeof(byte_extent_t));
+	http_request_t* requests = (http_request_t*) malloc(numPieces * sizeof(http_request_t));
+	if (pieces == NULL || requests == NULL)
+		handleError(L"readSectors",
+		            L"Unable to allocate memory for the requests");
+	uint64_t pieceIndex = 0;
+	extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint64_t position = 0;
+		while (position < extents[extentIndex].numBytes) {
+			uint64_t numBytes = extents[extentIndex].numBytes - position;
+			if (numBytes > HTTP_MAX_REQUEST_SIZE)
+				numBytes = HTTP_MAX_REQUEST_SIZE;
+			pieces[pieceIndex].byteOffset = extents[extentIndex].byteOffset + position;
+			pieces[pieceIndex].numBytes   = numBytes;
+			pieces[pieceIndex].buffer     = extents[extentIndex].buffer + position;
+			pieceIndex++;
+			position += numBytes;
+		}
+		extentIndex++;
+	}
+	qsort(pieces, numPieces, sizeof(byte_extent_t), compareByteExtents);
+
+	//
+	// COALESCE PIECES THAT LIE CLOSE TOGETHER INTO ONE REQUEST, AS LONG AS
+	// THE REQUEST DOES NOT GROW TOO LARGE.
+	uint32_t numRequests = 0;
+	pieceIndex = 0;
+	while (pieceIndex < numPieces) {
+		byte_extent_t* piece = &(pieces[pieceIndex]);
+		uint64_t pieceEnd = piece->byteOffset + piece->numBytes;
+		http_request_t* request = (numRequests > 0) ? &(requests[numRequests - 1]) : NULL;
+		if (request != NULL &&
+		    piece->byteOffset <= request->byteOffset + request->numBytes + HTTP_COALESCE_GAP &&
+		    pieceEnd - request->byteOffset <= HTTP_MAX_REQUEST_SIZE) {
+			if (pieceEnd > request->byteOffset + request->numBytes)
+				request->numBytes = pieceEnd - request->byteOffset;
+			request->numPieces++;
+		}
+		else {
+			request = &(requests[numRequests]);
+			request->byteOffset = piece->byteOffset;
+			request->numBytes   = piece->numBytes;
+			request->pieces     = piece;
+			request->numPieces  = 1;
+			numRequests++;
+		}
+		pieceIndex++;
+	}
+
+	//
+	// SHARE THE REQUESTS OUT BETWEEN AS MANY THREADS AS THERE ARE
+	// CONNECTIONS (THIS ONE INCLUDED).  IF A THREAD CANNOT BE STARTED, THE
+	// OTHERS JUST DO MORE OF THE WORK.
+	http_batch_t batch;
+	batch.httpBackend = httpBackend;
+	batch.requests    = requests;
+	batch.numRequests = numRequests;
+	batch.nextRequest = 0;
+	pthread_mutex_init(&(batch.lock), NULL);
+	uint32_t numThreads = (numRequests < httpBackend->numConnections) ? numRequests : httpBackend->numConnections;
+	pthread_t* threads = NULL;
+	uint32_t numStarted = 0;
+	if (numThreads > 1)
+		threads = (pthread_t*) malloc((numThreads - 1) * sizeof(pthread_t));
+	while (threads != NULL && numStarted < numThreads - 1 &&
+	       pthread_create(&(threads[numStarted]), NULL, httpWorker, &batch) == 0)
+		numStarted++;
+	httpWorker(&batch);
+	while (numStarted > 0) {
+		numStarted--;
+		pthread_join(threads[numStarted], NULL);
+	}
+	pthread_mutex_destroy(&(batch.lock));
+
+	free(threads);
+	free(requests);
+	free(pieces);
+
+}
+
+
+uint64_t getHttpSize(storage_backend_t* backend) {
+
+	return ((http_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getHttpBlockSize(storage_backend_t* backend) {
+
+	//
+	// ANYTHING CLOSER TOGETHER THAN THIS IS FETCHED IN ONE REQUEST ANYWAY.
+	(void) backend;
+	return HTTP_COALESCE_GAP;
+
+}
+
+
+void closeHttpBackend(storage_backend_t* backend) {
+
+	http_backend_t* httpBackend = (http_backend_t*) backend->state;
+	uint32_t connectionIndex = 0;
+	while (connectionIndex < httpBackend->numConnections) {
+		disconnectHttp(&(httpBackend->connections[connectionIndex]));
+		connectionIndex++;
+	}
+	pthread_mutex_destroy(&(httpBackend->poolLock));
+	pthread_cond_destroy(&(httpBackend->connectionFreed));
+	freeaddrinfo(httpBackend->addresses);
+	free(httpBackend->connections);
+	free(httpBackend->idleConnections);
+	free(httpBackend->hostHeader);
+	free(httpBackend->path);
+	free(httpBackend);
+	free(backend);
+
+}
+
+
+void parseHttpUrl(http_backend_t* httpBackend, char* url) {
+
+	//
+	// ONLY PLAIN HTTP IS SPOKEN.
+	if (strncasecmp(url, "http://", 7) != 0)
+		handleError(L"openDevice",
+		            L"The storage device must be an http:// URL");
+
+	//
+	// THE HOST (AND PORT) RUN UP TO THE PATH, WHICH DEFAULTS TO "/".
+	char* authority = url + 7;
+	size_t authorityLength = strcspn(authority, "/");
+	if (authorityLength == 0)
+		handleError(L"openDevice",
+		            L"The URL does not name a web server");
+	httpBackend->hostHeader = strndup(authority, authorityLength);
+	httpBackend->path = strdup((authority[authorityLength] == '/') ? authority + authorityLength : "/");
+	char* host = strndup(authority, authorityLength);
+	if (httpBackend->hostHeader == NULL || httpBackend->path == NULL || host == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// SPLIT OFF THE PORT, IF THERE IS ONE (AN IPv6 ADDRESS IS IN BRACKETS).
+	char*       hostName = host;
+	const char* port     = "80";
+	char*       colon    = strrchr(host, ':');
+	if (host[0] == '[') {
+		char* bracket = strchr(host, ']');
+		if (bracket == NULL)
+			handleError(L"openDevice",
+			            L"The URL does not name a web server");
+		*bracket = '\0';
+		hostName = host + 1;
+		colon = (bracket[1] == ':') ? bracket + 1 : NULL;
+	}
+	if (colon != NULL) {
+		*colon = '\0';
+		port = colon + 1;
+	}
+
+	//
+	// LOOK UP THE SERVER'S ADDRESSES.
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(hostName, port, &hints, &(httpBackend->addresses)) != 0)
+		handleError(L"openDevice",
+		            L"The web server could not be found");
+	free(host);
+
+}
+
+
+void* httpWorker(void* argument) {
+
+	http_batch_t* batch = (http_batch_t*) argument;
+
+	//
+	// KEEP TAKING THE NEXT REQUEST UNTIL THERE ARE NONE LEFT.
+	while (1) {
+		pthread_mutex_lock(&(batch->lock));
+		uint32_t requestIndex = batch->nextRequest;
+		if (requestIndex < batch->numRequests)
+			batch->nextRequest++;
+		pthread_mutex_unlock(&(batch->lock));
+		if (requestIndex >= batch->numRequests)
+			break;
+		performHttpRequest(batch->httpBackend, &(batch->requests[requestIndex]));
+	}
+	return NULL;
+
+}
+
+
+void performHttpRequest(http_backend_t* httpBackend, http_request_t* request) {
+
+	//
+	// A REQUEST FOR EXACTLY ONE PIECE IS RECEIVED STRAIGHT INTO ITS BUFFER.
+	byte_extent_t* pieces = request->pieces;
+	if (request->numPieces == 1 && pieces[0].numBytes == request->numBytes) {
+		fetchHttpRange(httpBackend, pieces[0].buffer, request->byteOffset, request->numBytes, NULL);
+		return;
+	}
+
+	//
+	// OTHERWISE, THE WHOLE RANGE (GAPS AND ALL) IS RECEIVED INTO A BUFFER OF
+	// ITS OWN, AND EACH PIECE IS COPIED OUT OF IT.
+	uint8_t* data = (uint8_t*) malloc(request->numBytes);
+	if (data == NULL)
+		handleError(L"readSectors",
+		            L"Unable to allocate memory for the requests");
+	fetchHttpRange(httpBackend, data, request->byteOffset, request->numBytes, NULL);
+	uint32_t pieceIndex = 0;
+	while (pieceIndex < request->numPieces) {
+		memcpy(pieces[pieceIndex].buffer,
+		       data + (pieces[pieceIndex].byteOffset - request->byteOffset),
+		       pieces[pieceIndex].numBytes);
+		pieceIndex++;
+	}
+	free(data);
+
+}
+
+
+void fetchHttpRange(http_backend_t* httpBackend,
+                    uint8_t*        buffer,
+                    uint64_t        byteOffset,
+                    uint64_t        numBytes,
+                    uint64_t*       totalSize) {
+
+	//
+	// TAKE AN IDLE CONNECTION, WAITING FOR ONE IF NEED BE.
+	pthread_mutex_lock(&(httpBackend->poolLock));
+	while (httpBackend->numIdle == 0)
+		pthread_cond_wait(&(httpBackend->connectionFreed), &(httpBackend->poolLock));
+	httpBackend->numIdle--;
+	http_connection_t* connection = &(httpBackend->connections[httpBackend->idleConnections[httpBackend->numIdle]]);
+	uint32_t connectionIndex = httpBackend->idleConnections[httpBackend->numIdle];
+	pthread_mutex_unlock(&(httpBackend->poolLock));
+
+	//
+	// IF A KEPT-ALIVE CONNECTION TURNS OUT TO HAVE BEEN CLOSED BY THE SERVER,
+	// TRY ONCE MORE ON A NEW ONE.
+	uint8_t wasConnected = (connection->socket >= 0);
+	if (!tryHttpRange(httpBackend, connection, buffer, byteOffset, numBytes, totalSize)) {
+		disconnectHttp(connection);
+		if (!wasConnected || !tryHttpRange(httpBackend, connection, buffer, byteOffset, numBytes, totalSize))
+			handleError(L"readSectors",
+			            L"Unable to reach the web server");
+	}
+
+	//
+	// PUT THE CONNECTION BACK.
+	pthread_mutex_lock(&(httpBackend->poolLock));
+	httpBackend->idleConnections[httpBackend->numIdle] = connectionIndex;
+	httpBackend->numIdle++;
+	pthread_cond_signal(&(httpBackend->connectionFreed));
+	pthread_mutex_unlock(&(httpBackend->poolLock));
+
+}
+
+
+uint8_t tryHttpRange(http_backend_t*    httpBackend,
+                     http_connection_t* connection,
+                     uint8_t*           buffer,
+                     uint64_t           byteOffset,
+                     uint64_t           numBytes,
+                     uint64_t*          totalSize) {
+
+	if (connection->socket < 0 && !connectHttp(httpBackend, connection))
+		return 0;
+
+	//
+	// SEND THE REQUEST.
+	size_t maxLength = strlen(httpBackend->path) + strlen(httpBackend->hostHeader) + 128;
+	char* request = (char*) malloc(maxLength);
+	if (request == NULL)
+		handleError(L"readSectors",
+		            L"Unable to allocate memory for the requests");
+	int length = snprintf(request, maxLength,
+	                      "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%llu-%llu\r\nUser-Agent: readfat\r\n\r\n",
+	                      httpBackend->path, httpBackend->hostHeader,
+	                      (unsigned long long) byteOffset, (unsigned long long) (byteOffset + numBytes - 1));
+	int numSent = 0;
+	while (numSent < length) {
+		ssize_t result = send(connection->socket, request + numSent, (size_t) (length - numSent), MSG_NOSIGNAL);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0) {
+			free(request);
+			return 0;
+		}
+		numSent += (int) result;
+	}
+	free(request);
+
+	//
+	// RECEIVE THE STATUS LINE.  ONCE IT HAS ARRIVED, THE SERVER HAS ANSWERED,
+	// SO ANYTHING THAT GOES WRONG FROM HERE ON IS AN ERROR.
+	char line[HTTP_MAX_LINE];
+	if (!receiveHttpLine(connection, line))
+		return 0;
+	int status = 0;
+	if (sscanf(line, "HTTP/%*d.%*d %d", &status) != 1)
+		handleError(L"readSectors",
+		            L"The web server sent an invalid response");
+
+	//
+	// RECEIVE THE HEADERS, UP TO THE BLANK LINE THAT ENDS THEM.
+	uint64_t contentLength = UINT64_MAX;
+	unsigned long long rangeStart = 0, rangeEnd = 0, rangeTotal = 0;
+	uint8_t keepAlive = 1;
+	while (1) {
+		if (!receiveHttpLine(connection, line))
+			handleError(L"readSectors",
+			            L"The connection to the web server was lost");
+		if (line[0] == '\0')
+			break;
+		if (strncasecmp(line, "Content-Length:", 15) == 0)
+			contentLength = strtoull(line + 15, NULL, 10);
+		else if (strncasecmp(line, "Content-Range:", 14) == 0)
+			sscanf(line + 14, " bytes %llu-%llu/%llu", &rangeStart, &rangeEnd, &rangeTotal);
+		else if (strncasecmp(line, "Connection:", 11) == 0 && strcasestr(line + 11, "close") != NULL)
+			keepAlive = 0;
+		else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line + 18, "chunked") != NULL)
+			handleError(L"readSectors",
+			            L"The web server sent a chunked response, which is not supported");
+	}
+
+	//
+	// MAKE SURE THE SERVER SENT JUST THE RANGE THAT WAS ASKED FOR (A SERVER
+	// THAT IGNORES THE RANGE WOULD SEND THE WHOLE IMAGE).
+	if (status == 200)
+		handleError(L"readSectors",
+		            L"The web server does not support range requests");
+	if (status != 206)
+		handleError(L"readSectors",
+		            L"The web server refused the request");
+	if (contentLength != numBytes || rangeStart != byteOffset || rangeEnd != byteOffset + numBytes - 1)
+		handleError(L"readSectors",
+		            L"The web server sent the wrong range");
+
+	//
+	// RECEIVE THE BODY.
+	if (!receiveHttpBytes(connection, buffer, numBytes))
+		handleError(L"readSectors",
+		            L"The connection to the web server was lost");
+	if (totalSize != NULL)
+		*totalSize = rangeTotal;
+	if (!keepAlive)
+		disconnectHttp(connection);
+	return 1;
+
+}
+
+
+uint8_t connectHttp(http_backend_t* httpBackend, http_connection_t* connection) {
+
+	//
+	// TRY EACH OF THE SERVER'S ADDRESSES IN TURN.
+	struct addrinfo* address = httpBackend->addresses;
+	while (address != NULL) {
+		int newSocket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (newSocket >= 0) {
+
+			//
+			// DO NOT WAIT FOREVER ON A SERVER THAT HAS GONE AWAY, AND SEND
+			// EACH (SMALL) REQUEST AS SOON AS IT IS WRITTEN.
+			struct timeval timeout;
+			timeout.tv_sec  = HTTP_TIMEOUT_SECONDS;
+			timeout.tv_usec = 0;
+			int noDelay = 1;
+			setsockopt(newSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(newSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+			setsockopt(newSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+			if (connect(newSocket, address->ai_addr, address->ai_addrlen) == 0) {
+				connection->socket      = newSocket;
+				connection->bufferStart = 0;
+				connection->bufferEnd   = 0;
+				return 1;
+			}
+			close(newSocket);
+		}
+		address = address->ai_next;
+	}
+	return 0;
+
+}
+
+
+void disconnectHttp(http_connection_t* connection) {
+
+	if (connection->socket >= 0)
+		close(connection->socket);
+	connection->socket      = -1;
+	connection->bufferStart = 0;
+	connection->bufferEnd   = 0;
+
+}
+
+
+uint8_t receiveHttpLine(http_connection_t* connection, char* line) {
+
+	uint32_t length = 0;
+	while (1) {
+
+		//
+		// TAKE CHARACTERS FROM THE BUFFER UP TO THE END OF THE LINE.
+		while (connection->bufferStart < connection->bufferEnd) {
+			char character = (char) connection->buffer[connection->bufferStart];
+			connection->bufferStart++;
+			if (character == '\n') {
+				if (length > 0 && line[length - 1] == '\r')
+					length--;
+				line[length] = '\0';
+				return 1;
+			}
+			if (length < HTTP_MAX_LINE - 1) {
+				line[length] = character;
+				length++;
+			}
+		}
+
+		//
+		// RECEIVE MORE WHEN THE BUFFER RUNS OUT.
+		ssize_t result = recv(connection->socket, connection->buffer, HTTP_BUFFER_SIZE, 0);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return 0;
+		connection->bufferStart = 0;
+		connection->bufferEnd   = (uint32_t) result;
+	}
+
+}
+
+
+uint8_t receiveHttpBytes(http_connection_t* connection, uint8_t* buffer, uint64_t numBytes) {
+
+	//
+	// USE UP WHAT IS LEFT IN THE BUFFER FIRST.
+	uint64_t numBuffered = connection->bufferEnd - connection->bufferStart;
+	if (numBuffered > numBytes)
+		numBuffered = numBytes;
+	memcpy(buffer, connection->buffer + connection->bufferStart, numBuffered);
+	connection->bufferStart += (uint32_t) numBuffered;
+
+	//
+	// THEN RECEIVE THE REST STRAIGHT INTO THE CALLER'S BUFFER.
+	uint64_t numReceived = numBuffered;
+	while (numReceived < numBytes) {
+		ssize_t result = recv(connection->socket, buffer + numReceived, numBytes - numReceived, 0);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return 0;
+		numReceived += (uint64_t) result;
+	}
+	return 1;
+
+}
+
+
+int compareByteExtents(const void* first, const void* second) {
+
+	uint64_t firstOffset  = ((const byte_extent_t*) first)->byteOffset;
+	uint64_t secondOffset = ((const byte_extent_t*) second)->byteOffset;
+	return (firstOffset > secondOffset) - (firstOffset < secondOffset);
+
+}
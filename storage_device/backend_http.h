@@ -0,0 +1,75 @@
+/******************************************************************************
+ * This file contains the
+ *                            HTTP BACKEND
+ * which reads an image from a web server with HTTP/1.1 range requests.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_HTTP_H_
+#define BACKEND_HTTP_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE DEFAULT NUMBER OF CONNECTIONS KEPT OPEN TO THE SERVER (AND SO THE MOST
+// REQUESTS IN FLIGHT AT ONCE).
+#define HTTP_DEFAULT_CONNECTIONS 4
+
+// RANGES SEPARATED BY NO MORE THAN THIS MANY BYTES ARE FETCHED WITH A SINGLE
+// REQUEST (THE BYTES IN BETWEEN ARE THROWN AWAY).
+#define HTTP_COALESCE_GAP (64 * 1024)
+
+// THE MOST BYTES FETCHED BY A SINGLE REQUEST.  LARGER READS ARE SPLIT UP, SO
+// THAT THEIR PIECES CAN BE FETCHED OVER SEVERAL CONNECTIONS AT ONCE.
+#define HTTP_MAX_REQUEST_SIZE (1024 * 1024)
+
+// HOW LONG TO WAIT FOR THE SERVER BEFORE GIVING UP (IN SECONDS).
+#define HTTP_TIMEOUT_SECONDS 30
+
+
+
+
+/*
+ * Opens the image at the given "http://host[:port]/path" URL, read-only.  The
+ * image is never downloaded as a whole: every read is served by HTTP/1.1
+ * "Range" requests.  Reads of ranges that lie close together are coalesced
+ * into one request, and the requests of a read are spread over up to
+ * "numConnections" kept-alive connections at once.  The server must answer
+ * range requests with "206 Partial Content".
+ *
+ * Every request is a round trip to the server, so the device should be given a
+ * block cache (see enableBlockCache) to keep what has already been fetched.
+ */
+storage_backend_t* openHttpBackend(char* url, uint32_t numConnections);
+
+
+
+
+#endif
@@ -0,0 +1,164 @@
+/******************************************************************************
+ * This file contains the
+ *                           MEMORY BACKEND
+ * which reads a storage device image that is already held in memory.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_memory.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE BLOCK SIZE REPORTED FOR AN IMAGE IN MEMORY, WHICH CAN BE READ AT ANY
+// GRANULARITY.
+#define MEMORY_BACKEND_BLOCK_SIZE 1
+
+
+
+
+/*
+ * A data structure used to store the state of the memory backend.
+ */
+typedef struct {
+
+	const uint8_t* image;          // The caller's image.
+	uint64_t       size;           // The size of the image (in bytes).
+
+} memory_backend_t;
+
+
+/*
+ * The memory backend's operations (see storage_backend.h).
+ */
+void           readMemoryExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t       getMemorySize(storage_backend_t* backend);
+uint32_t       getMemoryBlockSize(storage_backend_t* backend);
+void           closeMemoryBackend(storage_backend_t* backend);
+const uint8_t* viewMemoryBytes(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openMemoryBackend(const uint8_t* image, uint64_t size) {
+
+	//
+	// PARAMETER CHECK.
+	if (image == NULL)
+		handleError(L"openMemoryBackend",
+		            L"NULL 'image' parameter");
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	memory_backend_t* memoryBackend = (memory_backend_t*) calloc(1, sizeof(memory_backend_t));
+	if (memoryBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	memoryBackend->image = image;
+	memoryBackend->size  = size;
+
+	//
+	// FILL IN THE OPERATIONS.
+	storage_backend_t* backend = allocateStorageBackend(memoryBackend);
+	backend->readExtents  = readMemoryExtents;
+	backend->getSize      = getMemorySize;
+	backend->getBlockSize = getMemoryBlockSize;
+	backend->close        = closeMemoryBackend;
+	backend->viewBytes    = viewMemoryBytes;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readMemoryExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		memcpy(extents[extentIndex].buffer,
+		       viewMemoryBytes(backend, extents[extentIndex].byteOffset, extents[extentIndex].numBytes),
+		       extents[extentIndex].numBytes);
+		extentIndex++;
+	}
+
+}
+
+
+uint64_t getMemorySize(storage_backend_t* backend) {
+
+	return ((memory_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getMemoryBlockSize(storage_backend_t* backend) {
+
+	(void) backend;
+	return MEMORY_BACKEND_BLOCK_SIZE;
+
+}
+
+
+void closeMemoryBackend(storage_backend_t* backend) {
+
+	//
+	// THE IMAGE ITSELF BELONGS TO THE CALLER.
+	free(backend->state);
+	free(backend);
+
+}
+
+
+const uint8_t* viewMemoryBytes(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	memory_backend_t* memoryBackend = (memory_backend_t*) backend->state;
+
+	//
+	// VERIFY THE BYTES ARE ACTUALLY IN THE IMAGE.
+	if (byteOffset > memoryBackend->size || numBytes > memoryBackend->size - byteOffset)
+		handleError(L"readSectors",
+		            L"Unable to read in requested sectors");
+
+	return memoryBackend->image + byteOffset;
+
+}
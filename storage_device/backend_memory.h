@@ -0,0 +1,47 @@
+/******************************************************************************
+ * This file contains the
+ *                           MEMORY BACKEND
+ * which reads a storage device image that is already held in memory.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_MEMORY_H_
+#define BACKEND_MEMORY_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+/*
+ * Wraps an image of "size" bytes that is already in memory as a backend.  The
+ * image is NOT copied, and it is NOT freed when the backend is closed: it
+ * belongs to the caller, and must outlive the backend.
+ */
+storage_backend_t* openMemoryBackend(const uint8_t* image, uint64_t size);
+
+
+
+
+#endif
@@ -0,0 +1,191 @@
+/******************************************************************************
+ * This file contains the
+ *                            MMAP BACKEND
+ * which maps the entire storage device into memory.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_mmap.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+
+
+/*
+ * A data structure used to store the state of the mmap backend.
+ */
+typedef struct {
+
+	uint8_t* mapping;              // The device's mapped contents.
+	uint64_t size;                 // The size of the device (in bytes).
+
+} mmap_backend_t;
+
+
+/*
+ * The mmap backend's operations (see storage_backend.h).
+ */
+void           readMmapExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t       getMmapSize(storage_backend_t* backend);
+uint32_t       getMmapBlockSize(storage_backend_t* backend);
+void           closeMmapBackend(storage_backend_t* backend);
+const uint8_t* viewMmapBytes(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+void           adviseMmapWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openMmapBackend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	mmap_backend_t* mmapBackend = (mmap_backend_t*) calloc(1, sizeof(mmap_backend_t));
+	if (mmapBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// OPEN THE DEVICE.
+	int fileDescriptor = open(deviceFileName, O_RDONLY);
+	if (fileDescriptor < 0)
+		handleError(L"openDevice",
+		            L"The storage device could not be opened");
+
+	//
+	// GET THE SIZE OF THE DEVICE.  SEEKING TO THE END WORKS FOR BOTH IMAGE
+	// FILES AND BLOCK DEVICES (WHOSE st_size IS ALWAYS 0).
+	off_t size = lseek(fileDescriptor, 0, SEEK_END);
+	if (size <= 0)
+		handleError(L"openDevice",
+		            L"Unable to determine the size of the storage device");
+	mmapBackend->size = (uint64_t) size;
+
+	//
+	// MAP THE WHOLE DEVICE (READ-ONLY).  THE MAPPING STAYS VALID AFTER THE
+	// FILE DESCRIPTOR IS CLOSED.
+	void* mapping = mmap(NULL, mmapBackend->size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+		handleError(L"openDevice",
+		            L"The storage device could not be memory-mapped");
+	close(fileDescriptor);
+	mmapBackend->mapping = (uint8_t*) mapping;
+
+	//
+	// FILL IN THE OPERATIONS.
+	storage_backend_t* backend = allocateStorageBackend(mmapBackend);
+	backend->readExtents    = readMmapExtents;
+	backend->getSize        = getMmapSize;
+	backend->getBlockSize   = getMmapBlockSize;
+	backend->close          = closeMmapBackend;
+	backend->viewBytes      = viewMmapBytes;
+	backend->adviseWillNeed = adviseMmapWillNeed;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readMmapExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		memcpy(extents[extentIndex].buffer,
+		       viewMmapBytes(backend, extents[extentIndex].byteOffset, extents[extentIndex].numBytes),
+		       extents[extentIndex].numBytes);
+		extentIndex++;
+	}
+
+}
+
+
+uint64_t getMmapSize(storage_backend_t* backend) {
+
+	return ((mmap_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getMmapBlockSize(storage_backend_t* backend) {
+
+	(void) backend;
+	return (uint32_t) sysconf(_SC_PAGESIZE);
+
+}
+
+
+void closeMmapBackend(storage_backend_t* backend) {
+
+	mmap_backend_t* mmapBackend = (mmap_backend_t*) backend->state;
+	munmap(mmapBackend->mapping, mmapBackend->size);
+	free(mmapBackend);
+	free(backend);
+
+}
+
+
+const uint8_t* viewMmapBytes(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	mmap_backend_t* mmapBackend = (mmap_backend_t*) backend->state;
+
+	//
+	// VERIFY THE BYTES ARE ACTUALLY ON THE DEVICE.
+	if (byteOffset > mmapBackend->size || numBytes > mmapBackend->size - byteOffset)
+		handleError(L"readSectors",
+		            L"Unable to read in requested sectors");
+
+	return mmapBackend->mapping + byteOffset;
+
+}
+
+
+void adviseMmapWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	//
+	// THE MAPPING IS ADVISED DIRECTLY, AND THE ADVICE MUST START ON A PAGE
+	// BOUNDARY.
+	mmap_backend_t* mmapBackend = (mmap_backend_t*) backend->state;
+	uint64_t pageOffset = byteOffset % (uint64_t) sysconf(_SC_PAGESIZE);
+	madvise(mmapBackend->mapping + byteOffset - pageOffset,
+	        numBytes + pageOffset, MADV_WILLNEED);
+
+}
@@ -0,0 +1,43 @@
+/******************************************************************************
+ * This file contains the
+ *                            MMAP BACKEND
+ * which maps the entire storage device into memory.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_MMAP_H_
+#define BACKEND_MMAP_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+/*
+ * Maps the specified device or image file into memory (read-only).  Reads are
+ * copied out of the mapping, and the mapping can also be viewed in place.
+ */
+storage_backend_t* openMmapBackend(char* deviceFileName);
+
+
+
+
+#endif
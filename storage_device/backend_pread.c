@@ -0,0 +1,169 @@
+/******************************************************************************
+ * This file contains the
+ *                           PREAD BACKEND
+ * which reads the storage device with positional reads.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_pread.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+
+/*
+ * A data structure used to store the state of the pread backend.
+ */
+typedef struct {
+
+	int      fileDescriptor;       // The device.
+	uint64_t size;                 // The size of the device (in bytes).
+	uint32_t blockSize;            // The preferred I/O size of the device.
+
+} pread_backend_t;
+
+
+/*
+ * The pread backend's operations (see storage_backend.h).
+ */
+void     readPreadExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getPreadSize(storage_backend_t* backend);
+uint32_t getPreadBlockSize(storage_backend_t* backend);
+void     closePreadBackend(storage_backend_t* backend);
+void     advisePreadWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+int      getPreadFileDescriptor(storage_backend_t* backend);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openPreadBackend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	pread_backend_t* preadBackend = (pread_backend_t*) calloc(1, sizeof(pread_backend_t));
+	if (preadBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// OPEN THE DEVICE.
+	preadBackend->fileDescriptor = open(deviceFileName, O_RDONLY);
+	if (preadBackend->fileDescriptor < 0)
+		handleError(L"openDevice",
+		            L"The storage device could not be opened");
+
+	//
+	// GET THE SIZE OF THE DEVICE.  SEEKING TO THE END WORKS FOR BOTH IMAGE
+	// FILES AND BLOCK DEVICES (WHOSE st_size IS ALWAYS 0).
+	off_t size = lseek(preadBackend->fileDescriptor, 0, SEEK_END);
+	if (size < 0)
+		handleError(L"openDevice",
+		            L"Unable to determine the size of the storage device");
+	preadBackend->size = (uint64_t) size;
+
+	//
+	// GET THE PREFERRED I/O SIZE.
+	struct stat status;
+	preadBackend->blockSize = BUFSIZ;
+	if (fstat(preadBackend->fileDescriptor, &status) == 0 && status.st_blksize > 0)
+		preadBackend->blockSize = (uint32_t) status.st_blksize;
+
+	//
+	// FILL IN THE OPERATIONS.
+	storage_backend_t* backend = allocateStorageBackend(preadBackend);
+	backend->readExtents       = readPreadExtents;
+	backend->getSize           = getPreadSize;
+	backend->getBlockSize      = getPreadBlockSize;
+	backend->close             = closePreadBackend;
+	backend->adviseWillNeed    = advisePreadWillNeed;
+	backend->getFileDescriptor = getPreadFileDescriptor;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readPreadExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	preadExtents(((pread_backend_t*) backend->state)->fileDescriptor, extents, numExtents);
+
+}
+
+
+uint64_t getPreadSize(storage_backend_t* backend) {
+
+	return ((pread_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getPreadBlockSize(storage_backend_t* backend) {
+
+	return ((pread_backend_t*) backend->state)->blockSize;
+
+}
+
+
+void closePreadBackend(storage_backend_t* backend) {
+
+	pread_backend_t* preadBackend = (pread_backend_t*) backend->state;
+	close(preadBackend->fileDescriptor);
+	free(preadBackend);
+	free(backend);
+
+}
+
+
+void advisePreadWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	posix_fadvise(((pread_backend_t*) backend->state)->fileDescriptor,
+	              (off_t) byteOffset, (off_t) numBytes, POSIX_FADV_WILLNEED);
+
+}
+
+
+int getPreadFileDescriptor(storage_backend_t* backend) {
+
+	return ((pread_backend_t*) backend->state)->fileDescriptor;
+
+}
@@ -0,0 +1,45 @@
+/******************************************************************************
+ * This file contains the
+ *                           PREAD BACKEND
+ * which reads the storage device with positional reads.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_PREAD_H_
+#define BACKEND_PREAD_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+/*
+ * Opens the specified device or image file for positional reads (pread).
+ * There is no shared file position, so reads never need to be serialized.
+ * Extents that follow one another on the device are read in with a single
+ * preadv.  This is the backend storage devices are opened with by default.
+ */
+storage_backend_t* openPreadBackend(char* deviceFileName);
+
+
+
+
+#endif
@@ -0,0 +1,506 @@
+/******************************************************************************
+ * This file contains the
+ *                            QCOW2 BACKEND
+ * which reads the disk inside a qcow2 container without converting it first.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_qcow2.h"
+#include "storage_backend.h"
+#include "table_cache.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ZLIB
+#include <zlib.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE MAGIC NUMBER AT THE START OF A QCOW2 CONTAINER ("QFI\xfb").
+#define QCOW2_MAGIC 0x514649fb
+
+// THE NUMBER OF HEADER BYTES THAT ARE LOOKED AT (THE VERSION 3 HEADER; A
+// VERSION 2 HEADER IS THE FIRST 72 OF THEM).
+#define QCOW2_HEADER_SIZE    104
+#define QCOW2_V2_HEADER_SIZE 72
+
+// THE RANGE OF CLUSTER SIZES (AS POWERS OF TWO) THAT A CONTAINER MAY USE.
+#define QCOW2_MIN_CLUSTER_BITS 9
+#define QCOW2_MAX_CLUSTER_BITS 21
+
+// THE PARTS OF AN L1 OR L2 TABLE ENTRY.
+#define QCOW2_OFFSET_MASK     0x00fffffffffffe00ULL
+#define QCOW2_COMPRESSED_FLAG (1ULL << 62)
+#define QCOW2_ZERO_FLAG       1ULL
+
+// THE INCOMPATIBLE FEATURES A VERSION 3 CONTAINER MAY HAVE.  ONLY THE "DIRTY"
+// AND "CORRUPT" BITS ARE ALLOWED, SINCE NEITHER OF THEM CHANGES HOW THE DATA
+// IS FOUND.
+#define QCOW2_FEATURE_DIRTY   1ULL
+#define QCOW2_FEATURE_CORRUPT 2ULL
+
+
+
+
+/*
+ * A data structure used to store the state of the qcow2 backend.
+ */
+typedef struct {
+
+	int             fileDescriptor;        // The container file.
+	uint64_t        containerSize;         // The size of the container file.
+	uint64_t        size;                  // The size of the disk inside it.
+	uint32_t        clusterBits;           // The size of a cluster, as a power of two.
+	uint32_t        l2Bits;                // The number of entries in an L2 table, as a power of two.
+	uint64_t*       l1Table;               // The decoded L1 table (offsets of the L2 tables).
+	uint32_t        l1Size;                // The number of entries in the L1 table.
+	table_cache_t*  l2Cache;               // The most recently used L2 tables.
+	pthread_mutex_t compressedLock;        // Guards the two buffers below.
+	uint8_t*        compressedInput;       // Holds a compressed cluster as it is read in.
+	uint8_t*        decompressedCluster;   // The last compressed cluster decompressed.
+	uint64_t        decompressedEntry;     // Its L2 entry (0 if there is none yet).
+
+} qcow2_backend_t;
+
+
+/*
+ * The qcow2 backend's operations (see storage_backend.h).
+ */
+void     readQcow2Extents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getQcow2Size(storage_backend_t* backend);
+uint32_t getQcow2BlockSize(storage_backend_t* backend);
+void     closeQcow2Backend(storage_backend_t* backend);
+uint8_t  isQcow2Hole(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+
+/*
+ * Used to get the L2 entry of the cluster holding the given byte of the disk
+ * (0 if the cluster was never written).
+ */
+uint64_t getQcow2ClusterEntry(qcow2_backend_t* qcow2Backend, uint64_t byteOffset);
+
+
+/*
+ * Used by the table cache to read and decode an L2 table.
+ */
+void loadQcow2Table(void* context, uint64_t tableOffset, uint64_t* entries);
+
+
+/*
+ * Used to copy part of a compressed cluster into a buffer, decompressing the
+ * cluster unless it was the last one decompressed.
+ */
+void readQcow2CompressedCluster(qcow2_backend_t* qcow2Backend,
+                                uint64_t         entry,
+                                uint8_t*         buffer,
+                                uint64_t         clusterOffset,
+                                uint64_t         numBytes);
+
+
+/*
+ * Used to read a range of the container file, no matter how many calls it
+ * takes.
+ */
+void preadQcow2(qcow2_backend_t* qcow2Backend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset);
+
+
+/*
+ * Used to decode a big-endian number of the given width (in bytes).
+ */
+uint64_t readBigEndian(uint8_t* bytes, uint32_t numBytes);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openQcow2Backend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	qcow2_backend_t* qcow2Backend = (qcow2_backend_t*) calloc(1, sizeof(qcow2_backend_t));
+	if (qcow2Backend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	pthread_mutex_init(&(qcow2Backend->compressedLock), NULL);
+
+	//
+	// OPEN THE CONTAINER.
+	qcow2Backend->fileDescriptor = open(deviceFileName, O_RDONLY);
+	struct stat status;
+	if (qcow2Backend->fileDescriptor < 0 || fstat(qcow2Backend->fileDescriptor, &status) != 0)
+		handleError(L"openDevice",
+		            L"The storage device could not be opened");
+	qcow2Backend->containerSize = (uint64_t) status.st_size;
+
+	//
+	// READ IN THE HEADER.
+	uint8_t header[QCOW2_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	if (qcow2Backend->containerSize < QCOW2_V2_HEADER_SIZE)
+		handleError(L"openDevice",
+		            L"The storage device is not a qcow2 container");
+	preadQcow2(qcow2Backend, header,
+	           (qcow2Backend->containerSize < QCOW2_HEADER_SIZE) ? qcow2Backend->containerSize : QCOW2_HEADER_SIZE, 0);
+	if (readBigEndian(header, 4) != QCOW2_MAGIC)
+		handleError(L"openDevice",
+		            L"The storage device is not a qcow2 container");
+
+	//
+	// REFUSE ANYTHING THAT WOULD NEED MORE THAN THE CONTAINER ITSELF TO READ.
+	uint32_t version = (uint32_t) readBigEndian(header + 4, 4);
+	if (version != 2 && version != 3)
+		handleError(L"openDevice",
+		            L"Only qcow2 containers of version 2 or 3 are supported");
+	if (readBigEndian(header + 8, 8) != 0)
+		handleError(L"openDevice",
+		            L"qcow2 containers with a backing file are not supported");
+	if (readBigEndian(header + 32, 4) != 0)
+		handleError(L"openDevice",
+		            L"Encrypted qcow2 containers are not supported");
+	if (version == 3 && (readBigEndian(header + 72, 8) & ~(QCOW2_FEATURE_DIRTY | QCOW2_FEATURE_CORRUPT)) != 0)
+		handleError(L"openDevice",
+		            L"The qcow2 container uses features that are not supported");
+
+	//
+	// GET THE GEOMETRY OF THE CONTAINER.
+	qcow2Backend->clusterBits = (uint32_t) readBigEndian(header + 20, 4);
+	if (qcow2Backend->clusterBits < QCOW2_MIN_CLUSTER_BITS || qcow2Backend->clusterBits > QCOW2_MAX_CLUSTER_BITS)
+		handleError(L"openDevice",
+		            L"The qcow2 container is corrupt");
+	qcow2Backend->l2Bits = qcow2Backend->clusterBits - 3;
+	qcow2Backend->size   = readBigEndian(header + 24, 8);
+
+	//
+	// READ IN THE WHOLE L1 TABLE, WHICH IS SMALL (ONE ENTRY PER L2 TABLE).
+	qcow2Backend->l1Size = (uint32_t) readBigEndian(header + 36, 4);
+	uint64_t l1Offset = readBigEndian(header + 40, 8);
+	uint64_t l1Bytes  = (uint64_t) qcow2Backend->l1Size * 8;
+	if (l1Offset > qcow2Backend->containerSize || l1Bytes > qcow2Backend->containerSize - l1Offset)
+		handleError(L"openDevice",
+		            L"The qcow2 container is corrupt");
+	uint8_t* l1Data = (uint8_t*) malloc(l1Bytes + 1);
+	qcow2Backend->l1Table = (uint64_t*) malloc(l1Bytes + 1);
+	if (l1Data == NULL || qcow2Backend->l1Table == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	preadQcow2(qcow2Backend, l1Data, l1Bytes, l1Offset);
+	uint32_t l1Index = 0;
+	while (l1Index < qcow2Backend->l1Size) {
+		qcow2Backend->l1Table[l1Index] = readBigEndian(l1Data + (uint64_t) l1Index * 8, 8) & QCOW2_OFFSET_MASK;
+		l1Index++;
+	}
+	free(l1Data);
+
+	//
+	// THE L1 TABLE MUST REACH THE END OF THE DISK, SO THAT NO READ RUNS PAST IT.
+	uint32_t l1EntryBits = qcow2Backend->clusterBits + qcow2Backend->l2Bits;
+	uint64_t l1EntriesNeeded = (qcow2Backend->size >> l1EntryBits)
+	                         + ((qcow2Backend->size & ((1ULL << l1EntryBits) - 1)) != 0);
+	if (l1EntriesNeeded > qcow2Backend->l1Size)
+		handleError(L"openDevice",
+		            L"The qcow2 container is corrupt");
+
+	//
+	// SET UP THE CACHE OF L2 TABLES, AND THE BUFFERS FOR COMPRESSED CLUSTERS
+	// (A COMPRESSED CLUSTER CAN TAKE UP TO ONE SECTOR MORE THAN A CLUSTER).
+	qcow2Backend->l2Cache = createTableCache(TABLE_CACHE_TABLES, 1U << qcow2Backend->l2Bits,
+	                                         loadQcow2Table, qcow2Backend);
+	qcow2Backend->compressedInput     = (uint8_t*) malloc((1U << qcow2Backend->clusterBits) + 512);
+	qcow2Backend->decompressedCluster = (uint8_t*) malloc(1U << qcow2Backend->clusterBits);
+	if (qcow2Backend->compressedInput == NULL || qcow2Backend->decompressedCluster == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS NO FILE DESCRIPTOR FOR THE ASYNCHRONOUS
+	// READER, SINCE THE CONTAINER DOES NOT HOLD THE DISK'S BYTES IN PLACE.
+	storage_backend_t* backend = allocateStorageBackend(qcow2Backend);
+	backend->readExtents  = readQcow2Extents;
+	backend->getSize      = getQcow2Size;
+	backend->getBlockSize = getQcow2BlockSize;
+	backend->close        = closeQcow2Backend;
+	backend->isHole       = isQcow2Hole;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readQcow2Extents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	qcow2_backend_t* qcow2Backend = (qcow2_backend_t*) backend->state;
+	uint64_t clusterSize = 1ULL << qcow2Backend->clusterBits;
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint8_t* buffer   = extents[extentIndex].buffer;
+		uint64_t position = extents[extentIndex].byteOffset;
+		uint64_t end      = extents[extentIndex].byteOffset + extents[extentIndex].numBytes;
+
+		//
+		// VERIFY THE EXTENT IS ACTUALLY ON THE DISK.
+		if (end > qcow2Backend->size || end < position)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+
+		//
+		// TRANSLATE THE EXTENT ONE CLUSTER AT A TIME.  CLUSTERS THAT FOLLOW ONE
+		// ANOTHER IN THE CONTAINER TOO ARE READ IN WITH A SINGLE REQUEST.
+		uint8_t* runBuffer = buffer;
+		uint64_t runOffset = 0;
+		uint64_t runLength = 0;
+		while (position < end) {
+			uint64_t clusterOffset = position & (clusterSize - 1);
+			uint64_t numBytes = clusterSize - clusterOffset;
+			if (numBytes > end - position)
+				numBytes = end - position;
+			uint64_t entry = getQcow2ClusterEntry(qcow2Backend, position);
+			uint64_t hostOffset = entry & QCOW2_OFFSET_MASK;
+
+			if ((entry & QCOW2_COMPRESSED_FLAG) == 0 && (entry & QCOW2_ZERO_FLAG) == 0 && hostOffset != 0) {
+
+				//
+				// AN ORDINARY CLUSTER JOINS THE CURRENT RUN IF IT CARRIES ON
+				// FROM IT, OR STARTS A NEW ONE.
+				if (runLength > 0 && runOffset + runLength == hostOffset + clusterOffset) {
+					runLength += numBytes;
+				}
+				else {
+					if (runLength > 0)
+						preadQcow2(qcow2Backend, runBuffer, runLength, runOffset);
+					runBuffer = buffer;
+					runOffset = hostOffset + clusterOffset;
+					runLength = numBytes;
+				}
+			}
+			else {
+
+				//
+				// ANYTHING ELSE ENDS THE RUN.
+				if (runLength > 0)
+					preadQcow2(qcow2Backend, runBuffer, runLength, runOffset);
+				runLength = 0;
+				if ((entry & QCOW2_COMPRESSED_FLAG) != 0)
+					readQcow2CompressedCluster(qcow2Backend, entry, buffer, clusterOffset, numBytes);
+				else
+					memset(buffer, 0, numBytes);
+			}
+
+			buffer   += numBytes;
+			position += numBytes;
+		}
+		if (runLength > 0)
+			preadQcow2(qcow2Backend, runBuffer, runLength, runOffset);
+
+		extentIndex++;
+	}
+
+}
+
+
+uint64_t getQcow2Size(storage_backend_t* backend) {
+
+	return ((qcow2_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getQcow2BlockSize(storage_backend_t* backend) {
+
+	return 1U << ((qcow2_backend_t*) backend->state)->clusterBits;
+
+}
+
+
+void closeQcow2Backend(storage_backend_t* backend) {
+
+	qcow2_backend_t* qcow2Backend = (qcow2_backend_t*) backend->state;
+	destroyTableCache(qcow2Backend->l2Cache);
+	pthread_mutex_destroy(&(qcow2Backend->compressedLock));
+	free(qcow2Backend->compressedInput);
+	free(qcow2Backend->decompressedCluster);
+	free(qcow2Backend->l1Table);
+	close(qcow2Backend->fileDescriptor);
+	free(qcow2Backend);
+	free(backend);
+
+}
+
+
+uint8_t isQcow2Hole(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	qcow2_backend_t* qcow2Backend = (qcow2_backend_t*) backend->state;
+	uint64_t clusterSize = 1ULL << qcow2Backend->clusterBits;
+
+	//
+	// THE RANGE IS A HOLE IF EVERY CLUSTER IT TOUCHES WAS NEVER WRITTEN, OR
+	// IS MARKED AS ALL ZEROS.
+	uint64_t end = byteOffset + numBytes;
+	if (end > qcow2Backend->size || end < byteOffset)
+		return 0;
+	uint64_t position = byteOffset & ~(clusterSize - 1);
+	while (position < end) {
+		uint64_t entry = getQcow2ClusterEntry(qcow2Backend, position);
+		if ((entry & QCOW2_COMPRESSED_FLAG) != 0)
+			return 0;
+		if ((entry & QCOW2_ZERO_FLAG) == 0 && (entry & QCOW2_OFFSET_MASK) != 0)
+			return 0;
+		position += clusterSize;
+	}
+	return 1;
+
+}
+
+
+uint64_t getQcow2ClusterEntry(qcow2_backend_t* qcow2Backend, uint64_t byteOffset) {
+
+	uint64_t clusterNumber = byteOffset >> qcow2Backend->clusterBits;
+	uint64_t l1Index = clusterNumber >> qcow2Backend->l2Bits;
+	uint32_t l2Index = (uint32_t) (clusterNumber & ((1ULL << qcow2Backend->l2Bits) - 1));
+	if (l1Index >= qcow2Backend->l1Size || qcow2Backend->l1Table[l1Index] == 0)
+		return 0;
+	return lookupTableEntry(qcow2Backend->l2Cache, qcow2Backend->l1Table[l1Index], l2Index);
+
+}
+
+
+void loadQcow2Table(void* context, uint64_t tableOffset, uint64_t* entries) {
+
+	qcow2_backend_t* qcow2Backend = (qcow2_backend_t*) context;
+
+	//
+	// AN L2 TABLE TAKES UP EXACTLY ONE CLUSTER.  IT IS READ STRAIGHT INTO THE
+	// (EQUALLY LARGE) ARRAY OF ENTRIES, AND DECODED IN PLACE.
+	uint32_t numEntries = 1U << qcow2Backend->l2Bits;
+	preadQcow2(qcow2Backend, (uint8_t*) entries, (uint64_t) numEntries * 8, tableOffset);
+	uint32_t entryIndex = 0;
+	while (entryIndex < numEntries) {
+		entries[entryIndex] = readBigEndian((uint8_t*) (entries + entryIndex), 8);
+		entryIndex++;
+	}
+
+}
+
+
+void readQcow2CompressedCluster(qcow2_backend_t* qcow2Backend,
+                                uint64_t         entry,
+                                uint8_t*         buffer,
+                                uint64_t         clusterOffset,
+                                uint64_t         numBytes) {
+
+	uint64_t clusterSize = 1ULL << qcow2Backend->clusterBits;
+
+	pthread_mutex_lock(&(qcow2Backend->compressedLock));
+	if (qcow2Backend->decompressedEntry != entry) {
+
+		//
+		// FIND THE COMPRESSED DATA.  THE ENTRY HOLDS ITS OFFSET, AND HOW MANY
+		// SECTORS IT SPANS (PAST THE FIRST).  THAT IS NEVER MORE THAN WHAT THE
+		// BUFFER HOLDS, UNLESS THE CONTAINER IS CORRUPT.
+		uint32_t sizeShift = 62 - (qcow2Backend->clusterBits - 8);
+		uint64_t offset = entry & ((1ULL << sizeShift) - 1);
+		uint64_t numSectors = ((entry >> sizeShift) & ((1ULL << (qcow2Backend->clusterBits - 8)) - 1)) + 1;
+		uint64_t length = numSectors * 512 - (offset & 511);
+		if (offset >= qcow2Backend->containerSize || length > clusterSize + 512)
+			handleError(L"readSectors",
+			            L"The qcow2 container is corrupt");
+		if (length > qcow2Backend->containerSize - offset)
+			length = qcow2Backend->containerSize - offset;
+		preadQcow2(qcow2Backend, qcow2Backend->compressedInput, length, offset);
+
+		//
+		// DECOMPRESS IT (IT IS RAW DEFLATE, WITH A 4 KIB WINDOW).
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, -12) != Z_OK)
+			handleError(L"readSectors",
+			            L"Unable to start decompressing the storage device");
+		stream.next_in   = qcow2Backend->compressedInput;
+		stream.avail_in  = (uInt) length;
+		stream.next_out  = qcow2Backend->decompressedCluster;
+		stream.avail_out = (uInt) clusterSize;
+		int result = inflate(&stream, Z_FINISH);
+		inflateEnd(&stream);
+		if (result != Z_STREAM_END && !(result == Z_BUF_ERROR && stream.avail_out == 0))
+			handleError(L"readSectors",
+			            L"The qcow2 container is corrupt");
+		qcow2Backend->decompressedEntry = entry;
+	}
+	memcpy(buffer, qcow2Backend->decompressedCluster + clusterOffset, numBytes);
+	pthread_mutex_unlock(&(qcow2Backend->compressedLock));
+
+}
+
+
+void preadQcow2(qcow2_backend_t* qcow2Backend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset) {
+
+	while (numBytes > 0) {
+		ssize_t result = pread(qcow2Backend->fileDescriptor, buffer, numBytes, (off_t) byteOffset);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		buffer     += result;
+		numBytes   -= (uint64_t) result;
+		byteOffset += (uint64_t) result;
+	}
+
+}
+
+
+uint64_t readBigEndian(uint8_t* bytes, uint32_t numBytes) {
+
+	uint64_t value = 0;
+	uint32_t index = 0;
+	while (index < numBytes) {
+		value = (value << 8) | bytes[index];
+		index++;
+	}
+	return value;
+
+}
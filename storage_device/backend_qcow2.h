@@ -0,0 +1,50 @@
+/******************************************************************************
+ * This file contains the
+ *                            QCOW2 BACKEND
+ * which reads the disk inside a qcow2 container without converting it first.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_QCOW2_H_
+#define BACKEND_QCOW2_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+/*
+ * Opens a qcow2 container (version 2 or 3), read-only.  Offsets on the disk
+ * are translated to offsets in the container through the L1 table, which is
+ * read once when the container is opened, and the L2 tables, which are read as
+ * they are needed and kept decoded in a table cache (see table_cache.h).
+ * Clusters that were never written read as zeros, and deflate-compressed
+ * clusters are decompressed as they are read.
+ *
+ * Containers with a backing file, encryption, an external data file, extended
+ * L2 entries, or zstd compression are not supported.
+ */
+storage_backend_t* openQcow2Backend(char* deviceFileName);
+
+
+
+
+#endif
@@ -0,0 +1,359 @@
+/******************************************************************************
+ * This file contains the
+ *                           SPARSE BACKEND
+ * which reads a sparse image file, without reading its holes.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// SEEK_DATA AND SEEK_HOLE ARE GNU EXTENSIONS, AND MUST BE REQUESTED BEFORE ANY
+// HEADER IS INCLUDED.
+//
+#define _GNU_SOURCE
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_sparse.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+
+/*
+ * A data structure used to store one run of data in the image.  Everything
+ * between one run and the next is a hole.
+ */
+typedef struct {
+
+	uint64_t start;                // The first byte of the run.
+	uint64_t end;                  // The byte just past the end of the run.
+
+} data_segment_t;
+
+
+/*
+ * A data structure used to store the state of the sparse backend.
+ */
+typedef struct {
+
+	int             fileDescriptor;// The image.
+	uint64_t        size;          // The size of the image (in bytes).
+	uint32_t        blockSize;     // The preferred I/O size of the image.
+	data_segment_t* segments;      // The runs of data, in order.
+	uint32_t        numSegments;   // The number of runs of data.
+
+} sparse_backend_t;
+
+
+/*
+ * The sparse backend's operations (see storage_backend.h).
+ */
+void     readSparseExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getSparseSize(storage_backend_t* backend);
+uint32_t getSparseBlockSize(storage_backend_t* backend);
+void     closeSparseBackend(storage_backend_t* backend);
+void     adviseSparseWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+uint8_t  isSparseHole(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+
+/*
+ * Used to find every run of data in the image.
+ */
+void mapDataSegments(sparse_backend_t* sparseBackend);
+
+
+/*
+ * Used to find the first run of data that ends after the given byte offset.
+ * Returns "numSegments" if there is none.
+ */
+uint32_t findDataSegment(sparse_backend_t* sparseBackend, uint64_t byteOffset);
+
+
+/*
+ * Used to read a range of bytes that lies entirely within one run of data.
+ */
+void preadData(sparse_backend_t* sparseBackend, uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openSparseBackend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	sparse_backend_t* sparseBackend = (sparse_backend_t*) calloc(1, sizeof(sparse_backend_t));
+	if (sparseBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// OPEN THE IMAGE.
+	sparseBackend->fileDescriptor = open(deviceFileName, O_RDONLY);
+	if (sparseBackend->fileDescriptor < 0)
+		handleError(L"openDevice",
+		            L"The storage device could not be opened");
+
+	//
+	// GET THE SIZE OF THE IMAGE.
+	off_t size = lseek(sparseBackend->fileDescriptor, 0, SEEK_END);
+	if (size < 0)
+		handleError(L"openDevice",
+		            L"Unable to determine the size of the storage device");
+	sparseBackend->size = (uint64_t) size;
+
+	//
+	// GET THE PREFERRED I/O SIZE.
+	struct stat status;
+	sparseBackend->blockSize = BUFSIZ;
+	if (fstat(sparseBackend->fileDescriptor, &status) == 0 && status.st_blksize > 0)
+		sparseBackend->blockSize = (uint32_t) status.st_blksize;
+
+	//
+	// MAP OUT THE DATA AND THE HOLES.
+	mapDataSegments(sparseBackend);
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS DELIBERATELY NO FILE DESCRIPTOR FOR THE
+	// ASYNCHRONOUS READER, SO THAT EVERY READ GOES THROUGH THE MAP OF HOLES.
+	storage_backend_t* backend = allocateStorageBackend(sparseBackend);
+	backend->readExtents    = readSparseExtents;
+	backend->getSize        = getSparseSize;
+	backend->getBlockSize   = getSparseBlockSize;
+	backend->close          = closeSparseBackend;
+	backend->adviseWillNeed = adviseSparseWillNeed;
+	backend->isHole         = isSparseHole;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readSparseExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	sparse_backend_t* sparseBackend = (sparse_backend_t*) backend->state;
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint8_t* buffer   = extents[extentIndex].buffer;
+		uint64_t position = extents[extentIndex].byteOffset;
+		uint64_t end      = extents[extentIndex].byteOffset + extents[extentIndex].numBytes;
+
+		//
+		// VERIFY THE EXTENT IS ACTUALLY ON THE DEVICE.
+		if (end > sparseBackend->size || end < position)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+
+		//
+		// WALK THROUGH THE EXTENT, ZERO-FILLING THE HOLES AND READING THE DATA.
+		uint32_t segmentIndex = findDataSegment(sparseBackend, position);
+		while (position < end) {
+
+			//
+			// IF THERE IS NO MORE DATA IN THE EXTENT, THE REST OF IT IS A HOLE.
+			if (segmentIndex == sparseBackend->numSegments ||
+			    sparseBackend->segments[segmentIndex].start >= end) {
+				memset(buffer, 0, end - position);
+				break;
+			}
+
+			//
+			// ZERO-FILL THE HOLE BEFORE THE NEXT RUN OF DATA.
+			data_segment_t* segment = &(sparseBackend->segments[segmentIndex]);
+			if (segment->start > position) {
+				memset(buffer, 0, segment->start - position);
+				buffer  += segment->start - position;
+				position = segment->start;
+			}
+
+			//
+			// READ AS MUCH OF THE RUN OF DATA AS THE EXTENT COVERS.
+			uint64_t numBytes = ((segment->end < end) ? segment->end : end) - position;
+			preadData(sparseBackend, buffer, position, numBytes);
+			buffer   += numBytes;
+			position += numBytes;
+			segmentIndex++;
+		}
+
+		extentIndex++;
+	}
+
+}
+
+
+uint64_t getSparseSize(storage_backend_t* backend) {
+
+	return ((sparse_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getSparseBlockSize(storage_backend_t* backend) {
+
+	return ((sparse_backend_t*) backend->state)->blockSize;
+
+}
+
+
+void closeSparseBackend(storage_backend_t* backend) {
+
+	sparse_backend_t* sparseBackend = (sparse_backend_t*) backend->state;
+	close(sparseBackend->fileDescriptor);
+	free(sparseBackend->segments);
+	free(sparseBackend);
+	free(backend);
+
+}
+
+
+void adviseSparseWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	//
+	// THERE IS NO NEED TO ASK FOR A RANGE THAT IS NOTHING BUT A HOLE.
+	if (isSparseHole(backend, byteOffset, numBytes))
+		return;
+	posix_fadvise(((sparse_backend_t*) backend->state)->fileDescriptor,
+	              (off_t) byteOffset, (off_t) numBytes, POSIX_FADV_WILLNEED);
+
+}
+
+
+uint8_t isSparseHole(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	sparse_backend_t* sparseBackend = (sparse_backend_t*) backend->state;
+
+	//
+	// THE RANGE IS A HOLE IF THE FIRST RUN OF DATA ENDING AFTER ITS START ALSO
+	// STARTS AFTER ITS END.
+	uint32_t segmentIndex = findDataSegment(sparseBackend, byteOffset);
+	return (segmentIndex == sparseBackend->numSegments ||
+	        sparseBackend->segments[segmentIndex].start >= byteOffset + numBytes);
+
+}
+
+
+void mapDataSegments(sparse_backend_t* sparseBackend) {
+
+	uint32_t maxSegments = 16;
+	sparseBackend->segments = (data_segment_t*) malloc(maxSegments * sizeof(data_segment_t));
+	if (sparseBackend->segments == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the map of holes");
+
+	off_t position = 0;
+	while ((uint64_t) position < sparseBackend->size) {
+
+		//
+		// FIND THE START OF THE NEXT RUN OF DATA.  ENXIO MEANS THERE IS NONE
+		// (THE REST OF THE IMAGE IS A HOLE); ANY OTHER ERROR MEANS HOLES CANNOT
+		// BE REPORTED, SO THE REST OF THE IMAGE IS TREATED AS DATA.
+		off_t dataStart = lseek(sparseBackend->fileDescriptor, position, SEEK_DATA);
+		if (dataStart < 0 && errno == ENXIO)
+			break;
+		if (dataStart < 0)
+			dataStart = position;
+
+		//
+		// FIND THE END OF THE RUN OF DATA (THERE IS ALWAYS A HOLE AT THE END OF
+		// THE IMAGE).
+		off_t dataEnd = lseek(sparseBackend->fileDescriptor, dataStart, SEEK_HOLE);
+		if (dataEnd < 0)
+			dataEnd = (off_t) sparseBackend->size;
+
+		//
+		// ADD THE RUN TO THE MAP, MAKING ROOM FOR IT IF NEED BE.
+		if (sparseBackend->numSegments == maxSegments) {
+			maxSegments *= 2;
+			sparseBackend->segments = (data_segment_t*)
+					realloc(sparseBackend->segments, maxSegments * sizeof(data_segment_t));
+			if (sparseBackend->segments == NULL)
+				handleError(L"openDevice",
+				            L"Unable to allocate memory for the map of holes");
+		}
+		sparseBackend->segments[sparseBackend->numSegments].start = (uint64_t) dataStart;
+		sparseBackend->segments[sparseBackend->numSegments].end   = (uint64_t) dataEnd;
+		sparseBackend->numSegments++;
+
+		position = dataEnd;
+	}
+
+}
+
+
+uint32_t findDataSegment(sparse_backend_t* sparseBackend, uint64_t byteOffset) {
+
+	//
+	// THE RUNS ARE IN ORDER, SO BINARY SEARCH FOR THE FIRST ONE THAT ENDS
+	// AFTER THE OFFSET.
+	uint32_t low  = 0;
+	uint32_t high = sparseBackend->numSegments;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (sparseBackend->segments[middle].end <= byteOffset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+
+}
+
+
+void preadData(sparse_backend_t* sparseBackend, uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes) {
+
+	uint64_t numRead = 0;
+	while (numRead < numBytes) {
+		ssize_t result = pread(sparseBackend->fileDescriptor, buffer + numRead,
+		                       numBytes - numRead, (off_t) (byteOffset + numRead));
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		numRead += (uint64_t) result;
+	}
+
+}
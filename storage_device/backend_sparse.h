@@ -0,0 +1,48 @@
+/******************************************************************************
+ * This file contains the
+ *                           SPARSE BACKEND
+ * which reads a sparse image file, without reading its holes.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_SPARSE_H_
+#define BACKEND_SPARSE_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+/*
+ * Opens the specified image file for positional reads, and maps out where its
+ * data and its holes are (with SEEK_DATA and SEEK_HOLE) once, up front.  Any
+ * part of a read that falls in a hole is then zero-filled in memory, without
+ * asking the operating system for it at all.
+ *
+ * If the file system holding the image cannot report holes, the whole image
+ * is treated as data, and this behaves just like the pread backend.
+ */
+storage_backend_t* openSparseBackend(char* deviceFileName);
+
+
+
+
+#endif
@@ -0,0 +1,347 @@
+/******************************************************************************
+ * This file contains the
+ *                            SPLIT BACKEND
+ * which reads a raw image that was split into numbered segment files.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_split.h"
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+
+
+/*
+ * A data structure used to store one segment of the image.
+ */
+typedef struct {
+
+	int      fileDescriptor;       // The segment file.
+	uint64_t start;                // Where the segment starts on the device.
+	uint64_t size;                 // The size of the segment (in bytes).
+
+} segment_t;
+
+
+/*
+ * A data structure used to store the state of the split backend.
+ */
+typedef struct {
+
+	segment_t* segments;           // The segments, in order (this is the offset table).
+	uint32_t   numSegments;        // The number of segments.
+	uint64_t   size;               // The size of the whole device (in bytes).
+	uint32_t   blockSize;          // The preferred I/O size of the first segment.
+
+} split_backend_t;
+
+
+/*
+ * The split backend's operations (see storage_backend.h).
+ */
+void     readSplitExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getSplitSize(storage_backend_t* backend);
+uint32_t getSplitBlockSize(storage_backend_t* backend);
+void     closeSplitBackend(storage_backend_t* backend);
+void     adviseSplitWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+
+/*
+ * Used to get the name of the given segment, by counting up the number at the
+ * end of the first segment's name (keeping its width).  Returns NULL if the
+ * first segment's name does not end in a number.  The name is allocated, and
+ * must be freed by the caller.
+ */
+char* getSegmentName(char* firstSegmentName, uint32_t segmentIndex);
+
+
+/*
+ * Used to find the segment that holds the given byte of the device.
+ */
+uint32_t findSegment(split_backend_t* splitBackend, uint64_t byteOffset);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openSplitBackend(char* firstSegmentName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	split_backend_t* splitBackend = (split_backend_t*) calloc(1, sizeof(split_backend_t));
+	uint32_t maxSegments = 16;
+	if (splitBackend != NULL)
+		splitBackend->segments = (segment_t*) malloc(maxSegments * sizeof(segment_t));
+	if (splitBackend == NULL || splitBackend->segments == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// OPEN EVERY SEGMENT IN TURN, UNTIL THE NEXT ONE DOES NOT EXIST, AND
+	// RECORD WHERE EACH ONE STARTS.
+	while (1) {
+		char* segmentName = getSegmentName(firstSegmentName, splitBackend->numSegments);
+		if (segmentName == NULL)
+			handleError(L"openDevice",
+			            L"The first segment's name must end in a number (e.g. image.001)");
+		int fileDescriptor = open(segmentName, O_RDONLY);
+		free(segmentName);
+		if (fileDescriptor < 0 && errno == ENOENT && splitBackend->numSegments > 0)
+			break;
+		if (fileDescriptor < 0)
+			handleError(L"openDevice",
+			            L"The storage device could not be opened");
+
+		//
+		// GET THE SIZE OF THE SEGMENT.
+		off_t size = lseek(fileDescriptor, 0, SEEK_END);
+		if (size < 0)
+			handleError(L"openDevice",
+			            L"Unable to determine the size of the storage device");
+
+		//
+		// ADD IT TO THE TABLE, MAKING ROOM FOR IT IF NEED BE.
+		if (splitBackend->numSegments == maxSegments) {
+			maxSegments *= 2;
+			splitBackend->segments = (segment_t*)
+					realloc(splitBackend->segments, maxSegments * sizeof(segment_t));
+			if (splitBackend->segments == NULL)
+				handleError(L"openDevice",
+				            L"Unable to allocate memory for the storage device");
+		}
+		splitBackend->segments[splitBackend->numSegments].fileDescriptor = fileDescriptor;
+		splitBackend->segments[splitBackend->numSegments].start          = splitBackend->size;
+		splitBackend->segments[splitBackend->numSegments].size           = (uint64_t) size;
+		splitBackend->size += (uint64_t) size;
+		splitBackend->numSegments++;
+	}
+
+	//
+	// GET THE PREFERRED I/O SIZE.
+	struct stat status;
+	splitBackend->blockSize = BUFSIZ;
+	if (fstat(splitBackend->segments[0].fileDescriptor, &status) == 0 && status.st_blksize > 0)
+		splitBackend->blockSize = (uint32_t) status.st_blksize;
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS NO SINGLE FILE DESCRIPTOR FOR THE
+	// ASYNCHRONOUS READER TO USE.
+	storage_backend_t* backend = allocateStorageBackend(splitBackend);
+	backend->readExtents    = readSplitExtents;
+	backend->getSize        = getSplitSize;
+	backend->getBlockSize   = getSplitBlockSize;
+	backend->close          = closeSplitBackend;
+	backend->adviseWillNeed = adviseSplitWillNeed;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readSplitExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	split_backend_t* splitBackend = (split_backend_t*) backend->state;
+
+	//
+	// THE PIECES OF THE EXTENTS THAT FOLLOW ONE ANOTHER WITHIN A SEGMENT ARE
+	// GATHERED UP, AND READ WITH A SINGLE preadv.
+	struct iovec vectors[STORAGE_BACKEND_MAX_VECTORS];
+	int      numVectors    = 0;
+	uint32_t groupSegment  = 0;
+	uint64_t groupStart    = 0;
+	uint64_t groupEnd      = 0;
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint8_t* buffer   = extents[extentIndex].buffer;
+		uint64_t position = extents[extentIndex].byteOffset;
+		uint64_t end      = extents[extentIndex].byteOffset + extents[extentIndex].numBytes;
+
+		//
+		// VERIFY THE EXTENT IS ACTUALLY ON THE DEVICE.
+		if (end > splitBackend->size || end < position)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+
+		//
+		// SPLIT THE EXTENT AT THE SEGMENT BOUNDARIES IT CROSSES.
+		while (position < end) {
+			uint32_t  segmentIndex  = findSegment(splitBackend, position);
+			segment_t* segment      = &(splitBackend->segments[segmentIndex]);
+			uint64_t  segmentOffset = position - segment->start;
+			uint64_t  numBytes      = segment->size - segmentOffset;
+			if (numBytes > end - position)
+				numBytes = end - position;
+
+			//
+			// READ IN WHAT HAS BEEN GATHERED SO FAR IF THIS PIECE DOES NOT
+			// DIRECTLY FOLLOW IT.
+			if (numVectors > 0 &&
+			    (segmentIndex != groupSegment || segmentOffset != groupEnd || numVectors == STORAGE_BACKEND_MAX_VECTORS)) {
+				preadVectors(splitBackend->segments[groupSegment].fileDescriptor, vectors, numVectors, groupStart);
+				numVectors = 0;
+			}
+			if (numVectors == 0) {
+				groupSegment = segmentIndex;
+				groupStart   = segmentOffset;
+				groupEnd     = segmentOffset;
+			}
+
+			//
+			// GATHER THIS PIECE.
+			vectors[numVectors].iov_base = buffer;
+			vectors[numVectors].iov_len  = numBytes;
+			numVectors++;
+			groupEnd += numBytes;
+			buffer   += numBytes;
+			position += numBytes;
+		}
+
+		extentIndex++;
+	}
+
+	//
+	// READ IN WHATEVER IS LEFT.
+	if (numVectors > 0)
+		preadVectors(splitBackend->segments[groupSegment].fileDescriptor, vectors, numVectors, groupStart);
+
+}
+
+
+uint64_t getSplitSize(storage_backend_t* backend) {
+
+	return ((split_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getSplitBlockSize(storage_backend_t* backend) {
+
+	return ((split_backend_t*) backend->state)->blockSize;
+
+}
+
+
+void closeSplitBackend(storage_backend_t* backend) {
+
+	split_backend_t* splitBackend = (split_backend_t*) backend->state;
+	uint32_t segmentIndex = 0;
+	while (segmentIndex < splitBackend->numSegments) {
+		close(splitBackend->segments[segmentIndex].fileDescriptor);
+		segmentIndex++;
+	}
+	free(splitBackend->segments);
+	free(splitBackend);
+	free(backend);
+
+}
+
+
+void adviseSplitWillNeed(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	split_backend_t* splitBackend = (split_backend_t*) backend->state;
+
+	//
+	// ADVISE EACH SEGMENT THE RANGE TOUCHES ABOUT ITS OWN PART OF THE RANGE.
+	uint64_t end = byteOffset + numBytes;
+	while (byteOffset < end && byteOffset < splitBackend->size) {
+		segment_t* segment = &(splitBackend->segments[findSegment(splitBackend, byteOffset)]);
+		uint64_t segmentOffset = byteOffset - segment->start;
+		uint64_t length = segment->size - segmentOffset;
+		if (length > end - byteOffset)
+			length = end - byteOffset;
+		posix_fadvise(segment->fileDescriptor, (off_t) segmentOffset, (off_t) length, POSIX_FADV_WILLNEED);
+		byteOffset += length;
+	}
+
+}
+
+
+char* getSegmentName(char* firstSegmentName, uint32_t segmentIndex) {
+
+	//
+	// FIND THE NUMBER AT THE END OF THE NAME.
+	size_t nameLength = strlen(firstSegmentName);
+	size_t prefixLength = nameLength;
+	while (prefixLength > 0 && isdigit((unsigned char) firstSegmentName[prefixLength - 1]))
+		prefixLength--;
+	if (prefixLength == nameLength)
+		return NULL;
+
+	//
+	// COUNT UP FROM IT, KEEPING AT LEAST AS MANY DIGITS.
+	int numDigits = (int) (nameLength - prefixLength);
+	unsigned long long segmentNumber = strtoull(firstSegmentName + prefixLength, NULL, 10) + segmentIndex;
+	size_t maxLength = prefixLength + (size_t) numDigits + 21;
+	char* segmentName = (char*) malloc(maxLength);
+	if (segmentName == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	snprintf(segmentName, maxLength, "%.*s%0*llu",
+	         (int) prefixLength, firstSegmentName, numDigits, segmentNumber);
+	return segmentName;
+
+}
+
+
+uint32_t findSegment(split_backend_t* splitBackend, uint64_t byteOffset) {
+
+	//
+	// BINARY SEARCH FOR THE LAST SEGMENT THAT STARTS AT OR BEFORE THE OFFSET
+	// (WHICH SKIPS OVER ANY EMPTY SEGMENTS).
+	uint32_t low  = 0;
+	uint32_t high = splitBackend->numSegments;
+	while (high - low > 1) {
+		uint32_t middle = low + (high - low) / 2;
+		if (splitBackend->segments[middle].start <= byteOffset)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+
+}
+
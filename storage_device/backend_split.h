@@ -0,0 +1,49 @@
+/******************************************************************************
+ * This file contains the
+ *                            SPLIT BACKEND
+ * which reads a raw image that was split into numbered segment files.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_SPLIT_H_
+#define BACKEND_SPLIT_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+/*
+ * Opens a raw image split into segments, given the name of the first segment
+ * (e.g. "image.001").  The segments are the files whose names count up from
+ * there ("image.002", "image.003", and so on) until one does not exist, and
+ * together they are read as one device, without being joined on disk.
+ *
+ * A table of where each segment starts is built once, when the image is
+ * opened.  Reads that are contiguous on the device are gathered into a single
+ * preadv per segment they touch.
+ */
+storage_backend_t* openSplitBackend(char* firstSegmentName);
+
+
+
+
+#endif
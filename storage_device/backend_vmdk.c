@@ -0,0 +1,576 @@
+/******************************************************************************
+ * This file contains the
+ *                             VMDK BACKEND
+ * which reads the disk inside a sparse VMDK container without converting it
+ * first.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "backend_vmdk.h"
+#include "storage_backend.h"
+#include "table_cache.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ZLIB
+#include <zlib.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE MAGIC NUMBER AT THE START OF A SPARSE EXTENT ("KDMV").
+#define VMDK_MAGIC 0x564d444b
+
+// THE SIZE OF A SECTOR, IN WHICH EVERY OFFSET IN THE CONTAINER IS GIVEN.
+#define VMDK_SECTOR_SIZE 512
+
+// THE SIZE OF THE HEADER (AND OF THE FOOTER OF A STREAM-OPTIMIZED EXTENT,
+// WHICH IS FOLLOWED BY ONE MORE SECTOR: THE END-OF-STREAM MARKER).
+#define VMDK_HEADER_SIZE 512
+
+// THE GRAIN DIRECTORY OFFSET THAT MEANS IT IS GIVEN IN THE FOOTER INSTEAD.
+#define VMDK_GD_AT_END 0xffffffffffffffffULL
+
+// THE FLAG THAT MARKS AN EXTENT WHOSE GRAINS ARE COMPRESSED.
+#define VMDK_FLAG_COMPRESSED 0x10000
+
+// THE ONLY COMPRESSION ALGORITHM THERE IS.
+#define VMDK_COMPRESSION_DEFLATE 1
+
+// THE GRAIN TABLE ENTRY THAT MARKS A GRAIN OF ZEROS (0 MEANS UNALLOCATED).
+#define VMDK_ZERO_GRAIN 1
+
+// THE LARGEST GRAIN (IN SECTORS) AND GRAIN TABLE (IN ENTRIES) ACCEPTED.
+#define VMDK_MAX_GRAIN_SECTORS 2048
+#define VMDK_MAX_TABLE_ENTRIES 65536
+
+// THE LARGEST EMBEDDED DESCRIPTOR THAT IS READ.
+#define VMDK_MAX_DESCRIPTOR_SIZE (1024 * 1024)
+
+// THE SIZE OF THE HEADER OF A COMPRESSED GRAIN (ITS SECTOR NUMBER, AND THE
+// LENGTH OF THE DATA AFTER IT).
+#define VMDK_GRAIN_MARKER_SIZE 12
+
+
+
+
+/*
+ * A data structure used to store the state of the VMDK backend.
+ */
+typedef struct {
+
+	int             fileDescriptor;        // The container file.
+	uint64_t        containerSize;         // The size of the container file.
+	uint64_t        size;                  // The size of the disk inside it.
+	uint64_t        grainSize;             // The size of a grain (in bytes).
+	uint32_t        entriesPerTable;       // The number of entries in a grain table.
+	uint32_t*       grainDirectory;        // The sectors of the grain tables.
+	uint64_t        numTables;             // The number of entries in the grain directory.
+	uint8_t         compressed;            // 1 if the grains are compressed.
+	table_cache_t*  tableCache;            // The most recently used grain tables.
+	pthread_mutex_t compressedLock;        // Guards the buffers below.
+	uint8_t*        compressedInput;       // Holds a compressed grain as it is read in.
+	uint64_t        compressedInputSize;   // The size of that buffer.
+	uint8_t*        decompressedGrain;     // The last compressed grain decompressed.
+	uint64_t        decompressedEntry;     // Its grain table entry (0 if there is none yet).
+
+} vmdk_backend_t;
+
+
+/*
+ * The VMDK backend's operations (see storage_backend.h).
+ */
+void     readVmdkExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+uint64_t getVmdkSize(storage_backend_t* backend);
+uint32_t getVmdkBlockSize(storage_backend_t* backend);
+void     closeVmdkBackend(storage_backend_t* backend);
+uint8_t  isVmdkHole(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+
+/*
+ * Used to make sure the embedded descriptor (if there is one) describes a
+ * disk that is entirely inside this one file.
+ */
+void checkVmdkDescriptor(vmdk_backend_t* vmdkBackend, uint64_t descriptorOffset, uint64_t descriptorSize);
+
+
+/*
+ * Used to get the grain table entry of the grain holding the given byte of the
+ * disk (0 if the grain was never written).
+ */
+uint64_t getVmdkGrainEntry(vmdk_backend_t* vmdkBackend, uint64_t byteOffset);
+
+
+/*
+ * Used by the table cache to read and decode a grain table.
+ */
+void loadVmdkTable(void* context, uint64_t tableOffset, uint64_t* entries);
+
+
+/*
+ * Used to copy part of a compressed grain into a buffer, decompressing the
+ * grain unless it was the last one decompressed.
+ */
+void readVmdkCompressedGrain(vmdk_backend_t* vmdkBackend,
+                             uint64_t        entry,
+                             uint8_t*        buffer,
+                             uint64_t        grainOffset,
+                             uint64_t        numBytes);
+
+
+/*
+ * Used to read a range of the container file, no matter how many calls it
+ * takes.
+ */
+void preadVmdk(vmdk_backend_t* vmdkBackend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset);
+
+
+/*
+ * Used to decode a little-endian number of the given width (in bytes).
+ */
+uint64_t readLittleEndian(uint8_t* bytes, uint32_t numBytes);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* openVmdkBackend(char* deviceFileName) {
+
+	//
+	// ALLOCATE THE BACKEND'S STATE.
+	vmdk_backend_t* vmdkBackend = (vmdk_backend_t*) calloc(1, sizeof(vmdk_backend_t));
+	if (vmdkBackend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	pthread_mutex_init(&(vmdkBackend->compressedLock), NULL);
+
+	//
+	// OPEN THE CONTAINER.
+	vmdkBackend->fileDescriptor = open(deviceFileName, O_RDONLY);
+	struct stat status;
+	if (vmdkBackend->fileDescriptor < 0 || fstat(vmdkBackend->fileDescriptor, &status) != 0)
+		handleError(L"openDevice",
+		            L"The storage device could not be opened");
+	vmdkBackend->containerSize = (uint64_t) status.st_size;
+
+	//
+	// READ IN THE HEADER.
+	uint8_t header[VMDK_HEADER_SIZE];
+	if (vmdkBackend->containerSize < VMDK_HEADER_SIZE)
+		handleError(L"openDevice",
+		            L"The storage device is not a sparse VMDK container");
+	preadVmdk(vmdkBackend, header, VMDK_HEADER_SIZE, 0);
+	if (readLittleEndian(header, 4) != VMDK_MAGIC)
+		handleError(L"openDevice",
+		            L"The storage device is not a sparse VMDK container");
+	uint32_t version = (uint32_t) readLittleEndian(header + 4, 4);
+	if (version < 1 || version > 3)
+		handleError(L"openDevice",
+		            L"Only sparse VMDK containers of version 1 to 3 are supported");
+	checkVmdkDescriptor(vmdkBackend, readLittleEndian(header + 28, 8), readLittleEndian(header + 36, 8));
+
+	//
+	// A STREAM-OPTIMIZED EXTENT IS WRITTEN FRONT TO BACK, SO ITS GRAIN
+	// DIRECTORY IS ONLY FOUND IN THE FOOTER, JUST BEFORE THE LAST SECTOR.
+	if (readLittleEndian(header + 56, 8) == VMDK_GD_AT_END) {
+		if (vmdkBackend->containerSize < 3 * VMDK_HEADER_SIZE)
+			handleError(L"openDevice",
+			            L"The VMDK container is corrupt");
+		preadVmdk(vmdkBackend, header, VMDK_HEADER_SIZE, vmdkBackend->containerSize - 2 * VMDK_HEADER_SIZE);
+		if (readLittleEndian(header, 4) != VMDK_MAGIC || readLittleEndian(header + 56, 8) == VMDK_GD_AT_END)
+			handleError(L"openDevice",
+			            L"The VMDK container is corrupt");
+	}
+
+	//
+	// GET THE GEOMETRY OF THE CONTAINER.
+	uint64_t capacity    = readLittleEndian(header + 12, 8);
+	uint64_t grainSize   = readLittleEndian(header + 20, 8);
+	uint32_t flags       = (uint32_t) readLittleEndian(header + 8, 4);
+	uint32_t compression = (uint32_t) readLittleEndian(header + 77, 2);
+	vmdkBackend->entriesPerTable = (uint32_t) readLittleEndian(header + 44, 4);
+	if (grainSize == 0 || grainSize > VMDK_MAX_GRAIN_SECTORS || (grainSize & (grainSize - 1)) != 0 ||
+	    vmdkBackend->entriesPerTable == 0 || vmdkBackend->entriesPerTable > VMDK_MAX_TABLE_ENTRIES ||
+	    capacity > UINT64_MAX / VMDK_SECTOR_SIZE)
+		handleError(L"openDevice",
+		            L"The VMDK container is corrupt");
+	vmdkBackend->size      = capacity * VMDK_SECTOR_SIZE;
+	vmdkBackend->grainSize = grainSize * VMDK_SECTOR_SIZE;
+	if ((flags & VMDK_FLAG_COMPRESSED) != 0) {
+		if (compression != VMDK_COMPRESSION_DEFLATE)
+			handleError(L"openDevice",
+			            L"The VMDK container uses a compression algorithm that is not supported");
+		vmdkBackend->compressed = 1;
+	}
+
+	//
+	// READ IN THE WHOLE GRAIN DIRECTORY (ONE ENTRY PER GRAIN TABLE).
+	uint64_t grainsPerTable = grainSize * vmdkBackend->entriesPerTable;
+	vmdkBackend->numTables = (capacity + grainsPerTable - 1) / grainsPerTable;
+	uint64_t directoryOffset = readLittleEndian(header + 56, 8) * VMDK_SECTOR_SIZE;
+	uint64_t directoryBytes  = vmdkBackend->numTables * 4;
+	if (directoryOffset > vmdkBackend->containerSize || directoryBytes > vmdkBackend->containerSize - directoryOffset)
+		handleError(L"openDevice",
+		            L"The VMDK container is corrupt");
+	uint8_t* directoryData = (uint8_t*) malloc(directoryBytes + 1);
+	vmdkBackend->grainDirectory = (uint32_t*) malloc(directoryBytes + 1);
+	if (directoryData == NULL || vmdkBackend->grainDirectory == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	preadVmdk(vmdkBackend, directoryData, directoryBytes, directoryOffset);
+	uint64_t tableIndex = 0;
+	while (tableIndex < vmdkBackend->numTables) {
+		vmdkBackend->grainDirectory[tableIndex] = (uint32_t) readLittleEndian(directoryData + tableIndex * 4, 4);
+		tableIndex++;
+	}
+	free(directoryData);
+
+	//
+	// SET UP THE CACHE OF GRAIN TABLES, AND THE BUFFER FOR COMPRESSED GRAINS.
+	vmdkBackend->tableCache = createTableCache(TABLE_CACHE_TABLES, vmdkBackend->entriesPerTable,
+	                                           loadVmdkTable, vmdkBackend);
+	if (vmdkBackend->compressed) {
+		vmdkBackend->decompressedGrain = (uint8_t*) malloc(vmdkBackend->grainSize);
+		if (vmdkBackend->decompressedGrain == NULL)
+			handleError(L"openDevice",
+			            L"Unable to allocate memory for the storage device");
+	}
+
+	//
+	// FILL IN THE OPERATIONS.  THERE IS NO FILE DESCRIPTOR FOR THE ASYNCHRONOUS
+	// READER, SINCE THE CONTAINER DOES NOT HOLD THE DISK'S BYTES IN PLACE.
+	storage_backend_t* backend = allocateStorageBackend(vmdkBackend);
+	backend->readExtents  = readVmdkExtents;
+	backend->getSize      = getVmdkSize;
+	backend->getBlockSize = getVmdkBlockSize;
+	backend->close        = closeVmdkBackend;
+	backend->isHole       = isVmdkHole;
+	return backend;
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readVmdkExtents(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents) {
+
+	vmdk_backend_t* vmdkBackend = (vmdk_backend_t*) backend->state;
+
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		uint8_t* buffer   = extents[extentIndex].buffer;
+		uint64_t position = extents[extentIndex].byteOffset;
+		uint64_t end      = extents[extentIndex].byteOffset + extents[extentIndex].numBytes;
+
+		//
+		// VERIFY THE EXTENT IS ACTUALLY ON THE DISK.
+		if (end > vmdkBackend->size || end < position)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+
+		//
+		// TRANSLATE THE EXTENT ONE GRAIN AT A TIME.  GRAINS THAT FOLLOW ONE
+		// ANOTHER IN THE CONTAINER TOO ARE READ IN WITH A SINGLE REQUEST.
+		uint8_t* runBuffer = buffer;
+		uint64_t runOffset = 0;
+		uint64_t runLength = 0;
+		while (position < end) {
+			uint64_t grainOffset = position & (vmdkBackend->grainSize - 1);
+			uint64_t numBytes = vmdkBackend->grainSize - grainOffset;
+			if (numBytes > end - position)
+				numBytes = end - position;
+			uint64_t entry = getVmdkGrainEntry(vmdkBackend, position);
+
+			if (entry > VMDK_ZERO_GRAIN && !vmdkBackend->compressed) {
+
+				//
+				// AN ORDINARY GRAIN JOINS THE CURRENT RUN IF IT CARRIES ON FROM
+				// IT, OR STARTS A NEW ONE.
+				uint64_t hostOffset = entry * VMDK_SECTOR_SIZE + grainOffset;
+				if (runLength > 0 && runOffset + runLength == hostOffset) {
+					runLength += numBytes;
+				}
+				else {
+					if (runLength > 0)
+						preadVmdk(vmdkBackend, runBuffer, runLength, runOffset);
+					runBuffer = buffer;
+					runOffset = hostOffset;
+					runLength = numBytes;
+				}
+			}
+			else {
+
+				//
+				// ANYTHING ELSE ENDS THE RUN.
+				if (runLength > 0)
+					preadVmdk(vmdkBackend, runBuffer, runLength, runOffset);
+				runLength = 0;
+				if (entry > VMDK_ZERO_GRAIN)
+					readVmdkCompressedGrain(vmdkBackend, entry, buffer, grainOffset, numBytes);
+				else
+					memset(buffer, 0, numBytes);
+			}
+
+			buffer   += numBytes;
+			position += numBytes;
+		}
+		if (runLength > 0)
+			preadVmdk(vmdkBackend, runBuffer, runLength, runOffset);
+
+		extentIndex++;
+	}
+
+}
+
+
+uint64_t getVmdkSize(storage_backend_t* backend) {
+
+	return ((vmdk_backend_t*) backend->state)->size;
+
+}
+
+
+uint32_t getVmdkBlockSize(storage_backend_t* backend) {
+
+	return (uint32_t) ((vmdk_backend_t*) backend->state)->grainSize;
+
+}
+
+
+void closeVmdkBackend(storage_backend_t* backend) {
+
+	vmdk_backend_t* vmdkBackend = (vmdk_backend_t*) backend->state;
+	destroyTableCache(vmdkBackend->tableCache);
+	pthread_mutex_destroy(&(vmdkBackend->compressedLock));
+	free(vmdkBackend->compressedInput);
+	free(vmdkBackend->decompressedGrain);
+	free(vmdkBackend->grainDirectory);
+	close(vmdkBackend->fileDescriptor);
+	free(vmdkBackend);
+	free(backend);
+
+}
+
+
+uint8_t isVmdkHole(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes) {
+
+	vmdk_backend_t* vmdkBackend = (vmdk_backend_t*) backend->state;
+
+	//
+	// THE RANGE IS A HOLE IF EVERY GRAIN IT TOUCHES WAS NEVER WRITTEN, OR IS
+	// MARKED AS ALL ZEROS.
+	uint64_t end = byteOffset + numBytes;
+	if (end > vmdkBackend->size || end < byteOffset)
+		return 0;
+	uint64_t position = byteOffset & ~(vmdkBackend->grainSize - 1);
+	while (position < end) {
+		if (getVmdkGrainEntry(vmdkBackend, position) > VMDK_ZERO_GRAIN)
+			return 0;
+		position += vmdkBackend->grainSize;
+	}
+	return 1;
+
+}
+
+
+void checkVmdkDescriptor(vmdk_backend_t* vmdkBackend, uint64_t descriptorOffset, uint64_t descriptorSize) {
+
+	//
+	// THERE IS NOTHING TO CHECK IF THERE IS NO DESCRIPTOR.
+	if (descriptorOffset == 0 || descriptorSize == 0)
+		return;
+	uint64_t offset = descriptorOffset * VMDK_SECTOR_SIZE;
+	uint64_t length = descriptorSize * VMDK_SECTOR_SIZE;
+	if (length > VMDK_MAX_DESCRIPTOR_SIZE)
+		length = VMDK_MAX_DESCRIPTOR_SIZE;
+	if (offset > vmdkBackend->containerSize || length > vmdkBackend->containerSize - offset)
+		handleError(L"openDevice",
+		            L"The VMDK container is corrupt");
+
+	//
+	// READ IT IN AS A STRING.
+	char* descriptor = (char*) malloc(length + 1);
+	if (descriptor == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	preadVmdk(vmdkBackend, (uint8_t*) descriptor, length, offset);
+	descriptor[length] = '\0';
+
+	//
+	// ONLY THE TWO SINGLE-FILE SPARSE TYPES ARE READ, AND NEITHER MAY HAVE A
+	// PARENT DISK (A SNAPSHOT ONLY HOLDS WHAT CHANGED SINCE ITS PARENT).
+	char* createType = strstr(descriptor, "createType=\"");
+	if (createType != NULL &&
+	    strncmp(createType + 12, "monolithicSparse\"", 17) != 0 &&
+	    strncmp(createType + 12, "streamOptimized\"", 16) != 0)
+		handleError(L"openDevice",
+		            L"VMDK disks made of several extent files are not supported");
+	if (strstr(descriptor, "parentFileNameHint") != NULL)
+		handleError(L"openDevice",
+		            L"VMDK disks with a parent disk are not supported");
+	free(descriptor);
+
+}
+
+
+uint64_t getVmdkGrainEntry(vmdk_backend_t* vmdkBackend, uint64_t byteOffset) {
+
+	uint64_t grainNumber = byteOffset / vmdkBackend->grainSize;
+	uint64_t tableIndex  = grainNumber / vmdkBackend->entriesPerTable;
+	uint32_t entryIndex  = (uint32_t) (grainNumber % vmdkBackend->entriesPerTable);
+	if (tableIndex >= vmdkBackend->numTables || vmdkBackend->grainDirectory[tableIndex] == 0)
+		return 0;
+	return lookupTableEntry(vmdkBackend->tableCache, vmdkBackend->grainDirectory[tableIndex], entryIndex);
+
+}
+
+
+void loadVmdkTable(void* context, uint64_t tableOffset, uint64_t* entries) {
+
+	vmdk_backend_t* vmdkBackend = (vmdk_backend_t*) context;
+
+	//
+	// THE TABLE (OF 32-BIT ENTRIES) IS READ INTO THE FIRST HALF OF THE ARRAY
+	// OF 64-BIT ENTRIES, AND WIDENED IN PLACE FROM THE LAST ENTRY BACK, SO
+	// THAT NO ENTRY IS OVERWRITTEN BEFORE IT IS DECODED.
+	uint8_t* tableData = (uint8_t*) entries;
+	preadVmdk(vmdkBackend, tableData, (uint64_t) vmdkBackend->entriesPerTable * 4, tableOffset * VMDK_SECTOR_SIZE);
+	uint32_t entryIndex = vmdkBackend->entriesPerTable;
+	while (entryIndex > 0) {
+		entryIndex--;
+		entries[entryIndex] = readLittleEndian(tableData + (uint64_t) entryIndex * 4, 4);
+	}
+
+}
+
+
+void readVmdkCompressedGrain(vmdk_backend_t* vmdkBackend,
+                             uint64_t        entry,
+                             uint8_t*        buffer,
+                             uint64_t        grainOffset,
+                             uint64_t        numBytes) {
+
+	pthread_mutex_lock(&(vmdkBackend->compressedLock));
+	if (vmdkBackend->decompressedEntry != entry) {
+
+		//
+		// THE ENTRY POINTS AT THE GRAIN'S MARKER, WHICH GIVES THE LENGTH OF THE
+		// COMPRESSED DATA AFTER IT.
+		uint64_t offset = entry * VMDK_SECTOR_SIZE;
+		uint8_t marker[VMDK_GRAIN_MARKER_SIZE];
+		if (offset > vmdkBackend->containerSize || vmdkBackend->containerSize - offset < VMDK_GRAIN_MARKER_SIZE)
+			handleError(L"readSectors",
+			            L"The VMDK container is corrupt");
+		preadVmdk(vmdkBackend, marker, VMDK_GRAIN_MARKER_SIZE, offset);
+		uint64_t length = readLittleEndian(marker + 8, 4);
+		if (length > vmdkBackend->containerSize - offset - VMDK_GRAIN_MARKER_SIZE)
+			handleError(L"readSectors",
+			            L"The VMDK container is corrupt");
+
+		//
+		// READ IT IN, MAKING ROOM FOR IT IF NEED BE.
+		if (length > vmdkBackend->compressedInputSize) {
+			free(vmdkBackend->compressedInput);
+			vmdkBackend->compressedInput = (uint8_t*) malloc(length);
+			if (vmdkBackend->compressedInput == NULL)
+				handleError(L"readSectors",
+				            L"Unable to allocate memory for the storage device");
+			vmdkBackend->compressedInputSize = length;
+		}
+		preadVmdk(vmdkBackend, vmdkBackend->compressedInput, length, offset + VMDK_GRAIN_MARKER_SIZE);
+
+		//
+		// DECOMPRESS IT (IT IS A ZLIB STREAM).  A GRAIN AT THE END OF THE DISK
+		// MAY BE SHORT, SO WHATEVER IS NOT FILLED IN IS ZERO.
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit(&stream) != Z_OK)
+			handleError(L"readSectors",
+			            L"Unable to start decompressing the storage device");
+		stream.next_in   = vmdkBackend->compressedInput;
+		stream.avail_in  = (uInt) length;
+		stream.next_out  = vmdkBackend->decompressedGrain;
+		stream.avail_out = (uInt) vmdkBackend->grainSize;
+		int result = inflate(&stream, Z_FINISH);
+		inflateEnd(&stream);
+		if (result != Z_STREAM_END && !(result == Z_BUF_ERROR && stream.avail_out == 0))
+			handleError(L"readSectors",
+			            L"The VMDK container is corrupt");
+		memset(stream.next_out, 0, stream.avail_out);
+		vmdkBackend->decompressedEntry = entry;
+	}
+	memcpy(buffer, vmdkBackend->decompressedGrain + grainOffset, numBytes);
+	pthread_mutex_unlock(&(vmdkBackend->compressedLock));
+
+}
+
+
+void preadVmdk(vmdk_backend_t* vmdkBackend, uint8_t* buffer, uint64_t numBytes, uint64_t byteOffset) {
+
+	while (numBytes > 0) {
+		ssize_t result = pread(vmdkBackend->fileDescriptor, buffer, numBytes, (off_t) byteOffset);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		buffer     += result;
+		numBytes   -= (uint64_t) result;
+		byteOffset += (uint64_t) result;
+	}
+
+}
+
+
+uint64_t readLittleEndian(uint8_t* bytes, uint32_t numBytes) {
+
+	uint64_t value = 0;
+	while (numBytes > 0) {
+		numBytes--;
+		value = (value << 8) | bytes[numBytes];
+	}
+	return value;
+
+}
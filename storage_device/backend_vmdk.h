@@ -0,0 +1,52 @@
+/******************************************************************************
+ * This file contains the
+ *                             VMDK BACKEND
+ * which reads the disk inside a sparse VMDK container without converting it
+ * first.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BACKEND_VMDK_H_
+#define BACKEND_VMDK_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+
+
+
+/*
+ * Opens a single-file sparse VMDK container (monolithicSparse or
+ * streamOptimized), read-only.  Offsets on the disk are translated to offsets
+ * in the container through the grain directory, which is read once when the
+ * container is opened, and the grain tables, which are read as they are
+ * needed and kept decoded in a table cache (see table_cache.h).  Grains that
+ * were never written read as zeros, and compressed grains (streamOptimized)
+ * are decompressed as they are read.
+ *
+ * Disks made of several extent files, or with a parent disk, are not
+ * supported.
+ */
+storage_backend_t* openVmdkBackend(char* deviceFileName);
+
+
+
+
+#endif
@@ -0,0 +1,429 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                               BLOCK CACHE
+ * that sits between the file system and the storage device.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "block_cache.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// POSIX
+#include <pthread.h>
+
+
+
+
+/*
+ * A data structure used to store one cached block.
+ */
+typedef struct cache_entry_t cache_entry_t;
+struct cache_entry_t {
+
+	uint64_t       blockNumber;        // The block number (byte offset / block size).
+	uint32_t       length;             // The number of valid bytes (less than a block only at the end of the device).
+	uint8_t*       data;               // The block contents.
+	cache_entry_t* hashNext;           // The next entry in the same hash bucket.
+	cache_entry_t* newer;              // The next more recently used entry.
+	cache_entry_t* older;              // The next less recently used entry.
+
+};
+
+
+/*
+ * A data structure used to store one shard of the cache.
+ */
+typedef struct {
+
+	pthread_mutex_t lock;              // Guards everything in the shard.
+	cache_entry_t** buckets;           // The hash table.
+	uint32_t        bucketMask;        // The number of buckets, minus 1.
+	cache_entry_t*  newest;            // The most recently used entry.
+	cache_entry_t*  oldest;            // The least recently used entry (evicted first).
+	uint32_t        numEntries;        // The number of entries in the shard.
+	uint32_t        maxEntries;        // The number of entries the shard can hold.
+	uint64_t        hits;              // The number of lookups found in the shard.
+	uint64_t        misses;            // The number of lookups not found in the shard.
+
+} cache_shard_t;
+
+
+/*
+ * A data structure used to store the whole cache.
+ */
+struct block_cache_t {
+
+	cache_shard_t  shards[BLOCK_CACHE_NUM_SHARDS];
+	uint64_t       deviceSize;         // The size of the device (in bytes).
+	block_reader_t blockReader;        // Reads blocks that are not in the cache.
+	void*          context;            // Passed to the block reader.
+
+};
+
+
+/*
+ * Used to pick the shard, and the bucket within it, for a block number.
+ */
+uint64_t hashBlockNumber(uint64_t blockNumber);
+
+
+/*
+ * Used to find a block in its shard.  The shard must be locked.
+ */
+cache_entry_t* findEntry(cache_shard_t* shard, uint64_t blockNumber);
+
+
+/*
+ * Used to mark an entry as the most recently used in its shard.  The shard
+ * must be locked.
+ */
+void touchEntry(cache_shard_t* shard, cache_entry_t* entry);
+
+
+/*
+ * Used to add a block to the cache, evicting the least recently used block in
+ * its shard if the shard is full.
+ */
+void insertBlock(block_cache_t* blockCache, uint64_t blockNumber,
+                 uint8_t* data, uint32_t length);
+
+
+/*
+ * Used to copy the part of a block that overlaps the requested byte range into
+ * the caller's buffer.
+ */
+void copyOverlap(uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes,
+                 uint64_t blockNumber, uint8_t* data, uint32_t length);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+block_cache_t* createBlockCache(uint64_t       capacity,
+                                uint64_t       deviceSize,
+                                block_reader_t blockReader,
+                                void*          context) {
+
+	//
+	// ALLOCATE THE CACHE.
+	block_cache_t* blockCache = (block_cache_t*) calloc(1, sizeof(block_cache_t));
+	if (blockCache == NULL)
+		handleError(L"createBlockCache", L"Unable to allocate memory for the block cache");
+	blockCache->deviceSize  = deviceSize;
+	blockCache->blockReader = blockReader;
+	blockCache->context     = context;
+
+	//
+	// SPLIT THE CAPACITY EVENLY BETWEEN THE SHARDS.
+	uint64_t maxEntries = capacity / BLOCK_CACHE_BLOCK_SIZE / BLOCK_CACHE_NUM_SHARDS;
+	if (maxEntries == 0)
+		maxEntries = 1;
+
+	//
+	// SET UP EACH SHARD WITH A HASH TABLE OF AT LEAST TWICE AS MANY BUCKETS AS
+	// IT HAS ENTRIES (ROUNDED UP TO A POWER OF TWO).
+	uint32_t numBuckets = 1;
+	while (numBuckets < 2 * maxEntries)
+		numBuckets = numBuckets * 2;
+	uint32_t shardIndex = 0;
+	while (shardIndex < BLOCK_CACHE_NUM_SHARDS) {
+		cache_shard_t* shard = &(blockCache->shards[shardIndex]);
+		pthread_mutex_init(&(shard->lock), NULL);
+		shard->buckets = (cache_entry_t**) calloc(numBuckets, sizeof(cache_entry_t*));
+		if (shard->buckets == NULL)
+			handleError(L"createBlockCache", L"Unable to allocate memory for the block cache");
+		shard->bucketMask = numBuckets - 1;
+		shard->maxEntries = (uint32_t) maxEntries;
+		shardIndex++;
+	}
+
+	return blockCache;
+
+}
+
+
+void readThroughBlockCache(block_cache_t* blockCache,
+                           uint8_t*       buffer,
+                           uint64_t       byteOffset,
+                           uint64_t       numBytes) {
+
+	if (numBytes == 0)
+		return;
+
+	//
+	// VERIFY THE BYTES ARE ACTUALLY ON THE DEVICE.
+	if (byteOffset + numBytes > blockCache->deviceSize)
+		handleError(L"readSectors", L"Unable to read in requested sectors");
+
+	uint64_t firstBlock = byteOffset / BLOCK_CACHE_BLOCK_SIZE;
+	uint64_t lastBlock  = (byteOffset + numBytes - 1) / BLOCK_CACHE_BLOCK_SIZE;
+	uint64_t blockNumber = firstBlock;
+	while (blockNumber <= lastBlock) {
+
+		//
+		// TAKE THE BLOCK FROM THE CACHE IF IT IS THERE.
+		uint64_t hash = hashBlockNumber(blockNumber);
+		cache_shard_t* shard = &(blockCache->shards[hash % BLOCK_CACHE_NUM_SHARDS]);
+		pthread_mutex_lock(&(shard->lock));
+		cache_entry_t* entry = findEntry(shard, blockNumber);
+		if (entry != NULL) {
+			touchEntry(shard, entry);
+			copyOverlap(buffer, byteOffset, numBytes, blockNumber, entry->data, entry->length);
+			shard->hits++;
+			pthread_mutex_unlock(&(shard->lock));
+			blockNumber++;
+			continue;
+		}
+		shard->misses++;
+		pthread_mutex_unlock(&(shard->lock));
+
+		//
+		// OTHERWISE, FIND THE WHOLE RUN OF MISSING BLOCKS THAT STARTS HERE.
+		uint64_t runEnd = blockNumber + 1;
+		while (runEnd <= lastBlock) {
+			shard = &(blockCache->shards[hashBlockNumber(runEnd) % BLOCK_CACHE_NUM_SHARDS]);
+			pthread_mutex_lock(&(shard->lock));
+			entry = findEntry(shard, runEnd);
+			if (entry == NULL)
+				shard->misses++;
+			pthread_mutex_unlock(&(shard->lock));
+			if (entry != NULL)
+				break;
+			runEnd++;
+		}
+
+		//
+		// READ THE RUN FROM THE DEVICE WITH A SINGLE REQUEST.
+		uint64_t runOffset = blockNumber * BLOCK_CACHE_BLOCK_SIZE;
+		uint64_t runBytes  = runEnd * BLOCK_CACHE_BLOCK_SIZE;
+		if (runBytes > blockCache->deviceSize)
+			runBytes = blockCache->deviceSize;
+		runBytes = runBytes - runOffset;
+		uint8_t* runData = (uint8_t*) malloc(runBytes);
+		if (runData == NULL)
+			handleError(L"readSectors", L"Unable to allocate memory for the block cache");
+		blockCache->blockReader(blockCache->context, runData, runOffset, runBytes);
+
+		//
+		// HAND THE CALLER ITS PART OF EACH BLOCK, AND KEEP THE BLOCKS.
+		while (blockNumber < runEnd) {
+			uint64_t dataOffset = (blockNumber * BLOCK_CACHE_BLOCK_SIZE) - runOffset;
+			uint32_t length = (runBytes - dataOffset < BLOCK_CACHE_BLOCK_SIZE) ?
+			                  (uint32_t) (runBytes - dataOffset) : BLOCK_CACHE_BLOCK_SIZE;
+			copyOverlap(buffer, byteOffset, numBytes, blockNumber, runData + dataOffset, length);
+			insertBlock(blockCache, blockNumber, runData + dataOffset, length);
+			blockNumber++;
+		}
+		free(runData);
+	}
+
+}
+
+
+void getBlockCacheStatistics(block_cache_t* blockCache,
+                             uint64_t*      hits,
+                             uint64_t*      misses) {
+
+	*hits   = 0;
+	*misses = 0;
+	uint32_t shardIndex = 0;
+	while (shardIndex < BLOCK_CACHE_NUM_SHARDS) {
+		cache_shard_t* shard = &(blockCache->shards[shardIndex]);
+		pthread_mutex_lock(&(shard->lock));
+		*hits   += shard->hits;
+		*misses += shard->misses;
+		pthread_mutex_unlock(&(shard->lock));
+		shardIndex++;
+	}
+
+}
+
+
+void destroyBlockCache(block_cache_t* blockCache) {
+
+	if (blockCache == NULL)
+		return;
+
+	uint32_t shardIndex = 0;
+	while (shardIndex < BLOCK_CACHE_NUM_SHARDS) {
+		cache_shard_t* shard = &(blockCache->shards[shardIndex]);
+		cache_entry_t* entry = shard->newest;
+		while (entry != NULL) {
+			cache_entry_t* older = entry->older;
+			free(entry->data);
+			free(entry);
+			entry = older;
+		}
+		free(shard->buckets);
+		pthread_mutex_destroy(&(shard->lock));
+		shardIndex++;
+	}
+	free(blockCache);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+uint64_t hashBlockNumber(uint64_t blockNumber) {
+
+	//
+	// FIBONACCI HASHING SPREADS OUT RUNS OF CONSECUTIVE BLOCK NUMBERS.
+	return (blockNumber * 0x9e3779b97f4a7c15ull) >> 32;
+
+}
+
+
+cache_entry_t* findEntry(cache_shard_t* shard, uint64_t blockNumber) {
+
+	uint64_t bucket = (hashBlockNumber(blockNumber) / BLOCK_CACHE_NUM_SHARDS) & shard->bucketMask;
+	cache_entry_t* entry = shard->buckets[bucket];
+	while (entry != NULL && entry->blockNumber != blockNumber)
+		entry = entry->hashNext;
+	return entry;
+
+}
+
+
+void touchEntry(cache_shard_t* shard, cache_entry_t* entry) {
+
+	if (shard->newest == entry)
+		return;
+
+	//
+	// UNLINK THE ENTRY FROM WHERE IT IS.
+	if (entry->newer != NULL)
+		entry->newer->older = entry->older;
+	if (entry->older != NULL)
+		entry->older->newer = entry->newer;
+	if (shard->oldest == entry)
+		shard->oldest = entry->newer;
+
+	//
+	// RELINK IT AT THE FRONT.
+	entry->newer = NULL;
+	entry->older = shard->newest;
+	if (shard->newest != NULL)
+		shard->newest->newer = entry;
+	shard->newest = entry;
+	if (shard->oldest == NULL)
+		shard->oldest = entry;
+
+}
+
+
+void insertBlock(block_cache_t* blockCache, uint64_t blockNumber,
+                 uint8_t* data, uint32_t length) {
+
+	cache_shard_t* shard = &(blockCache->shards[hashBlockNumber(blockNumber) % BLOCK_CACHE_NUM_SHARDS]);
+	pthread_mutex_lock(&(shard->lock));
+
+	//
+	// ANOTHER THREAD MAY HAVE READ THE SAME BLOCK IN THE MEANTIME.
+	if (findEntry(shard, blockNumber) != NULL) {
+		pthread_mutex_unlock(&(shard->lock));
+		return;
+	}
+
+	//
+	// REUSE THE LEAST RECENTLY USED ENTRY IF THE SHARD IS FULL.
+	cache_entry_t* entry;
+	if (shard->numEntries == shard->maxEntries) {
+		entry = shard->oldest;
+
+		//
+		// REMOVE IT FROM ITS HASH BUCKET.
+		uint64_t bucket = (hashBlockNumber(entry->blockNumber) / BLOCK_CACHE_NUM_SHARDS) & shard->bucketMask;
+		cache_entry_t** link = &(shard->buckets[bucket]);
+		while (*link != entry)
+			link = &((*link)->hashNext);
+		*link = entry->hashNext;
+
+		//
+		// REMOVE IT FROM THE END OF THE LRU LIST.
+		shard->oldest = entry->newer;
+		if (shard->oldest != NULL)
+			shard->oldest->older = NULL;
+		else
+			shard->newest = NULL;
+		shard->numEntries--;
+	}
+
+	//
+	// OTHERWISE, ALLOCATE A NEW ONE.
+	else {
+		entry = (cache_entry_t*) malloc(sizeof(cache_entry_t));
+		if (entry != NULL)
+			entry->data = (uint8_t*) malloc(BLOCK_CACHE_BLOCK_SIZE);
+		if (entry == NULL || entry->data == NULL)
+			handleError(L"readSectors", L"Unable to allocate memory for the block cache");
+	}
+
+	//
+	// FILL IT IN, AND LINK IT INTO ITS BUCKET AND AT THE FRONT OF THE LIST.
+	entry->blockNumber = blockNumber;
+	entry->length = length;
+	memcpy(entry->data, data, length);
+	uint64_t bucket = (hashBlockNumber(blockNumber) / BLOCK_CACHE_NUM_SHARDS) & shard->bucketMask;
+	entry->hashNext = shard->buckets[bucket];
+	shard->buckets[bucket] = entry;
+	entry->newer = NULL;
+	entry->older = shard->newest;
+	if (shard->newest != NULL)
+		shard->newest->newer = entry;
+	shard->newest = entry;
+	if (shard->oldest == NULL)
+		shard->oldest = entry;
+	shard->numEntries++;
+
+	pthread_mutex_unlock(&(shard->lock));
+
+}
+
+
+void copyOverlap(uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes,
+                 uint64_t blockNumber, uint8_t* data, uint32_t length) {
+
+	//
+	// FIND WHERE THE BLOCK AND THE REQUESTED RANGE OVERLAP.
+	uint64_t blockStart = blockNumber * BLOCK_CACHE_BLOCK_SIZE;
+	uint64_t start = (blockStart > byteOffset) ? blockStart : byteOffset;
+	uint64_t end   = (blockStart + length < byteOffset + numBytes) ?
+	                 blockStart + length : byteOffset + numBytes;
+
+	if (start < end)
+		memcpy(buffer + (start - byteOffset), data + (start - blockStart), end - start);
+
+}
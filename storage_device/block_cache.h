@@ -0,0 +1,121 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                               BLOCK CACHE
+ * that sits between the file system and the storage device.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef BLOCK_CACHE_H_
+#define BLOCK_CACHE_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE SIZE OF EACH CACHED BLOCK (IN BYTES).  BLOCKS ARE ALIGNED TO THIS SIZE
+// ON THE DEVICE, SO THE SAME SECTORS ALWAYS LAND IN THE SAME BLOCK NO MATTER
+// HOW THEY WERE ASKED FOR.
+#define BLOCK_CACHE_BLOCK_SIZE 4096
+
+// THE NUMBER OF INDEPENDENTLY-LOCKED SHARDS THE CACHE IS SPLIT INTO.
+#define BLOCK_CACHE_NUM_SHARDS 16
+
+// THE DEFAULT CACHE SIZE (IN BYTES).
+#define DEFAULT_BLOCK_CACHE_SIZE (64 * 1024 * 1024)
+
+
+
+
+/*
+ * A cache of device blocks (see createBlockCache).
+ */
+typedef struct block_cache_t block_cache_t;
+
+
+
+
+/*
+ * The function the cache uses to read blocks it does not have.  It must read
+ * exactly "numBytes" bytes from the given byte offset into the buffer.
+ */
+typedef void (*block_reader_t)(void*    context,
+                               uint8_t* buffer,
+                               uint64_t byteOffset,
+                               uint64_t numBytes);
+
+
+
+
+/*
+ * Creates an empty cache holding up to "capacity" bytes of a device that is
+ * "deviceSize" bytes long.  Blocks that are not in the cache are read with
+ * "blockReader", which is passed "context".  The cache is split into shards,
+ * each with its own least-recently-used list and its own lock.
+ */
+block_cache_t* createBlockCache(uint64_t       capacity,
+                                uint64_t       deviceSize,
+                                block_reader_t blockReader,
+                                void*          context);
+
+
+
+
+/*
+ * Reads "numBytes" bytes from the given byte offset into the buffer, taking
+ * whatever it can from the cache.  Runs of blocks that are missing from the
+ * cache are read from the device with a single request each, and then kept.
+ */
+void readThroughBlockCache(block_cache_t* blockCache,
+                           uint8_t*       buffer,
+                           uint64_t       byteOffset,
+                           uint64_t       numBytes);
+
+
+
+
+/*
+ * Gets the number of block lookups that were (hits) and were not (misses)
+ * found in the cache.
+ */
+void getBlockCacheStatistics(block_cache_t* blockCache,
+                             uint64_t*      hits,
+                             uint64_t*      misses);
+
+
+
+
+/*
+ * Frees the cache and everything in it.
+ */
+void destroyBlockCache(block_cache_t* blockCache);
+
+
+
+
+#endif
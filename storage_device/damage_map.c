@@ -0,0 +1,496 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                               DAMAGE MAP
+ * that records which parts of a failing storage device could not be read, so
+ * that they are never read again.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "damage_map.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+// POSIX
+#include <pthread.h>
+#include <unistd.h>
+
+
+
+
+/*
+ * A data structure used to store one damaged region of the device.
+ */
+typedef struct {
+
+	uint64_t start;                // The first damaged byte.
+	uint64_t end;                  // The byte just past the last damaged byte.
+
+} damaged_region_t;
+
+
+/*
+ * A data structure used to store the whole map.
+ */
+struct damage_map_t {
+
+	char*             mapFileName; // Where the map is kept.
+	uint64_t          deviceSize;  // The size of the device (in bytes).
+	damaged_region_t* regions;     // The damaged regions, in order, none touching another.
+	uint32_t          numRegions;  // The number of damaged regions.
+	uint32_t          maxRegions;  // The number of regions there is room for.
+	pthread_mutex_t   lock;        // Guards the regions.
+
+};
+
+
+/*
+ * Used to find the first damaged region that ends after the given byte.
+ * Returns the number of regions if there is none.  The map must be locked.
+ */
+uint32_t findDamagedRegion(damage_map_t* damageMap, uint64_t byteOffset);
+
+
+/*
+ * Used to add a region to the map, merging it with any region it overlaps or
+ * touches.  The map must be locked.
+ */
+void insertDamagedRegion(damage_map_t* damageMap, uint64_t start, uint64_t end);
+
+
+/*
+ * Used to write the whole map out to its file.  The new map is written beside
+ * the old one and then renamed over it, so the file is never left half
+ * written.  The map must be locked.
+ */
+void saveDamageMap(damage_map_t* damageMap);
+
+
+/*
+ * Used to read the given range in with as many pread calls as it takes.
+ * Returns 1 if the whole range was read, and 0 if a read failed (or ran into
+ * the end of the device).
+ */
+uint8_t tryPread(int fileDescriptor, uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes);
+
+
+/*
+ * Used to read the given range in, trying again up to "maxRetries" times (with
+ * a growing wait before each retry).  Returns 1 if it was read, and 0 if not.
+ */
+uint8_t tryPreadWithRetries(int fileDescriptor, uint32_t maxRetries,
+                            uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes);
+
+
+/*
+ * Used to read in a range that failed to read as a whole, one sector at a
+ * time, filling in and recording each run of sectors that cannot be read.
+ */
+void readSectorBySector(damage_map_t* damageMap, int fileDescriptor, uint32_t maxRetries,
+                        uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+damage_map_t* loadDamageMap(char* mapFileName, uint64_t deviceSize) {
+
+	//
+	// PARAMETER CHECK.
+	if (mapFileName == NULL)
+		handleError(L"loadDamageMap", L"NULL 'mapFileName' parameter");
+
+	//
+	// ALLOCATE THE MAP.
+	damage_map_t* damageMap = (damage_map_t*) calloc(1, sizeof(damage_map_t));
+	if (damageMap != NULL) {
+		damageMap->maxRegions = 16;
+		damageMap->regions = (damaged_region_t*) malloc(damageMap->maxRegions * sizeof(damaged_region_t));
+		damageMap->mapFileName = strdup(mapFileName);
+	}
+	if (damageMap == NULL || damageMap->regions == NULL || damageMap->mapFileName == NULL)
+		handleError(L"loadDamageMap", L"Unable to allocate memory for the damage map");
+	damageMap->deviceSize = deviceSize;
+	pthread_mutex_init(&(damageMap->lock), NULL);
+
+	//
+	// A MAP FILE THAT DOES NOT EXIST YET IS AN EMPTY MAP.
+	FILE* mapFile = fopen(mapFileName, "r");
+	if (mapFile == NULL && errno == ENOENT)
+		return damageMap;
+	if (mapFile == NULL)
+		handleError(L"loadDamageMap", L"Unable to open the damage map file");
+
+	//
+	// READ IN EVERY BLOCK LINE ("POSITION SIZE STATUS").  COMMENTS START WITH
+	// '#', AND THE ONE LINE THAT GIVES THE CURRENT POSITION HAS A STATUS
+	// CHARACTER WHERE A BLOCK LINE HAS ITS SIZE, SO IT STOPS AFTER ONE FIELD.
+	char line[256];
+	while (fgets(line, sizeof(line), mapFile) != NULL) {
+		char* text = line;
+		while (*text == ' ' || *text == '\t')
+			text++;
+		if (*text == '#' || *text == '\n' || *text == '\r' || *text == '\0')
+			continue;
+
+		uint64_t position, size;
+		char status;
+		int numFields = sscanf(text, "%" SCNx64 " %" SCNx64 " %c", &position, &size, &status);
+		if (numFields == 1)
+			continue;
+		if (numFields != 3)
+			handleError(L"loadDamageMap", L"The damage map file is not a ddrescue mapfile");
+
+		//
+		// KEEP THE BLOCKS THAT COULD NOT BE READ (OR HAVE NOT BEEN READ IN
+		// FULL YET), CUT DOWN TO THE DEVICE.
+		if (status != '-' && status != '*' && status != '/')
+			continue;
+		if (position >= deviceSize)
+			continue;
+		if (size > deviceSize - position)
+			size = deviceSize - position;
+		if (size > 0)
+			insertDamagedRegion(damageMap, position, position + size);
+	}
+	fclose(mapFile);
+
+	return damageMap;
+
+}
+
+
+uint64_t findNextDamage(damage_map_t* damageMap,
+                        uint64_t      byteOffset,
+                        uint64_t*     damageEnd) {
+
+	uint64_t damageStart = UINT64_MAX;
+	pthread_mutex_lock(&(damageMap->lock));
+	uint32_t regionIndex = findDamagedRegion(damageMap, byteOffset);
+	if (regionIndex < damageMap->numRegions) {
+		damageStart = damageMap->regions[regionIndex].start;
+		*damageEnd  = damageMap->regions[regionIndex].end;
+	}
+	pthread_mutex_unlock(&(damageMap->lock));
+	return damageStart;
+
+}
+
+
+uint8_t isRangeDamaged(damage_map_t* damageMap,
+                       uint64_t      byteOffset,
+                       uint64_t      numBytes) {
+
+	if (numBytes == 0)
+		return 0;
+
+	uint64_t damageEnd;
+	return findNextDamage(damageMap, byteOffset, &damageEnd) < byteOffset + numBytes;
+
+}
+
+
+void addDamage(damage_map_t* damageMap,
+               uint64_t      byteOffset,
+               uint64_t      numBytes) {
+
+	if (numBytes == 0)
+		return;
+
+	pthread_mutex_lock(&(damageMap->lock));
+	insertDamagedRegion(damageMap, byteOffset, byteOffset + numBytes);
+	saveDamageMap(damageMap);
+	pthread_mutex_unlock(&(damageMap->lock));
+
+}
+
+
+void getDamageStatistics(damage_map_t* damageMap,
+                         uint64_t*     numRegions,
+                         uint64_t*     numBytes) {
+
+	pthread_mutex_lock(&(damageMap->lock));
+	*numRegions = damageMap->numRegions;
+	*numBytes   = 0;
+	uint32_t regionIndex = 0;
+	while (regionIndex < damageMap->numRegions) {
+		*numBytes += damageMap->regions[regionIndex].end - damageMap->regions[regionIndex].start;
+		regionIndex++;
+	}
+	pthread_mutex_unlock(&(damageMap->lock));
+
+}
+
+
+void readAroundDamage(damage_map_t* damageMap,
+                      int           fileDescriptor,
+                      uint32_t      maxRetries,
+                      uint8_t*      buffer,
+                      uint64_t      byteOffset,
+                      uint64_t      numBytes) {
+
+	uint64_t position = byteOffset;
+	uint64_t end      = byteOffset + numBytes;
+	while (position < end) {
+		uint64_t damageEnd  = 0;
+		uint64_t damageStart = findNextDamage(damageMap, position, &damageEnd);
+
+		//
+		// WHAT IS KNOWN TO BE DAMAGED IS FILLED IN, AND NEVER TOUCHED.
+		if (damageStart <= position) {
+			uint64_t length = ((damageEnd < end) ? damageEnd : end) - position;
+			memset(buffer + (position - byteOffset), DAMAGED_FILL_BYTE, length);
+			position += length;
+			continue;
+		}
+
+		//
+		// READ UP TO THE NEXT KNOWN DAMAGE IN ONE GO.  ONLY IF THAT FAILS IS
+		// THE PIECE TAKEN APART TO FIND THE SECTORS THAT CANNOT BE READ.
+		uint64_t pieceEnd = (damageStart < end) ? damageStart : end;
+		uint8_t* piece    = buffer + (position - byteOffset);
+		if (!tryPread(fileDescriptor, piece, position, pieceEnd - position))
+			readSectorBySector(damageMap, fileDescriptor, maxRetries,
+			                   piece, position, pieceEnd - position);
+		position = pieceEnd;
+	}
+
+}
+
+
+void freeDamageMap(damage_map_t* damageMap) {
+
+	if (damageMap == NULL)
+		return;
+
+	pthread_mutex_destroy(&(damageMap->lock));
+	free(damageMap->regions);
+	free(damageMap->mapFileName);
+	free(damageMap);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+uint32_t findDamagedRegion(damage_map_t* damageMap, uint64_t byteOffset) {
+
+	//
+	// BINARY SEARCH FOR THE FIRST REGION THAT ENDS AFTER THE BYTE.
+	uint32_t low  = 0;
+	uint32_t high = damageMap->numRegions;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (damageMap->regions[middle].end <= byteOffset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+
+}
+
+
+void insertDamagedRegion(damage_map_t* damageMap, uint64_t start, uint64_t end) {
+
+	//
+	// FIND THE REGIONS THE NEW ONE OVERLAPS OR TOUCHES (FIRST TO LAST - 1).
+	uint32_t first = findDamagedRegion(damageMap, start);
+	if (first > 0 && damageMap->regions[first - 1].end == start)
+		first--;
+	uint32_t last = first;
+	while (last < damageMap->numRegions && damageMap->regions[last].start <= end)
+		last++;
+
+	//
+	// IF THERE ARE ANY, THE NEW REGION TAKES THEM ALL IN, AND TAKES THE PLACE
+	// OF THE FIRST OF THEM.
+	if (last > first) {
+		if (damageMap->regions[first].start < start)
+			start = damageMap->regions[first].start;
+		if (damageMap->regions[last - 1].end > end)
+			end = damageMap->regions[last - 1].end;
+		memmove(&(damageMap->regions[first + 1]), &(damageMap->regions[last]),
+		        (damageMap->numRegions - last) * sizeof(damaged_region_t));
+		damageMap->numRegions -= last - first - 1;
+	}
+
+	//
+	// OTHERWISE, MAKE ROOM FOR IT.
+	else {
+		if (damageMap->numRegions == damageMap->maxRegions) {
+			damageMap->maxRegions *= 2;
+			damageMap->regions = (damaged_region_t*)
+					realloc(damageMap->regions, damageMap->maxRegions * sizeof(damaged_region_t));
+			if (damageMap->regions == NULL)
+				handleError(L"addDamage", L"Unable to allocate memory for the damage map");
+		}
+		memmove(&(damageMap->regions[first + 1]), &(damageMap->regions[first]),
+		        (damageMap->numRegions - first) * sizeof(damaged_region_t));
+		damageMap->numRegions++;
+	}
+
+	damageMap->regions[first].start = start;
+	damageMap->regions[first].end   = end;
+
+}
+
+
+void saveDamageMap(damage_map_t* damageMap) {
+
+	//
+	// WRITE THE NEW MAP BESIDE THE OLD ONE.
+	size_t nameLength = strlen(damageMap->mapFileName) + 5;
+	char* newFileName = (char*) malloc(nameLength);
+	if (newFileName == NULL)
+		handleError(L"addDamage", L"Unable to allocate memory for the damage map");
+	snprintf(newFileName, nameLength, "%s.new", damageMap->mapFileName);
+	FILE* mapFile = fopen(newFileName, "w");
+	if (mapFile == NULL)
+		handleError(L"addDamage", L"Unable to write the damage map file");
+
+	//
+	// THE HEADER, AND THE LINE THAT GIVES THE CURRENT POSITION (WHICH ONLY
+	// MATTERS TO ddrescue).
+	fprintf(mapFile, "# Mapfile. Created by readfat\n");
+	fprintf(mapFile, "# current_pos  current_status  current_pass\n");
+	fprintf(mapFile, "0x00000000     ?               1\n");
+	fprintf(mapFile, "#      pos        size  status\n");
+
+	//
+	// ONE BLOCK LINE FOR EACH DAMAGED REGION, AND FOR EACH GAP AROUND THEM, SO
+	// THAT THE BLOCKS COVER THE WHOLE DEVICE (AS ddrescue EXPECTS).
+	uint64_t position = 0;
+	uint32_t regionIndex = 0;
+	while (regionIndex < damageMap->numRegions) {
+		damaged_region_t* region = &(damageMap->regions[regionIndex]);
+		if (region->start > position)
+			fprintf(mapFile, "0x%08" PRIX64 "  0x%08" PRIX64 "  ?\n", position, region->start - position);
+		fprintf(mapFile, "0x%08" PRIX64 "  0x%08" PRIX64 "  -\n", region->start, region->end - region->start);
+		position = region->end;
+		regionIndex++;
+	}
+	if (position < damageMap->deviceSize)
+		fprintf(mapFile, "0x%08" PRIX64 "  0x%08" PRIX64 "  ?\n", position, damageMap->deviceSize - position);
+
+	//
+	// PUT IT IN PLACE OF THE OLD ONE ONLY ONCE IT IS SAFELY WRITTEN.
+	if (fflush(mapFile) != 0 || fsync(fileno(mapFile)) != 0 || fclose(mapFile) != 0 ||
+	    rename(newFileName, damageMap->mapFileName) != 0)
+		handleError(L"addDamage", L"Unable to write the damage map file");
+	free(newFileName);
+
+}
+
+
+uint8_t tryPread(int fileDescriptor, uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes) {
+
+	while (numBytes > 0) {
+		ssize_t result = pread(fileDescriptor, buffer, numBytes, (off_t) byteOffset);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return 0;
+		buffer     += result;
+		byteOffset += (uint64_t) result;
+		numBytes   -= (uint64_t) result;
+	}
+	return 1;
+
+}
+
+
+uint8_t tryPreadWithRetries(int fileDescriptor, uint32_t maxRetries,
+                            uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes) {
+
+	uint64_t delay = READ_RETRY_DELAY_MS;
+	uint32_t retry = 0;
+	while (!tryPread(fileDescriptor, buffer, byteOffset, numBytes)) {
+		if (retry == maxRetries)
+			return 0;
+
+		//
+		// BACK OFF BEFORE TRYING AGAIN, WAITING TWICE AS LONG EACH TIME.
+		struct timespec wait;
+		wait.tv_sec  = (time_t) (delay / 1000);
+		wait.tv_nsec = (long) (delay % 1000) * 1000000L;
+		nanosleep(&wait, NULL);
+		delay *= 2;
+		if (delay > READ_RETRY_MAX_DELAY_MS)
+			delay = READ_RETRY_MAX_DELAY_MS;
+		retry++;
+	}
+	return 1;
+
+}
+
+
+void readSectorBySector(damage_map_t* damageMap, int fileDescriptor, uint32_t maxRetries,
+                        uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes) {
+
+	//
+	// STEP THROUGH THE RANGE ONE SECTOR AT A TIME (THE FIRST AND LAST MAY BE
+	// PARTIAL SECTORS), KEEPING TRACK OF THE RUN OF SECTORS THAT COULD NOT BE
+	// READ SO THAT IT IS RECORDED ALL AT ONCE.
+	uint64_t position   = byteOffset;
+	uint64_t end        = byteOffset + numBytes;
+	uint64_t runStart   = 0;
+	uint8_t  inDamagedRun = 0;
+	while (position < end) {
+		uint64_t sectorEnd = (position / DAMAGE_MAP_SECTOR_SIZE + 1) * DAMAGE_MAP_SECTOR_SIZE;
+		if (sectorEnd > end)
+			sectorEnd = end;
+		uint8_t* sector = buffer + (position - byteOffset);
+
+		if (tryPreadWithRetries(fileDescriptor, maxRetries, sector, position, sectorEnd - position)) {
+			if (inDamagedRun)
+				addDamage(damageMap, runStart, position - runStart);
+			inDamagedRun = 0;
+		}
+		else {
+			memset(sector, DAMAGED_FILL_BYTE, sectorEnd - position);
+			if (!inDamagedRun)
+				runStart = position;
+			inDamagedRun = 1;
+		}
+
+		position = sectorEnd;
+	}
+	if (inDamagedRun)
+		addDamage(damageMap, runStart, end - runStart);
+
+}
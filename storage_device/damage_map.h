@@ -0,0 +1,155 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                               DAMAGE MAP
+ * that records which parts of a failing storage device could not be read, so
+ * that they are never read again.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef DAMAGE_MAP_H_
+#define DAMAGE_MAP_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE SMALLEST PIECE OF THE DEVICE THAT IS TRIED ON ITS OWN (IN BYTES) WHEN A
+// READ FAILS, AND SO THE SMALLEST PIECE THAT CAN BE RECORDED AS DAMAGED.
+#define DAMAGE_MAP_SECTOR_SIZE 512
+
+// THE NUMBER OF TIMES A FAILED SECTOR IS TRIED AGAIN BEFORE IT IS GIVEN UP ON.
+#define DEFAULT_READ_RETRIES 3
+
+// HOW LONG TO WAIT BEFORE THE FIRST RETRY (IN MILLISECONDS).  THE WAIT IS
+// DOUBLED BEFORE EACH RETRY AFTER THAT, UP TO THE LONGEST WAIT.
+#define READ_RETRY_DELAY_MS     10
+#define READ_RETRY_MAX_DELAY_MS 1000
+
+// THE BYTE THAT STANDS IN FOR EVERY BYTE THAT COULD NOT BE READ.
+#define DAMAGED_FILL_BYTE 0x00
+
+
+
+
+/*
+ * A map of the damaged parts of a device (see loadDamageMap).
+ */
+typedef struct damage_map_t damage_map_t;
+
+
+
+
+/*
+ * Loads the damage map kept in the given file for a device of "deviceSize"
+ * bytes, or starts an empty one if the file does not exist yet.
+ *
+ * The file is a GNU ddrescue mapfile, so a map written by ddrescue can be used
+ * as is: blocks marked '-' (bad sector), '*' (non-trimmed) or '/'
+ * (non-scraped) are taken to be damaged, and everything else is not.  Whenever
+ * damage is added, the whole file is rewritten, marking the damaged blocks '-'
+ * and the rest '?' (non-tried).
+ */
+damage_map_t* loadDamageMap(char* mapFileName, uint64_t deviceSize);
+
+
+
+
+/*
+ * Finds the first damaged region that ends after the given byte of the
+ * device.  Its first byte is returned (which may come before "byteOffset", if
+ * the byte is damaged itself), and the byte just past it is stored in
+ * "damageEnd".  If there is no such region, UINT64_MAX is returned.
+ */
+uint64_t findNextDamage(damage_map_t* damageMap,
+                        uint64_t      byteOffset,
+                        uint64_t*     damageEnd);
+
+
+
+
+/*
+ * Returns 1 if any of the given range of bytes is damaged, and 0 otherwise.
+ */
+uint8_t isRangeDamaged(damage_map_t* damageMap,
+                       uint64_t      byteOffset,
+                       uint64_t      numBytes);
+
+
+
+
+/*
+ * Records the given range of bytes as damaged, and rewrites the map file.
+ */
+void addDamage(damage_map_t* damageMap,
+               uint64_t      byteOffset,
+               uint64_t      numBytes);
+
+
+
+
+/*
+ * Gets the number of damaged regions, and the number of bytes in them.
+ */
+void getDamageStatistics(damage_map_t* damageMap,
+                         uint64_t*     numRegions,
+                         uint64_t*     numBytes);
+
+
+
+
+/*
+ * Reads the given range of bytes from the file descriptor, stepping around
+ * the damage.  Bytes that are known to be damaged are filled with
+ * DAMAGED_FILL_BYTE without being read at all.  If reading the rest fails, it
+ * is tried again one DAMAGE_MAP_SECTOR_SIZE sector at a time, and each sector
+ * that still fails after "maxRetries" more tries (waiting READ_RETRY_DELAY_MS,
+ * then twice as long each time, up to READ_RETRY_MAX_DELAY_MS) is filled in
+ * and added to the map.
+ *
+ * This never fails because of an unreadable sector.
+ */
+void readAroundDamage(damage_map_t* damageMap,
+                      int           fileDescriptor,
+                      uint32_t      maxRetries,
+                      uint8_t*      buffer,
+                      uint64_t      byteOffset,
+                      uint64_t      numBytes);
+
+
+
+
+/*
+ * Frees the map.  (The map file is always up to date, so nothing is written.)
+ */
+void freeDamageMap(damage_map_t* damageMap);
+
+
+
+
+#endif
@@ -20,7 +20,21 @@
 // (NOTHING)
 
 // LAYER 3: STORAGE_DEVICE
+#include "async_reader.h"
+#include "block_cache.h"
+#include "backend_compressed.h"
+#include "backend_direct.h"
+#include "backend_http.h"
+#include "backend_memory.h"
+#include "backend_mmap.h"
+#include "backend_pread.h"
+#include "backend_qcow2.h"
+#include "backend_sparse.h"
+#include "backend_split.h"
+#include "backend_vmdk.h"
+#include "damage_map.h"
 #include "device_interface.h"
+#include "storage_backend.h"
 
 // ERROR HANDLING
 #include "error.h"
@@ -29,50 +43,75 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <wchar.h>
 
 
 
 
+/*
+ * Used to read a range of bytes from the storage device's backend (stepping
+ * around the damage in degraded mode).  The "context" is the storage device,
+ * so that this can also serve as the block cache's reader.
+ */
+void readBytes(void* context, uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes);
 
-uint8_t* readSectors(uint8_t*  buffer,
-                     uint32_t* sectorLocations,
-                     uint32_t  numLocations,
-					 uint32_t  bytesPerSector,
-					 uint32_t  sectorsPerLocation,
-					 FILE*     storageDevice) {
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+uint8_t* readSectors(uint8_t*          buffer,
+                     uint64_t*         sectorLocations,
+                     uint32_t          numLocations,
+					 uint32_t          bytesPerSector,
+					 uint32_t          sectorsPerLocation,
+					 storage_device_t* storageDevice) {
 
 	//
-	// READ IN THE RAW DATA, ONE SECTOR AT A TIME.
+	// READ IN THE RAW DATA, ONE RUN OF CONTIGUOUS LOCATIONS AT A TIME.
 	uint32_t counter = 0;
-	uint32_t byteOffset = 0;
-	uint32_t result = 0;
+	uint32_t runLength = 0;
+	uint64_t numSectors = 0;
+	uint64_t byteOffset = 0;
+	uint64_t bytesPerLocation = (uint64_t) bytesPerSector * sectorsPerLocation;
 	while (counter < numLocations) {
 
 		//
-		// CALCULATE THE STARTING BYTE ADDRESS.
-		byteOffset = bytesPerSector * sectorLocations[counter];
-		
-		//
-		// SET THE STARTING POSITION IN THE STORAGE DEVICE.
-		fseek(storageDevice, byteOffset, SEEK_SET);
-		
+		// FIND THE RUN OF LOCATIONS THAT FOLLOW ONE ANOTHER ON THE DEVICE.
+		// THEY ALSO FOLLOW ONE ANOTHER IN THE BUFFER, SO THE WHOLE RUN CAN BE
+		// READ IN AT ONCE.
+		runLength = 1;
+		while (counter + runLength < numLocations &&
+		       sectorLocations[counter + runLength] ==
+		       sectorLocations[counter + runLength - 1] + sectorsPerLocation)
+			runLength++;
+		numSectors = (uint64_t) runLength * sectorsPerLocation;
+
 		//
-		// READ IN THE CURRENT SECTOR OR GROUP OF CONTIGUOUS SECTORS.
-		result = fread(buffer + (bytesPerSector * sectorsPerLocation * counter),
-		               bytesPerSector,
-					   sectorsPerLocation,
-					   storageDevice);
+		// CALCULATE THE STARTING BYTE ADDRESS.
+		byteOffset = (uint64_t) bytesPerSector * sectorLocations[counter];
 
 		//
-		// VERIFY THE SECTORS WERE READ PROPERLY.
-		if (result != sectorsPerLocation)
-			handleError(L"readSectors",
-			            L"Unable to read in requested sectors");
+		// READ IN THE CURRENT RUN OF CONTIGUOUS SECTORS, THROUGH THE BLOCK
+		// CACHE IF THERE IS ONE.
+		if (storageDevice->blockCache != NULL)
+			readThroughBlockCache(storageDevice->blockCache,
+			                      buffer + (bytesPerLocation * counter),
+			                      byteOffset,
+			                      (uint64_t) bytesPerSector * numSectors);
+		else
+			readBytes(storageDevice,
+			          buffer + (bytesPerLocation * counter),
+			          byteOffset,
+			          (uint64_t) bytesPerSector * numSectors);
 
 		//
-		// INCREMENT THE COUNTER.
-		counter++;
+		// MOVE ON TO THE NEXT RUN.
+		counter += runLength;
 	}
 	
 	return buffer;
@@ -80,9 +119,158 @@ uint8_t* readSectors(uint8_t*  buffer,
 }
 
 
+void readSectorExtents(sector_extent_t*  extents,
+                       uint32_t          numExtents,
+                       uint32_t          bytesPerSector,
+                       storage_device_t* storageDevice) {
+
+	//
+	// THERE IS NOTHING TO DO FOR AN EMPTY BATCH.
+	if (numExtents == 0)
+		return;
+
+	//
+	// IF ASYNCHRONOUS READS ARE ENABLED, SUBMIT THE WHOLE BATCH AT ONCE.
+	// (WITH A BLOCK CACHE, OR IN DEGRADED MODE, THE BATCH GOES THROUGH
+	// readSectors INSTEAD.)
+	if (storageDevice->asyncReader != NULL && storageDevice->blockCache == NULL &&
+	    storageDevice->damageMap == NULL) {
+		readExtentsAsync(storageDevice->asyncReader, extents, numExtents, bytesPerSector);
+		return;
+	}
+
+	//
+	// WITH A BLOCK CACHE, READ IN THE EXTENTS ONE AFTER ANOTHER THROUGH IT.
+	// IN DEGRADED MODE, EACH EXTENT IS READ AROUND THE DAMAGE ON ITS OWN.
+	uint32_t extentIndex = 0;
+	if (storageDevice->blockCache != NULL || storageDevice->damageMap != NULL) {
+		while (extentIndex < numExtents) {
+			readSectors(extents[extentIndex].buffer,
+			            &(extents[extentIndex].firstSector),
+			            1,
+			            bytesPerSector,
+			            extents[extentIndex].numSectors,
+			            storageDevice);
+			extentIndex++;
+		}
+		return;
+	}
+
+	//
+	// OTHERWISE, HAND THE WHOLE BATCH TO THE BACKEND AT ONCE.
+	byte_extent_t* byteExtents = (byte_extent_t*) malloc(sizeof(byte_extent_t) * numExtents);
+	if (byteExtents == NULL)
+		handleError(L"readSectorExtents",
+		            L"Unable to allocate memory for the extents");
+	while (extentIndex < numExtents) {
+		byteExtents[extentIndex].byteOffset = (uint64_t) extents[extentIndex].firstSector * bytesPerSector;
+		byteExtents[extentIndex].numBytes   = (uint64_t) extents[extentIndex].numSectors  * bytesPerSector;
+		byteExtents[extentIndex].buffer     = extents[extentIndex].buffer;
+		extentIndex++;
+	}
+	storageDevice->backend->readExtents(storageDevice->backend, byteExtents, numExtents);
+	free(byteExtents);
+
+}
+
+
+void prefetchSectorExtents(sector_extent_t*  extents,
+                           uint32_t          numExtents,
+                           uint32_t          bytesPerSector,
+                           storage_device_t* storageDevice) {
+
+	//
+	// THERE IS NOTHING TO DO IF PREFETCHING IS DISABLED, OR IF THE DEVICE
+	// DOES NOT GO THROUGH THE PAGE CACHE.
+	if (storageDevice->prefetchWindow == 0 || storageDevice->backend->adviseWillNeed == NULL)
+		return;
+
+	//
+	// ASK FOR EACH EXTENT IN TURN, UNTIL THE WINDOW IS FULL.
+	uint64_t numBytesRequested = 0;
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents && numBytesRequested < storageDevice->prefetchWindow) {
+		uint64_t byteOffset = (uint64_t) extents[extentIndex].firstSector * bytesPerSector;
+		uint64_t numBytes   = (uint64_t) extents[extentIndex].numSectors  * bytesPerSector;
+		if (numBytes > storageDevice->prefetchWindow - numBytesRequested)
+			numBytes = storageDevice->prefetchWindow - numBytesRequested;
+		if (byteOffset + numBytes > storageDevice->size)
+			break;
+		storageDevice->backend->adviseWillNeed(storageDevice->backend, byteOffset, numBytes);
+
+		numBytesRequested += numBytes;
+		extentIndex++;
+	}
+
+}
+
+
+const uint8_t* viewSectors(uint64_t          firstSector,
+                           uint32_t          numSectors,
+                           uint32_t          bytesPerSector,
+                           storage_device_t* storageDevice) {
+
+	//
+	// ONLY A DEVICE THAT IS ALREADY IN MEMORY CAN BE VIEWED IN PLACE.
+	if (storageDevice->backend->viewBytes == NULL)
+		return NULL;
+
+	//
+	// VERIFY THE SECTORS ARE ACTUALLY ON THE DEVICE.
+	uint64_t byteOffset = (uint64_t) bytesPerSector * firstSector;
+	uint64_t numBytes   = (uint64_t) bytesPerSector * numSectors;
+	if (byteOffset + numBytes > storageDevice->size)
+		handleError(L"viewSectors",
+		            L"Unable to view requested sectors");
+
+	//
+	// RETURN A POINTER INTO THE BACKEND'S COPY OF THE DEVICE.
+	return storageDevice->backend->viewBytes(storageDevice->backend, byteOffset, numBytes);
+
+}
+
+
+
+
+uint8_t areSectorsHoles(uint64_t          firstSector,
+                        uint32_t          numSectors,
+                        uint32_t          bytesPerSector,
+                        storage_device_t* storageDevice) {
+
+	//
+	// ONLY A BACKEND THAT KNOWS WHERE ITS HOLES ARE CAN TELL.
+	if (storageDevice->backend->isHole == NULL)
+		return 0;
+
+	return storageDevice->backend->isHole(storageDevice->backend,
+	                                      (uint64_t) bytesPerSector * firstSector,
+	                                      (uint64_t) bytesPerSector * numSectors);
+
+}
+
+
 
 
-FILE* openStorageDevice(char* deviceFileName) {
+uint8_t areSectorsDamaged(uint64_t          firstSector,
+                          uint32_t          numSectors,
+                          uint32_t          bytesPerSector,
+                          storage_device_t* storageDevice) {
+
+	//
+	// ONLY A DEVICE READ IN DEGRADED MODE KEEPS TRACK OF ITS DAMAGE.
+	if (storageDevice->damageMap == NULL)
+		return 0;
+
+	return isRangeDamaged(storageDevice->damageMap,
+	                      (uint64_t) bytesPerSector * firstSector,
+	                      (uint64_t) bytesPerSector * numSectors);
+
+}
+
+
+
+
+storage_device_t* openStorageDevice(char* deviceFileName, uint8_t mode) {
 
 	//
 	// PARAMETER CHECK.
@@ -91,14 +279,68 @@ FILE* openStorageDevice(char* deviceFileName) {
 		            L"NULL 'deviceFileName' parameter");
 
 	//
-	// OPEN THE DEVICE.
-	FILE* storageDevice = fopen(deviceFileName, "r");
+	// OPEN THE DEVICE WITH THE BACKEND THE CALLER ASKED FOR.
+	switch (mode) {
+
+		case STORAGE_MODE_MMAP:
+			return openStorageDeviceOnBackend(openMmapBackend(deviceFileName));
+
+		case STORAGE_MODE_DIRECT:
+			return openStorageDeviceOnBackend(openDirectBackend(deviceFileName));
+
+		case STORAGE_MODE_PREAD:
+			return openStorageDeviceOnBackend(openPreadBackend(deviceFileName));
+
+		case STORAGE_MODE_SPARSE:
+			return openStorageDeviceOnBackend(openSparseBackend(deviceFileName));
+
+		case STORAGE_MODE_COMPRESSED:
+			return openStorageDeviceOnBackend(openCompressedBackend(deviceFileName));
+
+		case STORAGE_MODE_SPLIT:
+			return openStorageDeviceOnBackend(openSplitBackend(deviceFileName));
+
+		case STORAGE_MODE_QCOW2:
+			return openStorageDeviceOnBackend(openQcow2Backend(deviceFileName));
+
+		case STORAGE_MODE_VMDK:
+			return openStorageDeviceOnBackend(openVmdkBackend(deviceFileName));
+
+		case STORAGE_MODE_HTTP:
+			return openStorageDeviceOnBackend(openHttpBackend(deviceFileName, HTTP_DEFAULT_CONNECTIONS));
+
+		default:
+			handleError(L"openDevice",
+			            L"Unknown storage device access mode");
+
+	}
+
+	return NULL;
+
+}
+
+
+
+
+storage_device_t* openStorageDeviceOnBackend(storage_backend_t* backend) {
+
+	//
+	// PARAMETER CHECK.
+	if (backend == NULL)
+		handleError(L"openDevice",
+		            L"NULL 'backend' parameter");
 
 	//
-	// VERIFY THE DEVICE WAS OPENED.
+	// ALLOCATE THE STORAGE DEVICE STRUCT.
+	storage_device_t* storageDevice = (storage_device_t*) calloc(1, sizeof(storage_device_t));
 	if (storageDevice == NULL)
 		handleError(L"openDevice",
-		            L"The storage device could not be opened");
+		            L"Unable to allocate memory for the storage device");
+
+	//
+	// THE SIZE NEVER CHANGES, SO IT IS ONLY ASKED FOR ONCE.
+	storageDevice->backend = backend;
+	storageDevice->size    = backend->getSize(backend);
 
 	//
 	// RETURN THE HANDLE TO THE DEVICE.
@@ -109,9 +351,126 @@ FILE* openStorageDevice(char* deviceFileName) {
 
 
 
-void closeStorageDevice(FILE* storageDevice) {
+storage_device_t* openStorageDeviceInMemory(const uint8_t* image, uint64_t size) {
+
+	return openStorageDeviceOnBackend(openMemoryBackend(image, size));
+
+}
+
+
+
+
+storage_device_t* openStorageDeviceOverHttp(char* url, uint32_t numConnections) {
 
-	fclose(storageDevice);
+	return openStorageDeviceOnBackend(openHttpBackend(url, numConnections));
 
 }
 
+
+
+
+void enableAsyncReads(storage_device_t* storageDevice, uint32_t queueDepth) {
+
+	//
+	// ONLY A BACKEND WITH A DESCRIPTOR THAT ANY BUFFER MAY BE READ INTO CAN BE
+	// READ ASYNCHRONOUSLY.
+	if (storageDevice->backend->getFileDescriptor == NULL || storageDevice->asyncReader != NULL)
+		return;
+
+	int fileDescriptor = storageDevice->backend->getFileDescriptor(storageDevice->backend);
+	if (fileDescriptor < 0)
+		return;
+	storageDevice->asyncReader = openAsyncReader(fileDescriptor, queueDepth);
+
+}
+
+
+
+
+void enableBlockCache(storage_device_t* storageDevice, uint64_t capacity) {
+
+	//
+	// A DEVICE THAT CAN BE VIEWED IN PLACE IS ALREADY READ STRAIGHT OUT OF
+	// MEMORY.
+	if (storageDevice->backend->viewBytes != NULL || storageDevice->blockCache != NULL)
+		return;
+
+	storageDevice->blockCache = createBlockCache(capacity, storageDevice->size,
+	                                             readBytes, storageDevice);
+
+}
+
+
+
+
+void enableDegradedReads(storage_device_t* storageDevice,
+                         char*             mapFileName,
+                         uint32_t          maxRetries) {
+
+	//
+	// FAILED SECTORS ARE READ AGAIN ONE AT A TIME, STRAIGHT FROM THE DEVICE
+	// FILE, SO THE BACKEND MUST HAVE ONE THAT ANY BUFFER MAY BE READ INTO.
+	if (storageDevice->backend->getFileDescriptor == NULL ||
+	    storageDevice->backend->getFileDescriptor(storageDevice->backend) < 0)
+		handleError(L"enableDegradedReads",
+		            L"Degraded reads need a device opened for positional reads");
+	if (storageDevice->damageMap != NULL)
+		return;
+
+	storageDevice->damageMap  = loadDamageMap(mapFileName, storageDevice->size);
+	storageDevice->maxRetries = maxRetries;
+
+}
+
+
+
+
+void setPrefetchWindow(storage_device_t* storageDevice, uint64_t prefetchWindow) {
+
+	storageDevice->prefetchWindow = prefetchWindow;
+
+}
+
+
+
+
+void closeStorageDevice(storage_device_t* storageDevice) {
+
+	closeAsyncReader(storageDevice->asyncReader);
+	destroyBlockCache(storageDevice->blockCache);
+	freeDamageMap(storageDevice->damageMap);
+
+	storageDevice->backend->close(storageDevice->backend);
+
+	free(storageDevice);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+void readBytes(void* context, uint8_t* buffer, uint64_t byteOffset, uint64_t numBytes) {
+
+	storage_device_t* storageDevice = (storage_device_t*) context;
+
+	//
+	// IN DEGRADED MODE, READ STRAIGHT FROM THE DEVICE FILE, AROUND THE DAMAGE.
+	if (storageDevice->damageMap != NULL) {
+		if (byteOffset + numBytes > storageDevice->size || byteOffset + numBytes < byteOffset)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		readAroundDamage(storageDevice->damageMap,
+		                 storageDevice->backend->getFileDescriptor(storageDevice->backend),
+		                 storageDevice->maxRetries,
+		                 buffer, byteOffset, numBytes);
+		return;
+	}
+
+	readBackendBytes(storageDevice->backend, buffer, byteOffset, numBytes);
+
+}
@@ -23,7 +23,9 @@
 // (NOTHING)
 
 // LAYER 3: STORAGE_DEVICE
-// (NOTHING)
+#include "block_cache.h"
+#include "damage_map.h"
+#include "storage_backend.h"
 
 // ERROR HANDLING
 #include "error.h"
@@ -43,6 +45,71 @@
 // WHEN READING THE BOOT SECTOR).
 #define DEFAULT_BYTES_PER_SECTOR 512
 
+// THE WAYS IN WHICH A STORAGE DEVICE FILE CAN BE ACCESSED (CHOSEN WHEN IT IS
+// OPENED).  EACH ONE SELECTS A STORAGE BACKEND (SEE storage_backend.h).
+#define STORAGE_MODE_PREAD  0
+#define STORAGE_MODE_MMAP   1
+#define STORAGE_MODE_DIRECT 2
+#define STORAGE_MODE_SPARSE 3
+#define STORAGE_MODE_COMPRESSED 4
+#define STORAGE_MODE_SPLIT  5
+#define STORAGE_MODE_QCOW2  6
+#define STORAGE_MODE_VMDK   7
+#define STORAGE_MODE_HTTP   8
+
+
+
+
+/*
+ * An asynchronous batch reader (see async_reader.h).
+ */
+typedef struct async_reader_t async_reader_t;
+
+
+
+
+/*
+ * A data structure used to store an open storage device.
+ * All reads go through the device's backend; the rest of the structure holds
+ * what is layered on top of it.
+ *
+ * THREAD SAFETY: once a device has been opened and set up (with
+ * enableAsyncReads, enableBlockCache, setPrefetchWindow and
+ * enableDegradedReads), any number of threads may call readSectors,
+ * readSectorExtents, prefetchSectorExtents, viewSectors, areSectorsHoles and
+ * areSectorsDamaged on it at once.  No read depends on a file
+ * position left behind by another (every backend uses positional reads), and
+ * the block cache, the asynchronous reader and the backends lock whatever they
+ * share.  Setting the device up and closing it must not overlap with any
+ * other call on it.
+ */
+typedef struct {
+
+	storage_backend_t* backend;    // Where the device's bytes actually come from.
+	uint64_t        size;          // The size of the device (in bytes).
+	async_reader_t* asyncReader;   // Used for batches of extents (NULL if not enabled).
+	block_cache_t*  blockCache;    // Sits beneath readSectors (NULL if not enabled).
+	uint64_t        prefetchWindow;// The most bytes prefetchSectorExtents asks for (0 if disabled).
+	damage_map_t*   damageMap;     // The unreadable parts of the device (NULL unless reads are degraded).
+	uint32_t        maxRetries;    // How many times a failed sector is tried again (in degraded mode).
+
+} storage_device_t;
+
+
+
+
+/*
+ * A data structure used to describe a run of contiguous sectors to be read,
+ * and where they are to be read into.
+ */
+typedef struct {
+
+	uint64_t firstSector;          // The first sector of the run.
+	uint32_t numSectors;           // The number of sectors in the run.
+	uint8_t* buffer;               // Where the contents of the run are stored.
+
+} sector_extent_t;
+
 
 
 
@@ -55,22 +122,184 @@
  * "sectorsPerLocation" is more than one, then multiple sectors are read
  * in at a time, and the sector numbers in "sectorLocations" are the
  * first sectors to be read in for each chunk.
+ *
+ * Locations that directly follow one another on the device (e.g. the clusters
+ * of an unfragmented file) are coalesced, and read in with a single request.
+ *
+ * Sector numbers and byte offsets are 64-bit throughout, so devices larger
+ * than 4 GiB can be read anywhere.
+ */
+uint8_t* readSectors(uint8_t*          buffer,
+                     uint64_t*         sectorLocations,
+                     uint32_t          numLocations,
+					 uint32_t          bytesPerSector,
+					 uint32_t          sectorsPerLocation,
+					 storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Reads every one of the given extents into its own buffer.  If asynchronous
+ * reads have been enabled, then all of the extents are submitted at once, so
+ * that many of them can be in flight together.  Otherwise, they are read in
+ * one after another (or through the block cache, if it is enabled).
+ */
+void readSectorExtents(sector_extent_t*  extents,
+                       uint32_t          numExtents,
+                       uint32_t          bytesPerSector,
+                       storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Tells the operating system that the given extents will be read soon, so it
+ * can start reading them in the background (posix_fadvise/madvise WILLNEED).
+ * The extents are taken in order, and no more than the device's prefetch
+ * window (in bytes) is requested in one call.  The extents' buffers are not
+ * used.  This has no effect if the prefetch window is 0, or if the backend
+ * cannot take such advice (e.g. direct reads, which bypass the page cache).
+ */
+void prefetchSectorExtents(sector_extent_t*  extents,
+                           uint32_t          numExtents,
+                           uint32_t          bytesPerSector,
+                           storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns a read-only pointer directly into the storage device's contents,
+ * starting at the given sector, without copying anything.  This is only
+ * possible if the device's backend holds the whole device in memory (i.e. it
+ * was opened with STORAGE_MODE_MMAP, or from memory); otherwise NULL is
+ * returned and the caller must use readSectors instead.
+ *
+ * The view remains valid until the storage device is closed.
+ */
+const uint8_t* viewSectors(uint64_t          firstSector,
+                           uint32_t          numSectors,
+                           uint32_t          bytesPerSector,
+                           storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns 1 if the given sectors are known to hold nothing but zeros, without
+ * reading them (i.e. they lie in a hole of a sparse image opened with
+ * STORAGE_MODE_SPARSE).  Returns 0 otherwise, including whenever the device
+ * cannot tell.  Scans of the data area can use this to skip whole runs of
+ * clusters.
+ */
+uint8_t areSectorsHoles(uint64_t          firstSector,
+                        uint32_t          numSectors,
+                        uint32_t          bytesPerSector,
+                        storage_device_t* storageDevice);
+
+
+
+
+/*
+ * Returns 1 if any of the given sectors is recorded as unreadable in the
+ * device's damage map (see enableDegradedReads), and 0 otherwise.  Their
+ * contents, as read, are then DAMAGED_FILL_BYTE rather than what was on the
+ * device.
  */
-uint8_t* readSectors(uint8_t*  buffer,
-                     uint32_t* sectorLocations,
-                     uint32_t  numLocations,
-					 uint32_t  bytesPerSector,
-					 uint32_t  sectorsPerLocation,
-					 FILE*     storageDevice);
+uint8_t areSectorsDamaged(uint64_t          firstSector,
+                          uint32_t          numSectors,
+                          uint32_t          bytesPerSector,
+                          storage_device_t* storageDevice);
 
 
 
 
 /*
  * Opens the specified storage device for reading.  The device is specified via
- * the absolute path of its device or image file.
+ * the absolute path of its device or image file, and the access mode is one of
+ * the STORAGE_MODE_ constants defined above.
+ */
+storage_device_t* openStorageDevice(char* deviceFileName, uint8_t mode);
+
+
+
+
+/*
+ * Opens a storage device on top of the given backend, which is then owned by
+ * the storage device (and closed along with it).
  */
-FILE* openStorageDevice(char* deviceFileName);
+storage_device_t* openStorageDeviceOnBackend(storage_backend_t* backend);
+
+
+
+
+/*
+ * Opens a storage device on an image of "size" bytes that is already in
+ * memory (see backend_memory.h).  The image still belongs to the caller.
+ */
+storage_device_t* openStorageDeviceInMemory(const uint8_t* image, uint64_t size);
+
+
+
+
+/*
+ * Opens a storage device on the image at the given http:// URL, fetching it
+ * with range requests over up to "numConnections" connections at once (see
+ * backend_http.h).  Opening it with STORAGE_MODE_HTTP instead uses
+ * HTTP_DEFAULT_CONNECTIONS connections.
+ */
+storage_device_t* openStorageDeviceOverHttp(char* url, uint32_t numConnections);
+
+
+
+
+/*
+ * Enables asynchronous reads (see async_reader.h) for batches of extents read
+ * with readSectorExtents, with up to "queueDepth" reads in flight at once.
+ * This has no effect unless the backend has a file descriptor to read from
+ * (so not on a memory-mapped device, which never waits on I/O, nor on a device
+ * opened for direct reads, which must go through aligned buffers).
+ */
+void enableAsyncReads(storage_device_t* storageDevice, uint32_t queueDepth);
+
+
+
+
+/*
+ * Enables a block cache (see block_cache.h) holding up to "capacity" bytes,
+ * beneath readSectors.  Sectors that have been read before are then served
+ * from memory instead of from the device.  This has no effect on a device
+ * whose backend already holds it in memory.
+ */
+void enableBlockCache(storage_device_t* storageDevice, uint64_t capacity);
+
+
+
+
+/*
+ * Switches the device into degraded mode, for reading failing media.  Reads no
+ * longer fail on sectors that cannot be read: those sectors are tried again up
+ * to "maxRetries" times with a growing wait in between, and then read as
+ * DAMAGED_FILL_BYTE and recorded in the damage map kept in "mapFileName" (see
+ * damage_map.h).  The map is loaded first, so the sectors recorded by earlier
+ * runs are never read again.  Batches of extents are read one extent at a time
+ * in this mode (never asynchronously).
+ *
+ * Only a device opened with STORAGE_MODE_PREAD can be read in degraded mode.
+ */
+void enableDegradedReads(storage_device_t* storageDevice,
+                         char*             mapFileName,
+                         uint32_t          maxRetries);
+
+
+
+
+/*
+ * Sets how many bytes prefetchSectorExtents may ask for at once (0 disables
+ * prefetching, which is the default).
+ */
+void setPrefetchWindow(storage_device_t* storageDevice, uint64_t prefetchWindow);
 
 
 
@@ -78,10 +307,9 @@ FILE* openStorageDevice(char* deviceFileName);
 /*
  * Closes the storage device.
  */
-void closeStorageDevice(FILE* storageDevice);
+void closeStorageDevice(storage_device_t* storageDevice);
 
 
 
 
 #endif
-
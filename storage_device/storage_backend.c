@@ -0,0 +1,145 @@
+/******************************************************************************
+ * This file contains the interface that every
+ *                          STORAGE BACKEND
+ * (the code that actually fetches bytes for a storage device) provides.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "storage_backend.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+// POSIX
+#include <sys/uio.h>
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+storage_backend_t* allocateStorageBackend(void* state) {
+
+	storage_backend_t* backend = (storage_backend_t*) calloc(1, sizeof(storage_backend_t));
+	if (backend == NULL)
+		handleError(L"openDevice",
+		            L"Unable to allocate memory for the storage device");
+	backend->state = state;
+	return backend;
+
+}
+
+
+void readBackendBytes(storage_backend_t* backend,
+                      uint8_t*           buffer,
+                      uint64_t           byteOffset,
+                      uint64_t           numBytes) {
+
+	byte_extent_t extent;
+	extent.byteOffset = byteOffset;
+	extent.numBytes   = numBytes;
+	extent.buffer     = buffer;
+	backend->readExtents(backend, &extent, 1);
+
+}
+
+
+void preadExtents(int            fileDescriptor,
+                  byte_extent_t* extents,
+                  uint32_t       numExtents) {
+
+	//
+	// GATHER UP EXTENTS THAT FOLLOW ONE ANOTHER ON THE DEVICE, AND READ EACH
+	// RUN OF THEM IN WITH A SINGLE preadv.
+	struct iovec vectors[STORAGE_BACKEND_MAX_VECTORS];
+	int      numVectors = 0;
+	uint64_t runStart   = 0;
+	uint64_t runEnd     = 0;
+	uint32_t extentIndex = 0;
+	while (extentIndex < numExtents) {
+		if (extents[extentIndex].numBytes == 0) {
+			extentIndex++;
+			continue;
+		}
+
+		//
+		// READ IN THE CURRENT RUN IF THIS EXTENT DOES NOT CARRY ON FROM IT.
+		if (numVectors > 0 &&
+		    (extents[extentIndex].byteOffset != runEnd || numVectors == STORAGE_BACKEND_MAX_VECTORS)) {
+			preadVectors(fileDescriptor, vectors, numVectors, runStart);
+			numVectors = 0;
+		}
+		if (numVectors == 0) {
+			runStart = extents[extentIndex].byteOffset;
+			runEnd   = extents[extentIndex].byteOffset;
+		}
+
+		vectors[numVectors].iov_base = extents[extentIndex].buffer;
+		vectors[numVectors].iov_len  = extents[extentIndex].numBytes;
+		numVectors++;
+		runEnd += extents[extentIndex].numBytes;
+		extentIndex++;
+	}
+	if (numVectors > 0)
+		preadVectors(fileDescriptor, vectors, numVectors, runStart);
+
+}
+
+
+void preadVectors(int           fileDescriptor,
+                  struct iovec* vectors,
+                  int           numVectors,
+                  uint64_t      byteOffset) {
+
+	while (numVectors > 0) {
+
+		//
+		// A READ OF NOTHING MEANS THE RANGE RUNS PAST THE END OF THE DEVICE.
+		ssize_t result = preadv(fileDescriptor, vectors, numVectors, (off_t) byteOffset);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			handleError(L"readSectors",
+			            L"Unable to read in requested sectors");
+		byteOffset += (uint64_t) result;
+
+		//
+		// SKIP OVER THE BUFFERS THAT WERE FILLED, AND TRIM THE ONE THAT WAS
+		// ONLY PARTLY FILLED.
+		size_t numRead = (size_t) result;
+		while (numVectors > 0 && numRead >= vectors[0].iov_len) {
+			numRead -= vectors[0].iov_len;
+			vectors++;
+			numVectors--;
+		}
+		if (numVectors > 0) {
+			vectors[0].iov_base = (uint8_t*) vectors[0].iov_base + numRead;
+			vectors[0].iov_len -= numRead;
+		}
+	}
+
+}
@@ -0,0 +1,167 @@
+/******************************************************************************
+ * This file contains the interface that every
+ *                          STORAGE BACKEND
+ * (the code that actually fetches bytes for a storage device) provides.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef STORAGE_BACKEND_H_
+#define STORAGE_BACKEND_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+// POSIX
+#include <sys/uio.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE MOST BUFFERS GATHERED INTO A SINGLE preadv.
+#define STORAGE_BACKEND_MAX_VECTORS 64
+
+
+
+
+/*
+ * A data structure used to describe a range of bytes to be read from a
+ * backend, and where they are to be read into.
+ */
+typedef struct {
+
+	uint64_t byteOffset;           // Where the range starts on the device.
+	uint64_t numBytes;             // The length of the range.
+	uint8_t* buffer;               // Where the contents of the range are stored.
+
+} byte_extent_t;
+
+
+
+
+/*
+ * A storage backend: a table of operations, plus the backend's own state.
+ *
+ * The first four operations must always be provided.  The rest are optional,
+ * and are left NULL by backends that cannot support them; the storage device
+ * checks for them before using them.
+ *
+ * Backends report failures through handleError, just like the rest of the
+ * storage device, so none of the operations return an error code.
+ *
+ * Once a backend is open, every one of its operations (except close) may be
+ * called by any number of threads at once.  Backends read with positional
+ * reads (pread/preadv), so no file position is shared between reads, and any
+ * state a backend changes as it reads (a cache, a buffer pool, a scratch
+ * buffer) is guarded by its own lock.
+ */
+typedef struct storage_backend_t storage_backend_t;
+
+struct storage_backend_t {
+
+	// Reads every one of the given extents into its own buffer.  Reading past
+	// the end of the device is an error.
+	void           (*readExtents)(storage_backend_t* backend, byte_extent_t* extents, uint32_t numExtents);
+
+	// Returns the size of the device (in bytes).
+	uint64_t       (*getSize)(storage_backend_t* backend);
+
+	// Returns the size (in bytes) of the blocks the device is best read in.
+	uint32_t       (*getBlockSize)(storage_backend_t* backend);
+
+	// Releases the device, along with the backend itself.
+	void           (*close)(storage_backend_t* backend);
+
+	// (Optional.)  Returns a read-only pointer straight into the device's
+	// contents, valid until the backend is closed.
+	const uint8_t* (*viewBytes)(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+	// (Optional.)  Tells the operating system that the given range will be
+	// read soon.
+	void           (*adviseWillNeed)(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+	// (Optional.)  Returns a file descriptor that any buffer may be read into
+	// with pread (this is what the asynchronous reader uses).
+	int            (*getFileDescriptor)(storage_backend_t* backend);
+
+	// (Optional.)  Returns 1 if the given range is known to hold nothing but
+	// zeros without reading it (i.e. it lies in a hole of a sparse image).
+	uint8_t        (*isHole)(storage_backend_t* backend, uint64_t byteOffset, uint64_t numBytes);
+
+	void*          state;          // The backend's own data.
+
+};
+
+
+
+
+/*
+ * Allocates a backend with no operations filled in, holding the given state.
+ * Used by the individual backends' open functions.
+ */
+storage_backend_t* allocateStorageBackend(void* state);
+
+
+
+
+/*
+ * Reads a single range of bytes through the given backend.
+ */
+void readBackendBytes(storage_backend_t* backend,
+                      uint8_t*           buffer,
+                      uint64_t           byteOffset,
+                      uint64_t           numBytes);
+
+
+
+
+/*
+ * Reads the given extents from a file descriptor with positional reads.
+ * Extents that follow one another on the device are gathered into a single
+ * preadv.  The descriptor's file position is never used or moved, so any
+ * number of threads may read through the same descriptor at once.
+ */
+void preadExtents(int            fileDescriptor,
+                  byte_extent_t* extents,
+                  uint32_t       numExtents);
+
+
+
+
+/*
+ * Reads one contiguous range of a file descriptor into the given buffers with
+ * preadv, no matter how many calls it takes.  The vectors are used up in the
+ * process.
+ */
+void preadVectors(int           fileDescriptor,
+                  struct iovec* vectors,
+                  int           numVectors,
+                  uint64_t      byteOffset);
+
+
+
+
+#endif
@@ -0,0 +1,188 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                               TABLE CACHE
+ * that keeps the translation tables of a disk image container (qcow2 L2 tables,
+ * VMDK grain tables) decoded in memory.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+#include "table_cache.h"
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+// POSIX
+#include <pthread.h>
+
+
+
+
+/*
+ * A data structure used to store one cached table.
+ */
+typedef struct {
+
+	uint64_t  tableOffset;         // Where the table is in the container (if "lastUsed" is not 0).
+	uint64_t* entries;             // The decoded entries.
+	uint64_t  lastUsed;            // When the table was last looked up in (0 if the slot is empty).
+
+} cached_table_t;
+
+
+/*
+ * A data structure used to store the whole cache.
+ */
+struct table_cache_t {
+
+	cached_table_t* tables;        // The slots.
+	uint32_t        numTables;     // The number of slots.
+	uint32_t        entriesPerTable; // The number of entries in each table.
+	uint32_t        newest;        // The slot most recently looked up in (checked first).
+	uint64_t        useCounter;    // Counts lookups, to find the least recently used table.
+	table_loader_t  tableLoader;   // Loads tables that are not in the cache.
+	void*           context;       // Passed to the table loader.
+	pthread_mutex_t lock;          // Guards everything in the cache.
+
+};
+
+
+/*
+ * Used to find the slot holding the given table, loading it into the least
+ * recently used slot if it is not there.  The cache must be locked.
+ */
+cached_table_t* findTable(table_cache_t* tableCache, uint64_t tableOffset);
+
+
+
+
+//
+// IMPLEMENTATION OF THE FUNCTIONS DEFINED IN THE HEADER (.h) FILE.
+//
+
+
+table_cache_t* createTableCache(uint32_t       numTables,
+                                uint32_t       entriesPerTable,
+                                table_loader_t tableLoader,
+                                void*          context) {
+
+	//
+	// ALLOCATE THE CACHE, WITH ROOM FOR EVERY TABLE UP FRONT.
+	table_cache_t* tableCache = (table_cache_t*) calloc(1, sizeof(table_cache_t));
+	if (tableCache != NULL)
+		tableCache->tables = (cached_table_t*) calloc(numTables, sizeof(cached_table_t));
+	if (tableCache == NULL || tableCache->tables == NULL)
+		handleError(L"openDevice", L"Unable to allocate memory for the table cache");
+	uint32_t tableIndex = 0;
+	while (tableIndex < numTables) {
+		tableCache->tables[tableIndex].entries = (uint64_t*) malloc((size_t) entriesPerTable * sizeof(uint64_t));
+		if (tableCache->tables[tableIndex].entries == NULL)
+			handleError(L"openDevice", L"Unable to allocate memory for the table cache");
+		tableIndex++;
+	}
+	tableCache->numTables       = numTables;
+	tableCache->entriesPerTable = entriesPerTable;
+	tableCache->tableLoader     = tableLoader;
+	tableCache->context         = context;
+	pthread_mutex_init(&(tableCache->lock), NULL);
+	return tableCache;
+
+}
+
+
+uint64_t lookupTableEntry(table_cache_t* tableCache,
+                          uint64_t       tableOffset,
+                          uint32_t       entryIndex) {
+
+	if (entryIndex >= tableCache->entriesPerTable)
+		handleError(L"readSectors", L"Unable to read in requested sectors");
+
+	pthread_mutex_lock(&(tableCache->lock));
+	uint64_t entry = findTable(tableCache, tableOffset)->entries[entryIndex];
+	pthread_mutex_unlock(&(tableCache->lock));
+	return entry;
+
+}
+
+
+void destroyTableCache(table_cache_t* tableCache) {
+
+	uint32_t tableIndex = 0;
+	while (tableIndex < tableCache->numTables) {
+		free(tableCache->tables[tableIndex].entries);
+		tableIndex++;
+	}
+	pthread_mutex_destroy(&(tableCache->lock));
+	free(tableCache->tables);
+	free(tableCache);
+
+}
+
+
+
+
+//
+// IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
+//
+
+
+cached_table_t* findTable(table_cache_t* tableCache, uint64_t tableOffset) {
+
+	tableCache->useCounter++;
+
+	//
+	// READS TEND TO STAY WITHIN ONE TABLE FOR A WHILE, SO TRY THE LAST ONE
+	// USED BEFORE SEARCHING.
+	cached_table_t* table = &(tableCache->tables[tableCache->newest]);
+	if (table->lastUsed != 0 && table->tableOffset == tableOffset) {
+		table->lastUsed = tableCache->useCounter;
+		return table;
+	}
+
+	//
+	// LOOK FOR THE TABLE, KEEPING TRACK OF THE LEAST RECENTLY USED SLOT.
+	uint32_t oldest = 0;
+	uint32_t tableIndex = 0;
+	while (tableIndex < tableCache->numTables) {
+		table = &(tableCache->tables[tableIndex]);
+		if (table->lastUsed != 0 && table->tableOffset == tableOffset) {
+			table->lastUsed = tableCache->useCounter;
+			tableCache->newest = tableIndex;
+			return table;
+		}
+		if (table->lastUsed < tableCache->tables[oldest].lastUsed)
+			oldest = tableIndex;
+		tableIndex++;
+	}
+
+	//
+	// LOAD IT INTO THE LEAST RECENTLY USED SLOT.  THE SLOT IS MARKED EMPTY
+	// FIRST, IN CASE THE LOADER FAILS PARTWAY.
+	table = &(tableCache->tables[oldest]);
+	table->lastUsed = 0;
+	tableCache->tableLoader(tableCache->context, tableOffset, table->entries);
+	table->tableOffset = tableOffset;
+	table->lastUsed    = tableCache->useCounter;
+	tableCache->newest = oldest;
+	return table;
+
+}
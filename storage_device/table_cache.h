@@ -0,0 +1,102 @@
+/******************************************************************************
+ * This file contains functions and data structures that operate on the
+ *                               TABLE CACHE
+ * that keeps the translation tables of a disk image container (qcow2 L2 tables,
+ * VMDK grain tables) decoded in memory.
+ *
+ * By Daniel Huettner
+ *****************************************************************************/
+
+#ifndef TABLE_CACHE_H_
+#define TABLE_CACHE_H_
+
+
+
+
+//
+// INCLUDES
+//
+
+// LAYER 1: USER_INTERFACE
+// (NOTHING)
+
+// LAYER 2: FILE_SYSTEM
+// (NOTHING)
+
+// LAYER 3: STORAGE_DEVICE
+// (NOTHING)
+
+// ERROR HANDLING
+#include "error.h"
+
+// STANDARD C LIBRARY
+#include <stdint.h>
+
+
+
+
+//
+// CONSTANTS
+//
+
+// THE NUMBER OF DECODED TABLES A CONTAINER BACKEND KEEPS IN ITS CACHE.
+#define TABLE_CACHE_TABLES 64
+
+
+
+
+/*
+ * A cache of decoded tables (see createTableCache).
+ */
+typedef struct table_cache_t table_cache_t;
+
+
+
+
+/*
+ * The function the cache uses to load tables it does not have.  It must read
+ * the table found at the given offset in the container, and decode every one
+ * of its entries (to host byte order) into "entries".
+ */
+typedef void (*table_loader_t)(void*     context,
+                               uint64_t  tableOffset,
+                               uint64_t* entries);
+
+
+
+
+/*
+ * Creates an empty cache holding up to "numTables" tables of
+ * "entriesPerTable" entries each.  Tables that are not in the cache are loaded
+ * with "tableLoader", which is passed "context".
+ */
+table_cache_t* createTableCache(uint32_t       numTables,
+                                uint32_t       entriesPerTable,
+                                table_loader_t tableLoader,
+                                void*          context);
+
+
+
+
+/*
+ * Gets one entry of the table found at the given offset in the container,
+ * loading the table (and evicting the least recently used one) if it is not
+ * in the cache.  The cache is locked for the lookup, so it may be used by
+ * several threads at once.
+ */
+uint64_t lookupTableEntry(table_cache_t* tableCache,
+                          uint64_t       tableOffset,
+                          uint32_t       entryIndex);
+
+
+
+
+/*
+ * Frees the cache and everything in it.
+ */
+void destroyTableCache(table_cache_t* tableCache);
+
+
+
+
+#endif
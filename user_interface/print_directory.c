@@ -22,6 +22,7 @@
 #include "file_allocation_table.h"
 #include "directory.h"
 #include "file_system_tools.h"
+#include "cluster_owner.h"
 
 // LAYER 3: STORAGE_DEVICE
 // (NOTHING)
@@ -43,8 +44,8 @@
  * Used to print one entry from a directory.
  */
 void printDirectoryEntry(file_t* directoryEntry,
-						 boot_sect_t* bootSector,
-						 uint32_t* fileAllocationTable);
+						 volume_t* volume,
+						 fat_t* fileAllocationTable);
 
 
 /*
@@ -58,8 +59,8 @@ void printName(wchar_t* absolutePathName);
  * Used to print a sequence of cluster numbers.
  * This function will split a long sequence of cluster numbers over multiple lines.
  */
-void printClusterSequence(uint32_t* clusters,       uint32_t numClusters,
-                          uint32_t  clustersPerRow, uint32_t clusterNumberLength);
+void printClusterSequence(cluster_extent_t* extents,       uint32_t numClusters,
+                          uint32_t          clustersPerRow, uint32_t clusterNumberLength);
 
 
 
@@ -72,15 +73,15 @@ void printClusterSequence(uint32_t* clusters,       uint32_t numClusters,
 
 void printDirectory(file_t*      directory,
                     uint8_t      recursive,
-                    boot_sect_t* bootSector,
-                    uint32_t*    fileAllocationTable) {
+                    volume_t*    volume,
+                    fat_t*       fileAllocationTable) {
 
 	//
 	// PARAMETER CHECK.
 	if (directory == NULL)
 		handleError(L"printDirectory", L"NULL 'directory' parameter");
-	if (bootSector == NULL)
-		handleError(L"printDirectory", L"NULL 'bootSector' parameter");
+	if (volume == NULL)
+		handleError(L"printDirectory", L"NULL 'volume' parameter");
 	if (fileAllocationTable == NULL)
 		handleError(L"printDirectory", L"NULL 'fileAllocationTable' parameter");
 
@@ -89,7 +90,7 @@ void printDirectory(file_t*      directory,
 	uint32_t childNumber = 0;
 	while (childNumber < directory->numChildren) {
 		if (!(directory->children[childNumber].type))
-			printDirectoryEntry(&(directory->children[childNumber]), bootSector, fileAllocationTable);
+			printDirectoryEntry(&(directory->children[childNumber]), volume, fileAllocationTable);
 		childNumber++;
 	}
 
@@ -98,11 +99,11 @@ void printDirectory(file_t*      directory,
 	childNumber = 0;
 	while (childNumber < directory->numChildren) {
 		if (directory->children[childNumber].type) {
-			printDirectoryEntry(&(directory->children[childNumber]), bootSector, fileAllocationTable);
+			printDirectoryEntry(&(directory->children[childNumber]), volume, fileAllocationTable);
 			if (recursive) {
 					printDirectory(&(directory->children[childNumber]),
 					               recursive,
-								   bootSector,
+								   volume,
 								   fileAllocationTable);
 			}
 		}
@@ -131,14 +132,60 @@ void printDirectoryTreeHeader() {
 
 
 
+void printClusterOwners(uint32_t*              clusterNumbers,
+                        uint32_t               numClusterNumbers,
+                        cluster_owner_index_t* clusterOwnerIndex,
+                        volume_t*              volume) {
+
+	//
+	// PRINT THE CENTERED TITLE, AND A DASHED LINE.
+	wchar_t* title = L"CLUSTER OWNERS";
+	wprintf(L"\n");
+	wprintf(L"%*ls\n", ((getTermWidth() - wcslen(title)) / 2) + wcslen(title), title);
+	printDashedLine();
+
+	//
+	// PRINT EACH CLUSTER, AND THE PATH NAME AND TYPE OF ITS OWNER, IN A "BOX"
+	// LIKE THE ONES THE DIRECTORY TREE IS PRINTED IN (WITH THE CLUSTER NUMBERS
+	// PADDED WITH ZEROS TO THE SAME WIDTH).
+	uint32_t clusterNumberLength = CHARACTERS_PER_FAT32_CLUSTER_NUMBER;
+	if (volume->fatVersion == FAT12)
+		clusterNumberLength = CHARACTERS_PER_FAT12_CLUSTER_NUMBER;
+	else if (volume->fatVersion == FAT16)
+		clusterNumberLength = CHARACTERS_PER_FAT16_CLUSTER_NUMBER;
+	uint32_t clusterIndex = 0;
+	while (clusterIndex < numClusterNumbers) {
+		wchar_t clusterNumberText[16];
+		swprintf(clusterNumberText, 16, L"0x%0*x", clusterNumberLength - 2, clusterNumbers[clusterIndex]);
+		wprintf(L"%ls%-*ls%ls\n", L"|CLUSTER |", CHARACTERS_PER_ROW_RIGHT_COLUMN, clusterNumberText, L"|");
+		file_t* owner = getClusterOwner(clusterOwnerIndex, clusterNumbers[clusterIndex]);
+		if (owner == NULL) {
+			wprintf(L"%ls%-*ls%ls\n", L"|  TYPE  |", CHARACTERS_PER_ROW_RIGHT_COLUMN, L"(NOT OWNED BY ANY FILE)", L"|");
+		}
+		else {
+			wchar_t* absolutePathName = (owner->parentDirectory == NULL) ? NULL : getAbsolutePathName(owner);
+			printName((absolutePathName == NULL) ? L"/" : absolutePathName);
+			free(absolutePathName);
+			wprintf(L"%ls%-*ls%ls\n", L"|  TYPE  |", CHARACTERS_PER_ROW_RIGHT_COLUMN,
+			        (owner->type) ? L"DIRECTORY" : L"FILE", L"|");
+		}
+		printDashedLine();
+		clusterIndex++;
+	}
+
+}
+
+
+
+
 //
 // IMPLEMENTATION OF THE HELPER FUNCTIONS AND DATA STRUCTURES DEFINED ABOVE.
 //
 
 
 void printDirectoryEntry(file_t* directoryEntry,
-						 boot_sect_t* bootSector,
-						 uint32_t* fileAllocationTable) {
+						 volume_t* volume,
+						 fat_t* fileAllocationTable) {
 
 	//
 	// GET THE ABSOLUTE PATH NAME OF THE FILE/DIRECTORY.
@@ -156,6 +203,8 @@ void printDirectoryEntry(file_t* directoryEntry,
 	//
 	// PRINT TYPE TO CONSOLE.
 	wchar_t* type = (directoryEntry->type) ? L"DIRECTORY" : L"FILE";
+	if (directoryEntry->damaged)
+		type = (directoryEntry->type) ? L"DIRECTORY (DAMAGED)" : L"FILE (DAMAGED)";
 	wprintf(L"%ls%-*ls%ls\n", L"|  TYPE  |", CHARACTERS_PER_ROW_RIGHT_COLUMN, type, L"|");
 
 	//
@@ -166,13 +215,17 @@ void printDirectoryEntry(file_t* directoryEntry,
 	// PRINT CLUSTERS TO CONSOLE.
 	// USE UP TO 80 CHARACTERS PER LINE TO PRINT THE PATHNAME.
 	// THIS CODE WILL SPLIT LONG NAMES OVER TWO MORE MORE LINES (WORD WRAP).
-	switch (getFatVersion(bootSector)) {
+	switch (volume->fatVersion) {
 		case FAT12:
-			printClusterSequence(directoryEntry->clusters, directoryEntry->numClusters,
+			printClusterSequence(directoryEntry->extents, directoryEntry->numClusters,
                                  CLUSTERS_PER_ROW_FAT12, CHARACTERS_PER_FAT12_CLUSTER_NUMBER);
 			break;
+		case FAT16:
+			printClusterSequence(directoryEntry->extents, directoryEntry->numClusters,
+                                 CLUSTERS_PER_ROW_FAT16, CHARACTERS_PER_FAT16_CLUSTER_NUMBER);
+			break;
 		case FAT32:
-			printClusterSequence(directoryEntry->clusters, directoryEntry->numClusters,
+			printClusterSequence(directoryEntry->extents, directoryEntry->numClusters,
                                  CLUSTERS_PER_ROW_FAT32, CHARACTERS_PER_FAT32_CLUSTER_NUMBER);
 			break;
 	}
@@ -282,8 +335,8 @@ void printName(wchar_t* absolutePathName) {
 }
 
 
-void printClusterSequence(uint32_t* clusters, uint32_t numClusters,
-                          uint32_t  clustersPerRow, uint32_t clusterNumberLength) {
+void printClusterSequence(cluster_extent_t* extents, uint32_t numClusters,
+                          uint32_t          clustersPerRow, uint32_t clusterNumberLength) {
 
 	//
 	// PRINT THE LEFT COLUMN TO THE CONSOLE.
@@ -297,14 +350,22 @@ void printClusterSequence(uint32_t* clusters, uint32_t numClusters,
 	}
 
 	//
-	// PRINTS ALL THE CLUSTERS IN THE SEQUENCE, ONE AT A TIME.
+	// PRINTS ALL THE CLUSTERS IN THE SEQUENCE, ONE AT A TIME, STEPPING THROUGH
+	// EACH EXTENT IN TURN.
 	uint32_t clusterIndex = 0;
+	uint32_t extentIndex = 0;
+	uint32_t clusterInExtent = 0;
 	uint32_t spaceAfterLastCluster = 0;
 	while (clusterIndex < numClusters) {
 
 		//
 		// PRINT THE CURRENT CLUSTER NUMBER IN THE SEQUENCE.
-		wprintf(L"%#0*x", clusterNumberLength, clusters[clusterIndex]);
+		wprintf(L"%#0*x", clusterNumberLength, extents[extentIndex].firstCluster + clusterInExtent);
+		clusterInExtent++;
+		if (clusterInExtent == extents[extentIndex].numClusters) {
+			extentIndex++;
+			clusterInExtent = 0;
+		}
 
 		//
 		// IF THERE IS SPACE IN THIS ROW FOR ANOTHER CLUSTER...
@@ -21,6 +21,7 @@
 
 // LAYER 2: FILE_SYSTEM
 #include "directory.h"
+#include "cluster_owner.h"
 
 // LAYER 3: STORAGE_DEVICE
 // (NOTHING)
@@ -50,12 +51,18 @@
 // THE WIDTH OF EACH FAT12 CLUSTER NUMBER PRINTED TO THE CONSOLE (i.e. 0xfff).
 #define CHARACTERS_PER_FAT12_CLUSTER_NUMBER 5
 
+// THE WIDTH OF EACH FAT16 CLUSTER NUMBER PRINTED TO THE CONSOLE (i.e. 0xffff).
+#define CHARACTERS_PER_FAT16_CLUSTER_NUMBER 6
+
 // THE WIDTH OF EACH FAT32 CLUSTER NUMBER PRINTED TO THE CONSOLE (i.e. 0xfffffff).
 #define CHARACTERS_PER_FAT32_CLUSTER_NUMBER 9
 
 // THE NUMBER OF FAT12 CLUSTERS THAT CAN FIT IN A ROW IN THE RIGHT COLUMN.
 #define CLUSTERS_PER_ROW_FAT12              ((CHARACTERS_PER_ROW_RIGHT_COLUMN + 1) / (CHARACTERS_PER_FAT12_CLUSTER_NUMBER + 1))
 
+// THE NUMBER OF FAT16 CLUSTERS THAT CAN FIT IN A ROW IN THE RIGHT COLUMN.
+#define CLUSTERS_PER_ROW_FAT16              ((CHARACTERS_PER_ROW_RIGHT_COLUMN + 1) / (CHARACTERS_PER_FAT16_CLUSTER_NUMBER + 1))
+
 // THE NUMBER OF FAT32 CLUSTERS THAT CAN FIT IN A ROW IN THE RIGHT COLUMN.
 #define CLUSTERS_PER_ROW_FAT32              ((CHARACTERS_PER_ROW_RIGHT_COLUMN + 1) / (CHARACTERS_PER_FAT32_CLUSTER_NUMBER + 1))
 
@@ -70,8 +77,8 @@
  */
 void printDirectory(file_t*      directory,
                     uint8_t      recursive,
-                    boot_sect_t* bootSector,
-                    uint32_t*    fileAllocationTable);
+                    volume_t*    volume,
+                    fat_t*       fileAllocationTable);
 
 
 
@@ -84,5 +91,18 @@ void printDirectoryTreeHeader();
 
 
 
+/*
+ * Prints which file or directory owns each of the given clusters (looked up
+ * in the given cluster owner index).  The cluster numbers are printed as wide
+ * as in the directory tree, for the volume's FAT version.
+ */
+void printClusterOwners(uint32_t*              clusterNumbers,
+                        uint32_t               numClusterNumbers,
+                        cluster_owner_index_t* clusterOwnerIndex,
+                        volume_t*              volume);
+
+
+
+
 #endif
 
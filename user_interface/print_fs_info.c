@@ -19,7 +19,9 @@
 
 // LAYER 2: FILE_SYSTEM
 #include "boot_sector.h"
+#include "fat_check.h"
 #include "file_system_tools.h"
+#include "file_allocation_table.h"
 
 // LAYER 3: STORAGE_DEVICE
 // (NOTHING)
@@ -40,14 +42,14 @@
 
 
 void printFileSystemInformation(char* deviceFileName,
-                                boot_sect_t* bootSector) {
+                                volume_t* volume) {
 
 	//
 	// PARAMETER CHECK.
-	if (bootSector == NULL)
+	if (deviceFileName == NULL)
 		handleError(L"printFileSystemInformation", L"NULL 'deviceFileName' parameter");
-	if (bootSector == NULL)
-		handleError(L"printFileSystemInformation", L"NULL 'bootSector' parameter");
+	if (volume == NULL)
+		handleError(L"printFileSystemInformation", L"NULL 'volume' parameter");
 
 	//
 	// MAKE SURE THE FILENAME IS NOT TOO LONG.
@@ -68,16 +70,17 @@ void printFileSystemInformation(char* deviceFileName,
 
 	//
 	// GET VARIOUS VALUES TO BE PRINTED.
-	uint32_t firstSector_FAT  = getSectorNumber_FileAllocationTable(bootSector);
-	uint32_t firstSector_Root = getSectorNumber_RootDirectory(bootSector);
-	uint32_t firstSector_Data =
-			getSectorNumber_DataCluster(bootSector, 2);
+	boot_sect_t* bootSector   = volume->bootSector;
+	uint64_t firstSector_FAT  = volume->firstSector_FAT;
+	uint64_t firstSector_Root = volume->firstSector_Root;
+	uint64_t firstSector_Data = volume->firstSector_Data;
 
 	//
-	// COMPUTE THE CAPACITY OF THE STORAGE DEVICE.
-	uint32_t cap = bootSector->numSectors_FAT12 * bootSector->bytesPerSector;
+	// COMPUTE THE CAPACITY OF THE STORAGE DEVICE.  THIS IS DONE IN 64 BITS, SINCE
+	// A FAT32 VOLUME CAN BE MUCH LARGER THAN 4 GB.
+	uint64_t cap = (uint64_t) bootSector->numSectors_FAT12 * bootSector->bytesPerSector;
 	if (cap == 0)
-		cap = bootSector->numSectors_FAT32 * bootSector->bytesPerSector;
+		cap = (uint64_t) bootSector->numSectors_FAT32 * bootSector->bytesPerSector;
 	wchar_t* capUnit = L"B";
 	if (cap >= 1000) {
 		cap = cap / 1000;
@@ -91,6 +94,10 @@ void printFileSystemInformation(char* deviceFileName,
 		cap = cap / 1000;
 		capUnit = L"GB";
 	}
+	if (cap >= 1000) {
+		cap = cap / 1000;
+		capUnit = L"TB";
+	}
 	uint8_t capLength = 1;
 	if (cap >= 10)
 		capLength = 2;
@@ -101,7 +108,7 @@ void printFileSystemInformation(char* deviceFileName,
 
 	//
 	// GET THE FAT VERSION.
-	uint32_t fatVersion = getFatVersion(bootSector);
+	uint32_t fatVersion = volume->fatVersion;
 
 	//
 	// PRINT THE TITLE.
@@ -114,20 +121,20 @@ void printFileSystemInformation(char* deviceFileName,
 	printDashedLine();
 	wprintf(L"%ls%-*ls%ls\n",  L"|DEVICE FILE        |",    RIGHT_COLUMN_WIDTH_FS, wideFileName,                    L"|");
 	wprintf(L"%ls%-*u%ls\n",   L"|FILE SYSTEM        |FAT", RIGHT_COLUMN_WIDTH_FS - 3, fatVersion,                  L"|");
-	wprintf(L"%ls%u%-*ls%ls\n",L"|SIZE               |",    cap, RIGHT_COLUMN_WIDTH_FS - capLength, capUnit,        L"|");
+	wprintf(L"%ls%llu%-*ls%ls\n",L"|SIZE               |",  (unsigned long long) cap, RIGHT_COLUMN_WIDTH_FS - capLength, capUnit,        L"|");
 	wprintf(L"%ls%-*u%ls\n",   L"|BYTES PER SECTOR   |",    RIGHT_COLUMN_WIDTH_FS, bootSector->bytesPerSector,      L"|");
 	wprintf(L"%ls%-*u%ls\n",   L"|SECTORS PER CLUSTER|",    RIGHT_COLUMN_WIDTH_FS, bootSector->sectorsPerCluster,   L"|");
-	if (fatVersion == FAT12)
+	if (fatVersion != FAT32)
 	wprintf(L"%ls%-*u%ls\n",   L"|ROOT DIR ENTRIES   |",    RIGHT_COLUMN_WIDTH_FS, bootSector->numRootEntries_FAT12,L"|");
-	if (fatVersion == FAT12)
+	if (fatVersion != FAT32)
 	wprintf(L"%ls%-*u%ls\n",   L"|SECTORS PER FAT    |",    RIGHT_COLUMN_WIDTH_FS, bootSector->sectorsPerFAT_FAT12, L"|");
 	if (fatVersion == FAT32)
 	wprintf(L"%ls%-*u%ls\n",   L"|SECTORS PER FAT    |",    RIGHT_COLUMN_WIDTH_FS, bootSector->sectorsPerFAT_FAT32, L"|");
 	wprintf(L"%ls%-*u%ls\n",   L"|RESERVED SECTORS   |",    RIGHT_COLUMN_WIDTH_FS, bootSector->numReservedSectors,  L"|");
 	wprintf(L"%ls%-*u%ls\n",   L"|HIDDEN DISK SECTORS|",    RIGHT_COLUMN_WIDTH_FS, bootSector->numHiddenSectors,    L"|");
-	wprintf(L"%ls%-*u%ls\n",   L"|FIRST FAT SECTOR   |",    RIGHT_COLUMN_WIDTH_FS, firstSector_FAT,                 L"|");
-	wprintf(L"%ls%-*u%ls\n",   L"|FIRST ROOT SECTOR  |",    RIGHT_COLUMN_WIDTH_FS, firstSector_Root,                L"|");
-	wprintf(L"%ls%-*u%ls\n",   L"|FIRST DATA SECTOR  |",    RIGHT_COLUMN_WIDTH_FS, firstSector_Data,                L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|FIRST FAT SECTOR   |",    RIGHT_COLUMN_WIDTH_FS, (unsigned long long) firstSector_FAT,  L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|FIRST ROOT SECTOR  |",    RIGHT_COLUMN_WIDTH_FS, (unsigned long long) firstSector_Root, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|FIRST DATA SECTOR  |",    RIGHT_COLUMN_WIDTH_FS, (unsigned long long) firstSector_Data, L"|");
 	printDashedLine();
 
 	//
@@ -136,3 +143,115 @@ void printFileSystemInformation(char* deviceFileName,
 		deviceFileName[RIGHT_COLUMN_WIDTH_FS] = temp;
 
 }
+
+
+void printCacheStatistics(uint64_t hits, uint64_t misses) {
+
+	//
+	// COMPUTE THE HIT RATE (AS A WHOLE PERCENTAGE).
+	uint64_t lookups = hits + misses;
+	uint64_t hitRate = (lookups == 0) ? 0 : (hits * 100) / lookups;
+	wchar_t hitRateText[8];
+	swprintf(hitRateText, 8, L"%llu%%", (unsigned long long) hitRate);
+
+	//
+	// PRINT THE TITLE.
+	wchar_t* title = L"CACHE STATISTICS";
+	wprintf(L"\n");
+	wprintf(L"%*ls\n", ((getTermWidth() - wcslen(title)) / 2) + wcslen(title), title);
+
+	//
+	// PRINT THE STATISTICS.
+	printDashedLine();
+	wprintf(L"%ls%-*llu%ls\n",  L"|BLOCK CACHE HITS   |", RIGHT_COLUMN_WIDTH_FS,     (unsigned long long) hits,    L"|");
+	wprintf(L"%ls%-*llu%ls\n",  L"|BLOCK CACHE MISSES |", RIGHT_COLUMN_WIDTH_FS,     (unsigned long long) misses,  L"|");
+	wprintf(L"%ls%-*ls%ls\n",   L"|HIT RATE           |", RIGHT_COLUMN_WIDTH_FS,     hitRateText,                  L"|");
+	printDashedLine();
+
+}
+
+
+void printDamageStatistics(char* mapFileName, uint64_t numRegions, uint64_t numBytes) {
+
+	//
+	// PRINT THE TITLE.
+	wchar_t* title = L"DAMAGE STATISTICS";
+	wprintf(L"\n");
+	wprintf(L"%*ls\n", ((getTermWidth() - wcslen(title)) / 2) + wcslen(title), title);
+
+	//
+	// PRINT THE STATISTICS (CUTTING THE MAP FILE NAME SHORT IF IT IS TOO LONG).
+	printDashedLine();
+	wprintf(L"%ls%-*.*s%ls\n", L"|DAMAGE MAP FILE    |", RIGHT_COLUMN_WIDTH_FS, RIGHT_COLUMN_WIDTH_FS, mapFileName, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|DAMAGED REGIONS    |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) numRegions, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|DAMAGED BYTES      |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) numBytes,   L"|");
+	printDashedLine();
+
+}
+
+
+
+
+void printFATWindowStatistics(uint64_t windowsRead, uint64_t maxBytes) {
+
+	//
+	// PRINT THE TITLE.
+	wchar_t* title = L"FAT WINDOW STATISTICS";
+	wprintf(L"\n");
+	wprintf(L"%*ls\n", ((getTermWidth() - wcslen(title)) / 2) + wcslen(title), title);
+
+	//
+	// PRINT THE STATISTICS.
+	printDashedLine();
+	wprintf(L"%ls%-*llu%ls\n", L"|WINDOW SIZE (BYTES)|", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) FAT_WINDOW_SIZE, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|MEMORY LIMIT (MB)  |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) (maxBytes / (1024 * 1024)), L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|WINDOWS READ IN    |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) windowsRead, L"|");
+	printDashedLine();
+
+}
+
+
+
+
+void printFATRunStatistics(uint64_t numRuns, uint64_t numBytes, uint32_t numEntries) {
+
+	//
+	// PRINT THE TITLE.
+	wchar_t* title = L"FAT RUN STATISTICS";
+	wprintf(L"\n");
+	wprintf(L"%*ls\n", ((getTermWidth() - wcslen(title)) / 2) + wcslen(title), title);
+
+	//
+	// PRINT THE STATISTICS (COMPARING THE RUNS TO A WHOLE TABLE OF 32-BIT
+	// ENTRIES).
+	printDashedLine();
+	wprintf(L"%ls%-*lu%ls\n",  L"|FAT ENTRIES        |", RIGHT_COLUMN_WIDTH_FS, (unsigned long) numEntries, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|RUNS               |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) numRuns, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|BYTES IN RUNS      |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) numBytes, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|BYTES UNCOMPRESSED |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) numEntries * sizeof(uint32_t), L"|");
+	printDashedLine();
+
+}
+
+void printFATCheckSummary(fat_check_summary_t* summary, char* reportFileName) {
+
+	//
+	// PRINT THE TITLE.
+	wchar_t* title = L"FAT CHECK SUMMARY";
+	wprintf(L"\n");
+	wprintf(L"%*ls\n", ((getTermWidth() - wcslen(title)) / 2) + wcslen(title), title);
+
+	//
+	// PRINT THE COUNTS.
+	printDashedLine();
+	wprintf(L"%ls%-*.*s%ls\n", L"|REPORT FILE        |", RIGHT_COLUMN_WIDTH_FS, RIGHT_COLUMN_WIDTH_FS, reportFileName, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|CYCLES             |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numCycles, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|CROSS-LINKS        |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numCrossLinks, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|BAD LINKS          |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numBadLinks, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|SIZE MISMATCHES    |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numSizeMismatches, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|DIRECTORY LOOPS    |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numDirectoryLoops, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|LOST CHAINS        |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numLostChains, L"|");
+	wprintf(L"%ls%-*llu%ls\n", L"|LOST CLUSTERS      |", RIGHT_COLUMN_WIDTH_FS, (unsigned long long) summary->numLostClusters, L"|");
+	printDashedLine();
+
+}
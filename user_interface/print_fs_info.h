@@ -21,6 +21,8 @@
 
 // LAYER 2: FILE_SYSTEM
 #include "boot_sector.h"
+#include "fat_check.h"
+#include "volume.h"
 
 // LAYER 3: STORAGE_DEVICE
 // (NOTHING)
@@ -29,7 +31,7 @@
 #include "error.h"
 
 // STANDARD C LIBRARY
-// (NOTHING)
+#include <stdint.h>
 
 
 
@@ -54,7 +56,51 @@
  * Prints information about the file system to the console.
  */
 void printFileSystemInformation(char* deviceFileName,
-                                boot_sect_t* bootSector);
+                                volume_t* volume);
+
+
+
+
+/*
+ * Prints the block cache's hit and miss counts to the console.
+ */
+void printCacheStatistics(uint64_t hits, uint64_t misses);
+
+
+
+
+/*
+ * Prints how much of the device could not be read (in degraded mode), and
+ * where the damage map is kept, to the console.
+ */
+void printDamageStatistics(char* mapFileName, uint64_t numRegions, uint64_t numBytes);
+
+
+
+
+/*
+ * Prints how many windows of a paged file allocation table were read in, and
+ * how much memory they were allowed to take up, to the console.
+ */
+void printFATWindowStatistics(uint64_t windowsRead, uint64_t maxBytes);
+
+
+
+
+/*
+ * Prints how many runs a compressed file allocation table is kept as, and how
+ * much memory they take up next to the whole table's, to the console.
+ */
+void printFATRunStatistics(uint64_t numRuns, uint64_t numBytes, uint32_t numEntries);
+
+
+
+
+/*
+ * Prints how many problems of each kind a check of the file allocation table
+ * found, and where the full report was written, to the console.
+ */
+void printFATCheckSummary(fat_check_summary_t* summary, char* reportFileName);
 
 
 